@@ -326,16 +326,34 @@ search_reserve_window(struct rb_root *root, ext2_fsblk_t goal)
 }
 
 /*
- * ext2_rsv_window_add() -- Insert a window to the block reservation rb tree.
+ * rsv_window_group() -- Find the block group a reservation window lives in.
  * @sb:			super block
+ * @rsv:		allocated reservation window
+ *
+ * Windows never cross a group boundary, so the group holding the first
+ * block of the window owns the tree (and the lock) the window is linked in.
+ */
+static inline struct ext2_rsv_group *
+rsv_window_group(struct super_block *sb, struct ext2_reserve_window_node *rsv)
+{
+	struct ext2_sb_info *sbi = EXT2_SB(sb);
+	unsigned long group;
+
+	group = (rsv->rsv_start - le32_to_cpu(sbi->s_es->s_first_data_block)) /
+		EXT2_BLOCKS_PER_GROUP(sb);
+	return &sbi->s_rsv_groups[group];
+}
+
+/*
+ * ext2_rsv_window_add() -- Insert a window to the block reservation rb tree.
+ * @root:		root of the group reservation tree
  * @rsv:		reservation window to add
  *
- * Must be called with rsv_lock held.
+ * Must be called with the group rsv lock held.
  */
-void ext2_rsv_window_add(struct super_block *sb,
+void ext2_rsv_window_add(struct rb_root *root,
 		    struct ext2_reserve_window_node *rsv)
 {
-	struct rb_root *root = &EXT2_SB(sb)->s_rsv_window_root;
 	struct rb_node *node = &rsv->rsv_node;
 	ext2_fsblk_t start = rsv->rsv_start;
 
@@ -368,16 +386,18 @@ void ext2_rsv_window_add(struct super_block *sb,
  * @rsv:		reservation window to remove
  *
  * Mark the block reservation window as not allocated, and unlink it
- * from the filesystem reservation window rb tree. Must be called with
- * rsv_lock held.
+ * from its group reservation window rb tree. Must be called with the
+ * rsv lock of that group held.
  */
 static void rsv_window_remove(struct super_block *sb,
 			      struct ext2_reserve_window_node *rsv)
 {
+	struct rb_root *root = &rsv_window_group(sb, rsv)->root;
+
 	rsv->rsv_start = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
 	rsv->rsv_end = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
 	rsv->rsv_alloc_hit = 0;
-	rb_erase(&rsv->rsv_node, &EXT2_SB(sb)->s_rsv_window_root);
+	rb_erase(&rsv->rsv_node, root);
 }
 
 /*
@@ -459,13 +479,19 @@ void ext2_discard_reservation(struct inode *inode)
 	struct ext2_inode_info *ei = EXT2_I(inode);
 	struct ext2_block_alloc_info *block_i = ei->i_block_alloc_info;
 	struct ext2_reserve_window_node *rsv;
-	spinlock_t *rsv_lock = &EXT2_SB(inode->i_sb)->s_rsv_window_lock;
+	spinlock_t *rsv_lock;
 
 	if (!block_i)
 		return;
 
+	/*
+	 * The window only moves under truncate_mutex, which our callers hold
+	 * or which is no longer contended, so its group cannot change under
+	 * us here.
+	 */
 	rsv = &block_i->rsv_window_node;
 	if (!rsv_is_empty(&rsv->rsv_window)) {
+		rsv_lock = &rsv_window_group(inode->i_sb, rsv)->lock;
 		spin_lock(rsv_lock);
 		if (!rsv_is_empty(&rsv->rsv_window))
 			rsv_window_remove(inode->i_sb, rsv);
@@ -744,10 +770,10 @@ ext2_try_to_allocate(struct super_block *sb, int group,
  * the place where start_block is, then start from there, when looking
  * for a reservable space.
  *
- * @last_block is normally the last block in this group. The search will end
+ * @last_block is the last block in this group. The search will end
  * when we found the start of next possible reservable space is out
- * of this boundary.  This could handle the cross boundary reservation
- * window request.
+ * of this boundary, and the window is trimmed so that it never crosses
+ * into the next group.
  *
  * Return: -1 if we could not find a range of sufficient size.  If we could,
  * return 0 and fill in @my_rsv with the range information.
@@ -800,8 +826,7 @@ static int find_next_reservable_window(
 
 		if (cur + size <= rsv->rsv_start) {
 			/*
-			 * Found a reserveable space big enough.  We could
-			 * have a reservation across the group boundary here
+			 * Found a reserveable space big enough.
 		 	 */
 			break;
 		}
@@ -828,11 +853,12 @@ static int find_next_reservable_window(
 	 * call find_next_reservable_window.
 	 */
 	my_rsv->rsv_start = cur;
-	my_rsv->rsv_end = cur + size - 1;
+	my_rsv->rsv_end = min_t(ext2_fsblk_t, cur + size - 1, last_block);
 	my_rsv->rsv_alloc_hit = 0;
 
 	if (prev != my_rsv)
-		ext2_rsv_window_add(sb, my_rsv);
+		ext2_rsv_window_add(&rsv_window_group(sb, my_rsv)->root,
+				    my_rsv);
 
 	return 0;
 }
@@ -845,8 +871,8 @@ static int find_next_reservable_window(
  * @group: The group we are trying to allocate in.
  * @bitmap_bh: The block group block bitmap.
  *
- * To make a new reservation, we search part of the filesystem reservation
- * list (the list inside the group). We try to allocate a new
+ * To make a new reservation, we search the reservation list of the
+ * group. We try to allocate a new
  * reservation window near @grp_goal, or the beginning of the
  * group, if @grp_goal is negative.
  *
@@ -874,10 +900,11 @@ static int alloc_new_reservation(struct ext2_reserve_window_node *my_rsv,
 	struct ext2_reserve_window_node *search_head;
 	ext2_fsblk_t group_first_block, group_end_block, start_block;
 	ext2_grpblk_t first_free_block;
-	struct rb_root *fs_rsv_root = &EXT2_SB(sb)->s_rsv_window_root;
+	struct ext2_rsv_group *grp = &EXT2_SB(sb)->s_rsv_groups[group];
+	struct rb_root *grp_rsv_root = &grp->root;
 	unsigned long size;
 	int ret;
-	spinlock_t *rsv_lock = &EXT2_SB(sb)->s_rsv_window_lock;
+	spinlock_t *rsv_lock = &grp->lock;
 
 	group_first_block = ext2_group_first_block_no(sb, group);
 	group_end_block = ext2_group_last_block_no(sb, group);
@@ -890,24 +917,7 @@ static int alloc_new_reservation(struct ext2_reserve_window_node *my_rsv,
 	size = my_rsv->rsv_goal_size;
 
 	if (!rsv_is_empty(&my_rsv->rsv_window)) {
-		/*
-		 * if the old reservation is cross group boundary
-		 * and if the goal is inside the old reservation window,
-		 * we will come here when we just failed to allocate from
-		 * the first part of the window. We still have another part
-		 * that belongs to the next group. In this case, there is no
-		 * point to discard our window and try to allocate a new one
-		 * in this group(which will fail). we should
-		 * keep the reservation window, just simply move on.
-		 *
-		 * Maybe we could shift the start block of the reservation
-		 * window to the first block of next group.
-		 */
-
-		if ((my_rsv->rsv_start <= group_end_block) &&
-				(my_rsv->rsv_end > group_end_block) &&
-				(start_block >= my_rsv->rsv_start))
-			return -1;
+		struct ext2_rsv_group *old_grp;
 
 		if ((my_rsv->rsv_alloc_hit >
 		     (my_rsv->rsv_end - my_rsv->rsv_start + 1) / 2)) {
@@ -922,13 +932,26 @@ static int alloc_new_reservation(struct ext2_reserve_window_node *my_rsv,
 				size = EXT2_MAX_RESERVE_BLOCKS;
 			my_rsv->rsv_goal_size= size;
 		}
+
+		/*
+		 * The old window lives in the tree of the group it was
+		 * allocated in.  If we are moving to another group, unlink
+		 * it from there first, so that we only ever hold one group
+		 * rsv lock at a time.
+		 */
+		old_grp = rsv_window_group(sb, my_rsv);
+		if (old_grp != grp) {
+			spin_lock(&old_grp->lock);
+			rsv_window_remove(sb, my_rsv);
+			spin_unlock(&old_grp->lock);
+		}
 	}
 
 	spin_lock(rsv_lock);
 	/*
 	 * shift the search start to the window near the goal block
 	 */
-	search_head = search_reserve_window(fs_rsv_root, start_block);
+	search_head = search_reserve_window(grp_rsv_root, start_block);
 
 	/*
 	 * find_next_reservable_window() simply finds a reservable window
@@ -996,6 +1019,7 @@ static int alloc_new_reservation(struct ext2_reserve_window_node *my_rsv,
  * try_to_extend_reservation()
  * @my_rsv:		given reservation window
  * @sb:			super block
+ * @group:		block group the window lives in
  * @size:		the delta to extend
  *
  * Attempt to expand the reservation window large enough to have
@@ -1007,30 +1031,30 @@ static int alloc_new_reservation(struct ext2_reserve_window_node *my_rsv,
  * window. To make this more efficient, given the total number of
  * blocks needed and the current size of the window, we try to
  * expand the reservation window size if necessary on a best-effort
- * basis before ext2_new_blocks() tries to allocate blocks.
+ * basis before ext2_new_blocks() tries to allocate blocks.  The window
+ * is never extended past the end of its block group.
  */
 static void try_to_extend_reservation(struct ext2_reserve_window_node *my_rsv,
-			struct super_block *sb, int size)
+			struct super_block *sb, unsigned int group, int size)
 {
 	struct ext2_reserve_window_node *next_rsv;
 	struct rb_node *next;
-	spinlock_t *rsv_lock = &EXT2_SB(sb)->s_rsv_window_lock;
+	ext2_fsblk_t limit = ext2_group_last_block_no(sb, group);
+	spinlock_t *rsv_lock = &EXT2_SB(sb)->s_rsv_groups[group].lock;
 
 	if (!spin_trylock(rsv_lock))
 		return;
 
 	next = rb_next(&my_rsv->rsv_node);
-
-	if (!next)
-		my_rsv->rsv_end += size;
-	else {
+	if (next) {
 		next_rsv = rb_entry(next, struct ext2_reserve_window_node, rsv_node);
-
-		if ((next_rsv->rsv_start - my_rsv->rsv_end - 1) >= size)
-			my_rsv->rsv_end += size;
-		else
-			my_rsv->rsv_end = next_rsv->rsv_start - 1;
+		limit = next_rsv->rsv_start - 1;
 	}
+
+	if ((limit - my_rsv->rsv_end) >= size)
+		my_rsv->rsv_end += size;
+	else
+		my_rsv->rsv_end = limit;
 	spin_unlock(rsv_lock);
 }
 
@@ -1058,7 +1082,7 @@ static void try_to_extend_reservation(struct ext2_reserve_window_node *my_rsv,
  * reservation), and there are lots of free blocks, but they are all
  * being reserved.
  *
- * We use a red-black tree for the per-filesystem reservation list.
+ * We use a red-black tree per block group for the reservation list.
  */
 static ext2_grpblk_t
 ext2_try_to_allocate_with_rsv(struct super_block *sb, unsigned int group,
@@ -1123,7 +1147,7 @@ ext2_try_to_allocate_with_rsv(struct super_block *sb, unsigned int group,
 					(grp_goal + group_first_block) + 1;
 
 			if (curr < *count)
-				try_to_extend_reservation(my_rsv, sb,
+				try_to_extend_reservation(my_rsv, sb, group,
 							*count - curr);
 		}
 
@@ -1134,7 +1158,7 @@ ext2_try_to_allocate_with_rsv(struct super_block *sb, unsigned int group,
 				   group, grp_goal, group_first_block,
 				   group_last_block, my_rsv->rsv_start,
 				   my_rsv->rsv_end);
-			rsv_window_dump(&EXT2_SB(sb)->s_rsv_window_root, 1);
+			rsv_window_dump(&EXT2_SB(sb)->s_rsv_groups[group].root, 1);
 			return -1;
 		}
 		ret = ext2_try_to_allocate(sb, group, bitmap_bh, grp_goal,
@@ -64,6 +64,17 @@ struct ext2_block_alloc_info {
 #define rsv_start rsv_window._rsv_start
 #define rsv_end rsv_window._rsv_end
 
+/*
+ * Reservation windows never cross a block group boundary, so each group
+ * keeps its own window tree and lock.  Allocators working in different
+ * groups then do not serialise on a single filesystem-wide lock.
+ */
+struct ext2_rsv_group {
+	spinlock_t			lock;
+	struct rb_root			root;
+	struct ext2_reserve_window_node	head;
+};
+
 struct mb_cache;
 
 /*
@@ -100,10 +111,8 @@ struct ext2_sb_info {
 	struct percpu_counter s_freeinodes_counter;
 	struct percpu_counter s_dirs_counter;
 	struct blockgroup_lock *s_blockgroup_lock;
-	/* root of the per fs reservation window tree */
-	spinlock_t s_rsv_window_lock;
-	struct rb_root s_rsv_window_root;
-	struct ext2_reserve_window_node s_rsv_window_head;
+	/* per block group reservation window trees */
+	struct ext2_rsv_group *s_rsv_groups;
 	/*
 	 * s_lock protects against concurrent modifications of s_mount_state,
 	 * s_blocks_last, s_overhead_last and the content of superblock's
@@ -714,7 +723,7 @@ extern struct ext2_group_desc * ext2_get_group_desc(struct super_block * sb,
 extern void ext2_discard_reservation (struct inode *);
 extern int ext2_should_retry_alloc(struct super_block *sb, int *retries);
 extern void ext2_init_block_alloc_info(struct inode *);
-extern void ext2_rsv_window_add(struct super_block *sb, struct ext2_reserve_window_node *rsv);
+extern void ext2_rsv_window_add(struct rb_root *root, struct ext2_reserve_window_node *rsv);
 
 /* dir.c */
 extern int ext2_add_link (struct dentry *, struct inode *);
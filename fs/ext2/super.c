@@ -165,6 +165,7 @@ static void ext2_put_super (struct super_block * sb)
 		brelse(sbi->s_group_desc[i]);
 	kvfree(sbi->s_group_desc);
 	kfree(sbi->s_debts);
+	kvfree(sbi->s_rsv_groups);
 	percpu_counter_destroy(&sbi->s_freeblocks_counter);
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
@@ -1099,6 +1100,13 @@ static int ext2_fill_super(struct super_block *sb, void *data, int silent)
 		ext2_msg(sb, KERN_ERR, "error: not enough memory");
 		goto failed_mount_group_desc;
 	}
+	sbi->s_rsv_groups = kvcalloc(sbi->s_groups_count,
+				     sizeof(*sbi->s_rsv_groups), GFP_KERNEL);
+	if (!sbi->s_rsv_groups) {
+		ret = -ENOMEM;
+		ext2_msg(sb, KERN_ERR, "error: not enough memory");
+		goto failed_mount_group_desc;
+	}
 	for (i = 0; i < db_count; i++) {
 		block = descriptor_loc(sb, logic_sb_block, i);
 		sbi->s_group_desc[i] = sb_bread(sb, block);
@@ -1118,20 +1126,24 @@ static int ext2_fill_super(struct super_block *sb, void *data, int silent)
 	get_random_bytes(&sbi->s_next_generation, sizeof(u32));
 	spin_lock_init(&sbi->s_next_gen_lock);
 
-	/* per filesystem reservation list head & lock */
-	spin_lock_init(&sbi->s_rsv_window_lock);
-	sbi->s_rsv_window_root = RB_ROOT;
-	/*
-	 * Add a single, static dummy reservation to the start of the
-	 * reservation window list --- it gives us a placeholder for
-	 * append-at-start-of-list which makes the allocation logic
-	 * _much_ simpler.
-	 */
-	sbi->s_rsv_window_head.rsv_start = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
-	sbi->s_rsv_window_head.rsv_end = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
-	sbi->s_rsv_window_head.rsv_alloc_hit = 0;
-	sbi->s_rsv_window_head.rsv_goal_size = 0;
-	ext2_rsv_window_add(sb, &sbi->s_rsv_window_head);
+	/* per block group reservation list heads & locks */
+	for (i = 0; i < sbi->s_groups_count; i++) {
+		struct ext2_rsv_group *grp = &sbi->s_rsv_groups[i];
+
+		spin_lock_init(&grp->lock);
+		grp->root = RB_ROOT;
+		/*
+		 * Add a single, static dummy reservation to the start of
+		 * each reservation window list --- it gives us a placeholder
+		 * for append-at-start-of-list which makes the allocation
+		 * logic _much_ simpler.
+		 */
+		grp->head.rsv_start = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
+		grp->head.rsv_end = EXT2_RESERVE_WINDOW_NOT_ALLOCATED;
+		grp->head.rsv_alloc_hit = 0;
+		grp->head.rsv_goal_size = 0;
+		ext2_rsv_window_add(&grp->root, &grp->head);
+	}
 
 	err = percpu_counter_init(&sbi->s_freeblocks_counter,
 				ext2_count_free_blocks(sb), GFP_KERNEL);
@@ -1212,6 +1224,7 @@ static int ext2_fill_super(struct super_block *sb, void *data, int silent)
 failed_mount_group_desc:
 	kvfree(sbi->s_group_desc);
 	kfree(sbi->s_debts);
+	kvfree(sbi->s_rsv_groups);
 failed_mount:
 	brelse(bh);
 failed_sbi:
@@ -9,10 +9,12 @@
 #include <linux/proc_fs.h>
 #include <linux/module.h>
 #include <linux/nsproxy.h>
+#include <linux/seq_file.h>
 #include <net/net_namespace.h>
 
 #include "netns.h"
 #include "procfs.h"
+#include "svcsubs.h"
 
 /*
  * We only allow strings that start with 'Y', 'y', or '1'.
@@ -67,26 +69,53 @@ static const struct proc_ops lockd_end_grace_proc_ops = {
 	.proc_release	= simple_transaction_release,
 };
 
+/*
+ * Statistics of the NLM server file table.
+ */
+static int
+nlm_file_stats_show(struct seq_file *m, void *v)
+{
+	struct nlm_file_stats stats;
+	unsigned int nfiles;
+
+	nfiles = nlm_file_stats_fold(&stats);
+	seq_printf(m, "files:     %u\n", nfiles);
+	seq_printf(m, "lookups:   %llu\n", stats.lookups);
+	seq_printf(m, "hits:      %llu\n", stats.hits);
+	seq_printf(m, "creates:   %llu\n", stats.creates);
+	seq_printf(m, "lookup_ns: %llu\n", stats.lookup_ns);
+	return 0;
+}
+
 int __init
 lockd_create_procfs(void)
 {
-	struct proc_dir_entry *entry;
+	struct proc_dir_entry *dir, *entry;
 
-	entry = proc_mkdir("fs/lockd", NULL);
-	if (!entry)
+	dir = proc_mkdir("fs/lockd", NULL);
+	if (!dir)
 		return -ENOMEM;
-	entry = proc_create("nlm_end_grace", S_IRUGO|S_IWUSR, entry,
+	entry = proc_create("nlm_end_grace", S_IRUGO|S_IWUSR, dir,
 			    &lockd_end_grace_proc_ops);
-	if (!entry) {
-		remove_proc_entry("fs/lockd", NULL);
-		return -ENOMEM;
-	}
+	if (!entry)
+		goto out_remove_dir;
+	entry = proc_create_single("nlm_file_stats", S_IRUGO, dir,
+				   nlm_file_stats_show);
+	if (!entry)
+		goto out_remove_grace;
 	return 0;
+
+out_remove_grace:
+	remove_proc_entry("nlm_end_grace", dir);
+out_remove_dir:
+	remove_proc_entry("fs/lockd", NULL);
+	return -ENOMEM;
 }
 
 void __exit
 lockd_remove_procfs(void)
 {
+	remove_proc_entry("fs/lockd/nlm_file_stats", NULL);
 	remove_proc_entry("fs/lockd/nlm_end_grace", NULL);
 	remove_proc_entry("fs/lockd", NULL);
 }
@@ -42,6 +42,7 @@
 
 #include "netns.h"
 #include "procfs.h"
+#include "svcsubs.h"
 
 #define NLMDBG_FACILITY		NLMDBG_SVC
 #define LOCKD_BUFSIZE		(1024 + NLMSVC_XDRSIZE)
@@ -597,6 +598,10 @@ static int __init init_nlm(void)
 	if (nlm_sysctl_table == NULL)
 		goto err_sysctl;
 #endif
+	err = nlm_files_init();
+	if (err)
+		goto err_files;
+
 	err = register_pernet_subsys(&lockd_net_ops);
 	if (err)
 		goto err_pernet;
@@ -610,6 +615,8 @@ static int __init init_nlm(void)
 err_procfs:
 	unregister_pernet_subsys(&lockd_net_ops);
 err_pernet:
+	nlm_files_exit();
+err_files:
 #ifdef CONFIG_SYSCTL
 	unregister_sysctl_table(nlm_sysctl_table);
 err_sysctl:
@@ -623,6 +630,7 @@ static void __exit exit_nlm(void)
 	nlm_shutdown_hosts();
 	lockd_remove_procfs();
 	unregister_pernet_subsys(&lockd_net_ops);
+	nlm_files_exit();
 #ifdef CONFIG_SYSCTL
 	unregister_sysctl_table(nlm_sysctl_table);
 #endif
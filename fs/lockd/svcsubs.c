@@ -13,6 +13,10 @@
 #include <linux/in.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/rhashtable.h>
 #include <linux/sunrpc/svc.h>
 #include <linux/sunrpc/addr.h>
 #include <linux/lockd/lockd.h>
@@ -21,16 +25,34 @@
 #include <linux/mount.h>
 #include <uapi/linux/nfs2.h>
 
+#include "svcsubs.h"
+
 #define NLMDBG_FACILITY		NLMDBG_SVCSUBS
 
 
 /*
  * Global file hash table
+ *
+ * Files are looked up under RCU and pinned by nlm_file_entry.pin before
+ * their f_mutex is taken; f_count and the unhashing of a file are
+ * protected by that per-file mutex, so lookups of different files never
+ * contend with each other.  The table holds one pin on every hashed file.
  */
-#define FILE_HASH_BITS		7
-#define FILE_NRHASH		(1<<FILE_HASH_BITS)
-static struct hlist_head	nlm_files[FILE_NRHASH];
-static DEFINE_MUTEX(nlm_file_mutex);
+struct nlm_file_entry {
+	struct nlm_file		file;
+	struct rhash_head	node;
+	refcount_t		pin;
+	bool			dead;		/* unhashed, under f_mutex */
+	struct rcu_head		rcu;
+};
+
+static struct rhashtable	nlm_files;
+static DEFINE_PER_CPU(struct nlm_file_stats, nlm_file_stats);
+
+static inline struct nlm_file_entry *nlm_file_entry(struct nlm_file *file)
+{
+	return container_of(file, struct nlm_file_entry, file);
+}
 
 #ifdef CONFIG_SUNRPC_DEBUG
 static inline void nlm_debug_print_fh(char *msg, struct nfs_fh *f)
@@ -62,13 +84,59 @@ static inline void nlm_debug_print_file(char *msg, struct nlm_file *file)
 }
 #endif
 
-static inline unsigned int file_hash(struct nfs_fh *f)
+static u32 nlm_file_key_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct nfs_fh *fh = data;
+
+	return jhash(fh->data, fh->size, seed);
+}
+
+static u32 nlm_file_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct nlm_file_entry *entry = data;
+
+	return nlm_file_key_hashfn(&entry->file.f_handle, len, seed);
+}
+
+static int nlm_file_obj_cmpfn(struct rhashtable_compare_arg *arg,
+			      const void *obj)
+{
+	const struct nlm_file_entry *entry = obj;
+
+	return nfs_compare_fh(arg->key, &entry->file.f_handle);
+}
+
+static const struct rhashtable_params nlm_file_params = {
+	.key_len		= sizeof(struct nfs_fh),
+	.head_offset		= offsetof(struct nlm_file_entry, node),
+	.hashfn			= nlm_file_key_hashfn,
+	.obj_hashfn		= nlm_file_obj_hashfn,
+	.obj_cmpfn		= nlm_file_obj_cmpfn,
+	.automatic_shrinking	= true,
+};
+
+static void nlm_file_unpin(struct nlm_file *file)
+{
+	struct nlm_file_entry *entry = nlm_file_entry(file);
+
+	if (refcount_dec_and_test(&entry->pin))
+		kfree_rcu(entry, rcu);
+}
+
+/*
+ * Find a hashed file and take a pin on it, so that its f_mutex can be
+ * taken after leaving the RCU read side.
+ */
+static struct nlm_file *nlm_file_find_pinned(struct nfs_fh *fh)
 {
-	unsigned int tmp=0;
-	int i;
-	for (i=0; i<NFS2_FHSIZE;i++)
-		tmp += f->data[i];
-	return tmp & (FILE_NRHASH - 1);
+	struct nlm_file_entry *entry;
+
+	rcu_read_lock();
+	entry = rhashtable_lookup(&nlm_files, fh, nlm_file_params);
+	if (entry && !refcount_inc_not_zero(&entry->pin))
+		entry = NULL;
+	rcu_read_unlock();
+	return entry ? &entry->file : NULL;
 }
 
 int lock_to_openmode(struct file_lock *lock)
@@ -97,6 +165,14 @@ static __be32 nlm_do_fopen(struct svc_rqst *rqstp,
 	return nfserr;
 }
 
+static void nlm_close_files(struct nlm_file *file)
+{
+	if (file->f_file[O_RDONLY])
+		nlmsvc_ops->fclose(file->f_file[O_RDONLY]);
+	if (file->f_file[O_WRONLY])
+		nlmsvc_ops->fclose(file->f_file[O_WRONLY]);
+}
+
 /*
  * Lookup file info. If it doesn't exist, create a file info struct
  * and open a (VFS) file for the given inode.
@@ -105,75 +181,95 @@ __be32
 nlm_lookup_file(struct svc_rqst *rqstp, struct nlm_file **result,
 					struct nlm_lock *lock)
 {
+	struct nlm_file_entry *entry, *old;
 	struct nlm_file	*file;
-	unsigned int	hash;
+	u64		start = ktime_get_ns();
 	__be32		nfserr;
 	int		mode;
 
 	nlm_debug_print_fh("nlm_lookup_file", &lock->fh);
 
-	hash = file_hash(&lock->fh);
+	this_cpu_inc(nlm_file_stats.lookups);
 	mode = lock_to_openmode(&lock->fl);
 
-	/* Lock file table */
-	mutex_lock(&nlm_file_mutex);
-
-	hlist_for_each_entry(file, &nlm_files[hash], f_list)
-		if (!nfs_compare_fh(&file->f_handle, &lock->fh)) {
-			mutex_lock(&file->f_mutex);
-			nfserr = nlm_do_fopen(rqstp, file, mode);
+again:
+	file = nlm_file_find_pinned(&lock->fh);
+	if (file) {
+		mutex_lock(&file->f_mutex);
+		if (nlm_file_entry(file)->dead) {
+			/* Lost a race with the last release, retry */
 			mutex_unlock(&file->f_mutex);
-			goto found;
+			nlm_file_unpin(file);
+			goto again;
 		}
+		nfserr = nlm_do_fopen(rqstp, file, mode);
+		if (!nfserr)
+			file->f_count++;
+		mutex_unlock(&file->f_mutex);
+		nlm_file_unpin(file);
+		if (nfserr)
+			goto out;
+		this_cpu_inc(nlm_file_stats.hits);
+		goto found;
+	}
 	nlm_debug_print_fh("creating file for", &lock->fh);
 
 	nfserr = nlm_lck_denied_nolocks;
-	file = kzalloc(sizeof(*file), GFP_KERNEL);
-	if (!file)
-		goto out_free;
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		goto out;
+	file = &entry->file;
 
 	memcpy(&file->f_handle, &lock->fh, sizeof(struct nfs_fh));
 	mutex_init(&file->f_mutex);
 	INIT_HLIST_NODE(&file->f_list);
 	INIT_LIST_HEAD(&file->f_blocks);
+	refcount_set(&entry->pin, 1);
+	file->f_count = 1;
 
 	nfserr = nlm_do_fopen(rqstp, file, mode);
 	if (nfserr)
-		goto out_unlock;
+		goto out_free;
 
-	hlist_add_head(&file->f_list, &nlm_files[hash]);
+	old = rhashtable_lookup_get_insert_fast(&nlm_files, &entry->node,
+						nlm_file_params);
+	if (old) {
+		/* Somebody else hashed this file first, or we are out of memory */
+		nlm_close_files(file);
+		kfree(entry);
+		if (IS_ERR(old)) {
+			nfserr = nlm_lck_denied_nolocks;
+			goto out;
+		}
+		goto again;
+	}
+	this_cpu_inc(nlm_file_stats.creates);
 
 found:
 	dprintk("lockd: found file %p (count %d)\n", file, file->f_count);
 	*result = file;
-	file->f_count++;
-
-out_unlock:
-	mutex_unlock(&nlm_file_mutex);
+out:
+	this_cpu_add(nlm_file_stats.lookup_ns, ktime_get_ns() - start);
 	return nfserr;
 
 out_free:
-	kfree(file);
-	goto out_unlock;
+	kfree(entry);
+	goto out;
 }
 
 /*
- * Delete a file after having released all locks, blocks and shares
+ * Unhash a file that has no more references, locks, blocks or shares.
+ * Called with f_mutex held; the caller closes the file and drops the
+ * table's pin once f_mutex has been released.
  */
 static inline void
-nlm_delete_file(struct nlm_file *file)
+nlm_unhash_file(struct nlm_file *file)
 {
+	struct nlm_file_entry *entry = nlm_file_entry(file);
+
 	nlm_debug_print_file("closing file", file);
-	if (!hlist_unhashed(&file->f_list)) {
-		hlist_del(&file->f_list);
-		if (file->f_file[O_RDONLY])
-			nlmsvc_ops->fclose(file->f_file[O_RDONLY]);
-		if (file->f_file[O_WRONLY])
-			nlmsvc_ops->fclose(file->f_file[O_WRONLY]);
-		kfree(file);
-	} else {
-		printk(KERN_WARNING "lockd: attempt to release unknown file!\n");
-	}
+	entry->dead = true;
+	rhashtable_remove_fast(&nlm_files, &entry->node, nlm_file_params);
 }
 
 static int nlm_unlock_files(struct nlm_file *file, const struct file_lock *fl)
@@ -284,50 +380,74 @@ nlm_file_inuse(struct nlm_file *file)
 	return 0;
 }
 
-static void nlm_close_files(struct nlm_file *file)
+/*
+ * Drop a file reference.  If there are no more locks etc, unhash and
+ * close the file.
+ */
+static void nlm_put_file(struct nlm_file *file)
 {
-	if (file->f_file[O_RDONLY])
-		nlmsvc_ops->fclose(file->f_file[O_RDONLY]);
-	if (file->f_file[O_WRONLY])
-		nlmsvc_ops->fclose(file->f_file[O_WRONLY]);
+	bool unhashed = false;
+
+	mutex_lock(&file->f_mutex);
+	if (--file->f_count == 0 && !nlm_file_inuse(file)) {
+		nlm_unhash_file(file);
+		unhashed = true;
+	}
+	mutex_unlock(&file->f_mutex);
+
+	if (unhashed) {
+		nlm_close_files(file);
+		nlm_file_unpin(file);
+	}
 }
 
 /*
  * Loop over all files in the file table.
+ *
+ * A resize of the table during the walk may cause some files to be
+ * inspected twice, which is harmless.
  */
 static int
 nlm_traverse_files(void *data, nlm_host_match_fn_t match,
 		int (*is_failover_file)(void *data, struct nlm_file *file))
 {
-	struct hlist_node *next;
+	struct rhashtable_iter iter;
+	struct nlm_file_entry *entry;
 	struct nlm_file	*file;
-	int i, ret = 0;
+	int ret = 0;
 
-	mutex_lock(&nlm_file_mutex);
-	for (i = 0; i < FILE_NRHASH; i++) {
-		hlist_for_each_entry_safe(file, next, &nlm_files[i], f_list) {
-			if (is_failover_file && !is_failover_file(data, file))
-				continue;
-			file->f_count++;
-			mutex_unlock(&nlm_file_mutex);
-
-			/* Traverse locks, blocks and shares of this file
-			 * and update file->f_locks count */
-			if (nlm_inspect_file(data, file, match))
-				ret = 1;
-
-			mutex_lock(&nlm_file_mutex);
-			file->f_count--;
-			/* No more references to this file. Let go of it. */
-			if (list_empty(&file->f_blocks) && !file->f_locks
-			 && !file->f_shares && !file->f_count) {
-				hlist_del(&file->f_list);
-				nlm_close_files(file);
-				kfree(file);
-			}
+	rhashtable_walk_enter(&nlm_files, &iter);
+	rhashtable_walk_start(&iter);
+	while ((entry = rhashtable_walk_next(&iter)) != NULL) {
+		if (IS_ERR(entry))
+			continue;
+		if (!refcount_inc_not_zero(&entry->pin))
+			continue;
+		rhashtable_walk_stop(&iter);
+
+		file = &entry->file;
+		mutex_lock(&file->f_mutex);
+		if (entry->dead ||
+		    (is_failover_file && !is_failover_file(data, file))) {
+			mutex_unlock(&file->f_mutex);
+			goto next;
 		}
+		file->f_count++;
+		mutex_unlock(&file->f_mutex);
+
+		/* Traverse locks, blocks and shares of this file
+		 * and update file->f_locks count */
+		if (nlm_inspect_file(data, file, match))
+			ret = 1;
+
+		/* Let go of it if this was the last reference. */
+		nlm_put_file(file);
+next:
+		nlm_file_unpin(file);
+		rhashtable_walk_start(&iter);
 	}
-	mutex_unlock(&nlm_file_mutex);
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 	return ret;
 }
 
@@ -346,14 +466,7 @@ nlm_release_file(struct nlm_file *file)
 	dprintk("lockd: nlm_release_file(%p, ct = %d)\n",
 				file, file->f_count);
 
-	/* Lock file table */
-	mutex_lock(&nlm_file_mutex);
-
-	/* If there are no more locks etc, delete the file */
-	if (--file->f_count == 0 && !nlm_file_inuse(file))
-		nlm_delete_file(file);
-
-	mutex_unlock(&nlm_file_mutex);
+	nlm_put_file(file);
 }
 
 /*
@@ -503,3 +616,38 @@ nlmsvc_unlock_all_by_ip(struct sockaddr *server_addr)
 	return ret ? -EIO : 0;
 }
 EXPORT_SYMBOL_GPL(nlmsvc_unlock_all_by_ip);
+
+/**
+ * nlm_file_stats_fold - sum up the file table statistics
+ * @stats: filled in with the totals over all CPUs
+ *
+ * Returns the number of files currently in the table.
+ */
+unsigned int
+nlm_file_stats_fold(struct nlm_file_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		struct nlm_file_stats *s = per_cpu_ptr(&nlm_file_stats, cpu);
+
+		stats->lookups += READ_ONCE(s->lookups);
+		stats->hits += READ_ONCE(s->hits);
+		stats->creates += READ_ONCE(s->creates);
+		stats->lookup_ns += READ_ONCE(s->lookup_ns);
+	}
+	return atomic_read(&nlm_files.nelems);
+}
+
+int __init
+nlm_files_init(void)
+{
+	return rhashtable_init(&nlm_files, &nlm_file_params);
+}
+
+void
+nlm_files_exit(void)
+{
+	rhashtable_destroy(&nlm_files);
+}
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * NLM server file table
+ */
+#ifndef _LOCKD_SVCSUBS_H
+#define _LOCKD_SVCSUBS_H
+
+#include <linux/types.h>
+
+struct nlm_file_stats {
+	u64	lookups;	/* nlm_lookup_file() calls */
+	u64	hits;		/* lookups that found a hashed file */
+	u64	creates;	/* files added to the table */
+	u64	lookup_ns;	/* total time spent in nlm_lookup_file() */
+};
+
+int nlm_files_init(void);
+void nlm_files_exit(void);
+unsigned int nlm_file_stats_fold(struct nlm_file_stats *stats);
+
+#endif /* _LOCKD_SVCSUBS_H */
@@ -991,6 +991,10 @@ struct nfs_server *nfs_alloc_server(void)
 
 	atomic_set(&server->active, 0);
 
+	spin_lock_init(&server->dio_lock);
+	init_waitqueue_head(&server->dio_wait);
+	INIT_LIST_HEAD(&server->dio_queue);
+
 	server->io_stats = nfs_alloc_iostats();
 	if (!server->io_stats) {
 		kfree(server);
@@ -70,6 +70,147 @@ static const struct nfs_pgio_completion_ops nfs_direct_write_completion_ops;
 static const struct nfs_commit_completion_ops nfs_direct_commit_completion_ops;
 static void nfs_direct_write_complete(struct nfs_direct_req *dreq);
 static void nfs_direct_write_schedule_work(struct work_struct *work);
+static void nfs_direct_send_deferred(struct work_struct *work);
+
+/*
+ * O_DIRECT pipelining window
+ *
+ * Each nfs_server keeps a budget of O_DIRECT bytes allowed on the wire,
+ * sized in rsize/wsize units.  Synchronous submitters wait for room in
+ * the window before building the next chunk; asynchronous ones must not
+ * block, so whatever doesn't fit is queued on the server and sent from
+ * nfsiod as completions open the window again.  Every completion adjusts
+ * the window from the observed RPC latency.  While latency stays close
+ * to the lowest recently seen value the pipe is not full yet and the
+ * window grows by about one I/O per round trip.  Once latency doubles,
+ * requests are queueing somewhere (transport, session slot table or
+ * server) and the window is cut by an eighth, at most once per round
+ * trip.  Failed or rescheduled I/O halves it.
+ */
+#define NFS_DIO_CWND_INIT_IOS	16		/* initial window, in I/Os */
+#define NFS_DIO_CWND_MIN_IOS	2		/* smallest window, in I/Os */
+#define NFS_DIO_CWND_MAX	(256UL << 20)	/* largest window, in bytes */
+#define NFS_DIO_MIN_RTT_WIN	(10 * HZ)	/* lifetime of a min RTT sample */
+
+static size_t nfs_direct_iosize(struct nfs_server *server, bool write)
+{
+	return max_t(size_t, write ? server->wsize : server->rsize, PAGE_SIZE);
+}
+
+static unsigned long nfs_direct_cwnd(struct nfs_server *server, size_t iosize)
+{
+	unsigned long cwnd = READ_ONCE(server->dio_cwnd);
+
+	if (!cwnd)
+		cwnd = NFS_DIO_CWND_INIT_IOS * iosize;
+	return clamp_t(unsigned long, cwnd, NFS_DIO_CWND_MIN_IOS * iosize,
+		       NFS_DIO_CWND_MAX);
+}
+
+static long nfs_direct_cwnd_room(struct nfs_server *server, size_t iosize)
+{
+	return nfs_direct_cwnd(server, iosize) -
+		atomic_long_read(&server->dio_inflight);
+}
+
+static bool nfs_direct_cwnd_open(struct nfs_server *server, size_t iosize)
+{
+	return nfs_direct_cwnd_room(server, iosize) > 0;
+}
+
+/*
+ * Wait until the server's window has room for another I/O of @iosize.
+ */
+static int nfs_direct_cwnd_wait(struct nfs_server *server, size_t iosize)
+{
+	if (nfs_direct_cwnd_open(server, iosize))
+		return 0;
+	nfs_inc_server_stats(server, NFSIOS_DIRECTWAIT);
+	return wait_event_killable(server->dio_wait,
+				   nfs_direct_cwnd_open(server, iosize));
+}
+
+/*
+ * Hand the first queued asynchronous request to nfsiod if the window
+ * has room for it.
+ */
+static void nfs_direct_cwnd_kick(struct nfs_server *server)
+{
+	struct nfs_direct_req *dreq;
+
+	spin_lock(&server->dio_lock);
+	dreq = list_first_entry_or_null(&server->dio_queue,
+					struct nfs_direct_req, dio_list);
+	if (dreq && nfs_direct_cwnd_open(server,
+			nfs_direct_iosize(server, dreq->dio_write)))
+		list_del_init(&dreq->dio_list);
+	else
+		dreq = NULL;
+	spin_unlock(&server->dio_lock);
+
+	if (dreq)
+		queue_work(nfsiod_workqueue, &dreq->dio_work);
+}
+
+/*
+ * Park the requests on @dreq->dio_reqs until the window opens.  The
+ * caller's reference on @dreq->io_count is handed to the queue.
+ */
+static void nfs_direct_cwnd_queue(struct nfs_direct_req *dreq)
+{
+	struct nfs_server *server = NFS_SERVER(dreq->inode);
+
+	spin_lock(&server->dio_lock);
+	list_add_tail(&dreq->dio_list, &server->dio_queue);
+	spin_unlock(&server->dio_lock);
+	nfs_direct_cwnd_kick(server);
+}
+
+static void nfs_direct_cwnd_update(struct nfs_pgio_header *hdr)
+{
+	struct nfs_server *server = NFS_SERVER(hdr->inode);
+	unsigned long bytes = hdr->dreq_bytes;
+	size_t iosize = nfs_direct_iosize(server, hdr->rw_mode & FMODE_WRITE);
+	unsigned long cwnd;
+	u64 rtt;
+
+	atomic_long_sub(bytes, &server->dio_inflight);
+
+	spin_lock(&server->dio_lock);
+	cwnd = nfs_direct_cwnd(server, iosize);
+	if (test_bit(NFS_IOHDR_REDO, &hdr->flags) ||
+	    test_bit(NFS_IOHDR_ERROR, &hdr->flags)) {
+		cwnd /= 2;
+		nfs_inc_server_stats(server, NFSIOS_DIRECTBACKOFF);
+	} else if (hdr->task.tk_start) {
+		rtt = ktime_to_ns(ktime_sub(ktime_get(), hdr->task.tk_start));
+		if (!server->dio_min_rtt || rtt < server->dio_min_rtt ||
+		    time_after(jiffies, server->dio_min_rtt_stamp +
+					NFS_DIO_MIN_RTT_WIN)) {
+			server->dio_min_rtt = rtt;
+			server->dio_min_rtt_stamp = jiffies;
+		}
+		if (rtt > 2 * server->dio_min_rtt) {
+			if (time_after(jiffies, server->dio_cwnd_stamp +
+						nsecs_to_jiffies(rtt))) {
+				cwnd -= cwnd / 8;
+				server->dio_cwnd_stamp = jiffies;
+				nfs_inc_server_stats(server, NFSIOS_DIRECTBACKOFF);
+			}
+		} else if (rtt <= server->dio_min_rtt + server->dio_min_rtt / 4)
+			/* a window's worth of completions adds one I/O */
+			cwnd += max_t(unsigned long,
+				      div64_ul((u64)iosize * bytes, cwnd), 1);
+	}
+	WRITE_ONCE(server->dio_cwnd,
+		   clamp_t(unsigned long, cwnd, NFS_DIO_CWND_MIN_IOS * iosize,
+			   NFS_DIO_CWND_MAX));
+	spin_unlock(&server->dio_lock);
+
+	if (wq_has_sleeper(&server->dio_wait))
+		wake_up_all(&server->dio_wait);
+	nfs_direct_cwnd_kick(server);
+}
 
 static inline void get_dreq(struct nfs_direct_req *dreq)
 {
@@ -181,6 +322,9 @@ static inline struct nfs_direct_req *nfs_direct_req_alloc(void)
 	INIT_LIST_HEAD(&dreq->mds_cinfo.list);
 	pnfs_init_ds_commit_info(&dreq->ds_cinfo);
 	INIT_WORK(&dreq->work, nfs_direct_write_schedule_work);
+	INIT_LIST_HEAD(&dreq->dio_reqs);
+	INIT_LIST_HEAD(&dreq->dio_list);
+	INIT_WORK(&dreq->dio_work, nfs_direct_send_deferred);
 	spin_lock_init(&dreq->lock);
 
 	return dreq;
@@ -263,6 +407,8 @@ static void nfs_direct_read_completion(struct nfs_pgio_header *hdr)
 	unsigned long bytes = 0;
 	struct nfs_direct_req *dreq = hdr->dreq;
 
+	nfs_direct_cwnd_update(hdr);
+
 	spin_lock(&dreq->lock);
 	if (test_bit(NFS_IOHDR_REDO, &hdr->flags)) {
 		spin_unlock(&dreq->lock);
@@ -303,6 +449,9 @@ static void nfs_read_sync_pgio_error(struct list_head *head, int error)
 static void nfs_direct_pgio_init(struct nfs_pgio_header *hdr)
 {
 	get_dreq(hdr->dreq);
+	hdr->dreq_bytes = hdr->good_bytes;
+	atomic_long_add(hdr->dreq_bytes,
+			&NFS_SERVER(hdr->inode)->dio_inflight);
 }
 
 static const struct nfs_pgio_completion_ops nfs_direct_read_completion_ops = {
@@ -317,17 +466,23 @@ static const struct nfs_pgio_completion_ops nfs_direct_read_completion_ops = {
  * bail and stop sending more reads.  Read length accounting is
  * handled automatically by nfs_direct_read_result().  Otherwise, if
  * no requests have been sent, just return an error.
+ *
+ * Unless this is swap I/O, each chunk first waits for room in the
+ * server's O_DIRECT window.  Asynchronous requests don't wait; once the
+ * window is full the remaining chunks are queued on the server instead.
  */
 
 static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 					      struct iov_iter *iter,
-					      loff_t pos)
+					      loff_t pos, bool swap)
 {
 	struct nfs_pageio_descriptor desc;
 	struct inode *inode = dreq->inode;
 	ssize_t result = -EINVAL;
 	size_t requested_bytes = 0;
-	size_t rsize = max_t(size_t, NFS_SERVER(inode)->rsize, PAGE_SIZE);
+	struct nfs_server *server = NFS_SERVER(inode);
+	size_t rsize = nfs_direct_iosize(server, false);
+	bool queue = false;
 
 	nfs_pageio_init_read(&desc, dreq->inode, false,
 			     &nfs_direct_read_completion_ops);
@@ -341,6 +496,16 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 		size_t pgbase;
 		unsigned npages, i;
 
+		if (!swap && !queue) {
+			if (dreq->iocb) {
+				queue = !nfs_direct_cwnd_open(server, rsize);
+			} else {
+				result = nfs_direct_cwnd_wait(server, rsize);
+				if (result)
+					break;
+			}
+		}
+
 		result = iov_iter_get_pages_alloc2(iter, &pagevec,
 						  rsize, &pgbase);
 		if (result < 0)
@@ -358,7 +523,9 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 				result = PTR_ERR(req);
 				break;
 			}
-			if (!nfs_pageio_add_request(&desc, req)) {
+			if (queue) {
+				nfs_list_add_request(req, &dreq->dio_reqs);
+			} else if (!nfs_pageio_add_request(&desc, req)) {
 				result = desc.pg_error;
 				nfs_release_request(req);
 				break;
@@ -387,6 +554,12 @@ static ssize_t nfs_direct_read_schedule_iovec(struct nfs_direct_req *dreq,
 		return result < 0 ? result : -EIO;
 	}
 
+	if (queue) {
+		nfs_inc_server_stats(server, NFSIOS_DIRECTWAIT);
+		get_dreq(dreq);
+		nfs_direct_cwnd_queue(dreq);
+	}
+
 	if (put_dreq(dreq))
 		nfs_direct_complete(dreq);
 	return requested_bytes;
@@ -459,7 +632,8 @@ ssize_t nfs_file_direct_read(struct kiocb *iocb, struct iov_iter *iter,
 		nfs_start_io_direct(inode);
 
 	NFS_I(inode)->read_io += count;
-	requested = nfs_direct_read_schedule_iovec(dreq, iter, iocb->ki_pos);
+	requested = nfs_direct_read_schedule_iovec(dreq, iter, iocb->ki_pos,
+						   swap);
 
 	if (!swap)
 		nfs_end_io_direct(inode);
@@ -732,6 +906,7 @@ static void nfs_direct_write_completion(struct nfs_pgio_header *hdr)
 
 	trace_nfs_direct_write_completion(dreq);
 
+	nfs_direct_cwnd_update(hdr);
 	nfs_init_cinfo_from_dreq(&cinfo, dreq);
 
 	spin_lock(&dreq->lock);
@@ -812,6 +987,94 @@ static const struct nfs_pgio_completion_ops nfs_direct_write_completion_ops = {
 	.reschedule_io = nfs_direct_write_reschedule_io,
 };
 
+/*
+ * Give up on a queued request that could not be sent.  Writes that hit a
+ * soft error are rescheduled through the commit list, as in
+ * nfs_direct_write_schedule_iovec(); anything else truncates the I/O.
+ */
+static void nfs_direct_drop_deferred(struct nfs_direct_req *dreq,
+				     struct nfs_page *req, int error)
+{
+	struct nfs_commit_info cinfo;
+
+	if (dreq->dio_write && error == -EAGAIN) {
+		nfs_init_cinfo_from_dreq(&cinfo, dreq);
+		spin_lock(&dreq->lock);
+		dreq->flags = NFS_ODIRECT_RESCHED_WRITES;
+		spin_unlock(&dreq->lock);
+		nfs_unlock_request(req);
+		nfs_mark_request_commit(req, NULL, &cinfo, 0);
+		return;
+	}
+
+	spin_lock(&dreq->lock);
+	nfs_direct_truncate_request(dreq, req);
+	if (!dreq->error)
+		dreq->error = error < 0 ? error : -EIO;
+	spin_unlock(&dreq->lock);
+	if (dreq->dio_write)
+		nfs_unlock_and_release_request(req);
+	else
+		nfs_release_request(req);
+}
+
+/*
+ * Send as much of an asynchronous request's queued I/O as the server's
+ * window has room for, and queue the rest again.
+ */
+static void nfs_direct_send_deferred(struct work_struct *work)
+{
+	struct nfs_direct_req *dreq = container_of(work, struct nfs_direct_req,
+						   dio_work);
+	struct nfs_server *server = NFS_SERVER(dreq->inode);
+	struct nfs_pageio_descriptor desc;
+	struct nfs_page *req;
+	int error = 0;
+	long room;
+
+	if (dreq->dio_write)
+		nfs_pageio_init_write(&desc, dreq->inode, dreq->dio_ioflags,
+				      false, &nfs_direct_write_completion_ops);
+	else
+		nfs_pageio_init_read(&desc, dreq->inode, false,
+				     &nfs_direct_read_completion_ops);
+	desc.pg_dreq = dreq;
+
+	room = nfs_direct_cwnd_room(server,
+				    nfs_direct_iosize(server, dreq->dio_write));
+	while (room > 0 && !list_empty(&dreq->dio_reqs)) {
+		req = nfs_list_entry(dreq->dio_reqs.next);
+		nfs_list_remove_request(req);
+		room -= req->wb_bytes;
+		if (!nfs_pageio_add_request(&desc, req)) {
+			error = desc.pg_error ? desc.pg_error : -EIO;
+			nfs_direct_drop_deferred(dreq, req, error);
+			break;
+		}
+	}
+	nfs_pageio_complete(&desc);
+
+	if (error) {
+		while (!list_empty(&dreq->dio_reqs)) {
+			req = nfs_list_entry(dreq->dio_reqs.next);
+			nfs_list_remove_request(req);
+			nfs_direct_drop_deferred(dreq, req, error);
+		}
+	}
+
+	if (!list_empty(&dreq->dio_reqs)) {
+		nfs_direct_cwnd_queue(dreq);
+		return;
+	}
+
+	if (put_dreq(dreq)) {
+		if (dreq->dio_write)
+			nfs_direct_write_complete(dreq);
+		else
+			nfs_direct_complete(dreq);
+	}
+}
+
 
 /*
  * NB: Return the value of the first error return code.  Subsequent
@@ -823,24 +1086,33 @@ static const struct nfs_pgio_completion_ops nfs_direct_write_completion_ops = {
  * bail and stop sending more writes.  Write length accounting is
  * handled automatically by nfs_direct_write_result().  Otherwise, if
  * no requests have been sent, just return an error.
+ *
+ * Unless this is swap I/O, each chunk first waits for room in the
+ * server's O_DIRECT window.  Asynchronous requests don't wait; once the
+ * window is full the remaining chunks are queued on the server instead.
  */
 static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 					       struct iov_iter *iter,
-					       loff_t pos, int ioflags)
+					       loff_t pos, int ioflags,
+					       bool swap)
 {
 	struct nfs_pageio_descriptor desc;
 	struct inode *inode = dreq->inode;
 	struct nfs_commit_info cinfo;
 	ssize_t result = 0;
 	size_t requested_bytes = 0;
-	size_t wsize = max_t(size_t, NFS_SERVER(inode)->wsize, PAGE_SIZE);
+	struct nfs_server *server = NFS_SERVER(inode);
+	size_t wsize = nfs_direct_iosize(server, true);
 	bool defer = false;
+	bool queue = false;
 
 	trace_nfs_direct_write_schedule_iovec(dreq);
 
 	nfs_pageio_init_write(&desc, inode, ioflags, false,
 			      &nfs_direct_write_completion_ops);
 	desc.pg_dreq = dreq;
+	dreq->dio_write = true;
+	dreq->dio_ioflags = ioflags;
 	get_dreq(dreq);
 	inode_dio_begin(inode);
 
@@ -851,6 +1123,16 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 		size_t pgbase;
 		unsigned npages, i;
 
+		if (!swap && !defer && !queue) {
+			if (dreq->iocb) {
+				queue = !nfs_direct_cwnd_open(server, wsize);
+			} else {
+				result = nfs_direct_cwnd_wait(server, wsize);
+				if (result)
+					break;
+			}
+		}
+
 		result = iov_iter_get_pages_alloc2(iter, &pagevec,
 						  wsize, &pgbase);
 		if (result < 0)
@@ -887,6 +1169,10 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 			}
 
 			nfs_lock_request(req);
+			if (queue) {
+				nfs_list_add_request(req, &dreq->dio_reqs);
+				continue;
+			}
 			if (nfs_pageio_add_request(&desc, req))
 				continue;
 
@@ -924,6 +1210,12 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 		return result < 0 ? result : -EIO;
 	}
 
+	if (queue) {
+		nfs_inc_server_stats(server, NFSIOS_DIRECTWAIT);
+		get_dreq(dreq);
+		nfs_direct_cwnd_queue(dreq);
+	}
+
 	if (put_dreq(dreq))
 		nfs_direct_write_complete(dreq);
 	return requested_bytes;
@@ -1002,12 +1294,12 @@ ssize_t nfs_file_direct_write(struct kiocb *iocb, struct iov_iter *iter,
 
 	if (swap) {
 		requested = nfs_direct_write_schedule_iovec(dreq, iter, pos,
-							    FLUSH_STABLE);
+							    FLUSH_STABLE, true);
 	} else {
 		nfs_start_io_direct(inode);
 
 		requested = nfs_direct_write_schedule_iovec(dreq, iter, pos,
-							    FLUSH_COND_STABLE);
+							    FLUSH_COND_STABLE, false);
 
 		if (mapping->nrpages) {
 			invalidate_inode_pages2_range(mapping,
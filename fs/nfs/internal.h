@@ -943,6 +943,13 @@ struct nfs_direct_req {
 	struct pnfs_ds_commit_info ds_cinfo;	/* Storage for cinfo */
 	struct work_struct	work;
 	int			flags;
+
+	/* requests waiting for room in the server's O_DIRECT window */
+	struct list_head	dio_reqs;
+	struct list_head	dio_list;	/* on nfs_server->dio_queue */
+	struct work_struct	dio_work;
+	int			dio_ioflags;	/* FLUSH_* flags for writes */
+	bool			dio_write;
 	/* for write */
 #define NFS_ODIRECT_DO_COMMIT		(1)	/* an unstable reply was received */
 #define NFS_ODIRECT_RESCHED_WRITES	(2)	/* write verification failed */
@@ -41,6 +41,9 @@
 
 #define NFSDBG_FACILITY		NFSDBG_PNFS
 #define PNFS_LAYOUTGET_RETRY_TIMEOUT (120*HZ)
+#define PNFS_LAYOUT_MAX_LSEGS	64	/* cached layout segments per inode */
+#define PNFS_PREFETCH_SEQ_IOS	2	/* sequential I/Os before prefetching */
+#define PNFS_PREFETCH_DISTANCE	4	/* I/Os left in segment when prefetching */
 
 /* Locking:
  *
@@ -549,6 +552,7 @@ pnfs_init_lseg(struct pnfs_layout_hdr *lo, struct pnfs_layout_segment *lseg,
 	lseg->pls_layout = lo;
 	lseg->pls_range = *range;
 	lseg->pls_seq = be32_to_cpu(stateid->seqid);
+	lseg->pls_last_used = jiffies;
 }
 
 static void pnfs_free_lseg(struct pnfs_layout_segment *lseg)
@@ -1718,6 +1722,58 @@ pnfs_layout_insert_lseg(struct pnfs_layout_hdr *lo,
 				free_me);
 }
 
+static bool
+pnfs_lseg_can_forget(const struct pnfs_layout_segment *lseg)
+{
+	return test_bit(NFS_LSEG_VALID, &lseg->pls_flags) &&
+		!test_bit(NFS_LSEG_ROC, &lseg->pls_flags) &&
+		!test_bit(NFS_LSEG_LAYOUTCOMMIT, &lseg->pls_flags) &&
+		!test_bit(NFS_LSEG_LAYOUTRETURN, &lseg->pls_flags) &&
+		refcount_read(&lseg->pls_refcount) == 1;
+}
+
+/*
+ * Keep the number of cached layout segments of an inode bounded.  Once
+ * the limit is exceeded, the least recently used segments that have no
+ * I/O outstanding and nothing to commit or return are forgotten.  The
+ * server is not told: a client may forget layouts (RFC 8881, section
+ * 12.5.5.1), and a later recall of the range is simply answered with
+ * NFS4ERR_NOMATCHING_LAYOUT.
+ *
+ * Must be called with the inode i_lock held, which also keeps new
+ * references from being taken through pnfs_find_lseg().
+ */
+static void
+pnfs_layout_trim_lsegs(struct pnfs_layout_hdr *lo,
+		       struct pnfs_layout_segment *keep,
+		       struct list_head *free_me)
+{
+	struct pnfs_layout_segment *lseg, *victim;
+	unsigned int nr = 0;
+
+	list_for_each_entry(lseg, &lo->plh_segs, pls_list)
+		if (test_bit(NFS_LSEG_VALID, &lseg->pls_flags))
+			nr++;
+
+	while (nr > PNFS_LAYOUT_MAX_LSEGS) {
+		victim = NULL;
+		list_for_each_entry(lseg, &lo->plh_segs, pls_list) {
+			if (lseg == keep || !pnfs_lseg_can_forget(lseg))
+				continue;
+			if (!victim || time_before(lseg->pls_last_used,
+						   victim->pls_last_used))
+				victim = lseg;
+		}
+		if (!victim)
+			break;
+		dprintk("%s: forgetting lseg %p offset %llu length %llu\n",
+			__func__, victim, victim->pls_range.offset,
+			victim->pls_range.length);
+		mark_lseg_invalid(victim, free_me);
+		nr--;
+	}
+}
+
 static struct pnfs_layout_hdr *
 alloc_init_layout_hdr(struct inode *ino,
 		      struct nfs_open_context *ctx,
@@ -1817,6 +1873,7 @@ pnfs_find_lseg(struct pnfs_layout_hdr *lo,
 		    pnfs_lseg_range_match(&lseg->pls_range, range,
 					  strict_iomode)) {
 			ret = pnfs_get_lseg(lseg);
+			ret->pls_last_used = jiffies;
 			break;
 		}
 	}
@@ -2211,6 +2268,96 @@ pnfs_update_layout(struct inode *ino,
 }
 EXPORT_SYMBOL_GPL(pnfs_update_layout);
 
+/*
+ * Sequential layout prefetch
+ *
+ * Large sequential scans would otherwise stall on a LAYOUTGET round trip
+ * every time the I/O crosses into a segment that is not cached yet.  Once
+ * a layout has seen a few back-to-back I/Os and the current one is close
+ * to the end of its segment, the next segment is fetched from nfsiod.
+ */
+struct pnfs_layout_prefetch {
+	struct work_struct	work;
+	struct nfs_open_context	*ctx;
+	struct pnfs_layout_hdr	*lo;
+	loff_t			pos;
+	u64			count;
+	enum pnfs_iomode	iomode;
+};
+
+static void pnfs_layout_prefetch_work(struct work_struct *work)
+{
+	struct pnfs_layout_prefetch *pf =
+		container_of(work, struct pnfs_layout_prefetch, work);
+	struct pnfs_layout_hdr *lo = pf->lo;
+	struct pnfs_layout_segment *lseg;
+
+	lseg = pnfs_update_layout(lo->plh_inode, pf->ctx, pf->pos, pf->count,
+				  pf->iomode, false, nfs_io_gfp_mask());
+	if (!IS_ERR_OR_NULL(lseg))
+		pnfs_put_lseg(lseg);
+
+	clear_bit(NFS_LAYOUT_PREFETCH, &lo->plh_flags);
+	pnfs_put_layout_hdr(lo);
+	put_nfs_open_context(pf->ctx);
+	kfree(pf);
+}
+
+/*
+ * Called from pnfs_generic_pg_test() for each request added to a
+ * descriptor, so that the detector sees the actual I/O stream rather than
+ * the (often open-ended) ranges passed to pnfs_update_layout().  The
+ * state is only a hint, so it is updated without holding the i_lock.
+ */
+static void
+pnfs_layout_prefetch(struct nfs_pageio_descriptor *pgio,
+		     struct nfs_page *req, u64 seg_end)
+{
+	struct pnfs_layout_segment *lseg = pgio->pg_lseg;
+	struct pnfs_layout_hdr *lo = lseg->pls_layout;
+	struct inode *ino = lo->plh_inode;
+	u64 iosize = max_t(u64, pgio->pg_bsize, PAGE_SIZE);
+	loff_t pos = req_offset(req);
+	loff_t next = pos + req->wb_bytes;
+	loff_t seq_next = READ_ONCE(lo->plh_seq_next);
+	struct pnfs_layout_prefetch *pf;
+
+	if (lseg->pls_range.length == NFS4_MAX_UINT64)
+		return;
+	/* A request retried after a flush is tested again */
+	if (next == seq_next)
+		return;
+	if (pos == seq_next)
+		WRITE_ONCE(lo->plh_seq_bytes,
+			   READ_ONCE(lo->plh_seq_bytes) + req->wb_bytes);
+	else
+		WRITE_ONCE(lo->plh_seq_bytes, 0);
+	WRITE_ONCE(lo->plh_seq_next, next);
+
+	if (READ_ONCE(lo->plh_seq_bytes) < PNFS_PREFETCH_SEQ_IOS * iosize ||
+	    next + PNFS_PREFETCH_DISTANCE * iosize < seg_end ||
+	    READ_ONCE(lo->plh_prefetch_pos) == seg_end ||
+	    (lseg->pls_range.iomode == IOMODE_READ &&
+	     seg_end >= i_size_read(ino)) ||
+	    test_and_set_bit(NFS_LAYOUT_PREFETCH, &lo->plh_flags))
+		return;
+	WRITE_ONCE(lo->plh_prefetch_pos, seg_end);
+
+	pf = kmalloc(sizeof(*pf), GFP_NOWAIT | __GFP_NOWARN);
+	if (!pf) {
+		clear_bit(NFS_LAYOUT_PREFETCH, &lo->plh_flags);
+		return;
+	}
+	INIT_WORK(&pf->work, pnfs_layout_prefetch_work);
+	pf->ctx = get_nfs_open_context(nfs_req_openctx(req));
+	pf->lo = lo;
+	pnfs_get_layout_hdr(lo);
+	pf->pos = seg_end;
+	pf->count = lseg->pls_range.length;
+	pf->iomode = lseg->pls_range.iomode;
+	queue_work(nfsiod_workqueue, &pf->work);
+}
+
 static bool
 pnfs_sanity_check_layout_range(struct pnfs_layout_range *range)
 {
@@ -2456,7 +2603,7 @@ pnfs_layout_process(struct nfs4_layoutget *lgp)
 
 	pnfs_get_lseg(lseg);
 	pnfs_layout_insert_lseg(lo, lseg, &free_me);
-
+	pnfs_layout_trim_lsegs(lo, lseg, &free_me);
 
 	if (res->return_on_close)
 		set_bit(NFS_LSEG_ROC, &lseg->pls_flags);
@@ -2830,6 +2977,8 @@ pnfs_generic_pg_test(struct nfs_pageio_descriptor *pgio,
 		seg_left = seg_end - req_start;
 		if (seg_left < size)
 			size = (unsigned int)seg_left;
+
+		pnfs_layout_prefetch(pgio, req, seg_end);
 	}
 
 	return size;
@@ -73,6 +73,7 @@ struct pnfs_layout_segment {
 	refcount_t pls_refcount;
 	u32 pls_seq;
 	unsigned long pls_flags;
+	unsigned long pls_last_used;	/* jiffies of last lookup, for trimming */
 	struct pnfs_layout_hdr *pls_layout;
 };
 
@@ -106,6 +107,7 @@ enum {
 	NFS_LAYOUT_INODE_FREEING,	/* The inode is being freed */
 	NFS_LAYOUT_HASHED,		/* The layout visible */
 	NFS_LAYOUT_DRAIN,
+	NFS_LAYOUT_PREFETCH,		/* LAYOUTGET prefetch queued */
 };
 
 enum layoutdriver_policy_flags {
@@ -211,6 +213,9 @@ struct pnfs_layout_hdr {
 	u32			plh_return_seq;
 	enum pnfs_iomode	plh_return_iomode;
 	loff_t			plh_lwb; /* last write byte for layoutcommit */
+	loff_t			plh_seq_next; /* expected next sequential I/O */
+	u64			plh_seq_bytes; /* sequential bytes in a row */
+	loff_t			plh_prefetch_pos; /* last prefetched offset */
 	const struct cred	*plh_lc_cred; /* layoutcommit cred */
 	struct inode		*plh_inode;
 	struct rcu_head		plh_rcu;
@@ -718,6 +718,11 @@ int nfs_show_stats(struct seq_file *m, struct dentry *root)
 	seq_puts(m, "\n\tbytes:\t");
 	for (i = 0; i < __NFSIOS_BYTESMAX; i++)
 		seq_printf(m, "%Lu ", totals.bytes[i]);
+
+	seq_printf(m, "\n\tdio:\tcwnd=%lu", READ_ONCE(nfss->dio_cwnd));
+	seq_printf(m, ",inflight=%ld", atomic_long_read(&nfss->dio_inflight));
+	seq_printf(m, ",min_rtt_us=%llu",
+		   div_u64(READ_ONCE(nfss->dio_min_rtt), NSEC_PER_USEC));
 	seq_putc(m, '\n');
 
 	rpc_clnt_show_stats(m, nfss->client);
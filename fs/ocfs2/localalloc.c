@@ -32,6 +32,10 @@
 
 #define OCFS2_LOCAL_ALLOC(dinode)	(&((dinode)->id2.i_lab))
 
+#define OCFS2_LA_ENABLE_INTERVAL	(30 * HZ)
+#define OCFS2_LA_GROW_INTERVAL		(5 * HZ)
+#define OCFS2_LA_SHRINK_INTERVAL	(60 * HZ)
+
 static u32 ocfs2_local_alloc_count_bits(struct ocfs2_dinode *alloc);
 
 static int ocfs2_local_alloc_find_clear_bits(struct ocfs2_super *osb,
@@ -176,6 +180,27 @@ unsigned int ocfs2_la_default_mb(struct ocfs2_super *osb)
 	return la_mb;
 }
 
+/*
+ * Largest window auto-scaling may grow to: what fits in the local alloc
+ * bitmap and in one cluster group (leaving room for block groups, like
+ * ocfs2_la_default_mb() does), but no more than this slot's share of
+ * the volume.
+ */
+static unsigned int ocfs2_la_max_auto_bits(struct ocfs2_super *osb)
+{
+	struct super_block *sb = osb->sb;
+	unsigned int gd_bits, max_bits;
+
+	max_bits = ocfs2_local_alloc_size(sb) * 8;
+	gd_bits = 8 * ocfs2_group_bitmap_size(sb, 0, osb->s_feature_incompat);
+	if (gd_bits > ocfs2_megabytes_to_clusters(sb, 32))
+		gd_bits -= ocfs2_megabytes_to_clusters(sb, 16);
+	max_bits = min(max_bits, gd_bits);
+	max_bits = min(max_bits, osb->osb_clusters_at_boot / osb->max_slots);
+
+	return max(max_bits, osb->local_alloc_default_bits);
+}
+
 void ocfs2_la_set_sizes(struct ocfs2_super *osb, int requested_mb)
 {
 	struct super_block *sb = osb->sb;
@@ -200,7 +225,15 @@ void ocfs2_la_set_sizes(struct ocfs2_super *osb, int requested_mb)
 			ocfs2_megabytes_to_clusters(sb, requested_mb);
 	}
 
+	/* Only scale the window if the user didn't ask for a size. */
+	if (requested_mb == -1)
+		osb->local_alloc_max_bits = ocfs2_la_max_auto_bits(osb);
+	else
+		osb->local_alloc_max_bits = osb->local_alloc_default_bits;
+
 	osb->local_alloc_bits = osb->local_alloc_default_bits;
+	osb->la_last_slide = jiffies;
+	osb->la_last_fragmented = jiffies - OCFS2_LA_ENABLE_INTERVAL - 1;
 }
 
 static inline int ocfs2_la_state_enabled(struct ocfs2_super *osb)
@@ -1025,7 +1058,48 @@ enum ocfs2_la_event {
 					 * enough bits free to satisfy
 					 * our request. */
 };
-#define OCFS2_LA_ENABLE_INTERVAL (30 * HZ)
+
+/*
+ * Window auto-scaling.
+ *
+ * A window used up within OCFS2_LA_GROW_INTERVAL means this node is
+ * allocating fast enough to keep going back to the cluster locked
+ * global bitmap, so the next window is doubled, up to
+ * local_alloc_max_bits. A window that lasted longer than
+ * OCFS2_LA_SHRINK_INTERVAL is halved back towards the default so that
+ * a quiet node doesn't sit on space other nodes could use. We don't
+ * grow for OCFS2_LA_ENABLE_INTERVAL after the global bitmap was found
+ * full or fragmented.
+ *
+ * Called under osb_lock on a normal window slide.
+ */
+static void ocfs2_la_autoscale(struct ocfs2_super *osb)
+{
+	unsigned long now = jiffies;
+	unsigned long age = now - osb->la_last_slide;
+	unsigned int bits = osb->local_alloc_bits;
+
+	osb->la_last_slide = now;
+	osb->la_last_window_ms = jiffies_to_msecs(age);
+
+	if (bits < osb->local_alloc_default_bits) {
+		/* Coming back from a throttled period. */
+		bits = osb->local_alloc_default_bits;
+	} else if (age < OCFS2_LA_GROW_INTERVAL &&
+		   time_after(now, osb->la_last_fragmented +
+				   OCFS2_LA_ENABLE_INTERVAL)) {
+		bits = min(bits * 2, osb->local_alloc_max_bits);
+		if (bits > osb->local_alloc_bits)
+			atomic_inc(&osb->alloc_stats.la_grows);
+	} else if (age > OCFS2_LA_SHRINK_INTERVAL) {
+		bits = max(bits / 2, osb->local_alloc_default_bits);
+		if (bits < osb->local_alloc_bits)
+			atomic_inc(&osb->alloc_stats.la_shrinks);
+	}
+
+	osb->local_alloc_bits = bits;
+}
+
 /*
  * Given an event, calculate the size of our next local alloc window.
  *
@@ -1072,6 +1146,7 @@ static int ocfs2_recalc_la_window(struct ocfs2_super *osb,
 		} else {
 			osb->local_alloc_state = OCFS2_LA_DISABLED;
 		}
+		osb->la_last_fragmented = jiffies;
 		queue_delayed_work(osb->ocfs2_wq, &osb->la_enable_wq,
 				   OCFS2_LA_ENABLE_INTERVAL);
 		goto out_unlock;
@@ -1084,7 +1159,7 @@ static int ocfs2_recalc_la_window(struct ocfs2_super *osb,
 	 * low space.
 	 */
 	if (osb->local_alloc_state != OCFS2_LA_THROTTLED)
-		osb->local_alloc_bits = osb->local_alloc_default_bits;
+		ocfs2_la_autoscale(osb);
 
 out_unlock:
 	state = osb->local_alloc_state;
@@ -241,6 +241,8 @@ struct ocfs2_alloc_stats
 	atomic_t bitmap_data;
 	atomic_t bg_allocs;
 	atomic_t bg_extends;
+	atomic_t la_grows;
+	atomic_t la_shrinks;
 };
 
 enum ocfs2_local_alloc_state
@@ -386,6 +388,11 @@ struct ocfs2_super
 	 */
 	unsigned int local_alloc_bits;
 	unsigned int local_alloc_default_bits;
+	unsigned int local_alloc_max_bits;	/* auto-scaling limit */
+	/* Window auto-scaling state, protected by osb_lock */
+	unsigned long la_last_slide;		/* jiffies */
+	unsigned long la_last_fragmented;	/* jiffies */
+	unsigned int la_last_window_ms;		/* lifetime of last window */
 	/* osb_clusters_at_boot can become stale! Do not trust it to
 	 * be up to date. */
 	unsigned int osb_clusters_at_boot;
@@ -298,10 +298,18 @@ static int ocfs2_osb_dump(struct ocfs2_super *osb, char *buf, int len)
 
 	out += scnprintf(buf + out, len - out,
 			"%10s => State: %u  Descriptor: %llu  Size: %u bits  "
-			"Default: %u bits\n",
+			"Default: %u bits  Max: %u bits\n",
 			"LocalAlloc", osb->local_alloc_state,
 			(unsigned long long)osb->la_last_gd,
-			osb->local_alloc_bits, osb->local_alloc_default_bits);
+			osb->local_alloc_bits, osb->local_alloc_default_bits,
+			osb->local_alloc_max_bits);
+
+	out += scnprintf(buf + out, len - out,
+			"%10s => Grows: %d  Shrinks: %d  LastWindow: %u ms\n",
+			"LAScaling",
+			atomic_read(&osb->alloc_stats.la_grows),
+			atomic_read(&osb->alloc_stats.la_shrinks),
+			osb->la_last_window_ms);
 
 	spin_lock(&osb->osb_lock);
 	out += scnprintf(buf + out, len - out,
@@ -1511,7 +1519,8 @@ static int ocfs2_show_options(struct seq_file *s, struct dentry *root)
 		seq_printf(s, ",commit=%u",
 			   (unsigned) (osb->osb_commit_interval / HZ));
 
-	local_alloc_megs = osb->local_alloc_bits >> (20 - osb->s_clustersize_bits);
+	local_alloc_megs = osb->local_alloc_default_bits >>
+				(20 - osb->s_clustersize_bits);
 	if (local_alloc_megs != ocfs2_la_default_mb(osb))
 		seq_printf(s, ",localalloc=%d", local_alloc_megs);
 
@@ -2059,6 +2068,8 @@ static int ocfs2_initialize_super(struct super_block *sb,
 	atomic_set(&osb->alloc_stats.bitmap_data, 0);
 	atomic_set(&osb->alloc_stats.bg_allocs, 0);
 	atomic_set(&osb->alloc_stats.bg_extends, 0);
+	atomic_set(&osb->alloc_stats.la_grows, 0);
+	atomic_set(&osb->alloc_stats.la_shrinks, 0);
 
 	/* Copy the blockcheck stats from the superblock probe */
 	osb->osb_ecc_stats = *stats;
@@ -872,6 +872,7 @@ DEFINE_XFILE_EVENT(xfile_pwrite);
 DEFINE_XFILE_EVENT(xfile_seek_data);
 DEFINE_XFILE_EVENT(xfile_get_page);
 DEFINE_XFILE_EVENT(xfile_put_page);
+DEFINE_XFILE_EVENT(xfile_cursor_refill);
 
 TRACE_EVENT(xfarray_create,
 	TP_PROTO(struct xfarray *xfa, unsigned long long required_capacity),
@@ -989,6 +990,31 @@ TRACE_EVENT(xfarray_sort,
 		  __entry->bytes)
 );
 
+TRACE_EVENT(xfarray_msort,
+	TP_PROTO(struct xfarray *xfa, uint64_t nr_runs, unsigned int nr_workers),
+	TP_ARGS(xfa, nr_runs, nr_workers),
+	TP_STRUCT__entry(
+		__field(unsigned long, ino)
+		__field(unsigned long long, nr)
+		__field(size_t, obj_size)
+		__field(unsigned long long, nr_runs)
+		__field(unsigned int, nr_workers)
+	),
+	TP_fast_assign(
+		__entry->ino = file_inode(xfa->xfile->file)->i_ino;
+		__entry->nr = xfa->nr;
+		__entry->obj_size = xfa->obj_size;
+		__entry->nr_runs = nr_runs;
+		__entry->nr_workers = nr_workers;
+	),
+	TP_printk("xfino 0x%lx nr %llu objsz %zu runs %llu workers %u",
+		  __entry->ino,
+		  __entry->nr,
+		  __entry->obj_size,
+		  __entry->nr_runs,
+		  __entry->nr_workers)
+);
+
 TRACE_EVENT(xfarray_sort_stats,
 	TP_PROTO(struct xfarray_sortinfo *si, int error),
 	TP_ARGS(si, error),
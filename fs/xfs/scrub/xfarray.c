@@ -11,6 +11,7 @@
 #include "scrub/xfarray.h"
 #include "scrub/scrub.h"
 #include "scrub/trace.h"
+#include <linux/min_heap.h>
 
 /*
  * Large Arrays of Fixed-Size Records
@@ -90,6 +91,7 @@ xfarray_create(
 
 	array->xfile = xfile;
 	array->obj_size = obj_size;
+	xfile_cursor_init(xfile, &array->cur);
 
 	if (is_power_of_2(obj_size))
 		array->obj_size_log = ilog2(obj_size);
@@ -122,6 +124,7 @@ void
 xfarray_destroy(
 	struct xfarray	*array)
 {
+	xfile_cursor_release(&array->cur);
 	xfile_destroy(array->xfile);
 	kfree(array);
 }
@@ -136,7 +139,7 @@ xfarray_load(
 	if (idx >= array->nr)
 		return -ENODATA;
 
-	return xfile_obj_load(array->xfile, ptr, array->obj_size,
+	return xfile_cursor_load(&array->cur, ptr, array->obj_size,
 			xfarray_pos(array, idx));
 }
 
@@ -152,7 +155,7 @@ xfarray_is_unset(
 	if (array->unset_slots == 0)
 		return false;
 
-	error = xfile_obj_load(array->xfile, temp, array->obj_size, pos);
+	error = xfile_cursor_load(&array->cur, temp, array->obj_size, pos);
 	if (!error && xfarray_element_is_null(array, temp))
 		return true;
 
@@ -184,7 +187,7 @@ xfarray_unset(
 		return 0;
 
 	memset(temp, 0, array->obj_size);
-	error = xfile_obj_store(array->xfile, temp, array->obj_size, pos);
+	error = xfile_cursor_store(&array->cur, temp, array->obj_size, pos);
 	if (error)
 		return error;
 
@@ -209,7 +212,7 @@ xfarray_store(
 
 	ASSERT(!xfarray_element_is_null(array, ptr));
 
-	ret = xfile_obj_store(array->xfile, ptr, array->obj_size,
+	ret = xfile_cursor_store(&array->cur, ptr, array->obj_size,
 			xfarray_pos(array, idx));
 	if (ret)
 		return ret;
@@ -245,12 +248,12 @@ xfarray_store_anywhere(
 	for (pos = 0;
 	     pos < endpos && array->unset_slots > 0;
 	     pos += array->obj_size) {
-		error = xfile_obj_load(array->xfile, temp, array->obj_size,
+		error = xfile_cursor_load(&array->cur, temp, array->obj_size,
 				pos);
 		if (error || !xfarray_element_is_null(array, temp))
 			continue;
 
-		error = xfile_obj_store(array->xfile, ptr, array->obj_size,
+		error = xfile_cursor_store(&array->cur, ptr, array->obj_size,
 				pos);
 		if (error)
 			return error;
@@ -552,7 +555,7 @@ xfarray_isort(
 	trace_xfarray_isort(si, lo, hi);
 
 	xfarray_sort_bump_loads(si);
-	error = xfile_obj_load(si->array->xfile, scratch, len, lo_pos);
+	error = xfile_cursor_load(&si->array->cur, scratch, len, lo_pos);
 	if (error)
 		return error;
 
@@ -560,7 +563,7 @@ xfarray_isort(
 	sort(scratch, hi - lo + 1, si->array->obj_size, si->cmp_fn, NULL);
 
 	xfarray_sort_bump_stores(si);
-	return xfile_obj_store(si->array->xfile, scratch, len, lo_pos);
+	return xfile_cursor_store(&si->array->cur, scratch, len, lo_pos);
 }
 
 /* Grab a page for sorting records. */
@@ -858,7 +861,7 @@ xfarray_sort_load_cached(
 		if (xfarray_sort_terminated(si, &error))
 			return error;
 
-		return xfile_obj_load(si->array->xfile, ptr,
+		return xfile_cursor_load(&si->array->cur, ptr,
 				si->array->obj_size, idx_pos);
 	}
 
@@ -926,8 +929,8 @@ xfarray_sort_load_cached(
  */
 #define QSORT_MAX_RECS		(1ULL << 63)
 
-int
-xfarray_sort(
+STATIC int
+xfarray_qsort(
 	struct xfarray		*array,
 	xfarray_cmp_fn		cmp_fn,
 	unsigned int		flags)
@@ -939,11 +942,6 @@ xfarray_sort(
 	xfarray_idx_t		lo, hi;
 	int			error = 0;
 
-	if (array->nr < 2)
-		return 0;
-	if (array->nr >= QSORT_MAX_RECS)
-		return -E2BIG;
-
 	error = xfarray_sortinfo_alloc(array, cmp_fn, flags, &si);
 	if (error)
 		return error;
@@ -1081,3 +1079,499 @@ xfarray_sort(
 	kvfree(si);
 	return error;
 }
+
+/*
+ * External Merge Sort
+ * ===================
+ *
+ * For arrays that span many pages, quicksort spends most of its time looking
+ * up xfile pages for individual records.  If we can allocate a second xfile
+ * of the same size, we can instead sort the array in two phases that only
+ * access the xfile sequentially:
+ *
+ * 1. Split the array into runs of XFARRAY_MSORT_RUN_PAGES, load each run into
+ *    memory, heapsort it, and write it back.  Runs are independent of each
+ *    other, so they are sorted in parallel on the unbound workqueue.  Each
+ *    worker owns a disjoint range of the xfile, so no locking is needed.
+ *
+ * 2. Merge up to XFARRAY_MSORT_FANIN sorted runs at a time into the other
+ *    xfile, streaming the records of each run through a page-sized buffer and
+ *    picking the smallest head record with a min-heap.  The merged runs are
+ *    the input of the next pass, until a single run remains.  If the last
+ *    pass wrote to the second xfile, it replaces the array's xfile.
+ *
+ * Between steps, the array always holds a permutation of the original records,
+ * so if we cannot allocate the memory for the merge sort, the caller can fall
+ * back to the in-place quicksort.
+ */
+
+struct xfarray_msort;
+
+/* Worker sorting initial runs in memory. */
+struct xfarray_msort_worker {
+	struct work_struct	work;
+	struct xfarray_msort	*ms;
+	void			*buf;
+};
+
+/* Sorted run being merged. */
+struct xfarray_msort_src {
+	struct xfarray_msort	*ms;
+	struct xfile		*xfile;
+
+	/* Next record to read from the xfile, and end of the run. */
+	xfarray_idx_t		next;
+	xfarray_idx_t		end;
+
+	/* Records buffered from the xfile, and the current head record. */
+	unsigned int		buf_nr;
+	unsigned int		buf_idx;
+	void			*buf;
+};
+
+struct xfarray_msort {
+	struct xfarray		*array;
+	xfarray_cmp_fn		cmp_fn;
+	unsigned int		flags;
+
+	/* Number of records in each initial run, and number of runs. */
+	xfarray_idx_t		run_nr;
+	uint64_t		nr_runs;
+
+	/* Run sorting state shared with the workers. */
+	atomic64_t		next_run;
+	atomic_t		nr_active;
+	struct completion	done;
+	bool			abort;
+	int			error;
+
+	/* Number of records in each merge buffer. */
+	unsigned int		buf_nr;
+
+	/* Merge state. */
+	struct xfarray_msort_src	*srcs;
+	struct xfarray_msort_src	**heap;
+	void			*outbuf;
+};
+
+/* Does this array span enough pages to be worth a merge sort? */
+static inline bool
+xfarray_want_msort(
+	struct xfarray		*array)
+{
+	return xfarray_pos(array, array->nr) >
+			(loff_t)XFARRAY_MSORT_RUN_PAGES << PAGE_SHIFT;
+}
+
+/* Sort initial runs until there are none left or the sort is aborted. */
+static void
+xfarray_msort_run_worker(
+	struct work_struct		*work)
+{
+	struct xfarray_msort_worker	*w;
+	struct xfarray_msort		*ms;
+	struct xfarray			*array;
+	uint64_t			run;
+	int				error = 0;
+
+	w = container_of(work, struct xfarray_msort_worker, work);
+	ms = w->ms;
+	array = ms->array;
+
+	while (!READ_ONCE(ms->abort)) {
+		xfarray_idx_t		lo, nr;
+		loff_t			pos, len;
+
+		run = atomic64_inc_return(&ms->next_run) - 1;
+		if (run >= ms->nr_runs)
+			break;
+
+		lo = run * ms->run_nr;
+		nr = min(ms->run_nr, array->nr - lo);
+		pos = xfarray_pos(array, lo);
+		len = xfarray_pos(array, nr);
+
+		error = xfile_obj_load(array->xfile, w->buf, len, pos);
+		if (error)
+			break;
+
+		sort(w->buf, nr, array->obj_size, ms->cmp_fn, NULL);
+
+		error = xfile_obj_store(array->xfile, w->buf, len, pos);
+		if (error)
+			break;
+
+		cond_resched();
+	}
+
+	if (error) {
+		cmpxchg(&ms->error, 0, error);
+		WRITE_ONCE(ms->abort, true);
+	}
+
+	if (atomic_dec_and_test(&ms->nr_active))
+		complete(&ms->done);
+}
+
+/* Sort each initial run of the array in memory. */
+STATIC int
+xfarray_msort_runs(
+	struct xfarray_msort		*ms)
+{
+	struct xfarray_msort_worker	*workers;
+	size_t				run_bytes;
+	unsigned int			nr_workers;
+	unsigned int			i;
+	bool				killed = false;
+	int				error = 0;
+
+	run_bytes = xfarray_pos(ms->array, ms->run_nr);
+	nr_workers = min_t(uint64_t, ms->nr_runs,
+			min_t(unsigned int, num_online_cpus(),
+			      XFARRAY_MSORT_MAX_WORKERS));
+
+	workers = kcalloc(nr_workers, sizeof(*workers), XCHK_GFP_FLAGS);
+	if (!workers)
+		return -ENOMEM;
+
+	/* Run with fewer workers if we can't get all the buffers. */
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].buf = kvmalloc(run_bytes, XCHK_GFP_FLAGS);
+		if (!workers[i].buf)
+			break;
+		workers[i].ms = ms;
+		INIT_WORK(&workers[i].work, xfarray_msort_run_worker);
+	}
+	nr_workers = i;
+	if (!nr_workers) {
+		error = -ENOMEM;
+		goto out_free;
+	}
+
+	trace_xfarray_msort(ms->array, ms->nr_runs, nr_workers);
+
+	atomic64_set(&ms->next_run, 0);
+	atomic_set(&ms->nr_active, nr_workers);
+	init_completion(&ms->done);
+	for (i = 0; i < nr_workers; i++)
+		queue_work(system_unbound_wq, &workers[i].work);
+
+	/*
+	 * Wake up every now and then to check for fatal signals, and to keep
+	 * the hung task detector quiet if the sort takes a long time.
+	 */
+	while (!wait_for_completion_timeout(&ms->done, HZ)) {
+		if (!killed && (ms->flags & XFARRAY_SORT_KILLABLE) &&
+		    fatal_signal_pending(current)) {
+			WRITE_ONCE(ms->abort, true);
+			killed = true;
+		}
+	}
+
+	error = ms->error;
+	if (!error && killed)
+		error = -EINTR;
+
+out_free:
+	for (i = 0; i < nr_workers; i++)
+		kvfree(workers[i].buf);
+	kfree(workers);
+	return error;
+}
+
+/* Refill the buffer of a merge source from its run. */
+static inline int
+xfarray_msort_src_fill(
+	struct xfarray_msort		*ms,
+	struct xfarray_msort_src	*src)
+{
+	struct xfarray			*array = ms->array;
+	unsigned int			nr;
+	int				error;
+
+	nr = min_t(xfarray_idx_t, ms->buf_nr, src->end - src->next);
+	error = xfile_obj_load(src->xfile, src->buf, xfarray_pos(array, nr),
+			xfarray_pos(array, src->next));
+	if (error)
+		return error;
+
+	src->next += nr;
+	src->buf_nr = nr;
+	src->buf_idx = 0;
+	return 0;
+}
+
+/* Return the head record of a merge source. */
+static inline void *
+xfarray_msort_src_head(
+	struct xfarray_msort_src	*src)
+{
+	return src->buf + xfarray_pos(src->ms->array, src->buf_idx);
+}
+
+static bool
+xfarray_msort_heap_less(
+	const void			*lhs,
+	const void			*rhs)
+{
+	struct xfarray_msort_src	*l;
+	struct xfarray_msort_src	*r;
+
+	l = *(struct xfarray_msort_src * const *)lhs;
+	r = *(struct xfarray_msort_src * const *)rhs;
+
+	return l->ms->cmp_fn(xfarray_msort_src_head(l),
+			     xfarray_msort_src_head(r)) < 0;
+}
+
+static void
+xfarray_msort_heap_swap(
+	void				*lhs,
+	void				*rhs)
+{
+	struct xfarray_msort_src	**l = lhs;
+	struct xfarray_msort_src	**r = rhs;
+
+	swap(*l, *r);
+}
+
+static const struct min_heap_callbacks xfarray_msort_heap_cbs = {
+	.elem_size	= sizeof(struct xfarray_msort_src *),
+	.less		= xfarray_msort_heap_less,
+	.swp		= xfarray_msort_heap_swap,
+};
+
+/*
+ * Merge the sorted runs of @run_nr records in the range [lo, end) of the @in
+ * xfile into a single sorted run at the same place in the @out xfile.
+ */
+STATIC int
+xfarray_msort_merge(
+	struct xfarray_msort		*ms,
+	struct xfile			*in,
+	struct xfile			*out,
+	xfarray_idx_t			lo,
+	xfarray_idx_t			end,
+	xfarray_idx_t			run_nr)
+{
+	struct xfarray			*array = ms->array;
+	struct xfarray_msort_src	*src;
+	struct min_heap			heap = {
+		.data			= ms->heap,
+		.size			= XFARRAY_MSORT_FANIN,
+	};
+	xfarray_idx_t			out_idx = lo;
+	xfarray_idx_t			start;
+	unsigned int			out_nr = 0;
+	int				error = 0;
+
+	for (start = lo, src = ms->srcs; start < end; start += run_nr, src++) {
+		src->xfile = in;
+		src->next = start;
+		src->end = min(end, start + run_nr);
+
+		error = xfarray_msort_src_fill(ms, src);
+		if (error)
+			return error;
+
+		ms->heap[heap.nr++] = src;
+	}
+	min_heapify_all(&heap, &xfarray_msort_heap_cbs);
+
+	while (heap.nr > 0) {
+		src = ms->heap[0];
+
+		memcpy(ms->outbuf + xfarray_pos(array, out_nr),
+				xfarray_msort_src_head(src), array->obj_size);
+		if (++out_nr == ms->buf_nr) {
+			error = xfile_obj_store(out, ms->outbuf,
+					xfarray_pos(array, out_nr),
+					xfarray_pos(array, out_idx));
+			if (error)
+				return error;
+			out_idx += out_nr;
+			out_nr = 0;
+
+			cond_resched();
+			if ((ms->flags & XFARRAY_SORT_KILLABLE) &&
+			    fatal_signal_pending(current))
+				return -EINTR;
+		}
+
+		/* Advance this run, and drop it from the heap once empty. */
+		if (++src->buf_idx == src->buf_nr) {
+			if (src->next == src->end) {
+				min_heap_pop(&heap, &xfarray_msort_heap_cbs);
+				continue;
+			}
+
+			error = xfarray_msort_src_fill(ms, src);
+			if (error)
+				return error;
+		}
+		min_heapify(&heap, 0, &xfarray_msort_heap_cbs);
+	}
+
+	if (out_nr == 0)
+		return 0;
+
+	return xfile_obj_store(out, ms->outbuf, xfarray_pos(array, out_nr),
+			xfarray_pos(array, out_idx));
+}
+
+/* Allocate the buffers needed to merge runs. */
+STATIC int
+xfarray_msort_alloc_merge(
+	struct xfarray_msort	*ms)
+{
+	struct xfarray		*array = ms->array;
+	size_t			buf_bytes;
+	unsigned int		i;
+
+	ms->buf_nr = max_t(unsigned int, 1, PAGE_SIZE / array->obj_size);
+	buf_bytes = xfarray_pos(array, ms->buf_nr);
+
+	ms->srcs = kcalloc(XFARRAY_MSORT_FANIN, sizeof(*ms->srcs),
+			XCHK_GFP_FLAGS);
+	if (!ms->srcs)
+		return -ENOMEM;
+
+	ms->heap = kcalloc(XFARRAY_MSORT_FANIN, sizeof(*ms->heap),
+			XCHK_GFP_FLAGS);
+	if (!ms->heap)
+		return -ENOMEM;
+
+	for (i = 0; i < XFARRAY_MSORT_FANIN; i++) {
+		ms->srcs[i].ms = ms;
+		ms->srcs[i].buf = kvmalloc(buf_bytes, XCHK_GFP_FLAGS);
+		if (!ms->srcs[i].buf)
+			return -ENOMEM;
+	}
+
+	ms->outbuf = kvmalloc(buf_bytes, XCHK_GFP_FLAGS);
+	if (!ms->outbuf)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/* Free the merge buffers. */
+STATIC void
+xfarray_msort_free_merge(
+	struct xfarray_msort	*ms)
+{
+	unsigned int		i;
+
+	kvfree(ms->outbuf);
+	if (ms->srcs) {
+		for (i = 0; i < XFARRAY_MSORT_FANIN; i++)
+			kvfree(ms->srcs[i].buf);
+	}
+	kfree(ms->heap);
+	kfree(ms->srcs);
+}
+
+/* Sort the array with an external merge sort. */
+STATIC int
+xfarray_msort(
+	struct xfarray		*array,
+	xfarray_cmp_fn		cmp_fn,
+	unsigned int		flags)
+{
+	struct xfarray_msort	ms = {
+		.array		= array,
+		.cmp_fn		= cmp_fn,
+		.flags		= flags,
+	};
+	struct xfile		*in = array->xfile;
+	struct xfile		*out;
+	struct xfile		*tmp;
+	xfarray_idx_t		run_nr;
+	xfarray_idx_t		lo;
+	int			error;
+
+	ms.run_nr = max_t(xfarray_idx_t, 1,
+			xfarray_idx(array, XFARRAY_MSORT_RUN_PAGES << PAGE_SHIFT));
+	ms.nr_runs = div64_u64(array->nr + ms.run_nr - 1, ms.run_nr);
+
+	error = xfarray_msort_alloc_merge(&ms);
+	if (error)
+		goto out_free;
+
+	error = xfile_create("xfarray msort", 0, &tmp);
+	if (error)
+		goto out_free;
+	out = tmp;
+
+	error = xfarray_msort_runs(&ms);
+	if (error)
+		goto out_xfile;
+
+	for (run_nr = ms.run_nr; run_nr < array->nr; ) {
+		xfarray_idx_t	group_nr;
+
+		/* Don't overflow the group size on the last pass. */
+		if (run_nr > (array->nr - 1) / XFARRAY_MSORT_FANIN)
+			group_nr = array->nr;
+		else
+			group_nr = run_nr * XFARRAY_MSORT_FANIN;
+
+		for (lo = 0; lo < array->nr; lo += group_nr) {
+			xfarray_idx_t	end;
+
+			end = lo + min(group_nr, array->nr - lo);
+			error = xfarray_msort_merge(&ms, in, out, lo, end,
+					run_nr);
+			if (error)
+				goto out_xfile;
+		}
+
+		swap(in, out);
+		run_nr = group_nr;
+	}
+
+out_xfile:
+	/*
+	 * A merge pass never modifies its input, so @in always holds all the
+	 * records, sorted if we got this far.  Make it the array's xfile.
+	 */
+	if (in != array->xfile) {
+		tmp = array->xfile;
+		array->xfile = in;
+		xfile_cursor_init(in, &array->cur);
+	}
+	xfile_destroy(tmp);
+out_free:
+	xfarray_msort_free_merge(&ms);
+	return error;
+}
+
+/*
+ * Sort the array.  Large arrays are sorted with the external merge sort if
+ * the memory for it can be allocated, and with the in-place quicksort
+ * otherwise.
+ */
+int
+xfarray_sort(
+	struct xfarray		*array,
+	xfarray_cmp_fn		cmp_fn,
+	unsigned int		flags)
+{
+	int			error;
+
+	if (array->nr < 2)
+		return 0;
+	if (array->nr >= QSORT_MAX_RECS)
+		return -E2BIG;
+
+	/* The merge sort may replace the xfile, so drop the cursor's pages. */
+	xfile_cursor_release(&array->cur);
+
+	if (xfarray_want_msort(array)) {
+		error = xfarray_msort(array, cmp_fn, flags);
+		if (error != -ENOMEM)
+			return error;
+	}
+
+	return xfarray_qsort(array, cmp_fn, flags);
+}
@@ -20,6 +20,9 @@ struct xfarray {
 	/* Underlying file that backs the array. */
 	struct xfile	*xfile;
 
+	/* Cursor for loads and stores to the xfile. */
+	struct xfile_cursor cur;
+
 	/* Number of array elements. */
 	xfarray_idx_t	nr;
 
@@ -132,6 +135,18 @@ struct xfarray_sortinfo {
 	 */
 };
 
+/*
+ * Arrays larger than this many pages are sorted with an external merge sort:
+ * runs of this size are sorted in memory and then merged.
+ */
+#define XFARRAY_MSORT_RUN_PAGES		(64)
+
+/* Merge this many sorted runs at a time. */
+#define XFARRAY_MSORT_FANIN		(64)
+
+/* Sort the initial runs with at most this many workers. */
+#define XFARRAY_MSORT_MAX_WORKERS	(8)
+
 /* Sort can be interrupted by a fatal signal. */
 #define XFARRAY_SORT_KILLABLE	(1U << 0)
 
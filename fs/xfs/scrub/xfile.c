@@ -15,6 +15,7 @@
 #include "scrub/scrub.h"
 #include "scrub/trace.h"
 #include <linux/shmem_fs.h>
+#include <linux/pagevec.h>
 
 /*
  * Swappable Temporary Memory
@@ -417,3 +418,198 @@ xfile_put_page(
 		return -EIO;
 	return 0;
 }
+
+/*
+ * xfile cursors
+ * =============
+ *
+ * Each xfile_obj_load or xfile_obj_store call looks up the shmem page cache
+ * for every page that it touches.  Callers that walk an xfile more or less
+ * sequentially can use a cursor instead.  The cursor grabs references to a
+ * batch of contiguous resident folios in a single page cache walk, and serves
+ * loads and stores from those folios until the caller moves past them.
+ *
+ * Positions that are not resident (holes, or folios that have been swapped
+ * out) go through the regular xfile_pread and xfile_pwrite paths.  These
+ * instantiate the page, and shmem swapin reads ahead the neighbouring swap
+ * slots, so the next batch will usually find the following folios resident.
+ *
+ * Stores lock the folio, check that it is still in the xfile, and only mark
+ * it dirty if it is not dirty already.  The folio is never left locked when a
+ * cursor call returns, so cursors can be mixed with xfile_get_page.
+ */
+
+/* Prepare a cursor for use. */
+void
+xfile_cursor_init(
+	struct xfile		*xf,
+	struct xfile_cursor	*cur)
+{
+	cur->xfile = xf;
+	cur->fidx = 0;
+	folio_batch_init(&cur->fbatch);
+}
+
+/* Drop all the folio references held by a cursor. */
+void
+xfile_cursor_release(
+	struct xfile_cursor	*cur)
+{
+	folio_batch_release(&cur->fbatch);
+	cur->fidx = 0;
+}
+
+static inline bool
+xfile_folio_contains(
+	struct folio		*folio,
+	loff_t			pos)
+{
+	return pos >= folio_pos(folio) &&
+	       pos < folio_pos(folio) + folio_size(folio);
+}
+
+/*
+ * Find the uptodate folio backing @pos, grabbing a new batch of folios if we
+ * moved outside the current one.  Returns NULL if the position is not
+ * resident in the page cache.
+ */
+static struct folio *
+xfile_cursor_folio(
+	struct xfile_cursor	*cur,
+	loff_t			pos)
+{
+	struct address_space	*mapping = file_inode(cur->xfile->file)->i_mapping;
+	struct folio_batch	*fbatch = &cur->fbatch;
+	struct folio		*folio;
+	pgoff_t			start = pos >> PAGE_SHIFT;
+	unsigned int		i;
+
+	for (i = cur->fidx; i < folio_batch_count(fbatch); i++) {
+		folio = fbatch->folios[i];
+		if (folio_pos(folio) > pos)
+			break;
+		if (xfile_folio_contains(folio, pos))
+			goto found;
+	}
+
+	/*
+	 * Only look up as many pages as the batch can hold so that a backwards
+	 * or random access doesn't walk the page cache far past @pos.
+	 */
+	xfile_cursor_release(cur);
+	filemap_get_folios_contig(mapping, &start, start + PAGEVEC_SIZE - 1,
+			fbatch);
+	if (!folio_batch_count(fbatch))
+		return NULL;
+
+	trace_xfile_cursor_refill(cur->xfile, pos,
+			((loff_t)start << PAGE_SHIFT) -
+			folio_pos(fbatch->folios[0]));
+
+	i = 0;
+	folio = fbatch->folios[0];
+	if (!xfile_folio_contains(folio, pos))
+		return NULL;
+
+found:
+	cur->fidx = i;
+	if (!folio_test_uptodate(folio) || folio->mapping != mapping)
+		return NULL;
+	return folio;
+}
+
+/*
+ * Load an object through a cursor.  As with xfile_obj_load, any failure is
+ * treated as a failure to allocate memory.
+ */
+int
+xfile_cursor_load(
+	struct xfile_cursor	*cur,
+	void			*buf,
+	size_t			count,
+	loff_t			pos)
+{
+	while (count > 0) {
+		struct folio	*folio;
+		unsigned int	len;
+		int		error;
+
+		len = min_t(size_t, count, PAGE_SIZE - offset_in_page(pos));
+
+		folio = xfile_cursor_folio(cur, pos);
+		if (folio) {
+			void	*kaddr;
+
+			kaddr = kmap_local_folio(folio,
+					offset_in_folio(folio, pos));
+			memcpy(buf, kaddr, len);
+			kunmap_local(kaddr);
+		} else {
+			error = xfile_obj_load(cur->xfile, buf, len, pos);
+			if (error)
+				return error;
+		}
+
+		count -= len;
+		pos += len;
+		buf += len;
+	}
+
+	return 0;
+}
+
+/*
+ * Store an object through a cursor.  As with xfile_obj_store, any failure is
+ * treated as a failure to allocate memory.
+ */
+int
+xfile_cursor_store(
+	struct xfile_cursor	*cur,
+	const void		*buf,
+	size_t			count,
+	loff_t			pos)
+{
+	struct inode		*inode = file_inode(cur->xfile->file);
+
+	while (count > 0) {
+		struct folio	*folio = NULL;
+		unsigned int	len;
+		int		error;
+
+		len = min_t(size_t, count, PAGE_SIZE - offset_in_page(pos));
+
+		/* Stores past EOF must go through write_end to extend EOF. */
+		if (pos + len <= i_size_read(inode))
+			folio = xfile_cursor_folio(cur, pos);
+		if (folio) {
+			folio_lock(folio);
+			if (folio->mapping != inode->i_mapping ||
+			    !folio_test_uptodate(folio)) {
+				folio_unlock(folio);
+				folio = NULL;
+			}
+		}
+
+		if (folio) {
+			void	*kaddr;
+
+			kaddr = kmap_local_folio(folio,
+					offset_in_folio(folio, pos));
+			memcpy(kaddr, buf, len);
+			kunmap_local(kaddr);
+			if (!folio_test_dirty(folio))
+				folio_mark_dirty(folio);
+			folio_unlock(folio);
+		} else {
+			error = xfile_obj_store(cur->xfile, buf, len, pos);
+			if (error)
+				return error;
+		}
+
+		count -= len;
+		pos += len;
+		buf += len;
+	}
+
+	return 0;
+}
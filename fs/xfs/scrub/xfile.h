@@ -6,6 +6,8 @@
 #ifndef __XFS_SCRUB_XFILE_H__
 #define __XFS_SCRUB_XFILE_H__
 
+#include <linux/pagevec.h>
+
 struct xfile_page {
 	struct page		*page;
 	void			*fsdata;
@@ -74,4 +76,25 @@ int xfile_get_page(struct xfile *xf, loff_t offset, unsigned int len,
 		struct xfile_page *xbuf);
 int xfile_put_page(struct xfile *xf, struct xfile_page *xbuf);
 
+/*
+ * Cursor for mostly sequential access to an xfile.  The cursor holds
+ * references to a batch of resident folios starting at the last position
+ * accessed, so that walking the xfile does not need a page cache lookup for
+ * every object.
+ */
+struct xfile_cursor {
+	struct xfile		*xfile;
+	struct folio_batch	fbatch;
+
+	/* Folio in @fbatch that was accessed last. */
+	unsigned int		fidx;
+};
+
+void xfile_cursor_init(struct xfile *xf, struct xfile_cursor *cur);
+void xfile_cursor_release(struct xfile_cursor *cur);
+int xfile_cursor_load(struct xfile_cursor *cur, void *buf, size_t count,
+		loff_t pos);
+int xfile_cursor_store(struct xfile_cursor *cur, const void *buf,
+		size_t count, loff_t pos);
+
 #endif /* __XFS_SCRUB_XFILE_H__ */
@@ -19,6 +19,7 @@
 #include <linux/mman.h>
 #include <linux/sched/mm.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/zonefs.h>
 
 #include "zonefs.h"
 
@@ -245,6 +246,7 @@ int zonefs_file_truncate(struct inode *inode, loff_t isize)
 	zonefs_update_stats(inode, isize);
 	truncate_setsize(inode, isize);
 	z->z_wpoffset = isize;
+	zonefs_file_drop_appends(inode);
 	zonefs_inode_account_active(inode);
 
 unlock:
@@ -429,7 +431,12 @@ static ssize_t zonefs_write_checks(struct kiocb *iocb, struct iov_iter *from)
 	if (iocb->ki_flags & IOCB_APPEND) {
 		if (zonefs_zone_is_cnv(z))
 			return -EINVAL;
-		mutex_lock(&zi->i_truncate_mutex);
+		if (iocb->ki_flags & IOCB_NOWAIT) {
+			if (!mutex_trylock(&zi->i_truncate_mutex))
+				return -EAGAIN;
+		} else {
+			mutex_lock(&zi->i_truncate_mutex);
+		}
 		iocb->ki_pos = z->z_wpoffset;
 		mutex_unlock(&zi->i_truncate_mutex);
 	}
@@ -443,6 +450,310 @@ static ssize_t zonefs_write_checks(struct kiocb *iocb, struct iov_iter *from)
 	return iov_iter_count(from);
 }
 
+/*
+ * Zone append direct write context. The bio must be the last field as
+ * zonefs_append_io structures are allocated with zonefs_append_bio_set.
+ */
+struct zonefs_append_io {
+	struct kiocb		*iocb;
+	loff_t			pos;
+	ssize_t			size;
+	struct list_head	entry;
+	struct work_struct	work;
+	struct bio		bio;
+};
+
+static struct bio_set zonefs_append_bio_set;
+static struct workqueue_struct *zonefs_append_wq;
+
+/*
+ * Zone appends may complete out of order, and the data of a completed append
+ * can only be exposed once all appends that landed before it in the zone have
+ * also completed. Completed appends beyond the inode size are thus kept on
+ * i_append_done, sorted by offset, and the inode size is only advanced over
+ * the range of completed appends that is contiguous with it.
+ */
+static void zonefs_file_dio_append_done(struct inode *inode,
+					struct zonefs_append_io *zio)
+{
+	struct zonefs_inode_info *zi = ZONEFS_I(inode);
+	struct zonefs_append_io *zp, *tmp;
+	LIST_HEAD(done);
+	loff_t isize;
+
+	mutex_lock(&zi->i_truncate_mutex);
+
+	list_for_each_entry_reverse(zp, &zi->i_append_done, entry) {
+		if (zp->pos < zio->pos)
+			break;
+	}
+	list_add(&zio->entry, &zp->entry);
+
+	isize = i_size_read(inode);
+	list_for_each_entry_safe(zp, tmp, &zi->i_append_done, entry) {
+		if (zp->pos > isize)
+			break;
+		isize = max(isize, zp->pos + zp->size);
+		list_move_tail(&zp->entry, &done);
+	}
+
+	if (isize > i_size_read(inode)) {
+		zonefs_update_stats(inode, isize);
+		zonefs_i_size_write(inode, isize);
+	}
+
+	mutex_unlock(&zi->i_truncate_mutex);
+
+	list_for_each_entry_safe(zp, tmp, &done, entry)
+		bio_put(&zp->bio);
+}
+
+/*
+ * Forget about completed zone appends that could not be exposed yet. Called
+ * with i_truncate_mutex held when the inode size is reset from the zone write
+ * pointer, which accounts for all the data written to the zone.
+ */
+void zonefs_file_drop_appends(struct inode *inode)
+{
+	struct zonefs_inode_info *zi = ZONEFS_I(inode);
+	struct zonefs_append_io *zp, *tmp;
+
+	lockdep_assert_held(&zi->i_truncate_mutex);
+
+	list_for_each_entry_safe(zp, tmp, &zi->i_append_done, entry) {
+		list_del(&zp->entry);
+		bio_put(&zp->bio);
+	}
+}
+
+static ssize_t zonefs_file_dio_append_end(struct zonefs_append_io *zio)
+{
+	struct bio *bio = &zio->bio;
+	struct kiocb *iocb = zio->iocb;
+	struct inode *inode = file_inode(iocb->ki_filp);
+	struct zonefs_inode_info *zi = ZONEFS_I(inode);
+	struct zonefs_zone *z = zonefs_inode_zone(inode);
+	ssize_t size = zio->size;
+	ssize_t ret = blk_status_to_errno(bio->bi_status);
+	loff_t pos = 0;
+
+	/*
+	 * On completion of a zone append, the bio sector indicates where the
+	 * device wrote the data. If the file zone was written underneath the
+	 * file system, the zone write pointer may not be where we expect it
+	 * to be, but the zone append can still succeed. So check manually that
+	 * the data was written within the file zone capacity.
+	 */
+	if (!ret) {
+		pos = (loff_t)(bio->bi_iter.bi_sector - z->z_sector) <<
+			SECTOR_SHIFT;
+		if (bio->bi_iter.bi_sector < z->z_sector ||
+		    pos + size > z->z_capacity) {
+			zonefs_warn(inode->i_sb,
+				"Corrupted write pointer %llu for zone at %llu\n",
+				bio->bi_iter.bi_sector, z->z_sector);
+			ret = -EIO;
+		}
+	}
+
+	bio_release_pages(bio, false);
+
+	if (!ret) {
+		zio->pos = pos;
+		zonefs_file_dio_append_done(inode, zio);
+		iocb->ki_pos = pos + size;
+		ret = size;
+	} else if (ret == -EAGAIN) {
+		/*
+		 * A REQ_NOWAIT zone append that would have blocked wrote
+		 * nothing: give back its zone space reservation. Other appends
+		 * may be in flight, so the write pointer must not be resynced.
+		 */
+		bio_put(bio);
+		mutex_lock(&zi->i_truncate_mutex);
+		z->z_wpoffset = max_t(loff_t, z->z_wpoffset - size,
+				      i_size_read(inode));
+		zonefs_inode_account_active(inode);
+		mutex_unlock(&zi->i_truncate_mutex);
+	} else {
+		bio_put(bio);
+		zonefs_io_error(inode, true);
+	}
+
+	trace_zonefs_file_dio_append(inode, size, ret);
+
+	return ret;
+}
+
+static void zonefs_file_dio_append_work(struct work_struct *work)
+{
+	struct zonefs_append_io *zio =
+		container_of(work, struct zonefs_append_io, work);
+	struct kiocb *iocb = zio->iocb;
+	struct inode *inode = file_inode(iocb->ki_filp);
+	ssize_t ret;
+
+	ret = zonefs_file_dio_append_end(zio);
+	inode_dio_end(inode);
+	iocb->ki_complete(iocb, ret);
+}
+
+static void zonefs_file_dio_append_end_io(struct bio *bio)
+{
+	struct zonefs_append_io *zio =
+		container_of(bio, struct zonefs_append_io, bio);
+
+	/* Updating the inode size needs i_truncate_mutex, so defer to a work */
+	INIT_WORK(&zio->work, zonefs_file_dio_append_work);
+	queue_work(zonefs_append_wq, &zio->work);
+}
+
+/*
+ * Handle O_APPEND direct writes to sequential zone files when the file system
+ * is mounted with the zone-append option. The data is written using a single
+ * zone append BIO, letting the device choose the write location. Writers thus
+ * do not need to be serialized on the zone write pointer: the inode lock is
+ * only taken shared and the zone space needed for the write is reserved
+ * upfront, so that many writes can be in flight for the same file, including
+ * asynchronous IOCB_NOWAIT writes. On completion, iocb->ki_pos is set to the
+ * end of the data written, which for synchronous writes tells the user where
+ * the data landed through the file position. Writers that need the offset of
+ * each write use the ZONEFS_IOC_ZONE_APPEND ioctl, which can be issued
+ * concurrently from any number of threads.
+ */
+static ssize_t zonefs_file_dio_append(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	struct zonefs_inode_info *zi = ZONEFS_I(inode);
+	struct zonefs_zone *z = zonefs_inode_zone(inode);
+	struct super_block *sb = inode->i_sb;
+	struct block_device *bdev = sb->s_bdev;
+	unsigned int max = bdev_max_zone_append_sectors(bdev);
+	blk_opf_t opf = REQ_OP_ZONE_APPEND | REQ_SYNC | REQ_IDLE;
+	bool nowait = iocb->ki_flags & IOCB_NOWAIT;
+	struct zonefs_append_io *zio;
+	struct bio *bio;
+	ssize_t ret, count;
+	int nr_pages;
+
+	if (nowait) {
+		if (!inode_trylock_shared(inode))
+			return -EAGAIN;
+		opf |= REQ_NOWAIT;
+	} else {
+		inode_lock_shared(inode);
+	}
+
+	count = zonefs_write_checks(iocb, from);
+	if (count <= 0) {
+		ret = count;
+		goto inode_unlock;
+	}
+
+	if (count & (sb->s_blocksize - 1)) {
+		ret = -EINVAL;
+		goto inode_unlock;
+	}
+
+	max = ALIGN_DOWN(max << SECTOR_SHIFT, sb->s_blocksize);
+	iov_iter_truncate(from, max);
+
+	/*
+	 * If the inode block size (zone write granularity) is smaller than the
+	 * page size, we may be appending data belonging to the last page of the
+	 * inode straddling inode->i_size, with that page already cached due to
+	 * a buffered read or readahead. So make sure to invalidate that page.
+	 * This will always be a no-op for the case where the block size is
+	 * equal to the page size.
+	 */
+	if (inode->i_mapping->nrpages) {
+		if (nowait) {
+			ret = -EAGAIN;
+			goto inode_unlock;
+		}
+		if (invalidate_inode_pages2_range(inode->i_mapping,
+				i_size_read(inode) >> PAGE_SHIFT, -1)) {
+			ret = -EBUSY;
+			goto inode_unlock;
+		}
+	}
+
+	nr_pages = iov_iter_npages(from, BIO_MAX_VECS);
+	bio = bio_alloc_bioset(bdev, nr_pages, opf,
+			       nowait ? GFP_NOWAIT : GFP_NOFS,
+			       &zonefs_append_bio_set);
+	if (!bio) {
+		ret = -EAGAIN;
+		goto inode_unlock;
+	}
+	bio->bi_iter.bi_sector = z->z_sector;
+	bio->bi_ioprio = iocb->ki_ioprio;
+	if (iocb_is_dsync(iocb))
+		bio->bi_opf |= REQ_FUA;
+
+	ret = bio_iov_iter_get_pages(bio, from);
+	if (unlikely(ret)) {
+		bio_put(bio);
+		goto inode_unlock;
+	}
+
+	count = bio->bi_iter.bi_size;
+	if (count & (sb->s_blocksize - 1)) {
+		ret = -EINVAL;
+		goto out_release;
+	}
+
+	/*
+	 * Reserve space in the zone for the write. As for regular direct
+	 * writes, if the IO fails, the error path will correct the write
+	 * pointer offset. Concurrent writers may have consumed the space seen
+	 * by zonefs_write_checks(), in which case we fail the write.
+	 */
+	if (nowait) {
+		if (!mutex_trylock(&zi->i_truncate_mutex)) {
+			ret = -EAGAIN;
+			goto out_release;
+		}
+	} else {
+		mutex_lock(&zi->i_truncate_mutex);
+	}
+	if (z->z_wpoffset + count > z->z_capacity) {
+		mutex_unlock(&zi->i_truncate_mutex);
+		ret = -EFBIG;
+		goto out_release;
+	}
+	z->z_wpoffset += count;
+	zonefs_inode_account_active(inode);
+	mutex_unlock(&zi->i_truncate_mutex);
+
+	task_io_account_write(count);
+
+	zio = container_of(bio, struct zonefs_append_io, bio);
+	zio->iocb = iocb;
+	zio->size = count;
+
+	if (is_sync_kiocb(iocb)) {
+		submit_bio_wait(bio);
+		ret = zonefs_file_dio_append_end(zio);
+		goto inode_unlock;
+	}
+
+	inode_dio_begin(inode);
+	bio->bi_end_io = zonefs_file_dio_append_end_io;
+	submit_bio(bio);
+	ret = -EIOCBQUEUED;
+
+inode_unlock:
+	inode_unlock_shared(inode);
+
+	return ret;
+
+out_release:
+	bio_release_pages(bio, false);
+	bio_put(bio);
+	goto inode_unlock;
+}
+
 /*
  * Handle direct writes. For sequential zone files, this is the only possible
  * write path. For these files, check that the user is issuing writes
@@ -461,6 +772,10 @@ static ssize_t zonefs_file_dio_write(struct kiocb *iocb, struct iov_iter *from)
 	struct super_block *sb = inode->i_sb;
 	ssize_t ret, count;
 
+	if (zonefs_zone_is_seq(z) && (iocb->ki_flags & IOCB_APPEND) &&
+	    (ZONEFS_SB(sb)->s_mount_opts & ZONEFS_MNTOPT_ZONE_APPEND))
+		return zonefs_file_dio_append(iocb, from);
+
 	/*
 	 * For async direct IOs to sequential zone files, refuse IOCB_NOWAIT
 	 * as this can cause write reordering (e.g. the first aio gets EAGAIN
@@ -845,6 +1160,67 @@ static int zonefs_file_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * Zone append write returning the file offset of the data written. Unlike
+ * write(2) on an O_APPEND file, this gives the offset back to the caller for
+ * each write, so that many threads can append to the same file concurrently
+ * and each one learn where its data landed.
+ */
+static long zonefs_ioc_zone_append(struct file *file,
+				   struct zonefs_zone_append __user *uza)
+{
+	struct inode *inode = file_inode(file);
+	struct zonefs_zone *z = zonefs_inode_zone(inode);
+	struct zonefs_zone_append za;
+	struct iov_iter iter;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	if (!zonefs_zone_is_seq(z) ||
+	    !(ZONEFS_SB(inode->i_sb)->s_mount_opts & ZONEFS_MNTOPT_ZONE_APPEND))
+		return -EOPNOTSUPP;
+
+	if (copy_from_user(&za, uza, sizeof(za)))
+		return -EFAULT;
+
+	if (za.len > MAX_RW_COUNT)
+		return -EINVAL;
+
+	ret = import_ubuf(ITER_SOURCE, u64_to_user_ptr(za.buf), za.len, &iter);
+	if (ret)
+		return ret;
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_flags |= IOCB_DIRECT | IOCB_APPEND;
+	kiocb.ki_pos = 0;
+
+	file_start_write(file);
+	ret = zonefs_file_write_iter(&kiocb, &iter);
+	file_end_write(file);
+	if (ret <= 0)
+		return ret;
+
+	za.offset = kiocb.ki_pos - ret;
+	if (copy_to_user(&uza->offset, &za.offset, sizeof(za.offset)))
+		return -EFAULT;
+
+	return ret;
+}
+
+static long zonefs_file_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	switch (cmd) {
+	case ZONEFS_IOC_ZONE_APPEND:
+		return zonefs_ioc_zone_append(file, (void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations zonefs_file_operations = {
 	.open		= zonefs_file_open,
 	.release	= zonefs_file_release,
@@ -856,4 +1232,31 @@ const struct file_operations zonefs_file_operations = {
 	.splice_read	= zonefs_file_splice_read,
 	.splice_write	= iter_file_splice_write,
 	.iopoll		= iocb_bio_iopoll,
+	.unlocked_ioctl	= zonefs_file_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
+
+int __init zonefs_file_init(void)
+{
+	int ret;
+
+	ret = bioset_init(&zonefs_append_bio_set, BIO_POOL_SIZE,
+			  offsetof(struct zonefs_append_io, bio),
+			  BIOSET_NEED_BVECS);
+	if (ret)
+		return ret;
+
+	zonefs_append_wq = alloc_workqueue("zonefs_append", WQ_MEM_RECLAIM, 0);
+	if (!zonefs_append_wq) {
+		bioset_exit(&zonefs_append_bio_set);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void zonefs_file_exit(void)
+{
+	destroy_workqueue(zonefs_append_wq);
+	bioset_exit(&zonefs_append_bio_set);
+}
@@ -353,6 +353,7 @@ static void zonefs_handle_io_error(struct inode *inode, struct blk_zone *zone,
 	zonefs_update_stats(inode, data_size);
 	zonefs_i_size_write(inode, data_size);
 	z->z_wpoffset = data_size;
+	zonefs_file_drop_appends(inode);
 	zonefs_inode_account_active(inode);
 }
 
@@ -425,6 +426,7 @@ static struct inode *zonefs_alloc_inode(struct super_block *sb)
 	inode_init_once(&zi->i_vnode);
 	mutex_init(&zi->i_truncate_mutex);
 	zi->i_wr_refcnt = 0;
+	INIT_LIST_HEAD(&zi->i_append_done);
 
 	return &zi->i_vnode;
 }
@@ -471,7 +473,7 @@ static int zonefs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 enum {
 	Opt_errors_ro, Opt_errors_zro, Opt_errors_zol, Opt_errors_repair,
-	Opt_explicit_open, Opt_err,
+	Opt_explicit_open, Opt_zone_append, Opt_err,
 };
 
 static const match_table_t tokens = {
@@ -480,6 +482,7 @@ static const match_table_t tokens = {
 	{ Opt_errors_zol,	"errors=zone-offline"},
 	{ Opt_errors_repair,	"errors=repair"},
 	{ Opt_explicit_open,	"explicit-open" },
+	{ Opt_zone_append,	"zone-append" },
 	{ Opt_err,		NULL}
 };
 
@@ -519,6 +522,14 @@ static int zonefs_parse_options(struct super_block *sb, char *options)
 		case Opt_explicit_open:
 			sbi->s_mount_opts |= ZONEFS_MNTOPT_EXPLICIT_OPEN;
 			break;
+		case Opt_zone_append:
+			if (!bdev_max_zone_append_sectors(sb->s_bdev)) {
+				zonefs_info(sb,
+					"Zone append not supported. Ignoring zone-append mount option\n");
+				break;
+			}
+			sbi->s_mount_opts |= ZONEFS_MNTOPT_ZONE_APPEND;
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -539,6 +550,8 @@ static int zonefs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",errors=zone-offline");
 	if (sbi->s_mount_opts & ZONEFS_MNTOPT_ERRORS_REPAIR)
 		seq_puts(seq, ",errors=repair");
+	if (sbi->s_mount_opts & ZONEFS_MNTOPT_ZONE_APPEND)
+		seq_puts(seq, ",zone-append");
 
 	return 0;
 }
@@ -1428,10 +1441,14 @@ static int __init zonefs_init(void)
 	if (ret)
 		return ret;
 
-	ret = zonefs_sysfs_init();
+	ret = zonefs_file_init();
 	if (ret)
 		goto destroy_inodecache;
 
+	ret = zonefs_sysfs_init();
+	if (ret)
+		goto file_exit;
+
 	ret = register_filesystem(&zonefs_type);
 	if (ret)
 		goto sysfs_exit;
@@ -1440,6 +1457,8 @@ static int __init zonefs_init(void)
 
 sysfs_exit:
 	zonefs_sysfs_exit();
+file_exit:
+	zonefs_file_exit();
 destroy_inodecache:
 	zonefs_destroy_inodecache();
 
@@ -1450,6 +1469,7 @@ static void __exit zonefs_exit(void)
 {
 	unregister_filesystem(&zonefs_type);
 	zonefs_sysfs_exit();
+	zonefs_file_exit();
 	zonefs_destroy_inodecache();
 }
 
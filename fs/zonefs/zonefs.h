@@ -104,6 +104,7 @@ struct zonefs_inode_info {
 
 	/* guarded by i_truncate_mutex */
 	unsigned int		i_wr_refcnt;
+	struct list_head	i_append_done;
 };
 
 static inline struct zonefs_inode_info *ZONEFS_I(struct inode *inode)
@@ -210,6 +211,7 @@ enum zonefs_features {
 	(ZONEFS_MNTOPT_ERRORS_RO | ZONEFS_MNTOPT_ERRORS_ZRO | \
 	 ZONEFS_MNTOPT_ERRORS_ZOL | ZONEFS_MNTOPT_ERRORS_REPAIR)
 #define ZONEFS_MNTOPT_EXPLICIT_OPEN	(1 << 4) /* Explicit open/close of zones on open/close */
+#define ZONEFS_MNTOPT_ZONE_APPEND	(1 << 5) /* Use zone append for O_APPEND direct writes */
 
 /*
  * In-memory Super block information.
@@ -279,6 +281,9 @@ extern const struct file_operations zonefs_dir_operations;
 extern const struct address_space_operations zonefs_file_aops;
 extern const struct file_operations zonefs_file_operations;
 int zonefs_file_truncate(struct inode *inode, loff_t isize);
+void zonefs_file_drop_appends(struct inode *inode);
+int zonefs_file_init(void);
+void zonefs_file_exit(void);
 
 /* In sysfs.c */
 int zonefs_sysfs_register(struct super_block *sb);
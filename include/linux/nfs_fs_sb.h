@@ -141,6 +141,16 @@ struct nfs_server {
 	struct nfs_iostats __percpu *io_stats;	/* I/O statistics */
 	atomic_long_t		writeback;	/* number of writeback pages */
 	unsigned int		write_congested;/* flag set when writeback gets too high */
+
+	/* O_DIRECT pipelining window, see fs/nfs/direct.c */
+	spinlock_t		dio_lock;	/* protects the window state */
+	unsigned long		dio_cwnd;	/* in-flight byte target */
+	atomic_long_t		dio_inflight;	/* O_DIRECT bytes on the wire */
+	u64			dio_min_rtt;	/* lowest recent RPC latency (ns) */
+	unsigned long		dio_min_rtt_stamp;
+	unsigned long		dio_cwnd_stamp;	/* last window reduction */
+	wait_queue_head_t	dio_wait;	/* submitters waiting for room */
+	struct list_head	dio_queue;	/* async dreqs waiting for room */
 	unsigned int		flags;		/* various flags */
 
 /* The following are for internal use only. Also see uapi/linux/nfs_mount.h */
@@ -116,6 +116,8 @@ enum nfs_stat_eventcounters {
 	NFSIOS_DELAY,
 	NFSIOS_PNFS_READ,
 	NFSIOS_PNFS_WRITE,
+	NFSIOS_DIRECTWAIT,
+	NFSIOS_DIRECTBACKOFF,
 	__NFSIOS_COUNTSMAX,
 };
 
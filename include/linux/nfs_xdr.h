@@ -1623,6 +1623,7 @@ struct nfs_pgio_header {
 	const struct nfs_rw_ops	*rw_ops;
 	struct nfs_io_completion *io_completion;
 	struct nfs_direct_req	*dreq;
+	unsigned int		dreq_bytes;	/* charged to the O_DIRECT window */
 #ifdef CONFIG_NFS_FSCACHE
 	void			*netfs;
 #endif
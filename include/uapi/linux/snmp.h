@@ -351,6 +351,8 @@ enum
 	LINUX_MIB_TLSRXDEVICERESYNC,		/* TlsRxDeviceResync */
 	LINUX_MIB_TLSDECRYPTRETRY,		/* TlsDecryptRetry */
 	LINUX_MIB_TLSRXNOPADVIOL,		/* TlsRxNoPadViolation */
+	LINUX_MIB_TLSRXASYNC,			/* TlsRxAsync */
+	LINUX_MIB_TLSRXASYNCWAIT,		/* TlsRxAsyncWait */
 	__LINUX_MIB_TLSMAX
 };
 
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Simple zone file system for zoned block devices.
+ *
+ * Copyright (C) 2019 Western Digital Corporation or its affiliates.
+ */
+#ifndef _UAPI_LINUX_ZONEFS_H
+#define _UAPI_LINUX_ZONEFS_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * struct zonefs_zone_append - Zone append write to a sequential zone file
+ *
+ * @buf: Address of the user buffer holding the data to write
+ * @len: Number of bytes to write, a multiple of the file system block size
+ * @offset: Set on return to the file offset at which the data was written
+ *
+ * Used with ZONEFS_IOC_ZONE_APPEND on a sequential zone file of a zonefs
+ * mounted with the zone-append option. The ioctl returns the number of bytes
+ * written. Any number of such writes can be in flight for the same file.
+ */
+struct zonefs_zone_append {
+	__u64	buf;
+	__u64	len;
+	__u64	offset;
+};
+
+#define ZONEFS_IOC_ZONE_APPEND	_IOWR('Z', 0x01, struct zonefs_zone_append)
+
+#endif /* _UAPI_LINUX_ZONEFS_H */
@@ -748,6 +748,8 @@ batadv_iv_ogm_slide_own_bcast_window(struct batadv_hard_iface *hard_iface)
 	u32 i;
 	u8 *w;
 
+	/* each window must be shifted exactly once */
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -770,6 +772,7 @@ batadv_iv_ogm_slide_own_bcast_window(struct batadv_hard_iface *hard_iface)
 		}
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
 }
 
 /**
@@ -1302,12 +1305,14 @@ batadv_iv_ogm_update_seqnos(const struct ethhdr *ethhdr,
  * @orig_node: the (cached) orig node for the originator of this OGM
  * @if_incoming: the interface where this packet was received
  * @if_outgoing: the interface for which the packet should be considered
+ * @ogm_buf: scratch buffer of at least ETH_HLEN + skb_headlen(skb) bytes
  */
 static void
 batadv_iv_ogm_process_per_outif(const struct sk_buff *skb, int ogm_offset,
 				struct batadv_orig_node *orig_node,
 				struct batadv_hard_iface *if_incoming,
-				struct batadv_hard_iface *if_outgoing)
+				struct batadv_hard_iface *if_outgoing,
+				u8 *ogm_buf)
 {
 	struct batadv_priv *bat_priv = netdev_priv(if_incoming->soft_iface);
 	struct batadv_hardif_neigh_node *hardif_neigh = NULL;
@@ -1322,20 +1327,22 @@ batadv_iv_ogm_process_per_outif(const struct sk_buff *skb, int ogm_offset,
 	bool is_from_best_next_hop = false;
 	bool is_single_hop_neigh = false;
 	bool sameseq, similar_ttl;
-	struct sk_buff *skb_priv;
 	struct ethhdr *ethhdr;
 	u8 *prev_sender;
 	bool is_bidirect;
+	int ogm_len;
 
-	/* create a private copy of the skb, as some functions change tq value
-	 * and/or flags.
+	/* create a private copy of this OGM, as some functions change tq value
+	 * and/or flags. Only the OGM itself is copied instead of the whole
+	 * aggregate, which made receiving large aggregates quadratic.
 	 */
-	skb_priv = skb_copy(skb, GFP_ATOMIC);
-	if (!skb_priv)
-		return;
+	ogm_packet = (struct batadv_ogm_packet *)(skb->data + ogm_offset);
+	ogm_len = BATADV_OGM_HLEN + ntohs(ogm_packet->tvlv_len);
+	memcpy(ogm_buf, eth_hdr(skb), ETH_HLEN);
+	memcpy(ogm_buf + ETH_HLEN, ogm_packet, ogm_len);
 
-	ethhdr = eth_hdr(skb_priv);
-	ogm_packet = (struct batadv_ogm_packet *)(skb_priv->data + ogm_offset);
+	ethhdr = (struct ethhdr *)ogm_buf;
+	ogm_packet = (struct batadv_ogm_packet *)(ogm_buf + ETH_HLEN);
 
 	dup_status = batadv_iv_ogm_update_seqnos(ethhdr, ogm_packet,
 						 if_incoming, if_outgoing);
@@ -1493,8 +1500,6 @@ batadv_iv_ogm_process_per_outif(const struct sk_buff *skb, int ogm_offset,
 	batadv_neigh_node_put(router_router);
 	batadv_neigh_node_put(orig_neigh_router);
 	batadv_hardif_neigh_put(hardif_neigh);
-
-	consume_skb(skb_priv);
 }
 
 /**
@@ -1545,9 +1550,11 @@ static void batadv_iv_ogm_process_reply(struct batadv_ogm_packet *ogm_packet,
  * @skb: the skb containing the OGM
  * @ogm_offset: offset to the OGM which should be processed (for aggregates)
  * @if_incoming: the interface where this packet was received
+ * @ogm_buf: scratch buffer of at least ETH_HLEN + skb_headlen(skb) bytes
  */
 static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
-				  struct batadv_hard_iface *if_incoming)
+				  struct batadv_hard_iface *if_incoming,
+				  u8 *ogm_buf)
 {
 	struct batadv_priv *bat_priv = netdev_priv(if_incoming->soft_iface);
 	struct batadv_orig_node *orig_neigh_node, *orig_node;
@@ -1557,7 +1564,6 @@ static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
 	bool has_directlink_flag;
 	struct ethhdr *ethhdr;
 	bool is_my_oldorig = false;
-	bool is_my_addr = false;
 	bool is_my_orig = false;
 
 	ogm_packet = (struct batadv_ogm_packet *)(skb->data + ogm_offset);
@@ -1602,10 +1608,6 @@ static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
 		if (hard_iface->soft_iface != if_incoming->soft_iface)
 			continue;
 
-		if (batadv_compare_eth(ethhdr->h_source,
-				       hard_iface->net_dev->dev_addr))
-			is_my_addr = true;
-
 		if (batadv_compare_eth(ogm_packet->orig,
 				       hard_iface->net_dev->dev_addr))
 			is_my_orig = true;
@@ -1616,13 +1618,6 @@ static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
 	}
 	rcu_read_unlock();
 
-	if (is_my_addr) {
-		batadv_dbg(BATADV_DBG_BATMAN, bat_priv,
-			   "Drop packet: received my own broadcast (sender: %pM)\n",
-			   ethhdr->h_source);
-		return;
-	}
-
 	if (is_my_orig) {
 		orig_neigh_node = batadv_iv_ogm_orig_get(bat_priv,
 							 ethhdr->h_source);
@@ -1657,7 +1652,8 @@ static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
 		return;
 
 	batadv_iv_ogm_process_per_outif(skb, ogm_offset, orig_node,
-					if_incoming, BATADV_IF_DEFAULT);
+					if_incoming, BATADV_IF_DEFAULT,
+					ogm_buf);
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(hard_iface, &batadv_hardif_list, list) {
@@ -1671,7 +1667,8 @@ static void batadv_iv_ogm_process(const struct sk_buff *skb, int ogm_offset,
 			continue;
 
 		batadv_iv_ogm_process_per_outif(skb, ogm_offset, orig_node,
-						if_incoming, hard_iface);
+						if_incoming, hard_iface,
+						ogm_buf);
 
 		batadv_hardif_put(hard_iface);
 	}
@@ -1723,7 +1720,10 @@ static int batadv_iv_ogm_receive(struct sk_buff *skb,
 {
 	struct batadv_priv *bat_priv = netdev_priv(if_incoming->soft_iface);
 	struct batadv_ogm_packet *ogm_packet;
+	struct batadv_hard_iface *hard_iface;
+	bool is_my_addr = false;
 	u8 *packet_pos;
+	u8 *ogm_buf;
 	int ogm_offset;
 	bool res;
 	int ret = NET_RX_DROP;
@@ -1742,13 +1742,45 @@ static int batadv_iv_ogm_receive(struct sk_buff *skb,
 	batadv_add_counter(bat_priv, BATADV_CNT_MGMT_RX_BYTES,
 			   skb->len + ETH_HLEN);
 
+	/* all OGMs of an aggregate share the sender, check it only once */
+	rcu_read_lock();
+	list_for_each_entry_rcu(hard_iface, &batadv_hardif_list, list) {
+		if (hard_iface->if_status != BATADV_IF_ACTIVE)
+			continue;
+
+		if (hard_iface->soft_iface != if_incoming->soft_iface)
+			continue;
+
+		if (batadv_compare_eth(eth_hdr(skb)->h_source,
+				       hard_iface->net_dev->dev_addr)) {
+			is_my_addr = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (is_my_addr) {
+		batadv_dbg(BATADV_DBG_BATMAN, bat_priv,
+			   "Drop packet: received my own broadcast (sender: %pM)\n",
+			   eth_hdr(skb)->h_source);
+		ret = NET_RX_SUCCESS;
+		goto free_skb;
+	}
+
+	/* scratch space for the private OGM copies, shared by all OGMs of
+	 * the aggregate
+	 */
+	ogm_buf = kmalloc(ETH_HLEN + skb_headlen(skb), GFP_ATOMIC);
+	if (!ogm_buf)
+		goto free_skb;
+
 	ogm_offset = 0;
 	ogm_packet = (struct batadv_ogm_packet *)skb->data;
 
 	/* unpack the aggregated packets and process them one by one */
 	while (batadv_iv_ogm_aggr_packet(ogm_offset, skb_headlen(skb),
 					 ogm_packet)) {
-		batadv_iv_ogm_process(skb, ogm_offset, if_incoming);
+		batadv_iv_ogm_process(skb, ogm_offset, if_incoming, ogm_buf);
 
 		ogm_offset += BATADV_OGM_HLEN;
 		ogm_offset += ntohs(ogm_packet->tvlv_len);
@@ -1757,6 +1789,7 @@ static int batadv_iv_ogm_receive(struct sk_buff *skb,
 		ogm_packet = (struct batadv_ogm_packet *)packet_pos;
 	}
 
+	kfree(ogm_buf);
 	ret = NET_RX_SUCCESS;
 
 free_skb:
@@ -1981,6 +2014,7 @@ batadv_iv_ogm_orig_dump(struct sk_buff *msg, struct netlink_callback *cb,
 	int sub = cb->args[2];
 	int portid = NETLINK_CB(cb->skb).portid;
 
+	batadv_hash_walk_begin(hash);
 	while (bucket < hash->size) {
 		head = &hash->table[bucket];
 
@@ -1992,6 +2026,7 @@ batadv_iv_ogm_orig_dump(struct sk_buff *msg, struct netlink_callback *cb,
 
 		bucket++;
 	}
+	batadv_hash_walk_end(hash);
 
 	cb->args[0] = bucket;
 	cb->args[1] = idx;
@@ -431,6 +431,7 @@ batadv_v_orig_dump(struct sk_buff *msg, struct netlink_callback *cb,
 	int sub = cb->args[2];
 	int portid = NETLINK_CB(cb->skb).portid;
 
+	batadv_hash_walk_begin(hash);
 	while (bucket < hash->size) {
 		head = &hash->table[bucket];
 
@@ -442,6 +443,7 @@ batadv_v_orig_dump(struct sk_buff *msg, struct netlink_callback *cb,
 
 		bucket++;
 	}
+	batadv_hash_walk_end(hash);
 
 	cb->args[0] = bucket;
 	cb->args[1] = idx;
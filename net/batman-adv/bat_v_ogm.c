@@ -848,14 +848,15 @@ batadv_v_ogm_aggr_packet(int buff_pos, int packet_len,
  * @skb: the skb containing the OGM
  * @ogm_offset: offset to the OGM which should be processed (for aggregates)
  * @if_incoming: the interface where this packet was received
+ * @hardif_neigh: the single hop neighbor which sent the aggregate
  */
 static void batadv_v_ogm_process(const struct sk_buff *skb, int ogm_offset,
-				 struct batadv_hard_iface *if_incoming)
+				 struct batadv_hard_iface *if_incoming,
+				 struct batadv_hardif_neigh_node *hardif_neigh)
 {
 	struct batadv_priv *bat_priv = netdev_priv(if_incoming->soft_iface);
 	struct ethhdr *ethhdr;
 	struct batadv_orig_node *orig_node = NULL;
-	struct batadv_hardif_neigh_node *hardif_neigh = NULL;
 	struct batadv_neigh_node *neigh_node = NULL;
 	struct batadv_hard_iface *hard_iface;
 	struct batadv_ogm2_packet *ogm_packet;
@@ -889,14 +890,6 @@ static void batadv_v_ogm_process(const struct sk_buff *skb, int ogm_offset,
 		return;
 	}
 
-	/* require ELP packets be to received from this neighbor first */
-	hardif_neigh = batadv_hardif_neigh_get(if_incoming, ethhdr->h_source);
-	if (!hardif_neigh) {
-		batadv_dbg(BATADV_DBG_BATMAN, bat_priv,
-			   "Drop packet: OGM via unknown neighbor!\n");
-		goto out;
-	}
-
 	orig_node = batadv_v_ogm_orig_get(bat_priv, ogm_packet->orig);
 	if (!orig_node)
 		goto out;
@@ -971,7 +964,6 @@ static void batadv_v_ogm_process(const struct sk_buff *skb, int ogm_offset,
 out:
 	batadv_orig_node_put(orig_node);
 	batadv_neigh_node_put(neigh_node);
-	batadv_hardif_neigh_put(hardif_neigh);
 }
 
 /**
@@ -986,6 +978,7 @@ int batadv_v_ogm_packet_recv(struct sk_buff *skb,
 			     struct batadv_hard_iface *if_incoming)
 {
 	struct batadv_priv *bat_priv = netdev_priv(if_incoming->soft_iface);
+	struct batadv_hardif_neigh_node *hardif_neigh;
 	struct batadv_ogm2_packet *ogm_packet;
 	struct ethhdr *ethhdr;
 	int ogm_offset;
@@ -1009,12 +1002,25 @@ int batadv_v_ogm_packet_recv(struct sk_buff *skb,
 	batadv_add_counter(bat_priv, BATADV_CNT_MGMT_RX_BYTES,
 			   skb->len + ETH_HLEN);
 
+	/* require ELP packets be to received from this neighbor first. All
+	 * OGMs of an aggregate come from the same neighbor, so look it up
+	 * only once
+	 */
+	hardif_neigh = batadv_hardif_neigh_get(if_incoming, ethhdr->h_source);
+	if (!hardif_neigh) {
+		batadv_dbg(BATADV_DBG_BATMAN, bat_priv,
+			   "Drop packet: OGM via unknown neighbor!\n");
+		ret = NET_RX_SUCCESS;
+		goto free_skb;
+	}
+
 	ogm_offset = 0;
 	ogm_packet = (struct batadv_ogm2_packet *)skb->data;
 
 	while (batadv_v_ogm_aggr_packet(ogm_offset, skb_headlen(skb),
 					ogm_packet)) {
-		batadv_v_ogm_process(skb, ogm_offset, if_incoming);
+		batadv_v_ogm_process(skb, ogm_offset, if_incoming,
+				     hardif_neigh);
 
 		ogm_offset += BATADV_OGM2_HLEN;
 		ogm_offset += ntohs(ogm_packet->tvlv_len);
@@ -1023,6 +1029,7 @@ int batadv_v_ogm_packet_recv(struct sk_buff *skb,
 		ogm_packet = (struct batadv_ogm2_packet *)packet_pos;
 	}
 
+	batadv_hardif_neigh_put(hardif_neigh);
 	ret = NET_RX_SUCCESS;
 
 free_skb:
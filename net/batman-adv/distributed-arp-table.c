@@ -576,6 +576,7 @@ static void batadv_choose_next_candidate(struct batadv_priv *bat_priv,
 	/* iterate over the originator list and find the node with the closest
 	 * dat_address which has not been selected yet
 	 */
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -600,6 +601,8 @@ static void batadv_choose_next_candidate(struct batadv_priv *bat_priv,
 		}
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
+
 	if (max_orig_node) {
 		cands[select].type = BATADV_DAT_CANDIDATE_ORIG;
 		cands[select].orig_node = max_orig_node;
@@ -9,8 +9,15 @@
 
 #include <linux/gfp.h>
 #include <linux/lockdep.h>
+#include <linux/log2.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
 
+/* upper bound for growable tables: 1 MiB of buckets on 64 bit */
+#define BATADV_HASH_MAX_SIZE	(1U << 16)
+
 /* clears the hash */
 static void batadv_hash_init(struct batadv_hashtable *hash)
 {
@@ -22,6 +29,11 @@ static void batadv_hash_init(struct batadv_hashtable *hash)
 	}
 
 	atomic_set(&hash->generation, 0);
+	rwlock_init(&hash->resize_lock);
+	seqcount_rwlock_init(&hash->seq, &hash->resize_lock);
+	hash->choose = NULL;
+	hash->node_offset = 0;
+	hash->lock_class = NULL;
 }
 
 /**
@@ -30,8 +42,8 @@ static void batadv_hash_init(struct batadv_hashtable *hash)
  */
 void batadv_hash_destroy(struct batadv_hashtable *hash)
 {
-	kfree(hash->list_locks);
-	kfree(hash->table);
+	kvfree(hash->list_locks);
+	kvfree(hash->table);
 	kfree(hash);
 }
 
@@ -79,6 +91,101 @@ void batadv_hash_set_lock_class(struct batadv_hashtable *hash,
 {
 	u32 i;
 
+	hash->lock_class = key;
+
 	for (i = 0; i < hash->size; i++)
 		lockdep_set_class(&hash->list_locks[i], key);
 }
+
+/**
+ * batadv_hash_set_growable() - Allow a hashtable to grow with its entries
+ * @hash: hash object to modify
+ * @choose: callback calculating the hash index, as passed to batadv_hash_add()
+ * @node_offset: offset of the hlist_node in the objects passed to @choose
+ *
+ * Lookups in a growable table have to use batadv_hash_head() and retry with
+ * batadv_hash_lookup_begin() and batadv_hash_lookup_retry(). Walks over its
+ * buckets, and bucket locks taken outside of batadv_hash_add() and
+ * batadv_hash_remove(), have to be enclosed in batadv_hash_walk_begin() and
+ * batadv_hash_walk_end().
+ */
+void batadv_hash_set_growable(struct batadv_hashtable *hash,
+			      batadv_hashdata_choose_cb choose,
+			      size_t node_offset)
+{
+	hash->choose = choose;
+	hash->node_offset = node_offset;
+}
+
+/**
+ * batadv_hash_grow() - Grow a hashtable to fit a number of entries
+ * @hash: hash object set up with batadv_hash_set_growable()
+ * @count: number of entries currently in the hash
+ *
+ * If there are more entries than buckets, move all entries to a new table with
+ * the next power of two buckets above @count. Writers and walks are held off
+ * while entries are moved, lockless lookups retry. Must be called from process
+ * context, and not concurrently for the same hash.
+ */
+void batadv_hash_grow(struct batadv_hashtable *hash, u32 count)
+{
+	struct hlist_head *table, *old_table;
+	struct hlist_node *node, *node_tmp;
+	spinlock_t *list_locks, *old_locks; /* bucket locks, not taken here */
+	u32 size, i, index;
+
+	might_sleep();
+
+	if (!hash->choose || count <= hash->size ||
+	    hash->size >= BATADV_HASH_MAX_SIZE)
+		return;
+
+	size = min_t(u32, roundup_pow_of_two(count), BATADV_HASH_MAX_SIZE);
+
+	table = kvmalloc_array(size, sizeof(*table), GFP_KERNEL);
+	list_locks = kvmalloc_array(size, sizeof(*list_locks), GFP_KERNEL);
+	if (!table || !list_locks)
+		goto free;
+
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_HEAD(&table[i]);
+		spin_lock_init(&list_locks[i]);
+		if (hash->lock_class)
+			lockdep_set_class(&list_locks[i], hash->lock_class);
+	}
+
+	write_lock_bh(&hash->resize_lock);
+	write_seqcount_begin(&hash->seq);
+
+	for (i = 0; i < hash->size; i++) {
+		hlist_for_each_safe(node, node_tmp, &hash->table[i]) {
+			index = hash->choose((void *)node - hash->node_offset,
+					     size);
+			hlist_del_rcu(node);
+			hlist_add_head_rcu(node, &table[index]);
+		}
+	}
+
+	old_table = hash->table;
+	old_locks = hash->list_locks;
+	WRITE_ONCE(hash->table, table);
+	hash->list_locks = list_locks;
+
+	/* a new size must only be seen with the new table: pairs with the
+	 * acquire in batadv_hash_head()
+	 */
+	smp_store_release(&hash->size, size);
+	atomic_inc(&hash->generation);
+
+	write_seqcount_end(&hash->seq);
+	write_unlock_bh(&hash->resize_lock);
+
+	/* lockless lookups might still walk the old buckets */
+	synchronize_rcu();
+
+	table = old_table;
+	list_locks = old_locks;
+free:
+	kvfree(list_locks);
+	kvfree(table);
+}
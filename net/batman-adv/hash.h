@@ -14,6 +14,7 @@
 #include <linux/list.h>
 #include <linux/lockdep.h>
 #include <linux/rculist.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock.h>
 #include <linux/stddef.h>
 #include <linux/types.h>
@@ -49,6 +50,24 @@ struct batadv_hashtable {
 
 	/** @generation: current (generation) sequence number */
 	atomic_t generation;
+
+	/**
+	 * @resize_lock: held for writing while the buckets are replaced, for
+	 *  reading by writers and walks over the buckets of growable tables
+	 */
+	rwlock_t resize_lock;
+
+	/** @seq: changes while entries are moved to new buckets */
+	seqcount_rwlock_t seq;
+
+	/** @choose: hash function of a growable table, or NULL */
+	batadv_hashdata_choose_cb choose;
+
+	/** @node_offset: offset of the hlist_node in the hashed objects */
+	size_t node_offset;
+
+	/** @lock_class: lockdep class key of the bucket locks */
+	struct lock_class_key *lock_class;
 };
 
 /* allocates and clears the hash */
@@ -58,9 +77,89 @@ struct batadv_hashtable *batadv_hash_new(u32 size);
 void batadv_hash_set_lock_class(struct batadv_hashtable *hash,
 				struct lock_class_key *key);
 
+/* allow the hash to grow with the number of entries */
+void batadv_hash_set_growable(struct batadv_hashtable *hash,
+			      batadv_hashdata_choose_cb choose,
+			      size_t node_offset);
+
+/* grow the hash to fit a number of entries, may sleep */
+void batadv_hash_grow(struct batadv_hashtable *hash, u32 count);
+
 /* free only the hashtable and the hash itself. */
 void batadv_hash_destroy(struct batadv_hashtable *hash);
 
+/**
+ * batadv_hash_walk_begin() - Keep the buckets of a hash from being replaced
+ * @hash: hash table to walk
+ *
+ * Needed around walks over the buckets of a growable table, and around bucket
+ * locks taken outside of batadv_hash_add() and batadv_hash_remove(). Bottom
+ * halves stay disabled until batadv_hash_walk_end().
+ */
+static inline void batadv_hash_walk_begin(struct batadv_hashtable *hash)
+{
+	read_lock_bh(&hash->resize_lock);
+}
+
+/**
+ * batadv_hash_walk_end() - Allow the buckets of a hash to be replaced again
+ * @hash: hash table walked
+ */
+static inline void batadv_hash_walk_end(struct batadv_hashtable *hash)
+{
+	read_unlock_bh(&hash->resize_lock);
+}
+
+/**
+ * batadv_hash_lookup_begin() - Start a lockless lookup in a growable hash
+ * @hash: hash table to look up
+ *
+ * Entries may be moved to other buckets while the RCU protected lookup runs:
+ * if nothing was found, it has to be retried if batadv_hash_lookup_retry()
+ * says so.
+ *
+ * Return: sequence count to pass to batadv_hash_lookup_retry()
+ */
+static inline unsigned int
+batadv_hash_lookup_begin(struct batadv_hashtable *hash)
+{
+	return read_seqcount_begin(&hash->seq);
+}
+
+/**
+ * batadv_hash_lookup_retry() - Check whether a lookup raced with a resize
+ * @hash: hash table looked up
+ * @seq: sequence count returned by batadv_hash_lookup_begin()
+ *
+ * Return: true if entries were moved since batadv_hash_lookup_begin()
+ */
+static inline bool batadv_hash_lookup_retry(struct batadv_hashtable *hash,
+					    unsigned int seq)
+{
+	return read_seqcount_retry(&hash->seq, seq);
+}
+
+/**
+ * batadv_hash_head() - Get the bucket for a key, for lockless lookups
+ * @hash: hash table to look up, under rcu_read_lock()
+ * @choose: callback calculating the hash index
+ * @data: data passed to @choose as argument
+ *
+ * Return: the bucket of the current table @data hashes to
+ */
+static inline struct hlist_head *
+batadv_hash_head(struct batadv_hashtable *hash,
+		 batadv_hashdata_choose_cb choose, const void *data)
+{
+	/* Tables only grow, and a new size is published after the new table:
+	 * pairs with the release in batadv_hash_grow()
+	 */
+	u32 size = smp_load_acquire(&hash->size);
+	struct hlist_head *table = READ_ONCE(hash->table);
+
+	return &table[choose(data, size)];
+}
+
 /**
  *	batadv_hash_add() - adds data to the hashtable
  *	@hash: storage hash table
@@ -87,11 +186,13 @@ static inline int batadv_hash_add(struct batadv_hashtable *hash,
 	if (!hash)
 		goto out;
 
+	batadv_hash_walk_begin(hash);
+
 	index = choose(data, hash->size);
 	head = &hash->table[index];
 	list_lock = &hash->list_locks[index];
 
-	spin_lock_bh(list_lock);
+	spin_lock(list_lock);
 
 	hlist_for_each(node, head) {
 		if (!compare(node, data))
@@ -108,7 +209,8 @@ static inline int batadv_hash_add(struct batadv_hashtable *hash,
 	ret = 0;
 
 unlock:
-	spin_unlock_bh(list_lock);
+	spin_unlock(list_lock);
+	batadv_hash_walk_end(hash);
 out:
 	return ret;
 }
@@ -136,10 +238,12 @@ static inline void *batadv_hash_remove(struct batadv_hashtable *hash,
 	struct hlist_head *head;
 	void *data_save = NULL;
 
+	batadv_hash_walk_begin(hash);
+
 	index = choose(data, hash->size);
 	head = &hash->table[index];
 
-	spin_lock_bh(&hash->list_locks[index]);
+	spin_lock(&hash->list_locks[index]);
 	hlist_for_each(node, head) {
 		if (!compare(node, data))
 			continue;
@@ -149,7 +253,9 @@ static inline void *batadv_hash_remove(struct batadv_hashtable *hash,
 		atomic_inc(&hash->generation);
 		break;
 	}
-	spin_unlock_bh(&hash->list_locks[index]);
+	spin_unlock(&hash->list_locks[index]);
+
+	batadv_hash_walk_end(hash);
 
 	return data_save;
 }
@@ -1969,6 +1969,7 @@ __batadv_mcast_flags_dump(struct sk_buff *msg, u32 portid,
 	long bucket_tmp = *bucket;
 	long idx_tmp = *idx;
 
+	batadv_hash_walk_begin(hash);
 	while (bucket_tmp < hash->size) {
 		if (batadv_mcast_flags_dump_bucket(msg, portid, cb, hash,
 						   bucket_tmp, &idx_tmp))
@@ -1977,6 +1978,7 @@ __batadv_mcast_flags_dump(struct sk_buff *msg, u32 portid,
 		bucket_tmp++;
 		idx_tmp = 0;
 	}
+	batadv_hash_walk_end(hash);
 
 	*bucket = bucket_tmp;
 	*idx = idx_tmp;
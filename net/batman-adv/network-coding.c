@@ -402,6 +402,7 @@ static void batadv_nc_purge_orig_hash(struct batadv_priv *bat_priv)
 		return;
 
 	/* For each orig_node */
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -411,6 +412,7 @@ static void batadv_nc_purge_orig_hash(struct batadv_priv *bat_priv)
 					     batadv_nc_to_purge_nc_node);
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
 }
 
 /**
@@ -60,15 +60,16 @@ batadv_orig_hash_find(struct batadv_priv *bat_priv, const void *data)
 	struct batadv_hashtable *hash = bat_priv->orig_hash;
 	struct hlist_head *head;
 	struct batadv_orig_node *orig_node, *orig_node_tmp = NULL;
-	int index;
+	unsigned int seq;
 
 	if (!hash)
 		return NULL;
 
-	index = batadv_choose_orig(data, hash->size);
-	head = &hash->table[index];
-
 	rcu_read_lock();
+retry:
+	seq = batadv_hash_lookup_begin(hash);
+	head = batadv_hash_head(hash, batadv_choose_orig, data);
+
 	hlist_for_each_entry_rcu(orig_node, head, hash_entry) {
 		if (!batadv_compare_eth(orig_node, data))
 			continue;
@@ -79,6 +80,9 @@ batadv_orig_hash_find(struct batadv_priv *bat_priv, const void *data)
 		orig_node_tmp = orig_node;
 		break;
 	}
+
+	if (!orig_node_tmp && batadv_hash_lookup_retry(hash, seq))
+		goto retry;
 	rcu_read_unlock();
 
 	return orig_node_tmp;
@@ -231,6 +235,8 @@ int batadv_originator_init(struct batadv_priv *bat_priv)
 
 	batadv_hash_set_lock_class(bat_priv->orig_hash,
 				   &batadv_orig_hash_lock_class_key);
+	batadv_hash_set_growable(bat_priv->orig_hash, batadv_choose_orig,
+				 offsetof(struct batadv_orig_node, hash_entry));
 
 	INIT_DELAYED_WORK(&bat_priv->orig_work, batadv_purge_orig);
 	queue_delayed_work(batadv_event_workqueue,
@@ -901,6 +907,7 @@ void batadv_originator_free(struct batadv_priv *bat_priv)
 
 	bat_priv->orig_hash = NULL;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -913,6 +920,7 @@ void batadv_originator_free(struct batadv_priv *bat_priv)
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
 
 	batadv_hash_destroy(hash);
 }
@@ -1247,20 +1255,24 @@ static bool batadv_purge_orig_node(struct batadv_priv *bat_priv,
 }
 
 /**
- * batadv_purge_orig_ref() - Purge all outdated originators
+ * batadv_purge_orig_hash() - Purge outdated originators from the hash
  * @bat_priv: the bat priv with all the soft interface information
+ *
+ * Return: the number of originators left in the hash
  */
-void batadv_purge_orig_ref(struct batadv_priv *bat_priv)
+static u32 batadv_purge_orig_hash(struct batadv_priv *bat_priv)
 {
 	struct batadv_hashtable *hash = bat_priv->orig_hash;
 	struct hlist_node *node_tmp;
 	struct hlist_head *head;
 	spinlock_t *list_lock; /* spinlock to protect write access */
 	struct batadv_orig_node *orig_node;
-	u32 i;
+	u32 i, count = 0;
 
 	if (!hash)
-		return;
+		return 0;
+
+	batadv_hash_walk_begin(hash);
 
 	/* for all origins... */
 	for (i = 0; i < hash->size; i++) {
@@ -1284,10 +1296,23 @@ void batadv_purge_orig_ref(struct batadv_priv *bat_priv)
 
 			batadv_frag_purge_orig(orig_node,
 					       batadv_frag_check_entry);
+			count++;
 		}
 		spin_unlock_bh(list_lock);
 	}
 
+	batadv_hash_walk_end(hash);
+
+	return count;
+}
+
+/**
+ * batadv_purge_orig_ref() - Purge all outdated originators
+ * @bat_priv: the bat priv with all the soft interface information
+ */
+void batadv_purge_orig_ref(struct batadv_priv *bat_priv)
+{
+	batadv_purge_orig_hash(bat_priv);
 	batadv_gw_election(bat_priv);
 }
 
@@ -1295,10 +1320,16 @@ static void batadv_purge_orig(struct work_struct *work)
 {
 	struct delayed_work *delayed_work;
 	struct batadv_priv *bat_priv;
+	u32 count;
 
 	delayed_work = to_delayed_work(work);
 	bat_priv = container_of(delayed_work, struct batadv_priv, orig_work);
-	batadv_purge_orig_ref(bat_priv);
+	count = batadv_purge_orig_hash(bat_priv);
+	batadv_gw_election(bat_priv);
+
+	/* only grown from here, so that it can't run concurrently */
+	batadv_hash_grow(bat_priv->orig_hash, count);
+
 	queue_delayed_work(batadv_event_workqueue,
 			   &bat_priv->orig_work,
 			   msecs_to_jiffies(BATADV_ORIG_WORK_PERIOD));
@@ -128,7 +128,7 @@ batadv_tt_hash_find(struct batadv_hashtable *hash, const u8 *addr,
 {
 	struct hlist_head *head;
 	struct batadv_tt_common_entry to_search, *tt, *tt_tmp = NULL;
-	u32 index;
+	unsigned int seq;
 
 	if (!hash)
 		return NULL;
@@ -136,10 +136,11 @@ batadv_tt_hash_find(struct batadv_hashtable *hash, const u8 *addr,
 	ether_addr_copy(to_search.addr, addr);
 	to_search.vid = vid;
 
-	index = batadv_choose_tt(&to_search, hash->size);
-	head = &hash->table[index];
-
 	rcu_read_lock();
+retry:
+	seq = batadv_hash_lookup_begin(hash);
+	head = batadv_hash_head(hash, batadv_choose_tt, &to_search);
+
 	hlist_for_each_entry_rcu(tt, head, hash_entry) {
 		if (!batadv_compare_eth(tt, addr))
 			continue;
@@ -153,6 +154,9 @@ batadv_tt_hash_find(struct batadv_hashtable *hash, const u8 *addr,
 		tt_tmp = tt;
 		break;
 	}
+
+	if (!tt_tmp && batadv_hash_lookup_retry(hash, seq))
+		goto retry;
 	rcu_read_unlock();
 
 	return tt_tmp;
@@ -589,6 +593,9 @@ static int batadv_tt_local_init(struct batadv_priv *bat_priv)
 
 	batadv_hash_set_lock_class(bat_priv->tt.local_hash,
 				   &batadv_tt_local_hash_lock_class_key);
+	batadv_hash_set_growable(bat_priv->tt.local_hash, batadv_choose_tt,
+				 offsetof(struct batadv_tt_common_entry,
+					  hash_entry));
 
 	return 0;
 }
@@ -1209,6 +1216,7 @@ int batadv_tt_local_dump(struct sk_buff *msg, struct netlink_callback *cb)
 
 	hash = bat_priv->tt.local_hash;
 
+	batadv_hash_walk_begin(hash);
 	while (bucket < hash->size) {
 		if (batadv_tt_local_dump_bucket(msg, portid, cb, bat_priv,
 						hash, bucket, &idx))
@@ -1216,6 +1224,7 @@ int batadv_tt_local_dump(struct sk_buff *msg, struct netlink_callback *cb)
 
 		bucket++;
 	}
+	batadv_hash_walk_end(hash);
 
 	ret = msg->len;
 
@@ -1319,17 +1328,22 @@ u16 batadv_tt_local_remove(struct batadv_priv *bat_priv, const u8 *addr,
  * @head: pointer to the list containing the local tt entries
  * @timeout: parameter deciding whether a given tt local entry is considered
  *  inactive or not
+ *
+ * Return: the number of entries in the list
  */
-static void batadv_tt_local_purge_list(struct batadv_priv *bat_priv,
-				       struct hlist_head *head,
-				       int timeout)
+static u32 batadv_tt_local_purge_list(struct batadv_priv *bat_priv,
+				      struct hlist_head *head,
+				      int timeout)
 {
 	struct batadv_tt_local_entry *tt_local_entry;
 	struct batadv_tt_common_entry *tt_common_entry;
 	struct hlist_node *node_tmp;
+	u32 count = 0;
 
 	hlist_for_each_entry_safe(tt_common_entry, node_tmp, head,
 				  hash_entry) {
+		count++;
+
 		tt_local_entry = container_of(tt_common_entry,
 					      struct batadv_tt_local_entry,
 					      common);
@@ -1346,6 +1360,8 @@ static void batadv_tt_local_purge_list(struct batadv_priv *bat_priv,
 		batadv_tt_local_set_pending(bat_priv, tt_local_entry,
 					    BATADV_TT_CLIENT_DEL, "timed out");
 	}
+
+	return count;
 }
 
 /**
@@ -1353,23 +1369,29 @@ static void batadv_tt_local_purge_list(struct batadv_priv *bat_priv,
  * @bat_priv: the bat priv with all the soft interface information
  * @timeout: parameter deciding whether a given tt local entry is considered
  *  inactive or not
+ *
+ * Return: the number of entries in the local table
  */
-static void batadv_tt_local_purge(struct batadv_priv *bat_priv,
-				  int timeout)
+static u32 batadv_tt_local_purge(struct batadv_priv *bat_priv,
+				 int timeout)
 {
 	struct batadv_hashtable *hash = bat_priv->tt.local_hash;
 	struct hlist_head *head;
 	spinlock_t *list_lock; /* protects write access to the hash lists */
-	u32 i;
+	u32 i, count = 0;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
 
 		spin_lock_bh(list_lock);
-		batadv_tt_local_purge_list(bat_priv, head, timeout);
+		count += batadv_tt_local_purge_list(bat_priv, head, timeout);
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
+
+	return count;
 }
 
 static void batadv_tt_local_table_free(struct batadv_priv *bat_priv)
@@ -1387,6 +1409,7 @@ static void batadv_tt_local_table_free(struct batadv_priv *bat_priv)
 
 	hash = bat_priv->tt.local_hash;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -1403,6 +1426,7 @@ static void batadv_tt_local_table_free(struct batadv_priv *bat_priv)
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
 
 	batadv_hash_destroy(hash);
 
@@ -1421,6 +1445,9 @@ static int batadv_tt_global_init(struct batadv_priv *bat_priv)
 
 	batadv_hash_set_lock_class(bat_priv->tt.global_hash,
 				   &batadv_tt_global_hash_lock_class_key);
+	batadv_hash_set_growable(bat_priv->tt.global_hash, batadv_choose_tt,
+				 offsetof(struct batadv_tt_common_entry,
+					  hash_entry));
 
 	return 0;
 }
@@ -1986,6 +2013,7 @@ int batadv_tt_global_dump(struct sk_buff *msg, struct netlink_callback *cb)
 
 	hash = bat_priv->tt.global_hash;
 
+	batadv_hash_walk_begin(hash);
 	while (bucket < hash->size) {
 		head = &hash->table[bucket];
 
@@ -1996,6 +2024,7 @@ int batadv_tt_global_dump(struct sk_buff *msg, struct netlink_callback *cb)
 
 		bucket++;
 	}
+	batadv_hash_walk_end(hash);
 
 	ret = msg->len;
 
@@ -2221,6 +2250,7 @@ void batadv_tt_global_del_orig(struct batadv_priv *bat_priv,
 	if (!hash)
 		return;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -2251,6 +2281,7 @@ void batadv_tt_global_del_orig(struct batadv_priv *bat_priv,
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
 	clear_bit(BATADV_ORIG_CAPA_HAS_TT, &orig_node->capa_initialized);
 }
 
@@ -2276,17 +2307,24 @@ static bool batadv_tt_global_to_purge(struct batadv_tt_global_entry *tt_global,
 	return purge;
 }
 
-static void batadv_tt_global_purge(struct batadv_priv *bat_priv)
+/**
+ * batadv_tt_global_purge() - purge outdated tt global entries
+ * @bat_priv: the bat priv with all the soft interface information
+ *
+ * Return: the number of entries left in the global table
+ */
+static u32 batadv_tt_global_purge(struct batadv_priv *bat_priv)
 {
 	struct batadv_hashtable *hash = bat_priv->tt.global_hash;
 	struct hlist_head *head;
 	struct hlist_node *node_tmp;
 	spinlock_t *list_lock; /* protects write access to the hash lists */
-	u32 i;
+	u32 i, count = 0;
 	char *msg = NULL;
 	struct batadv_tt_common_entry *tt_common;
 	struct batadv_tt_global_entry *tt_global;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -2298,8 +2336,10 @@ static void batadv_tt_global_purge(struct batadv_priv *bat_priv)
 						 struct batadv_tt_global_entry,
 						 common);
 
-			if (!batadv_tt_global_to_purge(tt_global, &msg))
+			if (!batadv_tt_global_to_purge(tt_global, &msg)) {
+				count++;
 				continue;
+			}
 
 			batadv_dbg(BATADV_DBG_TT, bat_priv,
 				   "Deleting global tt entry %pM (vid: %d): %s\n",
@@ -2313,6 +2353,9 @@ static void batadv_tt_global_purge(struct batadv_priv *bat_priv)
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
+
+	return count;
 }
 
 static void batadv_tt_global_table_free(struct batadv_priv *bat_priv)
@@ -2330,6 +2373,7 @@ static void batadv_tt_global_table_free(struct batadv_priv *bat_priv)
 
 	hash = bat_priv->tt.global_hash;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -2345,6 +2389,7 @@ static void batadv_tt_global_table_free(struct batadv_priv *bat_priv)
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
 
 	batadv_hash_destroy(hash);
 
@@ -2462,6 +2507,7 @@ static u32 batadv_tt_global_crc(struct batadv_priv *bat_priv,
 	u8 flags;
 	__be16 tmp_vid;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -2516,6 +2562,7 @@ static u32 batadv_tt_global_crc(struct batadv_priv *bat_priv,
 		}
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
 
 	return crc;
 }
@@ -2540,6 +2587,7 @@ static u32 batadv_tt_local_crc(struct batadv_priv *bat_priv,
 	u8 flags;
 	__be16 tmp_vid;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -2573,6 +2621,7 @@ static u32 batadv_tt_local_crc(struct batadv_priv *bat_priv,
 		}
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
 
 	return crc;
 }
@@ -2787,6 +2836,7 @@ static u16 batadv_tt_tvlv_generate(struct batadv_priv *bat_priv,
 	if (!valid_cb)
 		return tt_len;
 
+	batadv_hash_walk_begin(hash);
 	rcu_read_lock();
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
@@ -2811,6 +2861,7 @@ static u16 batadv_tt_tvlv_generate(struct batadv_priv *bat_priv,
 		}
 	}
 	rcu_read_unlock();
+	batadv_hash_walk_end(hash);
 
 	return batadv_tt_len(tt_tot - tt_num_entries);
 }
@@ -3574,16 +3625,21 @@ static void batadv_tt_purge(struct work_struct *work)
 	struct delayed_work *delayed_work;
 	struct batadv_priv_tt *priv_tt;
 	struct batadv_priv *bat_priv;
+	u32 local_count, global_count;
 
 	delayed_work = to_delayed_work(work);
 	priv_tt = container_of(delayed_work, struct batadv_priv_tt, work);
 	bat_priv = container_of(priv_tt, struct batadv_priv, tt);
 
-	batadv_tt_local_purge(bat_priv, BATADV_TT_LOCAL_TIMEOUT);
-	batadv_tt_global_purge(bat_priv);
+	local_count = batadv_tt_local_purge(bat_priv, BATADV_TT_LOCAL_TIMEOUT);
+	global_count = batadv_tt_global_purge(bat_priv);
 	batadv_tt_req_purge(bat_priv);
 	batadv_tt_roam_purge(bat_priv);
 
+	/* only grown from here, so that it can't run concurrently */
+	batadv_hash_grow(bat_priv->tt.local_hash, local_count);
+	batadv_hash_grow(bat_priv->tt.global_hash, global_count);
+
 	queue_delayed_work(batadv_event_workqueue, &bat_priv->tt.work,
 			   msecs_to_jiffies(BATADV_TT_WORK_PERIOD));
 }
@@ -3629,6 +3685,7 @@ static void batadv_tt_local_set_flags(struct batadv_priv *bat_priv, u16 flags,
 	if (!hash)
 		return;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 
@@ -3653,6 +3710,7 @@ static void batadv_tt_local_set_flags(struct batadv_priv *bat_priv, u16 flags,
 		}
 		rcu_read_unlock();
 	}
+	batadv_hash_walk_end(hash);
 }
 
 /* Purge out all the tt local entries marked with BATADV_TT_CLIENT_PENDING */
@@ -3669,6 +3727,7 @@ static void batadv_tt_local_purge_pending_clients(struct batadv_priv *bat_priv)
 	if (!hash)
 		return;
 
+	batadv_hash_walk_begin(hash);
 	for (i = 0; i < hash->size; i++) {
 		head = &hash->table[i];
 		list_lock = &hash->list_locks[i];
@@ -3694,6 +3753,7 @@ static void batadv_tt_local_purge_pending_clients(struct batadv_priv *bat_priv)
 		}
 		spin_unlock_bh(list_lock);
 	}
+	batadv_hash_walk_end(hash);
 }
 
 /**
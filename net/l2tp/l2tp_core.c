@@ -39,7 +39,8 @@
 #include <linux/ip.h>
 #include <linux/udp.h>
 #include <linux/l2tp.h>
-#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/rhashtable.h>
 #include <linux/sort.h>
 #include <linux/file.h>
 #include <linux/nsproxy.h>
@@ -112,9 +113,17 @@ struct l2tp_net {
 	/* Lock for write access to l2tp_tunnel_idr */
 	spinlock_t l2tp_tunnel_idr_lock;
 	struct idr l2tp_tunnel_idr;
-	struct hlist_head l2tp_session_hlist[L2TP_HASH_SIZE_2];
-	/* Lock for write access to l2tp_session_hlist */
-	spinlock_t l2tp_session_hlist_lock;
+	/* All sessions, keyed by tunnel and session ID */
+	struct rhashtable l2tp_session_htable;
+	/* L2TPv3 sessions, keyed by session ID only */
+	struct rhltable l2tp_v3_session_htable;
+	/* Serialises the L2TPv3 session ID uniqueness check with insertion */
+	spinlock_t l2tp_v3_session_htable_lock;
+};
+
+struct l2tp_session_key {
+	u32 tunnel_id;
+	u32 session_id;
 };
 
 #if IS_ENABLED(CONFIG_IPV6)
@@ -130,28 +139,78 @@ static inline struct l2tp_net *l2tp_pernet(const struct net *net)
 	return net_generic(net, l2tp_net_id);
 }
 
-/* Session hash global list for L2TPv3.
- * The session_id SHOULD be random according to RFC3931, but several
- * L2TP implementations use incrementing session_ids.  So we do a real
- * hash on the session_id, rather than a simple bitmask.
+/* Session tables.
+ * Session IDs SHOULD be random according to RFC2661 and RFC3931, but
+ * several L2TP implementations (Cisco and Microsoft) use incrementing
+ * session_ids, so both tables use a real hash rather than a bitmask.
+ * The tables grow with the number of sessions, so a single tunnel
+ * carrying tens of thousands of L2TPv2 sessions doesn't degrade
+ * data path lookups into long chain walks.
  */
-static inline struct hlist_head *
-l2tp_session_id_hash_2(struct l2tp_net *pn, u32 session_id)
+static u32 l2tp_session_key_hashfn(const void *data, u32 len, u32 seed)
 {
-	return &pn->l2tp_session_hlist[hash_32(session_id, L2TP_HASH_BITS_2)];
+	const struct l2tp_session_key *key = data;
+
+	return jhash_2words(key->tunnel_id, key->session_id, seed);
 }
 
-/* Session hash list.
- * The session_id SHOULD be random according to RFC2661, but several
- * L2TP implementations (Cisco and Microsoft) use incrementing
- * session_ids.  So we do a real hash on the session_id, rather than a
- * simple bitmask.
- */
-static inline struct hlist_head *
-l2tp_session_id_hash(struct l2tp_tunnel *tunnel, u32 session_id)
+static u32 l2tp_session_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct l2tp_session *session = data;
+
+	return jhash_2words(session->tunnel->tunnel_id, session->session_id, seed);
+}
+
+static int l2tp_session_obj_cmpfn(struct rhashtable_compare_arg *arg,
+				  const void *obj)
+{
+	const struct l2tp_session_key *key = arg->key;
+	const struct l2tp_session *session = obj;
+
+	return session->tunnel->tunnel_id != key->tunnel_id ||
+	       session->session_id != key->session_id;
+}
+
+static const struct rhashtable_params l2tp_session_htable_params = {
+	.head_offset		= offsetof(struct l2tp_session, hnode),
+	.key_len		= sizeof(struct l2tp_session_key),
+	.hashfn			= l2tp_session_key_hashfn,
+	.obj_hashfn		= l2tp_session_obj_hashfn,
+	.obj_cmpfn		= l2tp_session_obj_cmpfn,
+	.automatic_shrinking	= true,
+};
+
+static const struct rhashtable_params l2tp_v3_session_htable_params = {
+	.head_offset		= offsetof(struct l2tp_session, global_hnode),
+	.key_offset		= offsetof(struct l2tp_session, session_id),
+	.key_len		= sizeof_field(struct l2tp_session, session_id),
+	.automatic_shrinking	= true,
+};
+
+void l2tp_stats_fold(struct l2tp_stats *dest, const struct l2tp_stats __percpu *stats)
 {
-	return &tunnel->session_hlist[hash_32(session_id, L2TP_HASH_BITS)];
+	int cpu;
+
+	memset(dest, 0, sizeof(*dest));
+	if (!stats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct l2tp_stats *s = per_cpu_ptr(stats, cpu);
+
+		dest->tx_packets += READ_ONCE(s->tx_packets);
+		dest->tx_bytes += READ_ONCE(s->tx_bytes);
+		dest->tx_errors += READ_ONCE(s->tx_errors);
+		dest->rx_packets += READ_ONCE(s->rx_packets);
+		dest->rx_bytes += READ_ONCE(s->rx_bytes);
+		dest->rx_seq_discards += READ_ONCE(s->rx_seq_discards);
+		dest->rx_oos_packets += READ_ONCE(s->rx_oos_packets);
+		dest->rx_errors += READ_ONCE(s->rx_errors);
+		dest->rx_cookie_discards += READ_ONCE(s->rx_cookie_discards);
+		dest->rx_invalid += READ_ONCE(s->rx_invalid);
+	}
 }
+EXPORT_SYMBOL_GPL(l2tp_stats_fold);
 
 static void l2tp_tunnel_free(struct l2tp_tunnel *tunnel)
 {
@@ -165,6 +224,7 @@ static void l2tp_session_free(struct l2tp_session *session)
 	trace_free_session(session);
 	if (session->tunnel)
 		l2tp_tunnel_dec_refcount(session->tunnel);
+	free_percpu(session->stats);
 	kfree(session);
 }
 
@@ -248,20 +308,21 @@ EXPORT_SYMBOL_GPL(l2tp_tunnel_get_nth);
 struct l2tp_session *l2tp_tunnel_get_session(struct l2tp_tunnel *tunnel,
 					     u32 session_id)
 {
-	struct hlist_head *session_list;
+	struct l2tp_net *pn = l2tp_pernet(tunnel->l2tp_net);
+	struct l2tp_session_key key = {
+		.tunnel_id = tunnel->tunnel_id,
+		.session_id = session_id,
+	};
 	struct l2tp_session *session;
 
-	session_list = l2tp_session_id_hash(tunnel, session_id);
-
-	rcu_read_lock_bh();
-	hlist_for_each_entry_rcu(session, session_list, hlist)
-		if (session->session_id == session_id) {
-			l2tp_session_inc_refcount(session);
-			rcu_read_unlock_bh();
-
-			return session;
-		}
-	rcu_read_unlock_bh();
+	rcu_read_lock();
+	session = rhashtable_lookup(&pn->l2tp_session_htable, &key,
+				    l2tp_session_htable_params);
+	if (session && refcount_inc_not_zero(&session->ref_count)) {
+		rcu_read_unlock();
+		return session;
+	}
+	rcu_read_unlock();
 
 	return NULL;
 }
@@ -269,20 +330,21 @@ EXPORT_SYMBOL_GPL(l2tp_tunnel_get_session);
 
 struct l2tp_session *l2tp_session_get(const struct net *net, u32 session_id)
 {
-	struct hlist_head *session_list;
+	struct l2tp_net *pn = l2tp_pernet(net);
 	struct l2tp_session *session;
+	struct rhlist_head *list, *tmp;
 
-	session_list = l2tp_session_id_hash_2(l2tp_pernet(net), session_id);
-
-	rcu_read_lock_bh();
-	hlist_for_each_entry_rcu(session, session_list, global_hlist)
-		if (session->session_id == session_id) {
-			l2tp_session_inc_refcount(session);
-			rcu_read_unlock_bh();
+	rcu_read_lock();
+	list = rhltable_lookup(&pn->l2tp_v3_session_htable, &session_id,
+			       l2tp_v3_session_htable_params);
+	rhl_for_each_entry_rcu(session, tmp, list, global_hnode) {
+		if (!refcount_inc_not_zero(&session->ref_count))
+			continue;
+		rcu_read_unlock();
 
-			return session;
-		}
-	rcu_read_unlock_bh();
+		return session;
+	}
+	rcu_read_unlock();
 
 	return NULL;
 }
@@ -290,18 +352,15 @@ EXPORT_SYMBOL_GPL(l2tp_session_get);
 
 struct l2tp_session *l2tp_session_get_nth(struct l2tp_tunnel *tunnel, int nth)
 {
-	int hash;
 	struct l2tp_session *session;
 	int count = 0;
 
 	rcu_read_lock_bh();
-	for (hash = 0; hash < L2TP_HASH_SIZE; hash++) {
-		hlist_for_each_entry_rcu(session, &tunnel->session_hlist[hash], hlist) {
-			if (++count > nth) {
-				l2tp_session_inc_refcount(session);
-				rcu_read_unlock_bh();
-				return session;
-			}
+	hlist_for_each_entry_rcu(session, &tunnel->session_list, hlist) {
+		if (++count > nth) {
+			l2tp_session_inc_refcount(session);
+			rcu_read_unlock_bh();
+			return session;
 		}
 	}
 
@@ -311,19 +370,23 @@ struct l2tp_session *l2tp_session_get_nth(struct l2tp_tunnel *tunnel, int nth)
 }
 EXPORT_SYMBOL_GPL(l2tp_session_get_nth);
 
-/* Lookup a session by interface name.
+/* Lookup an L2TPv3 session by interface name.
  * This is very inefficient but is only used by management interfaces.
  */
 struct l2tp_session *l2tp_session_get_by_ifname(const struct net *net,
 						const char *ifname)
 {
 	struct l2tp_net *pn = l2tp_pernet(net);
-	int hash;
+	unsigned long tunnel_id, tmp;
 	struct l2tp_session *session;
+	struct l2tp_tunnel *tunnel;
 
 	rcu_read_lock_bh();
-	for (hash = 0; hash < L2TP_HASH_SIZE_2; hash++) {
-		hlist_for_each_entry_rcu(session, &pn->l2tp_session_hlist[hash], global_hlist) {
+	idr_for_each_entry_ul(&pn->l2tp_tunnel_idr, tunnel, tmp, tunnel_id) {
+		if (!tunnel || tunnel->version != L2TP_HDR_VER_3)
+			continue;
+
+		hlist_for_each_entry_rcu(session, &tunnel->session_list, hlist) {
 			if (!strcmp(session->ifname, ifname)) {
 				l2tp_session_inc_refcount(session);
 				rcu_read_unlock_bh();
@@ -342,13 +405,30 @@ EXPORT_SYMBOL_GPL(l2tp_session_get_by_ifname);
 int l2tp_session_register(struct l2tp_session *session,
 			  struct l2tp_tunnel *tunnel)
 {
+	struct l2tp_net *pn = l2tp_pernet(tunnel->l2tp_net);
+	struct l2tp_session_key key = {
+		.tunnel_id = tunnel->tunnel_id,
+		.session_id = session->session_id,
+	};
 	struct l2tp_session *session_walk;
-	struct hlist_head *g_head;
-	struct hlist_head *head;
-	struct l2tp_net *pn;
+	struct rhlist_head *list, *tmp;
+	bool hashed = false;
+	unsigned int refs;
 	int err;
 
-	head = l2tp_session_id_hash(tunnel, session->session_id);
+	session->stats = alloc_percpu(struct l2tp_stats);
+	if (!session->stats)
+		return -ENOMEM;
+
+	/* The session shows up in the session tables one at a time, and the
+	 * second insertion may still fail. Lookups only take a reference
+	 * with refcount_inc_not_zero(), so park the caller's references
+	 * until the session is fully registered. A failed registration then
+	 * leaves no reference behind that could outlive the caller freeing
+	 * the session.
+	 */
+	refs = refcount_read(&session->ref_count);
+	refcount_set(&session->ref_count, 0);
 
 	spin_lock_bh(&tunnel->hlist_lock);
 	if (!tunnel->acpt_newsess) {
@@ -356,38 +436,66 @@ int l2tp_session_register(struct l2tp_session *session,
 		goto err_tlock;
 	}
 
-	hlist_for_each_entry(session_walk, head, hlist)
-		if (session_walk->session_id == session->session_id) {
-			err = -EEXIST;
-			goto err_tlock;
-		}
+	/* Sessions of a given tunnel are only added under its hlist_lock,
+	 * so the ID can't be taken between this check and the insertion.
+	 */
+	rcu_read_lock();
+	session_walk = rhashtable_lookup(&pn->l2tp_session_htable, &key,
+					 l2tp_session_htable_params);
+	rcu_read_unlock();
+	if (session_walk) {
+		err = -EEXIST;
+		goto err_tlock;
+	}
 
 	if (tunnel->version == L2TP_HDR_VER_3) {
-		pn = l2tp_pernet(tunnel->l2tp_net);
-		g_head = l2tp_session_id_hash_2(pn, session->session_id);
-
-		spin_lock_bh(&pn->l2tp_session_hlist_lock);
+		spin_lock_bh(&pn->l2tp_v3_session_htable_lock);
 
 		/* IP encap expects session IDs to be globally unique, while
 		 * UDP encap doesn't.
 		 */
-		hlist_for_each_entry(session_walk, g_head, global_hlist)
-			if (session_walk->session_id == session->session_id &&
-			    (session_walk->tunnel->encap == L2TP_ENCAPTYPE_IP ||
-			     tunnel->encap == L2TP_ENCAPTYPE_IP)) {
+		rcu_read_lock();
+		list = rhltable_lookup(&pn->l2tp_v3_session_htable,
+				       &session->session_id,
+				       l2tp_v3_session_htable_params);
+		rhl_for_each_entry_rcu(session_walk, tmp, list, global_hnode)
+			if (session_walk->tunnel->encap == L2TP_ENCAPTYPE_IP ||
+			    tunnel->encap == L2TP_ENCAPTYPE_IP) {
+				rcu_read_unlock();
 				err = -EEXIST;
 				goto err_tlock_pnlock;
 			}
+		rcu_read_unlock();
+
+		err = rhashtable_insert_fast(&pn->l2tp_session_htable,
+					     &session->hnode,
+					     l2tp_session_htable_params);
+		if (err)
+			goto err_tlock_pnlock;
+		hashed = true;
+
+		err = rhltable_insert(&pn->l2tp_v3_session_htable,
+				      &session->global_hnode,
+				      l2tp_v3_session_htable_params);
+		if (err) {
+			rhashtable_remove_fast(&pn->l2tp_session_htable,
+					       &session->hnode,
+					       l2tp_session_htable_params);
+			goto err_tlock_pnlock;
+		}
 
-		l2tp_tunnel_inc_refcount(tunnel);
-		hlist_add_head_rcu(&session->global_hlist, g_head);
-
-		spin_unlock_bh(&pn->l2tp_session_hlist_lock);
+		spin_unlock_bh(&pn->l2tp_v3_session_htable_lock);
 	} else {
-		l2tp_tunnel_inc_refcount(tunnel);
+		err = rhashtable_insert_fast(&pn->l2tp_session_htable,
+					     &session->hnode,
+					     l2tp_session_htable_params);
+		if (err)
+			goto err_tlock;
 	}
 
-	hlist_add_head_rcu(&session->hlist, head);
+	l2tp_tunnel_inc_refcount(tunnel);
+	refcount_set(&session->ref_count, refs);
+	hlist_add_head_rcu(&session->hlist, &tunnel->session_list);
 	spin_unlock_bh(&tunnel->hlist_lock);
 
 	trace_register_session(session);
@@ -395,10 +503,21 @@ int l2tp_session_register(struct l2tp_session *session,
 	return 0;
 
 err_tlock_pnlock:
-	spin_unlock_bh(&pn->l2tp_session_hlist_lock);
+	spin_unlock_bh(&pn->l2tp_v3_session_htable_lock);
 err_tlock:
 	spin_unlock_bh(&tunnel->hlist_lock);
 
+	/* Lookups that found the session in the table before it was removed
+	 * again can't have taken a reference, but may still be reading it.
+	 * Let them finish before the caller frees it.
+	 */
+	if (hashed)
+		synchronize_rcu();
+
+	refcount_set(&session->ref_count, refs);
+	free_percpu(session->stats);
+	session->stats = NULL;
+
 	return err;
 }
 EXPORT_SYMBOL_GPL(l2tp_session_register);
@@ -420,7 +539,7 @@ static void l2tp_recv_queue_skb(struct l2tp_session *session, struct sk_buff *sk
 	skb_queue_walk_safe(&session->reorder_q, skbp, tmp) {
 		if (L2TP_SKB_CB(skbp)->ns > ns) {
 			__skb_queue_before(&session->reorder_q, skbp, skb);
-			atomic_long_inc(&session->stats.rx_oos_packets);
+			this_cpu_inc(session->stats->rx_oos_packets);
 			goto out;
 		}
 	}
@@ -443,10 +562,10 @@ static void l2tp_recv_dequeue_skb(struct l2tp_session *session, struct sk_buff *
 	 */
 	skb_orphan(skb);
 
-	atomic_long_inc(&tunnel->stats.rx_packets);
-	atomic_long_add(length, &tunnel->stats.rx_bytes);
-	atomic_long_inc(&session->stats.rx_packets);
-	atomic_long_add(length, &session->stats.rx_bytes);
+	this_cpu_inc(tunnel->stats->rx_packets);
+	this_cpu_add(tunnel->stats->rx_bytes, length);
+	this_cpu_inc(session->stats->rx_packets);
+	this_cpu_add(session->stats->rx_bytes, length);
 
 	if (L2TP_SKB_CB(skb)->has_seq) {
 		/* Bump our Nr */
@@ -481,8 +600,8 @@ static void l2tp_recv_dequeue(struct l2tp_session *session)
 
 		/* If the packet has been pending on the queue for too long, discard it */
 		if (time_after(jiffies, cb->expires)) {
-			atomic_long_inc(&session->stats.rx_seq_discards);
-			atomic_long_inc(&session->stats.rx_errors);
+			this_cpu_inc(session->stats->rx_seq_discards);
+			this_cpu_inc(session->stats->rx_errors);
 			trace_session_pkt_expired(session, cb->ns);
 			session->reorder_skip = 1;
 			__skb_unlink(skb, &session->reorder_q);
@@ -569,7 +688,7 @@ static int l2tp_recv_data_seq(struct l2tp_session *session, struct sk_buff *skb)
 			session->reorder_skip = 1;
 		}
 		if (!session->reorder_skip) {
-			atomic_long_inc(&session->stats.rx_seq_discards);
+			this_cpu_inc(session->stats->rx_seq_discards);
 			trace_session_pkt_oos(session, cb->ns);
 			goto discard;
 		}
@@ -655,7 +774,7 @@ void l2tp_recv_common(struct l2tp_session *session, struct sk_buff *skb,
 			pr_debug_ratelimited("%s: cookie mismatch (%u/%u). Discarding.\n",
 					     tunnel->name, tunnel->tunnel_id,
 					     session->session_id);
-			atomic_long_inc(&session->stats.rx_cookie_discards);
+			this_cpu_inc(session->stats->rx_cookie_discards);
 			goto discard;
 		}
 		ptr += session->peer_cookie_len;
@@ -707,7 +826,7 @@ void l2tp_recv_common(struct l2tp_session *session, struct sk_buff *skb,
 		if (session->recv_seq) {
 			pr_debug_ratelimited("%s: recv data has no seq numbers when required. Discarding.\n",
 					     session->name);
-			atomic_long_inc(&session->stats.rx_seq_discards);
+			this_cpu_inc(session->stats->rx_seq_discards);
 			goto discard;
 		}
 
@@ -723,7 +842,7 @@ void l2tp_recv_common(struct l2tp_session *session, struct sk_buff *skb,
 		} else if (session->send_seq) {
 			pr_debug_ratelimited("%s: recv data has no seq numbers when required. Discarding.\n",
 					     session->name);
-			atomic_long_inc(&session->stats.rx_seq_discards);
+			this_cpu_inc(session->stats->rx_seq_discards);
 			goto discard;
 		}
 	}
@@ -773,7 +892,7 @@ void l2tp_recv_common(struct l2tp_session *session, struct sk_buff *skb,
 	return;
 
 discard:
-	atomic_long_inc(&session->stats.rx_errors);
+	this_cpu_inc(session->stats->rx_errors);
 	kfree_skb(skb);
 }
 EXPORT_SYMBOL_GPL(l2tp_recv_common);
@@ -785,7 +904,7 @@ static void l2tp_session_queue_purge(struct l2tp_session *session)
 	struct sk_buff *skb = NULL;
 
 	while ((skb = skb_dequeue(&session->reorder_q))) {
-		atomic_long_inc(&session->stats.rx_errors);
+		this_cpu_inc(session->stats->rx_errors);
 		kfree_skb(skb);
 	}
 }
@@ -883,7 +1002,7 @@ static int l2tp_udp_recv_core(struct l2tp_tunnel *tunnel, struct sk_buff *skb)
 	return 0;
 
 invalid:
-	atomic_long_inc(&tunnel->stats.rx_invalid);
+	this_cpu_inc(tunnel->stats->rx_invalid);
 
 pass:
 	/* Put UDP header back */
@@ -1119,13 +1238,13 @@ int l2tp_xmit_skb(struct l2tp_session *session, struct sk_buff *skb)
 
 	ret = l2tp_xmit_core(session, skb, &len);
 	if (ret == NET_XMIT_SUCCESS) {
-		atomic_long_inc(&session->tunnel->stats.tx_packets);
-		atomic_long_add(len, &session->tunnel->stats.tx_bytes);
-		atomic_long_inc(&session->stats.tx_packets);
-		atomic_long_add(len, &session->stats.tx_bytes);
+		this_cpu_inc(session->tunnel->stats->tx_packets);
+		this_cpu_add(session->tunnel->stats->tx_bytes, len);
+		this_cpu_inc(session->stats->tx_packets);
+		this_cpu_add(session->stats->tx_bytes, len);
 	} else {
-		atomic_long_inc(&session->tunnel->stats.tx_errors);
-		atomic_long_inc(&session->stats.tx_errors);
+		this_cpu_inc(session->tunnel->stats->tx_errors);
+		this_cpu_inc(session->stats->tx_errors);
 	}
 	return ret;
 }
@@ -1135,6 +1254,14 @@ EXPORT_SYMBOL_GPL(l2tp_xmit_skb);
  * Tinnel and session create/destroy.
  *****************************************************************************/
 
+static void l2tp_tunnel_free_rcu(struct rcu_head *head)
+{
+	struct l2tp_tunnel *tunnel = container_of(head, struct l2tp_tunnel, rcu);
+
+	free_percpu(tunnel->stats);
+	kfree(tunnel);
+}
+
 /* Tunnel socket destruct hook.
  * The tunnel context is deleted only when all session sockets have been
  * closed.
@@ -1168,7 +1295,7 @@ static void l2tp_tunnel_destruct(struct sock *sk)
 	if (sk->sk_destruct)
 		(*sk->sk_destruct)(sk);
 
-	kfree_rcu(tunnel, rcu);
+	call_rcu(&tunnel->rcu, l2tp_tunnel_free_rcu);
 end:
 	return;
 }
@@ -1180,19 +1307,25 @@ static void l2tp_session_unhash(struct l2tp_session *session)
 
 	/* Remove the session from core hashes */
 	if (tunnel) {
-		/* Remove from the per-tunnel hash */
+		struct l2tp_net *pn = l2tp_pernet(tunnel->l2tp_net);
+
+		/* Remove from the per-tunnel list */
 		spin_lock_bh(&tunnel->hlist_lock);
 		hlist_del_init_rcu(&session->hlist);
 		spin_unlock_bh(&tunnel->hlist_lock);
 
-		/* For L2TPv3 we have a per-net hash: remove from there, too */
-		if (tunnel->version != L2TP_HDR_VER_2) {
-			struct l2tp_net *pn = l2tp_pernet(tunnel->l2tp_net);
+		/* Removing a session that isn't (or no longer) hashed is a
+		 * no-op, so this is safe for sessions which failed to
+		 * register and when called a second time.
+		 */
+		rhashtable_remove_fast(&pn->l2tp_session_htable, &session->hnode,
+				       l2tp_session_htable_params);
 
-			spin_lock_bh(&pn->l2tp_session_hlist_lock);
-			hlist_del_init_rcu(&session->global_hlist);
-			spin_unlock_bh(&pn->l2tp_session_hlist_lock);
-		}
+		/* For L2TPv3 we have a per-net hash: remove from there, too */
+		if (tunnel->version != L2TP_HDR_VER_2)
+			rhltable_remove(&pn->l2tp_v3_session_htable,
+					&session->global_hnode,
+					l2tp_v3_session_htable_params);
 
 		synchronize_rcu();
 	}
@@ -1203,26 +1336,22 @@ static void l2tp_session_unhash(struct l2tp_session *session)
 static void l2tp_tunnel_closeall(struct l2tp_tunnel *tunnel)
 {
 	struct l2tp_session *session;
-	int hash;
 
 	spin_lock_bh(&tunnel->hlist_lock);
 	tunnel->acpt_newsess = false;
-	for (hash = 0; hash < L2TP_HASH_SIZE; hash++) {
 again:
-		hlist_for_each_entry_rcu(session, &tunnel->session_hlist[hash], hlist) {
-			hlist_del_init_rcu(&session->hlist);
-
-			spin_unlock_bh(&tunnel->hlist_lock);
-			l2tp_session_delete(session);
-			spin_lock_bh(&tunnel->hlist_lock);
-
-			/* Now restart from the beginning of this hash
-			 * chain.  We always remove a session from the
-			 * list so we are guaranteed to make forward
-			 * progress.
-			 */
-			goto again;
-		}
+	hlist_for_each_entry_rcu(session, &tunnel->session_list, hlist) {
+		hlist_del_init_rcu(&session->hlist);
+
+		spin_unlock_bh(&tunnel->hlist_lock);
+		l2tp_session_delete(session);
+		spin_lock_bh(&tunnel->hlist_lock);
+
+		/* Now restart from the beginning of the list. We
+		 * always remove a session from the list so we are
+		 * guaranteed to make forward progress.
+		 */
+		goto again;
 	}
 	spin_unlock_bh(&tunnel->hlist_lock);
 }
@@ -1420,6 +1549,7 @@ int l2tp_tunnel_create(int fd, int version, u32 tunnel_id, u32 peer_tunnel_id,
 	sprintf(&tunnel->name[0], "tunl %u", tunnel_id);
 	spin_lock_init(&tunnel->hlist_lock);
 	tunnel->acpt_newsess = true;
+	INIT_HLIST_HEAD(&tunnel->session_list);
 
 	tunnel->encap = encap;
 
@@ -1471,12 +1601,18 @@ int l2tp_tunnel_register(struct l2tp_tunnel *tunnel, struct net *net,
 	struct sock *sk;
 	int ret;
 
+	tunnel->stats = alloc_percpu(struct l2tp_stats);
+	if (!tunnel->stats)
+		return -ENOMEM;
+
 	spin_lock_bh(&pn->l2tp_tunnel_idr_lock);
 	ret = idr_alloc_u32(&pn->l2tp_tunnel_idr, NULL, &tunnel_id, tunnel_id,
 			    GFP_ATOMIC);
 	spin_unlock_bh(&pn->l2tp_tunnel_idr_lock);
-	if (ret)
-		return ret == -ENOSPC ? -EEXIST : ret;
+	if (ret) {
+		ret = ret == -ENOSPC ? -EEXIST : ret;
+		goto err_free_stats;
+	}
 
 	if (tunnel->fd < 0) {
 		ret = l2tp_tunnel_sock_create(net, tunnel->tunnel_id,
@@ -1540,6 +1676,9 @@ int l2tp_tunnel_register(struct l2tp_tunnel *tunnel, struct net *net,
 		sockfd_put(sock);
 err:
 	l2tp_tunnel_remove(net, tunnel);
+err_free_stats:
+	free_percpu(tunnel->stats);
+	tunnel->stats = NULL;
 	return ret;
 }
 EXPORT_SYMBOL_GPL(l2tp_tunnel_register);
@@ -1618,7 +1757,6 @@ struct l2tp_session *l2tp_session_create(int priv_size, struct l2tp_tunnel *tunn
 		skb_queue_head_init(&session->reorder_q);
 
 		INIT_HLIST_NODE(&session->hlist);
-		INIT_HLIST_NODE(&session->global_hlist);
 
 		if (cfg) {
 			session->pwtype = cfg->pw_type;
@@ -1651,15 +1789,24 @@ EXPORT_SYMBOL_GPL(l2tp_session_create);
 static __net_init int l2tp_init_net(struct net *net)
 {
 	struct l2tp_net *pn = net_generic(net, l2tp_net_id);
-	int hash;
+	int err;
+
+	err = rhashtable_init(&pn->l2tp_session_htable,
+			      &l2tp_session_htable_params);
+	if (err)
+		return err;
+
+	err = rhltable_init(&pn->l2tp_v3_session_htable,
+			    &l2tp_v3_session_htable_params);
+	if (err) {
+		rhashtable_destroy(&pn->l2tp_session_htable);
+		return err;
+	}
 
 	idr_init(&pn->l2tp_tunnel_idr);
 	spin_lock_init(&pn->l2tp_tunnel_idr_lock);
 
-	for (hash = 0; hash < L2TP_HASH_SIZE_2; hash++)
-		INIT_HLIST_HEAD(&pn->l2tp_session_hlist[hash]);
-
-	spin_lock_init(&pn->l2tp_session_hlist_lock);
+	spin_lock_init(&pn->l2tp_v3_session_htable_lock);
 
 	return 0;
 }
@@ -1669,7 +1816,6 @@ static __net_exit void l2tp_exit_net(struct net *net)
 	struct l2tp_net *pn = l2tp_pernet(net);
 	struct l2tp_tunnel *tunnel = NULL;
 	unsigned long tunnel_id, tmp;
-	int hash;
 
 	rcu_read_lock_bh();
 	idr_for_each_entry_ul(&pn->l2tp_tunnel_idr, tunnel, tmp, tunnel_id) {
@@ -1682,8 +1828,10 @@ static __net_exit void l2tp_exit_net(struct net *net)
 		flush_workqueue(l2tp_wq);
 	rcu_barrier();
 
-	for (hash = 0; hash < L2TP_HASH_SIZE_2; hash++)
-		WARN_ON_ONCE(!hlist_empty(&pn->l2tp_session_hlist[hash]));
+	WARN_ON_ONCE(atomic_read(&pn->l2tp_session_htable.nelems));
+	WARN_ON_ONCE(atomic_read(&pn->l2tp_v3_session_htable.ht.nelems));
+	rhltable_destroy(&pn->l2tp_v3_session_htable);
+	rhashtable_destroy(&pn->l2tp_session_htable);
 	idr_destroy(&pn->l2tp_tunnel_idr);
 }
 
@@ -1719,6 +1867,7 @@ static int __init l2tp_init(void)
 static void __exit l2tp_exit(void)
 {
 	unregister_pernet_device(&l2tp_net_ops);
+	rcu_barrier(); /* Wait for completion of call_rcu()'s */
 	if (l2tp_wq) {
 		destroy_workqueue(l2tp_wq);
 		l2tp_wq = NULL;
@@ -4,6 +4,7 @@
  * Copyright (c) 2008,2009 Katalix Systems Ltd
  */
 #include <linux/refcount.h>
+#include <linux/rhashtable-types.h>
 
 #ifndef _L2TP_CORE_H_
 #define _L2TP_CORE_H_
@@ -19,27 +20,22 @@
 #define L2TP_TUNNEL_MAGIC	0x42114DDA
 #define L2TP_SESSION_MAGIC	0x0C04EB7D
 
-/* Per tunnel session hash table size */
-#define L2TP_HASH_BITS	4
-#define L2TP_HASH_SIZE	BIT(L2TP_HASH_BITS)
-
-/* System-wide session hash table size */
-#define L2TP_HASH_BITS_2	8
-#define L2TP_HASH_SIZE_2	BIT(L2TP_HASH_BITS_2)
-
 struct sk_buff;
 
+/* IO statistics. Tunnels and sessions keep one instance per CPU, updated with
+ * this_cpu_inc()/this_cpu_add(); l2tp_stats_fold() sums them for reporting.
+ */
 struct l2tp_stats {
-	atomic_long_t		tx_packets;
-	atomic_long_t		tx_bytes;
-	atomic_long_t		tx_errors;
-	atomic_long_t		rx_packets;
-	atomic_long_t		rx_bytes;
-	atomic_long_t		rx_seq_discards;
-	atomic_long_t		rx_oos_packets;
-	atomic_long_t		rx_errors;
-	atomic_long_t		rx_cookie_discards;
-	atomic_long_t		rx_invalid;
+	unsigned long		tx_packets;
+	unsigned long		tx_bytes;
+	unsigned long		tx_errors;
+	unsigned long		rx_packets;
+	unsigned long		rx_bytes;
+	unsigned long		rx_seq_discards;
+	unsigned long		rx_oos_packets;
+	unsigned long		rx_errors;
+	unsigned long		rx_cookie_discards;
+	unsigned long		rx_invalid;
 };
 
 struct l2tp_tunnel;
@@ -63,8 +59,9 @@ struct l2tp_session_cfg {
 
 /* Represents a session (pseudowire) instance.
  * Tracks runtime state including cookies, dataplane packet sequencing, and IO statistics.
- * Is linked into a per-tunnel session hashlist; and in the case of an L2TPv3 session into
- * an additional per-net ("global") hashlist.
+ * Is linked into its tunnel's session list and into a per-net session table keyed by
+ * tunnel and session ID; and in the case of an L2TPv3 session into an additional
+ * per-net ("global") table keyed by session ID only.
  */
 #define L2TP_SESSION_NAME_MAX 32
 struct l2tp_session {
@@ -88,7 +85,8 @@ struct l2tp_session {
 	u32			nr_oos;		/* NR of last OOS packet */
 	int			nr_oos_count;	/* for OOS recovery */
 	int			nr_oos_count_max;
-	struct hlist_node	hlist;		/* hash list node */
+	struct hlist_node	hlist;		/* node on tunnel's session_list */
+	struct rhash_head	hnode;		/* per-net session table node */
 	refcount_t		ref_count;
 
 	char			name[L2TP_SESSION_NAME_MAX]; /* for logging */
@@ -101,8 +99,8 @@ struct l2tp_session {
 	int			reorder_timeout; /* configured reorder timeout (in jiffies) */
 	int			reorder_skip;	/* set if skip to next nr */
 	enum l2tp_pwtype	pwtype;
-	struct l2tp_stats	stats;
-	struct hlist_node	global_hlist;	/* global hash list node */
+	struct l2tp_stats __percpu *stats;	/* allocated on registration */
+	struct rhlist_head	global_hnode;	/* per-net L2TPv3 session table node */
 
 	/* Session receive handler for data packets.
 	 * Each pseudowire implementation should implement this callback in order to
@@ -150,7 +148,7 @@ struct l2tp_tunnel_cfg {
 /* Represents a tunnel instance.
  * Tracks runtime state including IO statistics.
  * Holds the tunnel socket (either passed from userspace or directly created by the kernel).
- * Maintains a hashlist of sessions belonging to the tunnel instance.
+ * Maintains a list of sessions belonging to the tunnel instance.
  * Is linked into a per-net list of tunnels.
  */
 #define L2TP_TUNNEL_NAME_MAX 20
@@ -160,19 +158,20 @@ struct l2tp_tunnel {
 	unsigned long		dead;
 
 	struct rcu_head rcu;
-	spinlock_t		hlist_lock;	/* write-protection for session_hlist */
+	spinlock_t		hlist_lock;	/* write-protection for session_list */
 	bool			acpt_newsess;	/* indicates whether this tunnel accepts
 						 * new sessions. Protected by hlist_lock.
 						 */
-	struct hlist_head	session_hlist[L2TP_HASH_SIZE];
-						/* hashed list of sessions, hashed by id */
+	struct hlist_head	session_list;	/* sessions of this tunnel, for walks;
+						 * lookups use the per-net tables
+						 */
 	u32			tunnel_id;
 	u32			peer_tunnel_id;
 	int			version;	/* 2=>L2TPv2, 3=>L2TPv3 */
 
 	char			name[L2TP_TUNNEL_NAME_MAX]; /* for logging */
 	enum l2tp_encap_type	encap;
-	struct l2tp_stats	stats;
+	struct l2tp_stats __percpu *stats;	/* allocated on registration */
 
 	struct list_head	list;		/* list node on per-namespace list of tunnels */
 	struct net		*l2tp_net;	/* the net we belong to */
@@ -218,6 +217,9 @@ void l2tp_tunnel_dec_refcount(struct l2tp_tunnel *tunnel);
 void l2tp_session_inc_refcount(struct l2tp_session *session);
 void l2tp_session_dec_refcount(struct l2tp_session *session);
 
+/* Sum the per-CPU statistics of a tunnel or session into @dest. */
+void l2tp_stats_fold(struct l2tp_stats *dest, const struct l2tp_stats __percpu *stats);
+
 /* Tunnel and session lookup.
  * These functions take a reference on the instances they return, so
  * the caller must ensure that the reference is dropped appropriately.
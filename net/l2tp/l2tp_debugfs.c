@@ -122,18 +122,16 @@ static void l2tp_dfs_seq_tunnel_show(struct seq_file *m, void *v)
 {
 	struct l2tp_tunnel *tunnel = v;
 	struct l2tp_session *session;
+	struct l2tp_stats stats;
 	int session_count = 0;
-	int hash;
 
 	rcu_read_lock_bh();
-	for (hash = 0; hash < L2TP_HASH_SIZE; hash++) {
-		hlist_for_each_entry_rcu(session, &tunnel->session_hlist[hash], hlist) {
-			/* Session ID of zero is a dummy/reserved value used by pppol2tp */
-			if (session->session_id == 0)
-				continue;
+	hlist_for_each_entry_rcu(session, &tunnel->session_list, hlist) {
+		/* Session ID of zero is a dummy/reserved value used by pppol2tp */
+		if (session->session_id == 0)
+			continue;
 
-			session_count++;
-		}
+		session_count++;
 	}
 	rcu_read_unlock_bh();
 
@@ -164,19 +162,21 @@ static void l2tp_dfs_seq_tunnel_show(struct seq_file *m, void *v)
 	seq_printf(m, " %d sessions, refcnt %d/%d\n", session_count,
 		   tunnel->sock ? refcount_read(&tunnel->sock->sk_refcnt) : 0,
 		   refcount_read(&tunnel->ref_count));
-	seq_printf(m, " %08x rx %ld/%ld/%ld rx %ld/%ld/%ld\n",
+	l2tp_stats_fold(&stats, tunnel->stats);
+	seq_printf(m, " %08x rx %lu/%lu/%lu rx %lu/%lu/%lu\n",
 		   0,
-		   atomic_long_read(&tunnel->stats.tx_packets),
-		   atomic_long_read(&tunnel->stats.tx_bytes),
-		   atomic_long_read(&tunnel->stats.tx_errors),
-		   atomic_long_read(&tunnel->stats.rx_packets),
-		   atomic_long_read(&tunnel->stats.rx_bytes),
-		   atomic_long_read(&tunnel->stats.rx_errors));
+		   stats.tx_packets,
+		   stats.tx_bytes,
+		   stats.tx_errors,
+		   stats.rx_packets,
+		   stats.rx_bytes,
+		   stats.rx_errors);
 }
 
 static void l2tp_dfs_seq_session_show(struct seq_file *m, void *v)
 {
 	struct l2tp_session *session = v;
+	struct l2tp_stats stats;
 
 	seq_printf(m, "  SESSION %u, peer %u, %s\n", session->session_id,
 		   session->peer_session_id,
@@ -215,14 +215,15 @@ static void l2tp_dfs_seq_session_show(struct seq_file *m, void *v)
 		seq_puts(m, "\n");
 	}
 
-	seq_printf(m, "   %u/%u tx %ld/%ld/%ld rx %ld/%ld/%ld\n",
+	l2tp_stats_fold(&stats, session->stats);
+	seq_printf(m, "   %u/%u tx %lu/%lu/%lu rx %lu/%lu/%lu\n",
 		   session->nr, session->ns,
-		   atomic_long_read(&session->stats.tx_packets),
-		   atomic_long_read(&session->stats.tx_bytes),
-		   atomic_long_read(&session->stats.tx_errors),
-		   atomic_long_read(&session->stats.rx_packets),
-		   atomic_long_read(&session->stats.rx_bytes),
-		   atomic_long_read(&session->stats.rx_errors));
+		   stats.tx_packets,
+		   stats.tx_bytes,
+		   stats.tx_errors,
+		   stats.rx_packets,
+		   stats.rx_bytes,
+		   stats.rx_errors);
 
 	if (session->show)
 		session->show(m, session);
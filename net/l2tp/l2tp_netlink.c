@@ -384,6 +384,7 @@ static int l2tp_nl_tunnel_send_addr(struct sk_buff *skb, struct l2tp_tunnel *tun
 static int l2tp_nl_tunnel_send(struct sk_buff *skb, u32 portid, u32 seq, int flags,
 			       struct l2tp_tunnel *tunnel, u8 cmd)
 {
+	struct l2tp_stats stats;
 	void *hdr;
 	struct nlattr *nest;
 
@@ -402,35 +403,36 @@ static int l2tp_nl_tunnel_send(struct sk_buff *skb, u32 portid, u32 seq, int fla
 	if (!nest)
 		goto nla_put_failure;
 
+	l2tp_stats_fold(&stats, tunnel->stats);
 	if (nla_put_u64_64bit(skb, L2TP_ATTR_TX_PACKETS,
-			      atomic_long_read(&tunnel->stats.tx_packets),
+			      stats.tx_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_TX_BYTES,
-			      atomic_long_read(&tunnel->stats.tx_bytes),
+			      stats.tx_bytes,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_TX_ERRORS,
-			      atomic_long_read(&tunnel->stats.tx_errors),
+			      stats.tx_errors,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_PACKETS,
-			      atomic_long_read(&tunnel->stats.rx_packets),
+			      stats.rx_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_BYTES,
-			      atomic_long_read(&tunnel->stats.rx_bytes),
+			      stats.rx_bytes,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_SEQ_DISCARDS,
-			      atomic_long_read(&tunnel->stats.rx_seq_discards),
+			      stats.rx_seq_discards,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_COOKIE_DISCARDS,
-			      atomic_long_read(&tunnel->stats.rx_cookie_discards),
+			      stats.rx_cookie_discards,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_OOS_PACKETS,
-			      atomic_long_read(&tunnel->stats.rx_oos_packets),
+			      stats.rx_oos_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_ERRORS,
-			      atomic_long_read(&tunnel->stats.rx_errors),
+			      stats.rx_errors,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_INVALID,
-			      atomic_long_read(&tunnel->stats.rx_invalid),
+			      stats.rx_invalid,
 			      L2TP_ATTR_STATS_PAD))
 		goto nla_put_failure;
 	nla_nest_end(skb, nest);
@@ -715,6 +717,7 @@ static int l2tp_nl_session_send(struct sk_buff *skb, u32 portid, u32 seq, int fl
 	void *hdr;
 	struct nlattr *nest;
 	struct l2tp_tunnel *tunnel = session->tunnel;
+	struct l2tp_stats stats;
 
 	hdr = genlmsg_put(skb, portid, seq, &l2tp_nl_family, flags, cmd);
 	if (!hdr)
@@ -748,35 +751,36 @@ static int l2tp_nl_session_send(struct sk_buff *skb, u32 portid, u32 seq, int fl
 	if (!nest)
 		goto nla_put_failure;
 
+	l2tp_stats_fold(&stats, session->stats);
 	if (nla_put_u64_64bit(skb, L2TP_ATTR_TX_PACKETS,
-			      atomic_long_read(&session->stats.tx_packets),
+			      stats.tx_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_TX_BYTES,
-			      atomic_long_read(&session->stats.tx_bytes),
+			      stats.tx_bytes,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_TX_ERRORS,
-			      atomic_long_read(&session->stats.tx_errors),
+			      stats.tx_errors,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_PACKETS,
-			      atomic_long_read(&session->stats.rx_packets),
+			      stats.rx_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_BYTES,
-			      atomic_long_read(&session->stats.rx_bytes),
+			      stats.rx_bytes,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_SEQ_DISCARDS,
-			      atomic_long_read(&session->stats.rx_seq_discards),
+			      stats.rx_seq_discards,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_COOKIE_DISCARDS,
-			      atomic_long_read(&session->stats.rx_cookie_discards),
+			      stats.rx_cookie_discards,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_OOS_PACKETS,
-			      atomic_long_read(&session->stats.rx_oos_packets),
+			      stats.rx_oos_packets,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_ERRORS,
-			      atomic_long_read(&session->stats.rx_errors),
+			      stats.rx_errors,
 			      L2TP_ATTR_STATS_PAD) ||
 	    nla_put_u64_64bit(skb, L2TP_ATTR_RX_INVALID,
-			      atomic_long_read(&session->stats.rx_invalid),
+			      stats.rx_invalid,
 			      L2TP_ATTR_STATS_PAD))
 		goto nla_put_failure;
 	nla_nest_end(skb, nest);
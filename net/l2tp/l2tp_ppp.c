@@ -240,7 +240,7 @@ static void pppol2tp_recv(struct l2tp_session *session, struct sk_buff *skb, int
 		ppp_input(&po->chan, skb);
 	} else {
 		if (sock_queue_rcv_skb(sk, skb) < 0) {
-			atomic_long_inc(&session->stats.rx_errors);
+			this_cpu_inc(session->stats->rx_errors);
 			kfree_skb(skb);
 		}
 	}
@@ -1018,18 +1018,21 @@ static int pppol2tp_getname(struct socket *sock, struct sockaddr *uaddr,
  ****************************************************************************/
 
 static void pppol2tp_copy_stats(struct pppol2tp_ioc_stats *dest,
-				const struct l2tp_stats *stats)
+				const struct l2tp_stats __percpu *pcpu_stats)
 {
+	struct l2tp_stats stats;
+
 	memset(dest, 0, sizeof(*dest));
 
-	dest->tx_packets = atomic_long_read(&stats->tx_packets);
-	dest->tx_bytes = atomic_long_read(&stats->tx_bytes);
-	dest->tx_errors = atomic_long_read(&stats->tx_errors);
-	dest->rx_packets = atomic_long_read(&stats->rx_packets);
-	dest->rx_bytes = atomic_long_read(&stats->rx_bytes);
-	dest->rx_seq_discards = atomic_long_read(&stats->rx_seq_discards);
-	dest->rx_oos_packets = atomic_long_read(&stats->rx_oos_packets);
-	dest->rx_errors = atomic_long_read(&stats->rx_errors);
+	l2tp_stats_fold(&stats, pcpu_stats);
+	dest->tx_packets = stats.tx_packets;
+	dest->tx_bytes = stats.tx_bytes;
+	dest->tx_errors = stats.tx_errors;
+	dest->rx_packets = stats.rx_packets;
+	dest->rx_bytes = stats.rx_bytes;
+	dest->rx_seq_discards = stats.rx_seq_discards;
+	dest->rx_oos_packets = stats.rx_oos_packets;
+	dest->rx_errors = stats.rx_errors;
 }
 
 static int pppol2tp_tunnel_copy_stats(struct pppol2tp_ioc_stats *stats,
@@ -1038,7 +1041,7 @@ static int pppol2tp_tunnel_copy_stats(struct pppol2tp_ioc_stats *stats,
 	struct l2tp_session *session;
 
 	if (!stats->session_id) {
-		pppol2tp_copy_stats(stats, &tunnel->stats);
+		pppol2tp_copy_stats(stats, tunnel->stats);
 		return 0;
 	}
 
@@ -1054,7 +1057,7 @@ static int pppol2tp_tunnel_copy_stats(struct pppol2tp_ioc_stats *stats,
 		return -EBADR;
 	}
 
-	pppol2tp_copy_stats(stats, &session->stats);
+	pppol2tp_copy_stats(stats, session->stats);
 	l2tp_session_dec_refcount(session);
 
 	return 0;
@@ -1126,7 +1129,7 @@ static int pppol2tp_ioctl(struct socket *sock, unsigned int cmd,
 
 			stats.session_id = session_id;
 		} else {
-			pppol2tp_copy_stats(&stats, &session->stats);
+			pppol2tp_copy_stats(&stats, session->stats);
 			stats.session_id = session->session_id;
 		}
 		stats.tunnel_id = session->tunnel->tunnel_id;
@@ -1508,25 +1511,28 @@ static void pppol2tp_seq_stop(struct seq_file *p, void *v)
 static void pppol2tp_seq_tunnel_show(struct seq_file *m, void *v)
 {
 	struct l2tp_tunnel *tunnel = v;
+	struct l2tp_stats stats;
 
 	seq_printf(m, "\nTUNNEL '%s', %c %d\n",
 		   tunnel->name,
 		   (tunnel == tunnel->sock->sk_user_data) ? 'Y' : 'N',
 		   refcount_read(&tunnel->ref_count) - 1);
-	seq_printf(m, " %08x %ld/%ld/%ld %ld/%ld/%ld\n",
+	l2tp_stats_fold(&stats, tunnel->stats);
+	seq_printf(m, " %08x %lu/%lu/%lu %lu/%lu/%lu\n",
 		   0,
-		   atomic_long_read(&tunnel->stats.tx_packets),
-		   atomic_long_read(&tunnel->stats.tx_bytes),
-		   atomic_long_read(&tunnel->stats.tx_errors),
-		   atomic_long_read(&tunnel->stats.rx_packets),
-		   atomic_long_read(&tunnel->stats.rx_bytes),
-		   atomic_long_read(&tunnel->stats.rx_errors));
+		   stats.tx_packets,
+		   stats.tx_bytes,
+		   stats.tx_errors,
+		   stats.rx_packets,
+		   stats.rx_bytes,
+		   stats.rx_errors);
 }
 
 static void pppol2tp_seq_session_show(struct seq_file *m, void *v)
 {
 	struct l2tp_session *session = v;
 	struct l2tp_tunnel *tunnel = session->tunnel;
+	struct l2tp_stats stats;
 	unsigned char state;
 	char user_data_ok;
 	struct sock *sk;
@@ -1562,14 +1568,15 @@ static void pppol2tp_seq_session_show(struct seq_file *m, void *v)
 		   session->lns_mode ? "LNS" : "LAC",
 		   0,
 		   jiffies_to_msecs(session->reorder_timeout));
-	seq_printf(m, "   %u/%u %ld/%ld/%ld %ld/%ld/%ld\n",
+	l2tp_stats_fold(&stats, session->stats);
+	seq_printf(m, "   %u/%u %lu/%lu/%lu %lu/%lu/%lu\n",
 		   session->nr, session->ns,
-		   atomic_long_read(&session->stats.tx_packets),
-		   atomic_long_read(&session->stats.tx_bytes),
-		   atomic_long_read(&session->stats.tx_errors),
-		   atomic_long_read(&session->stats.rx_packets),
-		   atomic_long_read(&session->stats.rx_bytes),
-		   atomic_long_read(&session->stats.rx_errors));
+		   stats.tx_packets,
+		   stats.tx_bytes,
+		   stats.tx_errors,
+		   stats.rx_packets,
+		   stats.rx_bytes,
+		   stats.rx_errors);
 
 	if (sk) {
 		struct pppox_sock *po = pppox_sk(sk);
@@ -2437,6 +2437,12 @@ void ieee80211_txq_remove_vlan(struct ieee80211_local *local,
 void ieee80211_fill_txq_stats(struct cfg80211_txq_stats *txqstats,
 			      struct txq_info *txqi);
 void ieee80211_wake_txqs(struct tasklet_struct *t);
+/* driver API, belongs next to ieee80211_tx_dequeue() in <net/mac80211.h> */
+int ieee80211_tx_dequeue_bulk(struct ieee80211_hw *hw,
+			      struct ieee80211_txq *txq,
+			      struct sk_buff_head *skbs,
+			      unsigned int max_frames,
+			      unsigned int max_bytes);
 void ieee80211_send_auth(struct ieee80211_sub_if_data *sdata,
 			 u16 transaction, u16 auth_alg, u16 status,
 			 const u8 *extra, size_t extra_len, const u8 *bssid,
@@ -2617,21 +2617,23 @@ static void ieee80211_deliver_skb_to_local_stack(struct sk_buff *skb,
 }
 
 /*
- * requires that rx->skb is a frame with ethernet header
+ * Account @packets MSDUs of @bytes total length received on rx->sdata,
+ * taking each stats seqcount only once for the whole batch.
  */
-static void
-ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
+static void ieee80211_rx_account_msdus(struct ieee80211_rx_data *rx,
+				       unsigned int packets,
+				       unsigned int bytes)
 {
-	struct ieee80211_sub_if_data *sdata = rx->sdata;
-	struct net_device *dev = sdata->dev;
-	struct sk_buff *skb, *xmit_skb;
-	struct ethhdr *ehdr = (struct ethhdr *) rx->skb->data;
-	struct sta_info *dsta;
+	struct pcpu_sw_netstats *tstats;
 
-	skb = rx->skb;
-	xmit_skb = NULL;
+	if (!packets)
+		return;
 
-	dev_sw_netstats_rx_add(dev, skb->len);
+	tstats = this_cpu_ptr(rx->sdata->dev->tstats);
+	u64_stats_update_begin(&tstats->syncp);
+	u64_stats_add(&tstats->rx_bytes, bytes);
+	u64_stats_add(&tstats->rx_packets, packets);
+	u64_stats_update_end(&tstats->syncp);
 
 	if (rx->sta) {
 		/* The seqno index has the same property as needed
@@ -2640,9 +2642,26 @@ ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
 		 * frame, so count MSDUs.
 		 */
 		u64_stats_update_begin(&rx->link_sta->rx_stats.syncp);
-		rx->link_sta->rx_stats.msdu[rx->seqno_idx]++;
+		rx->link_sta->rx_stats.msdu[rx->seqno_idx] += packets;
 		u64_stats_update_end(&rx->link_sta->rx_stats.syncp);
 	}
+}
+
+/*
+ * requires that rx->skb is a frame with ethernet header,
+ * statistics must have been accounted by the caller
+ */
+static void
+__ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
+{
+	struct ieee80211_sub_if_data *sdata = rx->sdata;
+	struct net_device *dev = sdata->dev;
+	struct sk_buff *skb, *xmit_skb;
+	struct ethhdr *ehdr = (struct ethhdr *) rx->skb->data;
+	struct sta_info *dsta;
+
+	skb = rx->skb;
+	xmit_skb = NULL;
 
 	if ((sdata->vif.type == NL80211_IFTYPE_AP ||
 	     sdata->vif.type == NL80211_IFTYPE_AP_VLAN) &&
@@ -2720,6 +2739,16 @@ ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
 	}
 }
 
+/*
+ * requires that rx->skb is a frame with ethernet header
+ */
+static void
+ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
+{
+	ieee80211_rx_account_msdus(rx, 1, rx->skb->len);
+	__ieee80211_deliver_skb(rx);
+}
+
 #ifdef CONFIG_MAC80211_MESH
 static bool
 ieee80211_rx_mesh_fast_forward(struct ieee80211_sub_if_data *sdata,
@@ -2980,6 +3009,7 @@ __ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx, u8 data_offset)
 	ieee80211_rx_result res;
 	struct ethhdr ethhdr;
 	const u8 *check_da = ethhdr.h_dest, *check_sa = ethhdr.h_source;
+	unsigned int packets = 0, bytes = 0;
 
 	if (unlikely(ieee80211_has_a4(hdr->frame_control))) {
 		check_da = NULL;
@@ -3053,13 +3083,20 @@ __ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx, u8 data_offset)
 		if (!ieee80211_frame_allowed(rx, fc))
 			goto free;
 
-		ieee80211_deliver_skb(rx);
+		/* the subframes all belong to the same MPDU, so the
+		 * statistics are accounted once for the whole burst
+		 */
+		packets++;
+		bytes += rx->skb->len;
+		__ieee80211_deliver_skb(rx);
 		continue;
 
 free:
 		dev_kfree_skb(rx->skb);
 	}
 
+	ieee80211_rx_account_msdus(rx, packets, bytes);
+
 	return RX_QUEUED;
 }
 
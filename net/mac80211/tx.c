@@ -3787,8 +3787,15 @@ static bool ieee80211_xmit_fast(struct ieee80211_sub_if_data *sdata,
 	return true;
 }
 
-struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
-				     struct ieee80211_txq *txq)
+/*
+ * Dequeue and finish the TX processing of one frame from @txq. The
+ * expected airtime of the frame is stored in its tx_time_est and added
+ * to @airtime, charging it to the station's pending airtime is left to
+ * the caller so that it can be done once for a batch of frames.
+ */
+static struct sk_buff *__ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+					      struct ieee80211_txq *txq,
+					      u32 *airtime)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct txq_info *txqi = container_of(txq, struct txq_info, txq);
@@ -3804,11 +3811,6 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	unsigned long flags;
 	bool q_stopped;
 
-	WARN_ON_ONCE(softirq_count() == 0);
-
-	if (!ieee80211_txq_airtime_check(hw, txq))
-		return NULL;
-
 begin:
 	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
 	q_stopped = local->queue_stop_reasons[q];
@@ -3968,17 +3970,12 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	if (tx.sta &&
 	    wiphy_ext_feature_isset(local->hw.wiphy, NL80211_EXT_FEATURE_AQL)) {
 		bool ampdu = txq->ac != IEEE80211_AC_VO;
-		u32 airtime;
-
-		airtime = ieee80211_calc_expected_tx_airtime(hw, vif, txq->sta,
-							     skb->len, ampdu);
-		if (airtime) {
-			airtime = ieee80211_info_set_tx_time_est(info, airtime);
-			ieee80211_sta_update_pending_airtime(local, tx.sta,
-							     txq->ac,
-							     airtime,
-							     false);
-		}
+		u32 est;
+
+		est = ieee80211_calc_expected_tx_airtime(hw, vif, txq->sta,
+							 skb->len, ampdu);
+		if (est)
+			*airtime += ieee80211_info_set_tx_time_est(info, est);
 	}
 
 	return skb;
@@ -3988,6 +3985,37 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 
 	return skb;
 }
+
+static void ieee80211_txq_charge_airtime(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq,
+					 u32 airtime)
+{
+	struct sta_info *sta;
+
+	if (!airtime || !txq->sta)
+		return;
+
+	sta = container_of(txq->sta, struct sta_info, sta);
+	ieee80211_sta_update_pending_airtime(hw_to_local(hw), sta, txq->ac,
+					     airtime, false);
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq)
+{
+	struct sk_buff *skb;
+	u32 airtime = 0;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	if (!ieee80211_txq_airtime_check(hw, txq))
+		return NULL;
+
+	skb = __ieee80211_tx_dequeue(hw, txq, &airtime);
+	ieee80211_txq_charge_airtime(hw, txq, airtime);
+
+	return skb;
+}
 EXPORT_SYMBOL(ieee80211_tx_dequeue);
 
 static inline s32 ieee80211_sta_deficit(struct sta_info *sta, u8 ac)
@@ -4127,11 +4155,16 @@ EXPORT_SYMBOL(__ieee80211_schedule_txq);
 
 DEFINE_STATIC_KEY_FALSE(aql_disable);
 
-bool ieee80211_txq_airtime_check(struct ieee80211_hw *hw,
-				 struct ieee80211_txq *txq)
+/* @uncharged is the airtime of frames already dequeued from @txq but not
+ * yet added to the pending airtime, see ieee80211_tx_dequeue_bulk()
+ */
+static bool __ieee80211_txq_airtime_check(struct ieee80211_hw *hw,
+					  struct ieee80211_txq *txq,
+					  u32 uncharged)
 {
 	struct sta_info *sta;
 	struct ieee80211_local *local = hw_to_local(hw);
+	s32 pending;
 
 	if (!wiphy_ext_feature_isset(local->hw.wiphy, NL80211_EXT_FEATURE_AQL))
 		return true;
@@ -4146,20 +4179,77 @@ bool ieee80211_txq_airtime_check(struct ieee80211_hw *hw,
 		return true;
 
 	sta = container_of(txq->sta, struct sta_info, sta);
-	if (atomic_read(&sta->airtime[txq->ac].aql_tx_pending) <
-	    sta->airtime[txq->ac].aql_limit_low)
+	pending = atomic_read(&sta->airtime[txq->ac].aql_tx_pending) +
+		  uncharged;
+	if (pending < sta->airtime[txq->ac].aql_limit_low)
 		return true;
 
-	if (atomic_read(&local->aql_total_pending_airtime) <
+	if (atomic_read(&local->aql_total_pending_airtime) + uncharged <
 	    local->aql_threshold &&
-	    atomic_read(&sta->airtime[txq->ac].aql_tx_pending) <
-	    sta->airtime[txq->ac].aql_limit_high)
+	    pending < sta->airtime[txq->ac].aql_limit_high)
 		return true;
 
 	return false;
 }
+
+bool ieee80211_txq_airtime_check(struct ieee80211_hw *hw,
+				 struct ieee80211_txq *txq)
+{
+	return __ieee80211_txq_airtime_check(hw, txq, 0);
+}
 EXPORT_SYMBOL(ieee80211_txq_airtime_check);
 
+/**
+ * ieee80211_tx_dequeue_bulk - dequeue a batch of frames from a txq
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @txq: pointer obtained from station or virtual interface, or from
+ *	ieee80211_next_txq()
+ * @skbs: list the dequeued frames are appended to
+ * @max_frames: maximum number of frames to dequeue
+ * @max_bytes: stop once at least this many bytes have been dequeued,
+ *	0 for no byte limit
+ *
+ * Like ieee80211_tx_dequeue(), but meant for drivers that build an
+ * aggregate from several frames of the same txq: the expected airtime of
+ * all frames is charged to the station with a single pending airtime
+ * update. The AQL check is still done before each frame, counting the
+ * airtime of the frames already in the batch, so a batch stops where
+ * repeated ieee80211_tx_dequeue() calls would.
+ *
+ * Return: the number of frames appended to @skbs.
+ */
+int ieee80211_tx_dequeue_bulk(struct ieee80211_hw *hw,
+			      struct ieee80211_txq *txq,
+			      struct sk_buff_head *skbs,
+			      unsigned int max_frames,
+			      unsigned int max_bytes)
+{
+	unsigned int bytes = 0;
+	struct sk_buff *skb;
+	u32 airtime = 0;
+	int n = 0;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	while (n < max_frames && (!max_bytes || bytes < max_bytes)) {
+		if (!__ieee80211_txq_airtime_check(hw, txq, airtime))
+			break;
+
+		skb = __ieee80211_tx_dequeue(hw, txq, &airtime);
+		if (!skb)
+			break;
+
+		bytes += skb->len;
+		__skb_queue_tail(skbs, skb);
+		n++;
+	}
+
+	ieee80211_txq_charge_airtime(hw, txq, airtime);
+
+	return n;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue_bulk);
+
 static bool
 ieee80211_txq_schedule_airtime_check(struct ieee80211_local *local, u8 ac)
 {
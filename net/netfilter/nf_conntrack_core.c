@@ -69,6 +69,8 @@ struct conntrack_gc_work {
 	u32			avg_timeout;
 	u32			count;
 	u32			start_time;
+	u32			tuples;
+	u32			hsize;
 	bool			exiting;
 	bool			early_drop;
 };
@@ -99,6 +101,12 @@ static DEFINE_MUTEX(nf_conntrack_mutex);
 #define MIN_CHAINLEN	50u
 #define MAX_CHAINLEN	(80u - MIN_CHAINLEN)
 
+/* Per-CPU batch of entry count updates. The count is never summed exactly on
+ * allocation, so nf_conntrack_max can be exceeded by up to this many entries
+ * per CPU.
+ */
+#define NF_CT_COUNT_BATCH	32
+
 static struct conntrack_gc_work conntrack_gc_work;
 
 void nf_conntrack_lock(spinlock_t *lock) __acquires(lock)
@@ -202,6 +210,34 @@ static void nf_conntrack_all_unlock(void)
 unsigned int nf_conntrack_htable_size __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_htable_size);
 
+/* While the table is being resized, nf_conntrack_hash buckets below the
+ * cursor have been moved to nf_conntrack_hash_next. Changes are made with all
+ * bucket locks held, and published by nf_conntrack_generation.
+ */
+static struct hlist_nulls_head *nf_conntrack_hash_next __read_mostly;
+static unsigned int nf_conntrack_htable_size_next __read_mostly;
+static unsigned int nf_conntrack_resize_cursor __read_mostly;
+
+/* Buckets moved per step while holding all bucket locks */
+#define NF_CT_RESIZE_STEP	256u
+
+/* Automatic resizing aims at an average of two tuples per bucket, as the
+ * default table size does, and kicks in at four times this load when
+ * growing, or a quarter of it when shrinking. The table is not shrunk below
+ * an eighth of nf_conntrack_max, so that a burst of new connections can't
+ * build chains long enough to fail insertions before the next resize.
+ */
+#define NF_CT_HASH_LOAD		2u
+#define NF_CT_HASH_AUTO_MIN	1024u
+#define NF_CT_HASH_AUTO_MAX	(1u << 22)
+
+u8 nf_conntrack_hash_auto __read_mostly = 1;
+struct nf_conntrack_resize_stats nf_conntrack_resize_stats;
+
+static unsigned int nf_conntrack_hash_target;
+static void nf_conntrack_hash_resize_work(struct work_struct *work);
+static DECLARE_WORK(nf_conntrack_hash_work, nf_conntrack_hash_resize_work);
+
 unsigned int nf_conntrack_max __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_max);
 seqcount_spinlock_t nf_conntrack_generation __read_mostly;
@@ -225,9 +261,102 @@ static u32 hash_conntrack_raw(const struct nf_conntrack_tuple *tuple,
 			&key);
 }
 
+/* Bucket index for @hash, past the end of nf_conntrack_hash if the bucket
+ * has already been moved to the table being resized to. Stable with any
+ * bucket lock held, see nf_conntrack_double_lock().
+ */
 static u32 scale_hash(u32 hash)
 {
-	return reciprocal_scale(hash, nf_conntrack_htable_size);
+	u32 bucket = reciprocal_scale(hash, nf_conntrack_htable_size);
+
+	if (unlikely(bucket < nf_conntrack_resize_cursor))
+		return nf_conntrack_htable_size +
+		       reciprocal_scale(hash, nf_conntrack_htable_size_next);
+
+	return bucket;
+}
+
+/* Hash slot for an index returned by scale_hash() */
+static struct hlist_nulls_head *nf_ct_hslot(u32 bucket)
+{
+	if (unlikely(bucket >= nf_conntrack_htable_size))
+		return &nf_conntrack_hash_next[bucket - nf_conntrack_htable_size];
+
+	return &nf_conntrack_hash[bucket];
+}
+
+/* Like nf_conntrack_get_ht(), also fetching the table being resized to, if
+ * any. Lockless lookups failing on both tables need to be restarted if the
+ * returned sequence changed meanwhile, as entries might have been moved.
+ */
+static unsigned int nf_conntrack_get_ht_next(struct hlist_nulls_head **hash,
+					     unsigned int *hsize,
+					     struct hlist_nulls_head **next,
+					     unsigned int *nsize)
+{
+	unsigned int sequence;
+
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		*hash = nf_conntrack_hash;
+		*hsize = nf_conntrack_htable_size;
+		*next = nf_conntrack_hash_next;
+		*nsize = nf_conntrack_htable_size_next;
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	return sequence;
+}
+
+/* Bucket for an index spanning both tables returned by
+ * nf_conntrack_get_ht_next(): indexes past the end of @hash refer to @next.
+ * Returns NULL past the end of both.
+ */
+static struct hlist_nulls_head *
+nf_ct_walk_hslot(struct hlist_nulls_head *hash, unsigned int hsize,
+		 struct hlist_nulls_head *next, unsigned int nsize,
+		 unsigned int bucket)
+{
+	if (bucket < hsize)
+		return &hash[bucket];
+	if (next && bucket - hsize < nsize)
+		return &next[bucket - hsize];
+
+	return NULL;
+}
+
+/* Request automatic resize to @hashsize buckets, provided that, once clamped
+ * to the allowed range, it still grows or shrinks the table as @grow says.
+ */
+static void nf_conntrack_hash_auto_resize(unsigned int hashsize, bool grow)
+{
+	unsigned int cur = READ_ONCE(nf_conntrack_htable_size);
+	unsigned int ct_max = READ_ONCE(nf_conntrack_max);
+	unsigned int min_size, max_size;
+
+	if (!READ_ONCE(nf_conntrack_hash_auto) ||
+	    READ_ONCE(nf_conntrack_hash_next))
+		return;
+
+	max_size = max(min(ct_max ?: NF_CT_HASH_AUTO_MAX, NF_CT_HASH_AUTO_MAX),
+		       cur);
+	min_size = max(NF_CT_HASH_AUTO_MIN, ct_max / 8);
+
+	hashsize = min(max(hashsize, min_size), max_size);
+	if (grow ? hashsize <= cur : hashsize >= cur)
+		return;
+
+	WRITE_ONCE(nf_conntrack_hash_target, hashsize);
+	queue_work(system_unbound_wq, &nf_conntrack_hash_work);
+}
+
+/* Check load after a full gc scan, which found @tuples in @hsize buckets */
+static void nf_conntrack_hash_check_load(unsigned int tuples,
+					 unsigned int hsize)
+{
+	if (tuples / (NF_CT_HASH_LOAD * 2) > hsize)
+		nf_conntrack_hash_auto_resize(tuples / NF_CT_HASH_LOAD, true);
+	else if (tuples < hsize / 4 * NF_CT_HASH_LOAD)
+		nf_conntrack_hash_auto_resize(tuples / NF_CT_HASH_LOAD, false);
 }
 
 static u32 __hash_conntrack(const struct net *net,
@@ -735,13 +864,16 @@ static struct nf_conntrack_tuple_hash *
 ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 		      const struct nf_conntrack_tuple *tuple, u32 hash)
 {
+	struct hlist_nulls_head *ct_hash, *next_hash;
+	unsigned int bucket, hsize, next_size;
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
-	unsigned int bucket, hsize;
+	unsigned int sequence;
 
 begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
+	sequence = nf_conntrack_get_ht_next(&ct_hash, &hsize,
+					    &next_hash, &next_size);
+walk:
 	bucket = reciprocal_scale(hash, hsize);
 
 	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
@@ -766,6 +898,19 @@ ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 		goto begin;
 	}
 
+	/* Table is being resized: entry might have been moved already */
+	if (unlikely(next_hash)) {
+		ct_hash = next_hash;
+		hsize = next_size;
+		next_hash = NULL;
+		goto walk;
+	}
+
+	if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
+		NF_CT_STAT_INC_ATOMIC(net, search_restart);
+		goto begin;
+	}
+
 	return NULL;
 }
 
@@ -831,9 +976,9 @@ static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 				       unsigned int reply_hash)
 {
 	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
-			   &nf_conntrack_hash[hash]);
+			   nf_ct_hslot(hash));
 	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
-			   &nf_conntrack_hash[reply_hash]);
+			   nf_ct_hslot(reply_hash));
 }
 
 static bool nf_ct_ext_valid_pre(const struct nf_ct_ext *ext)
@@ -895,7 +1040,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	max_chainlen = MIN_CHAINLEN + get_random_u32_below(MAX_CHAINLEN);
 
 	/* See if there's one in the list already, including reverse */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode) {
+	hlist_nulls_for_each_entry(h, n, nf_ct_hslot(hash), hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
@@ -906,7 +1051,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 
 	chainlen = 0;
 
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode) {
+	hlist_nulls_for_each_entry(h, n, nf_ct_hslot(reply_hash), hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
@@ -937,6 +1082,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	return 0;
 chaintoolong:
 	NF_CT_STAT_INC(net, chaintoolong);
+	nf_conntrack_hash_auto_resize(nf_conntrack_htable_size * 2, true);
 	err = -ENOSPC;
 out:
 	nf_conntrack_double_unlock(hash, reply_hash);
@@ -1048,7 +1194,7 @@ static int nf_ct_resolve_clash_harder(struct sk_buff *skb, u32 repl_idx)
 	/* Reply direction must never result in a clash, unless both origin
 	 * and reply tuples are identical.
 	 */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[repl_idx], hnnode) {
+	hlist_nulls_for_each_entry(h, n, nf_ct_hslot(repl_idx), hnnode) {
 		if (nf_ct_key_equal(h,
 				    &loser_ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
@@ -1074,7 +1220,7 @@ static int nf_ct_resolve_clash_harder(struct sk_buff *skb, u32 repl_idx)
 	hlist_nulls_add_fake(&loser_ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
 
 	hlist_nulls_add_head_rcu(&loser_ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
-				 &nf_conntrack_hash[repl_idx]);
+				 nf_ct_hslot(repl_idx));
 
 	NF_CT_STAT_INC(net, clash_resolve);
 	return NF_ACCEPT;
@@ -1222,7 +1368,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	/* See if there's one in the list already, including reverse:
 	   NAT could have grabbed it without realizing, since we're
 	   not in the hash.  If there is, we lost race. */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode) {
+	hlist_nulls_for_each_entry(h, n, nf_ct_hslot(hash), hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
@@ -1231,7 +1377,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	}
 
 	chainlen = 0;
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode) {
+	hlist_nulls_for_each_entry(h, n, nf_ct_hslot(reply_hash), hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
@@ -1239,6 +1385,8 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 chaintoolong:
 			NF_CT_STAT_INC(net, chaintoolong);
 			NF_CT_STAT_INC(net, insert_failed);
+			nf_conntrack_hash_auto_resize(nf_conntrack_htable_size * 2,
+						      true);
 			ret = NF_DROP;
 			goto dying;
 		}
@@ -1295,18 +1443,23 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 {
 	struct net *net = nf_ct_net(ignored_conntrack);
 	const struct nf_conntrack_zone *zone;
+	struct hlist_nulls_head *ct_hash, *next_hash;
+	unsigned int hash, hsize, next_size;
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
-	unsigned int hash, hsize;
+	unsigned int sequence, raw_hash;
 	struct hlist_nulls_node *n;
 	struct nf_conn *ct;
 
 	zone = nf_ct_zone(ignored_conntrack);
+	raw_hash = hash_conntrack_raw(tuple, nf_ct_zone_id(zone, IP_CT_DIR_REPLY),
+				      net);
 
 	rcu_read_lock();
  begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
-	hash = __hash_conntrack(net, tuple, nf_ct_zone_id(zone, IP_CT_DIR_REPLY), hsize);
+	sequence = nf_conntrack_get_ht_next(&ct_hash, &hsize,
+					    &next_hash, &next_size);
+ walk:
+	hash = reciprocal_scale(raw_hash, hsize);
 
 	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash], hnnode) {
 		ct = nf_ct_tuplehash_to_ctrack(h);
@@ -1348,6 +1501,18 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 		goto begin;
 	}
 
+	if (unlikely(next_hash)) {
+		ct_hash = next_hash;
+		hsize = next_size;
+		next_hash = NULL;
+		goto walk;
+	}
+
+	if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
+		NF_CT_STAT_INC_ATOMIC(net, search_restart);
+		goto begin;
+	}
+
 	rcu_read_unlock();
 
 	return 0;
@@ -1403,22 +1568,61 @@ static unsigned int early_drop_list(struct net *net,
 	return drops;
 }
 
+/* Evict from buckets recorded by gc_worker(), starting from a random one */
+static bool early_drop_candidates(struct net *net)
+{
+	struct nf_conntrack_net_priv *cpriv = nf_ct_pernet_priv(net);
+	unsigned int i, slot, bucket, hsize, next_size, drops;
+	struct hlist_nulls_head *ct_hash, *next_hash, *head;
+
+	slot = get_random_u32_below(NF_CT_DROP_CANDIDATES);
+
+	for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
+		slot = (slot + 1) % NF_CT_DROP_CANDIDATES;
+		bucket = READ_ONCE(cpriv->drop_cand[slot]);
+		if (!bucket--)
+			continue;
+
+		rcu_read_lock();
+		nf_conntrack_get_ht_next(&ct_hash, &hsize, &next_hash, &next_size);
+		head = nf_ct_walk_hslot(ct_hash, hsize, next_hash, next_size,
+					bucket);
+		drops = head ? early_drop_list(net, head) : 0;
+		rcu_read_unlock();
+
+		if (drops) {
+			NF_CT_STAT_ADD_ATOMIC(net, early_drop, drops);
+			return true;
+		}
+
+		/* stale: nothing left to evict there */
+		WRITE_ONCE(cpriv->drop_cand[slot], 0);
+	}
+
+	return false;
+}
+
 static noinline int early_drop(struct net *net, unsigned int hash)
 {
 	unsigned int i, bucket;
 
+	if (early_drop_candidates(net))
+		return true;
+
 	for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
-		struct hlist_nulls_head *ct_hash;
-		unsigned int hsize, drops;
+		struct hlist_nulls_head *ct_hash, *next_hash;
+		unsigned int hsize, next_size, drops;
 
 		rcu_read_lock();
-		nf_conntrack_get_ht(&ct_hash, &hsize);
-		if (!i)
-			bucket = reciprocal_scale(hash, hsize);
-		else
-			bucket = (bucket + 1) % hsize;
-
+		nf_conntrack_get_ht_next(&ct_hash, &hsize, &next_hash, &next_size);
+		bucket = (reciprocal_scale(hash, hsize) + i) % hsize;
 		drops = early_drop_list(net, &ct_hash[bucket]);
+
+		/* Table is being resized: entries might have been moved */
+		if (unlikely(next_hash)) {
+			bucket = (reciprocal_scale(hash, next_size) + i) % next_size;
+			drops += early_drop_list(net, &next_hash[bucket]);
+		}
 		rcu_read_unlock();
 
 		if (drops) {
@@ -1452,9 +1656,21 @@ static bool gc_worker_can_early_drop(const struct nf_conn *ct)
 	return false;
 }
 
+/* Record bucket as holding entries early_drop() can evict, so that it doesn't
+ * need to search for them when the table is full.
+ */
+static void gc_record_drop_candidate(const struct nf_conn *ct,
+				     unsigned int bucket)
+{
+	struct nf_conntrack_net_priv *cpriv = nf_ct_pernet_priv(nf_ct_net(ct));
+	unsigned int slot = cpriv->drop_fill++ % NF_CT_DROP_CANDIDATES;
+
+	WRITE_ONCE(cpriv->drop_cand[slot], bucket + 1);
+}
+
 static void gc_worker(struct work_struct *work)
 {
-	unsigned int i, hashsz, nf_conntrack_max95 = 0;
+	unsigned int i, hashsz, next_size, nf_conntrack_max95 = 0;
 	u32 end_time, start_time = nfct_time_stamp;
 	struct conntrack_gc_work *gc_work;
 	unsigned int expired_count = 0;
@@ -1472,6 +1688,10 @@ static void gc_worker(struct work_struct *work)
 		gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
 		gc_work->count = GC_SCAN_INITIAL_COUNT;
 		gc_work->start_time = start_time;
+		gc_work->tuples = 0;
+		/* Don't check the load if a resize is running already */
+		gc_work->hsize = READ_ONCE(nf_conntrack_hash_next) ? 0 :
+				 READ_ONCE(nf_conntrack_htable_size);
 	}
 
 	next_run = gc_work->avg_timeout;
@@ -1480,25 +1700,33 @@ static void gc_worker(struct work_struct *work)
 	end_time = start_time + GC_SCAN_MAX_DURATION;
 
 	do {
+		struct hlist_nulls_head *ct_hash, *next_hash, *head;
 		struct nf_conntrack_tuple_hash *h;
-		struct hlist_nulls_head *ct_hash;
+		bool drop_recorded = false;
 		struct hlist_nulls_node *n;
+		unsigned int tuples = 0;
 		struct nf_conn *tmp;
 
 		rcu_read_lock();
 
-		nf_conntrack_get_ht(&ct_hash, &hashsz);
-		if (i >= hashsz) {
+		/* While the table is being resized, buckets of the new table
+		 * follow the ones of the current table, as moved entries would
+		 * be missed otherwise.
+		 */
+		nf_conntrack_get_ht_next(&ct_hash, &hashsz, &next_hash, &next_size);
+		head = nf_ct_walk_hslot(ct_hash, hashsz, next_hash, next_size, i);
+		if (!head) {
 			rcu_read_unlock();
 			break;
 		}
 
-		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
-			struct nf_conntrack_net *cnet;
+		hlist_nulls_for_each_entry_rcu(h, n, head, hnnode) {
+			struct nf_conntrack_net_priv *cpriv;
 			struct net *net;
 			long expires;
 
 			tmp = nf_ct_tuplehash_to_ctrack(h);
+			tuples++;
 
 			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
 				nf_ct_offload_timeout(tmp);
@@ -1526,6 +1754,13 @@ static void gc_worker(struct work_struct *work)
 				continue;
 			}
 
+			if (!drop_recorded &&
+			    !test_bit(IPS_ASSURED_BIT, &tmp->status) &&
+			    !gc_worker_skip_ct(tmp)) {
+				gc_record_drop_candidate(tmp, i);
+				drop_recorded = true;
+			}
+
 			expires = clamp(nf_ct_expires(tmp), GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_CLAMP);
 			expires = (expires - (long)next_run) / ++count;
 			next_run += expires;
@@ -1534,8 +1769,9 @@ static void gc_worker(struct work_struct *work)
 				continue;
 
 			net = nf_ct_net(tmp);
-			cnet = nf_ct_pernet(net);
-			if (atomic_read(&cnet->count) < nf_conntrack_max95)
+			cpriv = nf_ct_pernet_priv(net);
+			if (percpu_counter_read_positive(&cpriv->count) <
+			    nf_conntrack_max95)
 				continue;
 
 			/* need to take reference to avoid possible races */
@@ -1566,6 +1802,14 @@ static void gc_worker(struct work_struct *work)
 		cond_resched();
 		i++;
 
+		/* Only count complete buckets: after an early exit on expired
+		 * entries, the scan resumes from the same bucket.
+		 */
+		gc_work->tuples += tuples;
+
+		if (next_hash)
+			hashsz += next_size;
+
 		delta_time = nfct_time_stamp - end_time;
 		if (delta_time > 0 && i < hashsz) {
 			gc_work->avg_timeout = next_run;
@@ -1578,6 +1822,10 @@ static void gc_worker(struct work_struct *work)
 
 	gc_work->next_bucket = 0;
 
+	/* Buckets moved by a resize during the scan might have been missed */
+	if (gc_work->hsize == hashsz && !READ_ONCE(nf_conntrack_hash_next))
+		nf_conntrack_hash_check_load(gc_work->tuples, hashsz);
+
 	next_run = clamp(next_run, GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_MAX);
 
 	delta_time = max_t(s32, nfct_time_stamp - gc_work->start_time, 1);
@@ -1609,18 +1857,23 @@ __nf_conntrack_alloc(struct net *net,
 		     const struct nf_conntrack_tuple *repl,
 		     gfp_t gfp, u32 hash)
 {
-	struct nf_conntrack_net *cnet = nf_ct_pernet(net);
-	unsigned int ct_count;
+	struct nf_conntrack_net_priv *cpriv = nf_ct_pernet_priv(net);
 	struct nf_conn *ct;
 
-	/* We don't want any race condition at early drop stage */
-	ct_count = atomic_inc_return(&cnet->count);
+	/* Only the approximate count is checked, so that allocations never
+	 * need to sum the per-CPU counts: the limit is enforced with a slack
+	 * of NF_CT_COUNT_BATCH entries per CPU.
+	 */
+	percpu_counter_add_batch(&cpriv->count, 1, NF_CT_COUNT_BATCH);
 
-	if (nf_conntrack_max && unlikely(ct_count > nf_conntrack_max)) {
+	if (nf_conntrack_max &&
+	    unlikely(percpu_counter_read(&cpriv->count) >
+		     (s64)nf_conntrack_max)) {
 		if (!early_drop(net, hash)) {
 			if (!conntrack_gc_work.early_drop)
 				conntrack_gc_work.early_drop = true;
-			atomic_dec(&cnet->count);
+			percpu_counter_add_batch(&cpriv->count, -1,
+						 NF_CT_COUNT_BATCH);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
 		}
@@ -1653,7 +1906,7 @@ __nf_conntrack_alloc(struct net *net,
 	refcount_set(&ct->ct_general.use, 0);
 	return ct;
 out:
-	atomic_dec(&cnet->count);
+	percpu_counter_add_batch(&cpriv->count, -1, NF_CT_COUNT_BATCH);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -1670,7 +1923,7 @@ EXPORT_SYMBOL_GPL(nf_conntrack_alloc);
 void nf_conntrack_free(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
-	struct nf_conntrack_net *cnet;
+	struct nf_conntrack_net_priv *cpriv;
 
 	/* A freed object has refcnt == 0, that's
 	 * the golden rule for SLAB_TYPESAFE_BY_RCU
@@ -1689,10 +1942,11 @@ void nf_conntrack_free(struct nf_conn *ct)
 
 	kfree(ct->ext);
 	kmem_cache_free(nf_conntrack_cachep, ct);
-	cnet = nf_ct_pernet(net);
+	cpriv = nf_ct_pernet_priv(net);
 
-	smp_mb__before_atomic();
-	atomic_dec(&cnet->count);
+	/* pairs with netns cleanup waiting for the count to drop to zero */
+	smp_mb();
+	percpu_counter_add_batch(&cpriv->count, -1, NF_CT_COUNT_BATCH);
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_free);
 
@@ -2427,11 +2681,10 @@ void nf_ct_iterate_cleanup_net(int (*iter)(struct nf_conn *i, void *data),
 			       const struct nf_ct_iter_data *iter_data)
 {
 	struct net *net = iter_data->net;
-	struct nf_conntrack_net *cnet = nf_ct_pernet(net);
 
 	might_sleep();
 
-	if (atomic_read(&cnet->count) == 0)
+	if (nf_conntrack_count(net) == 0)
 		return;
 
 	nf_ct_iterate_cleanup(iter, iter_data);
@@ -2457,9 +2710,7 @@ nf_ct_iterate_destroy(int (*iter)(struct nf_conn *i, void *data), void *data)
 
 	down_read(&net_rwsem);
 	for_each_net(net) {
-		struct nf_conntrack_net *cnet = nf_ct_pernet(net);
-
-		if (atomic_read(&cnet->count) == 0)
+		if (nf_conntrack_count(net) == 0)
 			continue;
 		nf_queue_nf_hook_drop(net);
 	}
@@ -2508,6 +2759,7 @@ void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_hook, NULL);
 	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	cancel_work_sync(&nf_conntrack_hash_work);
 	kvfree(nf_conntrack_hash);
 
 	nf_conntrack_proto_fini();
@@ -2544,11 +2796,9 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 i_see_dead_people:
 	busy = 0;
 	list_for_each_entry(net, net_exit_list, exit_list) {
-		struct nf_conntrack_net *cnet = nf_ct_pernet(net);
-
 		iter_data.net = net;
 		nf_ct_iterate_cleanup_net(kill_all, &iter_data);
-		if (atomic_read(&cnet->count) != 0)
+		if (nf_conntrack_count(net) != 0)
 			busy = 1;
 	}
 	if (busy) {
@@ -2559,6 +2809,7 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	list_for_each_entry(net, net_exit_list, exit_list) {
 		nf_conntrack_ecache_pernet_fini(net);
 		nf_conntrack_expect_pernet_fini(net);
+		percpu_counter_destroy(&nf_ct_pernet_priv(net)->count);
 		free_percpu(net->ct.stat);
 	}
 }
@@ -2584,14 +2835,38 @@ void *nf_ct_alloc_hashtable(unsigned int *sizep, int nulls)
 }
 EXPORT_SYMBOL_GPL(nf_ct_alloc_hashtable);
 
-int nf_conntrack_hash_resize(unsigned int hashsize)
+/* Move @from to @to buckets of nf_conntrack_hash to the new table */
+static void nf_conntrack_hash_move(unsigned int from, unsigned int to)
 {
-	int i, bucket;
-	unsigned int old_size;
-	struct hlist_nulls_head *hash, *old_hash;
 	struct nf_conntrack_tuple_hash *h;
+	unsigned int i, bucket;
 	struct nf_conn *ct;
 
+	for (i = from; i < to; i++) {
+		while (!hlist_nulls_empty(&nf_conntrack_hash[i])) {
+			unsigned int zone_id;
+
+			h = hlist_nulls_entry(nf_conntrack_hash[i].first,
+					      struct nf_conntrack_tuple_hash, hnnode);
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			hlist_nulls_del_rcu(&h->hnnode);
+
+			zone_id = nf_ct_zone_id(nf_ct_zone(ct), NF_CT_DIRECTION(h));
+			bucket = __hash_conntrack(nf_ct_net(ct), &h->tuple, zone_id,
+						  nf_conntrack_htable_size_next);
+			hlist_nulls_add_head_rcu(&h->hnnode,
+						 &nf_conntrack_hash_next[bucket]);
+			nf_conntrack_resize_stats.moved++;
+		}
+	}
+}
+
+int nf_conntrack_hash_resize(unsigned int hashsize)
+{
+	struct hlist_nulls_head *hash, *old_hash;
+	unsigned int i, end, old_size;
+	unsigned long start;
+
 	if (!hashsize)
 		return -EINVAL;
 
@@ -2607,40 +2882,64 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 		return 0;
 	}
 
+	start = jiffies;
+
+	/* From now on, lookups also search the new table, and bucket locks
+	 * are taken for, and entries added to, the new table once the bucket
+	 * they would have been in has been moved, see scale_hash().
+	 */
 	local_bh_disable();
 	nf_conntrack_all_lock();
 	write_seqcount_begin(&nf_conntrack_generation);
+	nf_conntrack_hash_next = hash;
+	nf_conntrack_htable_size_next = hashsize;
+	nf_conntrack_resize_cursor = 0;
+	write_seqcount_end(&nf_conntrack_generation);
+	nf_conntrack_all_unlock();
+	local_bh_enable();
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
+	/* Move a few buckets at a time, so that insertions and deletions are
+	 * only held off for short periods. Lockless lookups in parallel never
+	 * miss moved entries, as they restart if the cursor moved meanwhile.
 	 */
+	for (i = 0; i < old_size; i = end) {
+		end = min(i + NF_CT_RESIZE_STEP, old_size);
 
-	for (i = 0; i < nf_conntrack_htable_size; i++) {
-		while (!hlist_nulls_empty(&nf_conntrack_hash[i])) {
-			unsigned int zone_id;
-
-			h = hlist_nulls_entry(nf_conntrack_hash[i].first,
-					      struct nf_conntrack_tuple_hash, hnnode);
-			ct = nf_ct_tuplehash_to_ctrack(h);
-			hlist_nulls_del_rcu(&h->hnnode);
+		local_bh_disable();
+		nf_conntrack_all_lock();
+		nf_conntrack_hash_move(i, end);
+		write_seqcount_begin(&nf_conntrack_generation);
+		nf_conntrack_resize_cursor = end;
+		write_seqcount_end(&nf_conntrack_generation);
+		nf_conntrack_all_unlock();
+		local_bh_enable();
 
-			zone_id = nf_ct_zone_id(nf_ct_zone(ct), NF_CT_DIRECTION(h));
-			bucket = __hash_conntrack(nf_ct_net(ct),
-						  &h->tuple, zone_id, hashsize);
-			hlist_nulls_add_head_rcu(&h->hnnode, &hash[bucket]);
-		}
+		nf_conntrack_resize_stats.steps++;
+		cond_resched();
 	}
+
+	local_bh_disable();
+	nf_conntrack_all_lock();
+	write_seqcount_begin(&nf_conntrack_generation);
+
 	old_hash = nf_conntrack_hash;
 
 	nf_conntrack_hash = hash;
 	nf_conntrack_htable_size = hashsize;
+	nf_conntrack_hash_next = NULL;
+	nf_conntrack_htable_size_next = 0;
+	nf_conntrack_resize_cursor = 0;
 
 	write_seqcount_end(&nf_conntrack_generation);
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	if (hashsize > old_size)
+		nf_conntrack_resize_stats.grows++;
+	else
+		nf_conntrack_resize_stats.shrinks++;
+	nf_conntrack_resize_stats.last_msecs = jiffies_to_msecs(jiffies - start);
+
 	mutex_unlock(&nf_conntrack_mutex);
 
 	synchronize_net();
@@ -2648,6 +2947,21 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	return 0;
 }
 
+static void nf_conntrack_hash_resize_work(struct work_struct *work)
+{
+	unsigned int hashsize = READ_ONCE(nf_conntrack_hash_target);
+	unsigned int old_size = READ_ONCE(nf_conntrack_htable_size);
+
+	if (!READ_ONCE(nf_conntrack_hash_auto) ||
+	    nf_conntrack_hash_resize(hashsize) ||
+	    READ_ONCE(nf_conntrack_htable_size) == old_size)
+		return;
+
+	mutex_lock(&nf_conntrack_mutex);
+	nf_conntrack_resize_stats.auto_resizes++;
+	mutex_unlock(&nf_conntrack_mutex);
+}
+
 int nf_conntrack_set_hashsize(const char *val, const struct kernel_param *kp)
 {
 	unsigned int hashsize;
@@ -2781,16 +3095,20 @@ void nf_conntrack_init_end(void)
 
 int nf_conntrack_init_net(struct net *net)
 {
-	struct nf_conntrack_net *cnet = nf_ct_pernet(net);
+	struct nf_conntrack_net_priv *cpriv = nf_ct_pernet_priv(net);
 	int ret = -ENOMEM;
 
 	BUILD_BUG_ON(IP_CT_UNTRACKED == IP_CT_NUMBER);
 	BUILD_BUG_ON_NOT_POWER_OF_2(CONNTRACK_LOCKS);
-	atomic_set(&cnet->count, 0);
 
+	ret = percpu_counter_init(&cpriv->count, 0, GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	ret = -ENOMEM;
 	net->ct.stat = alloc_percpu(struct ip_conntrack_stat);
 	if (!net->ct.stat)
-		return ret;
+		goto err_stat;
 
 	ret = nf_conntrack_expect_pernet_init(net);
 	if (ret < 0)
@@ -2805,6 +3123,8 @@ int nf_conntrack_init_net(struct net *net)
 
 err_expect:
 	free_percpu(net->ct.stat);
+err_stat:
+	percpu_counter_destroy(&cpriv->count);
 	return ret;
 }
 
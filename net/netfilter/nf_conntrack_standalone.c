@@ -24,6 +24,8 @@
 #include <net/netfilter/nf_conntrack_timestamp.h>
 #include <linux/rculist_nulls.h>
 
+#include "nf_internals.h"
+
 static bool enable_hooks __read_mostly;
 MODULE_PARM_DESC(enable_hooks, "Always enable conntrack hooks");
 module_param(enable_hooks, bool, 0000);
@@ -465,6 +467,20 @@ static const struct seq_operations ct_cpu_seq_ops = {
 	.show	= ct_cpu_seq_show,
 };
 
+static int ct_resize_seq_show(struct seq_file *seq, void *v)
+{
+	const struct nf_conntrack_resize_stats *st = &nf_conntrack_resize_stats;
+
+	seq_printf(seq, "buckets: %u\n", READ_ONCE(nf_conntrack_htable_size));
+	seq_printf(seq, "grows: %u\n", READ_ONCE(st->grows));
+	seq_printf(seq, "shrinks: %u\n", READ_ONCE(st->shrinks));
+	seq_printf(seq, "auto_resizes: %u\n", READ_ONCE(st->auto_resizes));
+	seq_printf(seq, "steps: %u\n", READ_ONCE(st->steps));
+	seq_printf(seq, "moved: %lu\n", READ_ONCE(st->moved));
+	seq_printf(seq, "last_msecs: %u\n", READ_ONCE(st->last_msecs));
+	return 0;
+}
+
 static int nf_conntrack_standalone_init_proc(struct net *net)
 {
 	struct proc_dir_entry *pde;
@@ -485,8 +501,18 @@ static int nf_conntrack_standalone_init_proc(struct net *net)
 			&ct_cpu_seq_ops, sizeof(struct seq_net_private));
 	if (!pde)
 		goto out_stat_nf_conntrack;
+
+	/* hash table is global, resizes are only reported in init_net */
+	if (net_eq(net, &init_net)) {
+		pde = proc_create_single("nf_conntrack_resize", 0444,
+					 net->proc_net_stat, ct_resize_seq_show);
+		if (!pde)
+			goto out_stat_nf_conntrack_resize;
+	}
 	return 0;
 
+out_stat_nf_conntrack_resize:
+	remove_proc_entry("nf_conntrack", net->proc_net_stat);
 out_stat_nf_conntrack:
 	remove_proc_entry("nf_conntrack", net->proc_net);
 out_nf_conntrack:
@@ -495,6 +521,8 @@ static int nf_conntrack_standalone_init_proc(struct net *net)
 
 static void nf_conntrack_standalone_fini_proc(struct net *net)
 {
+	if (net_eq(net, &init_net))
+		remove_proc_entry("nf_conntrack_resize", net->proc_net_stat);
 	remove_proc_entry("nf_conntrack", net->proc_net_stat);
 	remove_proc_entry("nf_conntrack", net->proc_net);
 }
@@ -511,9 +539,9 @@ static void nf_conntrack_standalone_fini_proc(struct net *net)
 
 u32 nf_conntrack_count(const struct net *net)
 {
-	const struct nf_conntrack_net *cnet = nf_ct_pernet(net);
+	struct nf_conntrack_net_priv *cpriv = nf_ct_pernet_priv(net);
 
-	return atomic_read(&cnet->count);
+	return percpu_counter_sum_positive(&cpriv->count);
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_count);
 
@@ -544,12 +572,24 @@ nf_conntrack_hash_sysctl(struct ctl_table *table, int write,
 	return ret;
 }
 
+static int
+nf_conntrack_count_sysctl(struct ctl_table *table, int write,
+			  void *buffer, size_t *lenp, loff_t *ppos)
+{
+	unsigned int count = nf_conntrack_count(table->data);
+	struct ctl_table tmp = *table;
+
+	tmp.data = &count;
+	return proc_dointvec(&tmp, write, buffer, lenp, ppos);
+}
+
 static struct ctl_table_header *nf_ct_netfilter_header;
 
 enum nf_ct_sysctl_index {
 	NF_SYSCTL_CT_MAX,
 	NF_SYSCTL_CT_COUNT,
 	NF_SYSCTL_CT_BUCKETS,
+	NF_SYSCTL_CT_BUCKETS_AUTO,
 	NF_SYSCTL_CT_CHECKSUM,
 	NF_SYSCTL_CT_LOG_INVALID,
 	NF_SYSCTL_CT_EXPECT_MAX,
@@ -627,7 +667,7 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.procname	= "nf_conntrack_count",
 		.maxlen		= sizeof(int),
 		.mode		= 0444,
-		.proc_handler	= proc_dointvec,
+		.proc_handler	= nf_conntrack_count_sysctl,
 	},
 	[NF_SYSCTL_CT_BUCKETS] = {
 		.procname       = "nf_conntrack_buckets",
@@ -636,6 +676,15 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.mode           = 0644,
 		.proc_handler   = nf_conntrack_hash_sysctl,
 	},
+	[NF_SYSCTL_CT_BUCKETS_AUTO] = {
+		.procname	= "nf_conntrack_buckets_auto",
+		.data		= &nf_conntrack_hash_auto,
+		.maxlen		= sizeof(u8),
+		.mode		= 0644,
+		.proc_handler	= proc_dou8vec_minmax,
+		.extra1 	= SYSCTL_ZERO,
+		.extra2 	= SYSCTL_ONE,
+	},
 	[NF_SYSCTL_CT_CHECKSUM] = {
 		.procname	= "nf_conntrack_checksum",
 		.data		= &init_net.ct.sysctl_checksum,
@@ -1060,7 +1109,7 @@ static int nf_conntrack_standalone_init_sysctl(struct net *net)
 	if (!table)
 		return -ENOMEM;
 
-	table[NF_SYSCTL_CT_COUNT].data = &cnet->count;
+	table[NF_SYSCTL_CT_COUNT].data = net;
 	table[NF_SYSCTL_CT_CHECKSUM].data = &net->ct.sysctl_checksum;
 	table[NF_SYSCTL_CT_LOG_INVALID].data = &net->ct.sysctl_log_invalid;
 	table[NF_SYSCTL_CT_ACCT].data = &net->ct.sysctl_acct;
@@ -1089,6 +1138,7 @@ static int nf_conntrack_standalone_init_sysctl(struct net *net)
 		table[NF_SYSCTL_CT_MAX].mode = 0444;
 		table[NF_SYSCTL_CT_EXPECT_MAX].mode = 0444;
 		table[NF_SYSCTL_CT_BUCKETS].mode = 0444;
+		table[NF_SYSCTL_CT_BUCKETS_AUTO].mode = 0444;
 	}
 
 	cnet->sysctl_header = register_net_sysctl_sz(net, "net/netfilter",
@@ -1182,7 +1232,7 @@ static struct pernet_operations nf_conntrack_net_ops = {
 	.init		= nf_conntrack_pernet_init,
 	.exit_batch	= nf_conntrack_pernet_exit,
 	.id		= &nf_conntrack_net_id,
-	.size = sizeof(struct nf_conntrack_net),
+	.size = sizeof(struct nf_conntrack_net_priv),
 };
 
 static int __init nf_conntrack_standalone_init(void)
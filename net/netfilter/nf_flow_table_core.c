@@ -14,9 +14,25 @@
 #include <net/netfilter/nf_conntrack_l4proto.h>
 #include <net/netfilter/nf_conntrack_tuple.h>
 
+#include "nf_flow_table_xmit.h"
+
 static DEFINE_MUTEX(flowtable_lock);
 static LIST_HEAD(flowtables);
 
+/* Last flow found by each CPU: packets of the same flow tend to come in
+ * bursts, and a hit saves hashing the tuple and walking the bucket. Entries
+ * are only valid as long as no flow was freed since they were stored, see
+ * flow_offload_free().
+ */
+struct flow_offload_cache {
+	const struct nf_flowtable		*flow_table;
+	struct flow_offload_tuple_rhash		*tuplehash;
+	unsigned int				gen;
+};
+
+static DEFINE_PER_CPU(struct flow_offload_cache, flow_offload_cache);
+static atomic_t flow_offload_free_gen;
+
 static void
 flow_offload_fill_dir(struct flow_offload *flow,
 		      enum flow_offload_tuple_dir dir)
@@ -215,6 +231,17 @@ void flow_offload_free(struct flow_offload *flow)
 		break;
 	}
 	nf_ct_put(flow->ct);
+
+	/* Invalidate cached lookups before the flow can go away: readers that
+	 * don't see the new generation are waited for by the grace period.
+	 * Readers that do see it must not find the flow in the table anymore,
+	 * so order the removal before the increment. Pairs with the acquire
+	 * in flow_offload_cache_lookup().
+	 */
+	smp_mb__before_atomic();
+	atomic_inc(&flow_offload_free_gen);
+	smp_mb__after_atomic();
+
 	kfree_rcu(flow, rcu_head);
 }
 EXPORT_SYMBOL_GPL(flow_offload_free);
@@ -348,6 +375,34 @@ void flow_offload_teardown(struct flow_offload *flow)
 }
 EXPORT_SYMBOL_GPL(flow_offload_teardown);
 
+/* Softirqs can't nest on this CPU, so the cache can't be updated under us */
+static struct flow_offload_tuple_rhash *
+flow_offload_cache_lookup(struct nf_flowtable *flow_table,
+			  struct flow_offload_tuple *tuple)
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct flow_offload_cache *cache;
+	unsigned int gen;
+
+	gen = atomic_read_acquire(&flow_offload_free_gen);
+	cache = this_cpu_ptr(&flow_offload_cache);
+
+	tuplehash = cache->tuplehash;
+	if (tuplehash && cache->flow_table == flow_table && cache->gen == gen &&
+	    !memcmp(&tuplehash->tuple, tuple,
+		    offsetof(struct flow_offload_tuple, __hash)))
+		return tuplehash;
+
+	tuplehash = rhashtable_lookup(&flow_table->rhashtable, tuple,
+				      nf_flow_offload_rhash_params);
+
+	cache->flow_table = flow_table;
+	cache->tuplehash = tuplehash;
+	cache->gen = gen;
+
+	return tuplehash;
+}
+
 struct flow_offload_tuple_rhash *
 flow_offload_lookup(struct nf_flowtable *flow_table,
 		    struct flow_offload_tuple *tuple)
@@ -356,8 +411,11 @@ flow_offload_lookup(struct nf_flowtable *flow_table,
 	struct flow_offload *flow;
 	int dir;
 
-	tuplehash = rhashtable_lookup(&flow_table->rhashtable, tuple,
-				      nf_flow_offload_rhash_params);
+	if (likely(in_softirq()))
+		tuplehash = flow_offload_cache_lookup(flow_table, tuple);
+	else
+		tuplehash = rhashtable_lookup(&flow_table->rhashtable, tuple,
+					      nf_flow_offload_rhash_params);
 	if (!tuplehash)
 		return NULL;
 
@@ -670,6 +728,8 @@ static int __init nf_flow_table_module_init(void)
 	if (ret)
 		goto out_offload;
 
+	nf_flow_xmit_init();
+
 	return 0;
 
 out_offload:
@@ -679,6 +739,7 @@ static int __init nf_flow_table_module_init(void)
 
 static void __exit nf_flow_table_module_exit(void)
 {
+	nf_flow_xmit_exit();
 	nf_flow_table_offload_exit();
 	unregister_pernet_subsys(&nf_flow_table_net_ops);
 }
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <linux/kernel.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/module.h>
 #include <linux/netfilter.h>
 #include <linux/rhashtable.h>
@@ -15,10 +16,13 @@
 #include <net/neighbour.h>
 #include <net/netfilter/nf_flow_table.h>
 #include <net/netfilter/nf_conntrack_acct.h>
+#include <net/sch_generic.h>
 /* For layer 4 checksum field offset. */
 #include <linux/tcp.h>
 #include <linux/udp.h>
 
+#include "nf_flow_table_xmit.h"
+
 static int nf_flow_state_check(struct flow_offload *flow, int proto,
 			       struct sk_buff *skb, unsigned int thoff)
 {
@@ -329,6 +333,188 @@ static void nf_flow_encap_pop(struct sk_buff *skb,
 	}
 }
 
+/* Packets for direct transmission are queued on each CPU until the end of
+ * the receive softirq, and sent grouped by flow. Consecutive packets of a
+ * flow go to the same device queue, and are handed to the driver as one
+ * list with xmit_more set, if there's no qdisc or egress hook to run first.
+ */
+#define NF_FLOW_XMIT_BATCH	64
+
+struct nf_flow_xmit_batch {
+	struct sk_buff_head	skbs;
+	struct tasklet_struct	tasklet;
+};
+
+static DEFINE_PER_CPU(struct nf_flow_xmit_batch, nf_flow_xmit_batch);
+
+/* Flows are only compared by address here, never dereferenced: the batch
+ * is flushed outside of the RCU read-side section of the hook.
+ */
+struct nf_flow_xmit_cb {
+	const struct flow_offload_tuple_rhash	*tuplehash;
+};
+
+#define NF_FLOW_XMIT_CB(skb)	((struct nf_flow_xmit_cb *)(skb)->cb)
+
+static bool nf_flow_xmit_same_flow(const struct sk_buff *a,
+				   const struct sk_buff *b)
+{
+	return NF_FLOW_XMIT_CB(a)->tuplehash == NF_FLOW_XMIT_CB(b)->tuplehash &&
+	       a->dev == b->dev;
+}
+
+static bool nf_flow_xmit_can_bulk(struct net_device *dev,
+				  struct netdev_queue *txq)
+{
+	if (!(dev->flags & IFF_UP) || rcu_dereference_bh(txq->qdisc)->enqueue)
+		return false;
+#ifdef CONFIG_NET_XGRESS
+	if (rcu_access_pointer(dev->tcx_egress))
+		return false;
+#endif
+#ifdef CONFIG_NETFILTER_EGRESS
+	if (rcu_access_pointer(dev->nf_hooks_egress))
+		return false;
+#endif
+	return !dev_xmit_recursion();
+}
+
+/* Transmit packets of one flow, all for the same device */
+static void nf_flow_xmit_flow(struct net_device *dev, struct sk_buff_head *flow)
+{
+	struct sk_buff *skb, *head = NULL, **pprev = &head;
+	struct netdev_queue *txq = NULL;
+	unsigned int n = 0;
+	bool again = false;
+	u16 queue;
+	int rc, cpu;
+
+	if (skb_queue_len(flow) > 1)
+		txq = netdev_core_pick_tx(dev, skb_peek(flow), NULL);
+
+	if (!txq || !nf_flow_xmit_can_bulk(dev, txq)) {
+		/* A qdisc sets xmit_more itself on bulk dequeue */
+		while ((skb = __skb_dequeue(flow))) {
+			dev_queue_xmit(skb);
+			n++;
+		}
+		goto out;
+	}
+
+	queue = skb_get_queue_mapping(skb_peek(flow));
+	while ((skb = __skb_dequeue(flow))) {
+		skb_set_queue_mapping(skb, queue);
+		*pprev = skb;
+		pprev = &skb->next;
+		n++;
+	}
+
+	head = validate_xmit_skb_list(head, dev, &again);
+	if (!head)
+		goto out;
+
+	cpu = smp_processor_id();
+	HARD_TX_LOCK(dev, txq, cpu);
+	if (!netif_xmit_stopped(txq)) {
+		dev_xmit_recursion_inc();
+		head = dev_hard_start_xmit(head, dev, txq, &rc);
+		dev_xmit_recursion_dec();
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	/* Devices without a qdisc can't requeue: drop what wasn't sent, as
+	 * dev_queue_xmit() does.
+	 */
+	while (head) {
+		skb = head;
+		head = head->next;
+		skb_mark_not_on_list(skb);
+		dev_core_stats_tx_dropped_inc(dev);
+		kfree_skb(skb);
+	}
+out:
+	while (n--)
+		dev_put(dev);
+}
+
+static void nf_flow_xmit_flush(struct nf_flow_xmit_batch *batch)
+{
+	struct sk_buff *skb, *next, *tmp;
+	struct sk_buff_head flow;
+
+	__skb_queue_head_init(&flow);
+
+	rcu_read_lock_bh();
+	while ((skb = __skb_dequeue(&batch->skbs))) {
+		__skb_queue_tail(&flow, skb);
+
+		/* Pick later packets of the same flow, keeping their order */
+		skb_queue_walk_safe(&batch->skbs, next, tmp) {
+			if (!nf_flow_xmit_same_flow(skb, next))
+				continue;
+
+			__skb_unlink(next, &batch->skbs);
+			__skb_queue_tail(&flow, next);
+		}
+
+		nf_flow_xmit_flow(skb->dev, &flow);
+	}
+	rcu_read_unlock_bh();
+}
+
+static void nf_flow_xmit_tasklet(struct tasklet_struct *t)
+{
+	struct nf_flow_xmit_batch *batch;
+
+	batch = container_of(t, struct nf_flow_xmit_batch, tasklet);
+	nf_flow_xmit_flush(batch);
+}
+
+static void nf_flow_xmit_queue(struct sk_buff *skb,
+			       const struct flow_offload_tuple_rhash *tuplehash)
+{
+	struct nf_flow_xmit_batch *batch;
+
+	/* The batch can only be used with bottom halves disabled */
+	if (unlikely(!in_softirq())) {
+		dev_queue_xmit(skb);
+		return;
+	}
+
+	skb_reset_mac_header(skb);
+	NF_FLOW_XMIT_CB(skb)->tuplehash = tuplehash;
+	dev_hold(skb->dev);
+
+	batch = this_cpu_ptr(&nf_flow_xmit_batch);
+	__skb_queue_tail(&batch->skbs, skb);
+
+	if (skb_queue_len(&batch->skbs) >= NF_FLOW_XMIT_BATCH)
+		nf_flow_xmit_flush(batch);
+	else if (skb_queue_len(&batch->skbs) == 1)
+		tasklet_schedule(&batch->tasklet);
+}
+
+void nf_flow_xmit_init(void)
+{
+	struct nf_flow_xmit_batch *batch;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(&nf_flow_xmit_batch, cpu);
+		__skb_queue_head_init(&batch->skbs);
+		tasklet_setup(&batch->tasklet, nf_flow_xmit_tasklet);
+	}
+}
+
+/* Hooks are unregistered at this point: only scheduled flushes are left */
+void nf_flow_xmit_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(&nf_flow_xmit_batch, cpu)->tasklet);
+}
+
 static unsigned int nf_flow_queue_xmit(struct net *net, struct sk_buff *skb,
 				       const struct flow_offload_tuple_rhash *tuplehash,
 				       unsigned short type)
@@ -342,7 +528,7 @@ static unsigned int nf_flow_queue_xmit(struct net *net, struct sk_buff *skb,
 	skb->dev = outdev;
 	dev_hard_header(skb, skb->dev, type, tuplehash->tuple.out.h_dest,
 			tuplehash->tuple.out.h_source, skb->len);
-	dev_queue_xmit(skb);
+	nf_flow_xmit_queue(skb, tuplehash);
 
 	return NF_STOLEN;
 }
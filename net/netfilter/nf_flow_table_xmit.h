@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _NF_FLOW_TABLE_XMIT_H
+#define _NF_FLOW_TABLE_XMIT_H
+
+void nf_flow_xmit_init(void);
+void nf_flow_xmit_exit(void);
+
+#endif /* _NF_FLOW_TABLE_XMIT_H */
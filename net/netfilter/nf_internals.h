@@ -5,6 +5,8 @@
 #include <linux/list.h>
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
+#include <linux/percpu_counter.h>
+#include <net/netfilter/nf_conntrack.h>
 
 /* nf_conntrack_netlink.c: applied on tuple filters */
 #define CTA_FILTER_F_CTA_IP_SRC			(1 << 0)
@@ -23,6 +25,43 @@
 #define CTA_FILTER_F_ALL			(CTA_FILTER_F_MAX-1)
 #define CTA_FILTER_FLAG(ctattr) CTA_FILTER_F_ ## ctattr
 
+/* nf_conntrack_core.c: hash table resizes, protected by nf_conntrack_mutex */
+struct nf_conntrack_resize_stats {
+	unsigned int	grows;
+	unsigned int	shrinks;
+	unsigned int	auto_resizes;
+	unsigned int	steps;
+	unsigned long	moved;
+	unsigned int	last_msecs;
+};
+
+extern struct nf_conntrack_resize_stats nf_conntrack_resize_stats;
+extern u8 nf_conntrack_hash_auto;
+
+/* nf_conntrack_core.c: per-netns state private to the conntrack core.
+ * Allocated as pernet data in place of struct nf_conntrack_net, which must
+ * come first, so that nf_ct_pernet() keeps working.
+ */
+#define NF_CT_DROP_CANDIDATES	64
+
+struct nf_conntrack_net_priv {
+	struct nf_conntrack_net	cnet;
+
+	/* entries, batched per CPU; cnet.count is unused */
+	struct percpu_counter	count;
+
+	/* buckets with unassured entries, as bucket + 1, recorded by gc */
+	unsigned int		drop_fill;
+	unsigned int		drop_cand[NF_CT_DROP_CANDIDATES];
+};
+
+static inline struct nf_conntrack_net_priv *
+nf_ct_pernet_priv(const struct net *net)
+{
+	return container_of(nf_ct_pernet(net), struct nf_conntrack_net_priv,
+			    cnet);
+}
+
 /* nf_queue.c */
 void nf_queue_nf_hook_drop(struct net *net);
 
@@ -23,6 +23,8 @@
 #include <net/net_namespace.h>
 #include <net/sock.h>
 
+#include "nft_fused.h"
+
 #define NFT_MODULE_AUTOLOAD_LIMIT (MODULE_NAME_LEN - sizeof("nft-expr-255-"))
 #define NFT_SET_MAX_ANONLEN 16
 
@@ -4266,7 +4268,11 @@ static const struct nft_set_type *nft_set_types[] = {
 	&nft_set_bitmap_type,
 	&nft_set_rbtree_type,
 #if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+	&nft_set_pipapo_avx512_type,
 	&nft_set_pipapo_avx2_type,
+#endif
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+	&nft_set_pipapo_neon_type,
 #endif
 	&nft_set_pipapo_type,
 };
@@ -9531,10 +9537,11 @@ static bool nft_expr_reduce(struct nft_regs_track *track,
 static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *chain)
 {
 	const struct nft_expr *expr, *last;
+	unsigned int size, data_size, prev_size, fused;
 	struct nft_regs_track track = {};
-	unsigned int size, data_size;
 	void *data, *data_boundary;
 	struct nft_rule_dp *prule;
+	struct nft_expr *prev;
 	struct nft_rule *rule;
 
 	/* already handled or inactive chain? */
@@ -9568,6 +9575,8 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 			return -ENOMEM;
 
 		size = 0;
+		prev = NULL;
+		prev_size = 0;
 		track.last = nft_expr_last(rule);
 		nft_rule_for_each_expr(expr, last, rule) {
 			track.cur = expr;
@@ -9577,10 +9586,19 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 				continue;
 			}
 
+			/* Fused expression replaces the previous one in place */
+			if (prev && (fused = nft_expr_fuse(prev, expr))) {
+				size = prev_size + fused;
+				prev = NULL;
+				continue;
+			}
+
 			if (WARN_ON_ONCE(data + size + expr->ops->size > data_boundary))
 				return -ENOMEM;
 
 			memcpy(data + size, expr, expr->ops->size);
+			prev = data + size;
+			prev_size = size;
 			size += expr->ops->size;
 		}
 		if (WARN_ON_ONCE(size >= 1 << 12))
@@ -16,11 +16,15 @@
 #include <linux/static_key.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nf_tables.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <net/netfilter/nf_tables_core.h>
 #include <net/netfilter/nf_tables.h>
 #include <net/netfilter/nf_log.h>
 #include <net/netfilter/nft_meta.h>
 
+#include "nft_fused.h"
+
 #if defined(CONFIG_RETPOLINE) && defined(CONFIG_X86)
 
 static struct static_key_false nf_tables_skip_direct_calls;
@@ -176,6 +180,119 @@ static bool nft_payload_fast_eval(const struct nft_expr *expr,
 	return true;
 }
 
+/* Payload load followed by a comparison of the loaded register, fused into
+ * a single expression when the rule blob is built. The payload part comes
+ * first, so that nft_payload_fast_eval() and nft_payload_eval() can be used
+ * on the fused expression as it is.
+ */
+struct nft_payload_cmp_fast_expr {
+	struct nft_payload		payload;
+	struct nft_cmp_fast_expr	cmp;
+};
+
+/* Evaluations of fused expressions, and how many of them couldn't use the fast
+ * payload path. These are global, not per netns, and only reported in the
+ * initial network namespace.
+ */
+static DEFINE_PER_CPU(unsigned long, nft_fused_hit);
+static DEFINE_PER_CPU(unsigned long, nft_fused_slow);
+
+static bool nft_fuse_exprs __read_mostly = true;
+module_param_named(fuse_exprs, nft_fuse_exprs, bool, 0644);
+MODULE_PARM_DESC(fuse_exprs, "Fuse payload and cmp expressions in rule blobs");
+
+static void nft_payload_cmp_fast_eval(const struct nft_expr *expr,
+				      struct nft_regs *regs,
+				      struct nft_pktinfo *pkt)
+{
+	const struct nft_payload_cmp_fast_expr *priv = nft_expr_priv(expr);
+
+	this_cpu_inc(nft_fused_hit);
+
+	if (unlikely(!nft_payload_fast_eval(expr, regs, pkt))) {
+		this_cpu_inc(nft_fused_slow);
+
+		nft_payload_eval(expr, regs, pkt);
+		if (regs->verdict.code != NFT_CONTINUE)
+			return;
+	}
+
+	if (((regs->data[priv->cmp.sreg] & priv->cmp.mask) == priv->cmp.data) ^
+	    priv->cmp.inv)
+		return;
+	regs->verdict.code = NFT_BREAK;
+}
+
+static const struct nft_expr_ops nft_payload_cmp_fast_ops = {
+	.type		= &nft_payload_type,
+	.size		= NFT_EXPR_SIZE(sizeof(struct nft_payload_cmp_fast_expr)),
+	.eval		= nft_payload_cmp_fast_eval,
+};
+
+/**
+ * nft_expr_fuse() - Fuse expression with the previous one in a rule blob
+ * @prev:	Previous expression, already copied to the blob
+ * @expr:	Next expression, not copied yet
+ *
+ * A fast payload load into a register, immediately followed by a fast
+ * comparison of the same register, is replaced by a single expression,
+ * saving one dispatch per rule evaluation. The fused expression is never
+ * larger than the two original ones together, so it fits in the space
+ * accounted for them.
+ *
+ * Return: size of fused expression replacing @prev, in which case @expr must
+ * not be copied, 0 if expressions can't be fused.
+ */
+unsigned int nft_expr_fuse(struct nft_expr *prev, const struct nft_expr *expr)
+{
+	struct nft_payload_cmp_fast_expr *fused = nft_expr_priv(prev);
+	const struct nft_cmp_fast_expr *cmp = nft_expr_priv(expr);
+
+	BUILD_BUG_ON(NFT_EXPR_SIZE(sizeof(*fused)) >
+		     NFT_EXPR_SIZE(sizeof(struct nft_payload)) +
+		     NFT_EXPR_SIZE(sizeof(*cmp)));
+
+	if (!READ_ONCE(nft_fuse_exprs) ||
+	    prev->ops != &nft_payload_fast_ops ||
+	    expr->ops != &nft_cmp_fast_ops ||
+	    fused->payload.dreg != cmp->sreg)
+		return 0;
+
+	fused->cmp = *cmp;
+	prev->ops = &nft_payload_cmp_fast_ops;
+
+	return nft_payload_cmp_fast_ops.size;
+}
+
+#ifdef CONFIG_PROC_FS
+static int nft_fused_seq_show(struct seq_file *seq, void *v)
+{
+	unsigned long hit = 0, slow = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		hit += READ_ONCE(*per_cpu_ptr(&nft_fused_hit, cpu));
+		slow += READ_ONCE(*per_cpu_ptr(&nft_fused_slow, cpu));
+	}
+
+	seq_printf(seq, "fused_hit: %lu\n", hit);
+	seq_printf(seq, "fused_slow: %lu\n", slow);
+	return 0;
+}
+
+/* Statistics are best effort: failing to create the file is not fatal */
+void nft_fused_init_proc(void)
+{
+	proc_create_single("nf_tables_fused", 0444, init_net.proc_net_stat,
+			   nft_fused_seq_show);
+}
+
+void nft_fused_fini_proc(void)
+{
+	remove_proc_entry("nf_tables_fused", init_net.proc_net_stat);
+}
+#endif
+
 DEFINE_STATIC_KEY_FALSE(nft_counters_enabled);
 
 static noinline void nft_update_chain_stats(const struct nft_chain *chain,
@@ -283,6 +400,8 @@ nft_do_chain(struct nft_pktinfo *pkt, void *priv)
 				nft_cmp16_fast_eval(expr, &regs);
 			else if (expr->ops == &nft_bitwise_fast_ops)
 				nft_bitwise_fast_eval(expr, &regs);
+			else if (expr->ops == &nft_payload_cmp_fast_ops)
+				nft_payload_cmp_fast_eval(expr, &regs, pkt);
 			else if (expr->ops != &nft_payload_fast_ops ||
 				 !nft_payload_fast_eval(expr, &regs, pkt))
 				expr_call_ops_eval(expr, &regs, pkt);
@@ -389,6 +508,8 @@ int __init nf_tables_core_module_init(void)
 			goto err;
 	}
 
+	nft_fused_init_proc();
+
 	nf_skip_indirect_calls_enable();
 
 	return 0;
@@ -407,6 +528,8 @@ void nf_tables_core_module_exit(void)
 {
 	int i;
 
+	nft_fused_fini_proc();
+
 	i = ARRAY_SIZE(nft_basic_types);
 	while (i-- > 0)
 		nft_unregister_expr(nft_basic_types[i]);
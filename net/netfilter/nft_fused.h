@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _NFT_FUSED_H
+#define _NFT_FUSED_H
+
+unsigned int nft_expr_fuse(struct nft_expr *prev, const struct nft_expr *expr);
+
+#ifdef CONFIG_PROC_FS
+void nft_fused_init_proc(void);
+void nft_fused_fini_proc(void);
+#else
+static inline void nft_fused_init_proc(void) {}
+static inline void nft_fused_fini_proc(void) {}
+#endif
+
+#endif /* _NFT_FUSED_H */
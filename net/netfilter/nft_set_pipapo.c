@@ -340,8 +340,18 @@
 #include <linux/bitops.h>
 
 #include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_avx512.h"
+#include "nft_set_pipapo_neon.h"
 #include "nft_set_pipapo.h"
 
+/* Only affects sets created after it's changed: meant to compare the lookup
+ * implementations on the same machine
+ */
+unsigned int nft_pipapo_simd __read_mostly = NFT_PIPAPO_SIMD_512;
+module_param_named(pipapo_simd, nft_pipapo_simd, uint, 0644);
+MODULE_PARM_DESC(pipapo_simd,
+		 "Highest SIMD level for new pipapo sets: 0 none, 1 AVX2/NEON, 2 AVX-512");
+
 /**
  * pipapo_refill() - For each set bit, set bits from selected mapping table item
  * @map:	Bitmap to be scanned for set bits
@@ -502,28 +512,25 @@ bool nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
  * pipapo_get() - Get matching element reference given key data
  * @net:	Network namespace
  * @set:	nftables API set representation
+ * @m:		Matching data to search, working copy or current one
  * @data:	Key data to be matched against existing elements
  * @genmask:	If set, check that element is active in given genmask
  *
- * This is essentially the same as the lookup function, except that it matches
- * key data against the uncommitted copy and doesn't use preallocated maps for
- * bitmap results.
+ * This is essentially the same as the lookup function, except that it doesn't
+ * use preallocated maps for bitmap results.
  *
  * Return: pointer to &struct nft_pipapo_elem on match, error pointer otherwise.
  */
 static struct nft_pipapo_elem *pipapo_get(const struct net *net,
 					  const struct nft_set *set,
+					  const struct nft_pipapo_match *m,
 					  const u8 *data, u8 genmask)
 {
 	struct nft_pipapo_elem *ret = ERR_PTR(-ENOENT);
-	struct nft_pipapo *priv = nft_set_priv(set);
 	unsigned long *res_map, *fill_map = NULL;
-	const struct nft_pipapo_match *m;
 	const struct nft_pipapo_field *f;
 	int i;
 
-	m = priv->clone;
-
 	res_map = kmalloc_array(m->bsize_max, sizeof(*res_map), GFP_ATOMIC);
 	if (!res_map) {
 		ret = ERR_PTR(-ENOMEM);
@@ -604,10 +611,56 @@ static struct nft_pipapo_elem *pipapo_get(const struct net *net,
 static void *nft_pipapo_get(const struct net *net, const struct nft_set *set,
 			    const struct nft_set_elem *elem, unsigned int flags)
 {
-	return pipapo_get(net, set, (const u8 *)elem->key.val.data,
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m = rcu_dereference(priv->match);
+
+	return pipapo_get(net, set, m, (const u8 *)elem->key.val.data,
 			 nft_genmask_cur(net));
 }
 
+/**
+ * pipapo_realloc_mt() - Resize mapping table, keeping spare buckets
+ * @f:		Field containing mapping table
+ * @old_rules:	Previous amount of rules in field
+ * @rules:	New amount of rules
+ *
+ * The table is only reallocated if it's too small, or if it would have more
+ * than two chunks of unused buckets, and it's then sized with one spare chunk.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static int pipapo_realloc_mt(struct nft_pipapo_field *f,
+			     unsigned long old_rules, unsigned long rules)
+{
+	union nft_pipapo_map_bucket *new_mt, *old_mt = f->mt;
+	unsigned long rules_alloc;
+
+	if (rules <= f->rules_alloc &&
+	    rules + 2 * NFT_PIPAPO_MT_CHUNK >= f->rules_alloc)
+		goto out;
+
+	rules_alloc = rules + NFT_PIPAPO_MT_CHUNK;
+
+	new_mt = kvmalloc_array(rules_alloc, sizeof(*new_mt), GFP_KERNEL);
+	if (!new_mt)
+		return -ENOMEM;
+
+	if (old_mt)
+		memcpy(new_mt, old_mt, min(old_rules, rules) * sizeof(*new_mt));
+
+	f->mt = new_mt;
+	f->rules_alloc = rules_alloc;
+	kvfree(old_mt);
+
+out:
+	if (rules > old_rules) {
+		memset(f->mt + old_rules, 0,
+		       (rules - old_rules) * sizeof(*f->mt));
+	}
+
+	return 0;
+}
+
 /**
  * pipapo_resize() - Resize lookup or mapping table, or both
  * @f:		Field containing lookup and mapping tables
@@ -623,9 +676,8 @@ static void *nft_pipapo_get(const struct net *net, const struct nft_set *set,
 static int pipapo_resize(struct nft_pipapo_field *f, int old_rules, int rules)
 {
 	long *new_lt = NULL, *new_p, *old_lt = f->lt, *old_p;
-	union nft_pipapo_map_bucket *new_mt, *old_mt = f->mt;
 	size_t new_bucket_size, copy;
-	int group, bucket;
+	int group, bucket, err;
 
 	new_bucket_size = DIV_ROUND_UP(rules, BITS_PER_LONG);
 #ifdef NFT_PIPAPO_ALIGN
@@ -665,16 +717,10 @@ static int pipapo_resize(struct nft_pipapo_field *f, int old_rules, int rules)
 	}
 
 mt:
-	new_mt = kvmalloc(rules * sizeof(*new_mt), GFP_KERNEL);
-	if (!new_mt) {
+	err = pipapo_realloc_mt(f, old_rules, rules);
+	if (err) {
 		kvfree(new_lt);
-		return -ENOMEM;
-	}
-
-	memcpy(new_mt, f->mt, min(old_rules, rules) * sizeof(*new_mt));
-	if (rules > old_rules) {
-		memset(new_mt + old_rules, 0,
-		       (rules - old_rules) * sizeof(*new_mt));
+		return err;
 	}
 
 	if (new_lt) {
@@ -683,9 +729,6 @@ static int pipapo_resize(struct nft_pipapo_field *f, int old_rules, int rules)
 		kvfree(old_lt);
 	}
 
-	f->mt = new_mt;
-	kvfree(old_mt);
-
 	return 0;
 }
 
@@ -1179,6 +1222,225 @@ static int pipapo_realloc_scratch(struct nft_pipapo_match *clone,
 	return 0;
 }
 
+/**
+ * struct nft_pipapo_op - Change to matching data, logged for later replay
+ * @list:	Linked in &struct nft_pipapo.log
+ * @e:		Inserted element, NULL for deletions
+ * @rulemap:	For deletions, first rule and amount of rules for each field
+ * @key:	For insertions, start and end of range, set width bytes each
+ */
+struct nft_pipapo_op {
+	struct list_head list;
+	struct nft_pipapo_elem *e;
+	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
+	u8 key[];
+};
+
+/**
+ * pipapo_match_size() - Size of lookup and mapping tables, bytes
+ * @m:		Matching data
+ *
+ * Return: bytes copied by pipapo_clone() for @m, save for scratch maps.
+ */
+static size_t pipapo_match_size(const struct nft_pipapo_match *m)
+{
+	const struct nft_pipapo_field *f;
+	size_t size = 0;
+	int i;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		size += f->groups * NFT_PIPAPO_BUCKETS(f->bb) * f->bsize *
+			sizeof(*f->lt);
+		size += f->rules * sizeof(*f->mt);
+	}
+
+	return size;
+}
+
+/**
+ * pipapo_log_reset() - Drop logged changes
+ * @priv:	Set private data
+ * @overflow:	Mark log as incomplete, so that it won't be used
+ */
+static void pipapo_log_reset(struct nft_pipapo *priv, bool overflow)
+{
+	struct nft_pipapo_op *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, &priv->log, list) {
+		list_del(&op->list);
+		kfree(op);
+	}
+
+	priv->log_cost = 0;
+	priv->log_overflow = overflow;
+}
+
+/**
+ * pipapo_log_add() - Log change made to working copy
+ * @priv:	Set private data
+ * @m:		Working copy, already changed
+ * @op:		Change to be logged, freed here if not needed
+ * @cost:	Estimate of bytes of tables touched to replay this change
+ *
+ * Once replaying the log would touch more data than copying all the tables,
+ * there's no point in keeping it: mark it as incomplete instead.
+ */
+static void pipapo_log_add(struct nft_pipapo *priv,
+			   const struct nft_pipapo_match *m,
+			   struct nft_pipapo_op *op, size_t cost)
+{
+	if (priv->log_overflow) {
+		kfree(op);
+		return;
+	}
+
+	priv->log_cost += cost;
+	if (priv->log_cost > pipapo_match_size(m)) {
+		kfree(op);
+		pipapo_log_reset(priv, true);
+		return;
+	}
+
+	list_add_tail(&op->list, &priv->log);
+}
+
+/**
+ * pipapo_log_insert() - Log insertion of element into working copy
+ * @priv:	Set private data
+ * @m:		Working copy, element already inserted
+ * @rulemap:	First rule and amount of rules inserted for each field
+ * @start:	Start of range, or key, with nftables padding
+ * @end:	End of range, same as @start for non-ranged entries
+ * @e:		Inserted element
+ *
+ * Key data is copied, as the element might be gone by the time we replay this.
+ */
+static void pipapo_log_insert(struct nft_pipapo *priv,
+			      const struct nft_pipapo_match *m,
+			      const union nft_pipapo_map_bucket *rulemap,
+			      const u8 *start, const u8 *end,
+			      struct nft_pipapo_elem *e)
+{
+	const struct nft_pipapo_field *f;
+	struct nft_pipapo_op *op;
+	size_t cost = 0;
+	int i;
+
+	if (priv->log_overflow)
+		return;
+
+	op = kmalloc(struct_size(op, key, priv->width * 2), GFP_KERNEL);
+	if (!op) {
+		pipapo_log_reset(priv, true);
+		return;
+	}
+
+	op->e = e;
+	memcpy(op->key, start, priv->width);
+	memcpy(op->key + priv->width, end, priv->width);
+
+	nft_pipapo_for_each_field(f, i, m) {
+		cost += rulemap[i].n * (f->groups * NFT_PIPAPO_BUCKETS(f->bb) /
+					BITS_PER_BYTE + sizeof(*f->mt));
+	}
+
+	pipapo_log_add(priv, m, op, cost);
+}
+
+/**
+ * pipapo_log_drop() - Log deletion of rules from working copy
+ * @priv:	Set private data
+ * @m:		Working copy, before rules are dropped
+ * @rulemap:	Rules to be dropped, as passed to pipapo_drop()
+ *
+ * Rule indices are the same in the copy we replay this on, as long as the same
+ * changes are replayed in the same order, so the rule map is all we need.
+ */
+static void pipapo_log_drop(struct nft_pipapo *priv,
+			    const struct nft_pipapo_match *m,
+			    const union nft_pipapo_map_bucket *rulemap)
+{
+	struct nft_pipapo_op *op;
+
+	if (priv->log_overflow)
+		return;
+
+	op = kmalloc(sizeof(*op), GFP_KERNEL);
+	if (!op) {
+		pipapo_log_reset(priv, true);
+		return;
+	}
+
+	op->e = NULL;
+	memcpy(op->rulemap, rulemap, sizeof(op->rulemap));
+
+	/* pipapo_drop() shifts all the buckets in each lookup table */
+	pipapo_log_add(priv, m, op, pipapo_match_size(m));
+}
+
+/**
+ * pipapo_insert_elem() - Insert rules for a new element into matching data
+ * @m:		Matching data
+ * @start:	Start of range, or key, with nftables padding
+ * @end:	End of range, same as @start for non-ranged entries
+ * @e:		Element the new rules map to
+ * @rulemap:	Filled with first rule and amount of rules for each field
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+static int pipapo_insert_elem(struct nft_pipapo_match *m,
+			      const u8 *start, const u8 *end,
+			      struct nft_pipapo_elem *e,
+			      union nft_pipapo_map_bucket *rulemap)
+{
+	struct nft_pipapo_field *f;
+	int i, bsize_max, err;
+
+	bsize_max = m->bsize_max;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		int ret;
+
+		rulemap[i].to = f->rules;
+
+		ret = memcmp(start, end,
+			     f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f));
+		if (!ret)
+			ret = pipapo_insert(f, start, f->groups * f->bb);
+		else
+			ret = pipapo_expand(f, start, end, f->groups * f->bb);
+
+		if (ret < 0)
+			return ret;
+
+		if (f->bsize > bsize_max)
+			bsize_max = f->bsize;
+
+		rulemap[i].n = ret;
+
+		start += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+		end += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+	if (!*get_cpu_ptr(m->scratch) || bsize_max > m->bsize_max) {
+		put_cpu_ptr(m->scratch);
+
+		err = pipapo_realloc_scratch(m, bsize_max);
+		if (err)
+			return err;
+
+		m->bsize_max = bsize_max;
+	} else {
+		put_cpu_ptr(m->scratch);
+	}
+
+	pipapo_map(m, rulemap, e);
+
+	return 0;
+}
+
+static int pipapo_clone_ready(const struct nft_set *set);
+
 /**
  * nft_pipapo_insert() - Validate and insert ranged elements
  * @net:	Network namespace
@@ -1197,18 +1459,24 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 	const u8 *start = (const u8 *)elem->key.val.data, *end;
 	struct nft_pipapo_elem *e = elem->priv, *dup;
 	struct nft_pipapo *priv = nft_set_priv(set);
-	struct nft_pipapo_match *m = priv->clone;
 	u8 genmask = nft_genmask_next(net);
+	struct nft_pipapo_match *m;
 	struct nft_pipapo_field *f;
 	const u8 *start_p, *end_p;
-	int i, bsize_max, err = 0;
+	int i, err;
 
 	if (nft_set_ext_exists(ext, NFT_SET_EXT_KEY_END))
 		end = (const u8 *)nft_set_ext_key_end(ext)->data;
 	else
 		end = start;
 
-	dup = pipapo_get(net, set, start, genmask);
+	err = pipapo_clone_ready(set);
+	if (err)
+		return err;
+
+	m = priv->clone;
+
+	dup = pipapo_get(net, set, m, start, genmask);
 	if (!IS_ERR(dup)) {
 		/* Check if we already have the same exact entry */
 		const struct nft_data *dup_key, *dup_end;
@@ -1230,7 +1498,7 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 
 	if (PTR_ERR(dup) == -ENOENT) {
 		/* Look for partially overlapping entries */
-		dup = pipapo_get(net, set, end, nft_genmask_next(net));
+		dup = pipapo_get(net, set, m, end, nft_genmask_next(net));
 	}
 
 	if (PTR_ERR(dup) != -ENOENT) {
@@ -1258,48 +1526,17 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 	/* Insert */
 	priv->dirty = true;
 
-	bsize_max = m->bsize_max;
-
-	nft_pipapo_for_each_field(f, i, m) {
-		int ret;
-
-		rulemap[i].to = f->rules;
-
-		ret = memcmp(start, end,
-			     f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f));
-		if (!ret)
-			ret = pipapo_insert(f, start, f->groups * f->bb);
-		else
-			ret = pipapo_expand(f, start, end, f->groups * f->bb);
-
-		if (ret < 0)
-			return ret;
-
-		if (f->bsize > bsize_max)
-			bsize_max = f->bsize;
-
-		rulemap[i].n = ret;
-
-		start += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
-		end += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	err = pipapo_insert_elem(m, start, end, e, rulemap);
+	if (err) {
+		/* Partial insertion, we can't replay this */
+		pipapo_log_reset(priv, true);
+		return err;
 	}
 
-	if (!*get_cpu_ptr(m->scratch) || bsize_max > m->bsize_max) {
-		put_cpu_ptr(m->scratch);
-
-		err = pipapo_realloc_scratch(m, bsize_max);
-		if (err)
-			return err;
-
-		m->bsize_max = bsize_max;
-	} else {
-		put_cpu_ptr(m->scratch);
-	}
+	pipapo_log_insert(priv, m, rulemap, start, end, e);
 
 	*ext2 = &e->ext;
 
-	pipapo_map(m, rulemap, e);
-
 	return 0;
 }
 
@@ -1356,7 +1593,8 @@ static struct nft_pipapo_match *pipapo_clone(struct nft_pipapo_match *old)
 		       src->bsize * sizeof(*dst->lt) *
 		       src->groups * NFT_PIPAPO_BUCKETS(src->bb));
 
-		dst->mt = kvmalloc(src->rules * sizeof(*src->mt), GFP_KERNEL);
+		dst->mt = kvmalloc_array(src->rules_alloc, sizeof(*src->mt),
+					 GFP_KERNEL);
 		if (!dst->mt)
 			goto out_mt;
 
@@ -1624,6 +1862,7 @@ static void pipapo_gc(const struct nft_set *_set, struct nft_pipapo_match *m)
 				return;
 
 			nft_pipapo_gc_deactivate(net, set, e);
+			pipapo_log_drop(priv, m, rulemap);
 			pipapo_drop(m, rulemap);
 			nft_trans_gc_elem_add(gc, e);
 
@@ -1682,6 +1921,136 @@ static void pipapo_reclaim_match(struct rcu_head *rcu)
 	pipapo_free_match(m);
 }
 
+static bool nft_pipapo_transaction_mutex_held(const struct nft_set *set)
+{
+#ifdef CONFIG_PROVE_LOCKING
+	const struct net *net = read_pnet(&set->net);
+
+	return lockdep_is_held(&nft_pernet(net)->commit_mutex);
+#else
+	return true;
+#endif
+}
+
+/**
+ * pipapo_log_replay() - Apply logged changes to a stale working copy
+ * @priv:	Set private data
+ * @m:		Previous matching data, not used for lookups anymore
+ *
+ * Return: 0 on success, negative error code on failure, in which case @m is
+ * left in an inconsistent state and needs to be freed.
+ */
+static int pipapo_log_replay(struct nft_pipapo *priv,
+			     struct nft_pipapo_match *m)
+{
+	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
+	struct nft_pipapo_op *op;
+	int err;
+
+	list_for_each_entry(op, &priv->log, list) {
+		if (!op->e) {
+			pipapo_drop(m, op->rulemap);
+			continue;
+		}
+
+		err = pipapo_insert_elem(m, op->key, op->key + priv->width,
+					 op->e, rulemap);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* Below this size of lookup and mapping tables, copying them is cheaper than
+ * waiting for an RCU grace period to replay changes on the previous copy.
+ */
+#define NFT_PIPAPO_REPLAY_MIN_SIZE	(256 * 1024)
+
+/**
+ * pipapo_clone_should_wait() - Check if waiting to replay the log pays off
+ * @priv:	Set private data
+ * @m:		Current matching data
+ *
+ * Replaying the log is always preferred once lookups can't use the stale
+ * working copy anymore. Otherwise, we need to wait for a grace period, which
+ * takes milliseconds: only do that if the tables are large enough, and if the
+ * log touches less than half of them, so that copying them would take longer.
+ *
+ * Return: true if we should wait and replay, false if we should copy @m.
+ */
+static bool pipapo_clone_should_wait(const struct nft_pipapo *priv,
+				     const struct nft_pipapo_match *m)
+{
+	size_t size;
+
+	if (poll_state_synchronize_rcu(priv->clone_gp))
+		return true;
+
+	size = pipapo_match_size(m);
+
+	return size >= NFT_PIPAPO_REPLAY_MIN_SIZE && priv->log_cost < size / 2;
+}
+
+/**
+ * pipapo_clone_ready() - Make sure we have an up-to-date working copy
+ * @set:	nftables API set representation
+ *
+ * On commit, the previous matching data becomes the working copy for the next
+ * transaction, and the changes we just committed are kept in a log. Before
+ * changing the working copy, wait until lookups can't use it anymore, and
+ * replay the log on it: for small updates to large sets, this is much cheaper
+ * than copying all the tables. See pipapo_clone_should_wait() for when
+ * waiting isn't worth it.
+ *
+ * If there's no working copy, the log is incomplete, replaying it fails, or
+ * waiting doesn't pay off, fall back to a copy of the current matching data.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+static int pipapo_clone_ready(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+
+	if (priv->clone && !priv->clone_stale)
+		return 0;
+
+	m = rcu_dereference_protected(priv->match,
+				      nft_pipapo_transaction_mutex_held(set));
+
+	if (priv->clone && !pipapo_clone_should_wait(priv, m)) {
+		/* Lookups might still use it, free it after a grace period */
+		call_rcu(&priv->clone->rcu, pipapo_reclaim_match);
+		priv->clone = NULL;
+		priv->clone_stale = false;
+	}
+
+	if (priv->clone) {
+		priv->clone_stale = false;
+
+		cond_synchronize_rcu(priv->clone_gp);
+
+		if (!pipapo_log_replay(priv, priv->clone)) {
+			pipapo_log_reset(priv, false);
+			return 0;
+		}
+
+		pipapo_free_match(priv->clone);
+		priv->clone = NULL;
+	}
+
+	pipapo_log_reset(priv, false);
+
+	m = pipapo_clone(m);
+	if (IS_ERR(m))
+		return PTR_ERR(m);
+
+	priv->clone = m;
+
+	return 0;
+}
+
 /**
  * nft_pipapo_commit() - Replace lookup data with current working copy
  * @set:	nftables API set representation
@@ -1690,63 +2059,55 @@ static void pipapo_reclaim_match(struct rcu_head *rcu)
  * copy before committing it for lookup, and don't replace the table if the
  * working copy doesn't have pending changes.
  *
- * We also need to create a new working copy for subsequent insertions and
- * deletions.
+ * The previous matching data is kept as working copy for subsequent insertions
+ * and deletions, see pipapo_clone_ready(). If the log of changes we just
+ * committed is incomplete, the previous matching data can't be brought up to
+ * date, so we free it instead, and copy the current one on the next change.
  */
 static void nft_pipapo_commit(const struct nft_set *set)
 {
 	struct nft_pipapo *priv = nft_set_priv(set);
-	struct nft_pipapo_match *new_clone, *old;
+	struct nft_pipapo_match *old;
 
-	if (time_after_eq(jiffies, priv->last_gc + nft_set_gc_interval(set)))
+	if (time_after_eq(jiffies, priv->last_gc + nft_set_gc_interval(set)) &&
+	    !pipapo_clone_ready(set))
 		pipapo_gc(set, priv->clone);
 
 	if (!priv->dirty)
 		return;
 
-	new_clone = pipapo_clone(priv->clone);
-	if (IS_ERR(new_clone))
-		return;
-
 	priv->dirty = false;
 
 	old = rcu_access_pointer(priv->match);
 	rcu_assign_pointer(priv->match, priv->clone);
-	if (old)
-		call_rcu(&old->rcu, pipapo_reclaim_match);
 
-	priv->clone = new_clone;
-}
+	if (old && !priv->log_overflow) {
+		priv->clone = old;
+		priv->clone_stale = true;
+		priv->clone_gp = get_state_synchronize_rcu();
+		return;
+	}
 
-static bool nft_pipapo_transaction_mutex_held(const struct nft_set *set)
-{
-#ifdef CONFIG_PROVE_LOCKING
-	const struct net *net = read_pnet(&set->net);
+	pipapo_log_reset(priv, false);
+	priv->clone = NULL;
 
-	return lockdep_is_held(&nft_pernet(net)->commit_mutex);
-#else
-	return true;
-#endif
+	if (old)
+		call_rcu(&old->rcu, pipapo_reclaim_match);
 }
 
 static void nft_pipapo_abort(const struct nft_set *set)
 {
 	struct nft_pipapo *priv = nft_set_priv(set);
-	struct nft_pipapo_match *new_clone, *m;
 
 	if (!priv->dirty)
 		return;
 
-	m = rcu_dereference_protected(priv->match, nft_pipapo_transaction_mutex_held(set));
-
-	new_clone = pipapo_clone(m);
-	if (IS_ERR(new_clone))
-		return;
-
 	priv->dirty = false;
 
+	/* A fresh copy is made on the next change, see pipapo_clone_ready() */
+	pipapo_log_reset(priv, false);
 	pipapo_free_match(priv->clone);
-	priv->clone = new_clone;
+	priv->clone = NULL;
 }
 
 /**
@@ -1785,9 +2146,17 @@ static void nft_pipapo_activate(const struct net *net,
 static void *pipapo_deactivate(const struct net *net, const struct nft_set *set,
 			       const u8 *data, const struct nft_set_ext *ext)
 {
+	struct nft_pipapo *priv = nft_set_priv(set);
 	struct nft_pipapo_elem *e;
 
-	e = pipapo_get(net, set, data, nft_genmask_next(net));
+	/* The element is then removed from the working copy on commit, and
+	 * nft_pipapo_remove() can't fail: get the copy ready now. From
+	 * nft_pipapo_flush(), this was already done by nft_pipapo_walk().
+	 */
+	if (pipapo_clone_ready(set))
+		return NULL;
+
+	e = pipapo_get(net, set, priv->clone, data, nft_genmask_next(net));
 	if (IS_ERR(e))
 		return NULL;
 
@@ -1829,13 +2198,21 @@ static void *nft_pipapo_deactivate(const struct net *net,
  * subsequent calls, but we would leak all the elements after the first one,
  * because they wouldn't then be freed as result of API calls.
  *
+ * This is called from nft_pipapo_walk() under rcu_read_lock(), so it can't get
+ * the working copy ready by itself: the walk did that already, and if it
+ * failed, fail here too, instead of deactivating an element we couldn't remove.
+ *
  * Return: true if element was found and deactivated.
  */
 static bool nft_pipapo_flush(const struct net *net, const struct nft_set *set,
 			     void *elem)
 {
+	struct nft_pipapo *priv = nft_set_priv(set);
 	struct nft_pipapo_elem *e = elem;
 
+	if (!priv->clone || priv->clone_stale)
+		return false;
+
 	return pipapo_deactivate(net, set, (const u8 *)nft_set_ext_key(&e->ext),
 				 &e->ext);
 }
@@ -1971,11 +2348,16 @@ static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
 			      const struct nft_set_elem *elem)
 {
 	struct nft_pipapo *priv = nft_set_priv(set);
-	struct nft_pipapo_match *m = priv->clone;
 	struct nft_pipapo_elem *e = elem->priv;
 	int rules_f0, first_rule = 0;
+	struct nft_pipapo_match *m;
 	const u8 *data;
 
+	/* The working copy was made ready when the element was inserted or
+	 * deactivated in this transaction, see pipapo_deactivate() and
+	 * nft_pipapo_walk(), so removal can't fail here.
+	 */
+	m = priv->clone;
 	data = (const u8 *)nft_set_ext_key(&e->ext);
 
 	while ((rules_f0 = pipapo_rules_same_key(m->f, first_rule))) {
@@ -2012,6 +2394,7 @@ static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
 
 			if (last && f->mt[rulemap[i].to].e == e) {
 				priv->dirty = true;
+				pipapo_log_drop(priv, m, rulemap);
 				pipapo_drop(m, rulemap);
 				return;
 			}
@@ -2032,6 +2415,12 @@ static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
  * As elements are referenced in the mapping array for the last field, directly
  * scan that array: there's no need to follow rule mappings from the first
  * field.
+ *
+ * Elements deactivated by update walks, that is, flush, are removed from the
+ * working copy on commit: get the copy ready before we start, as
+ * pipapo_clone_ready() might sleep. If that fails, there's no working copy and
+ * no pending changes, so the current matching data is still accurate, and
+ * nft_pipapo_flush() fails instead.
  */
 static void nft_pipapo_walk(const struct nft_ctx *ctx, struct nft_set *set,
 			    struct nft_set_iter *iter)
@@ -2044,8 +2433,12 @@ static void nft_pipapo_walk(const struct nft_ctx *ctx, struct nft_set *set,
 	WARN_ON_ONCE(iter->type != NFT_ITER_READ &&
 		     iter->type != NFT_ITER_UPDATE);
 
+	if (iter->type == NFT_ITER_UPDATE)
+		pipapo_clone_ready(set);
+
+	/* Without an up-to-date working copy, there are no pending changes */
 	rcu_read_lock();
-	if (iter->type == NFT_ITER_READ)
+	if (iter->type == NFT_ITER_READ || !priv->clone || priv->clone_stale)
 		m = rcu_dereference(priv->match);
 	else
 		m = priv->clone;
@@ -2174,6 +2567,7 @@ static int nft_pipapo_init(const struct nft_set *set,
 
 		f->bsize = 0;
 		f->rules = 0;
+		f->rules_alloc = 0;
 		NFT_PIPAPO_LT_ASSIGN(f, NULL);
 		f->mt = NULL;
 	}
@@ -2186,6 +2580,9 @@ static int nft_pipapo_init(const struct nft_set *set,
 	}
 
 	priv->dirty = false;
+	priv->clone_stale = false;
+	INIT_LIST_HEAD(&priv->log);
+	pipapo_log_reset(priv, false);
 
 	rcu_assign_pointer(priv->match, m);
 
@@ -2240,6 +2637,13 @@ static void nft_pipapo_destroy(const struct nft_ctx *ctx,
 	int cpu;
 
 	m = rcu_dereference_protected(priv->match, true);
+
+	/* A stale working copy doesn't reference all the current elements */
+	if (priv->clone && !priv->clone_stale)
+		nft_set_pipapo_match_destroy(ctx, set, priv->clone);
+	else if (m)
+		nft_set_pipapo_match_destroy(ctx, set, m);
+
 	if (m) {
 		rcu_barrier();
 
@@ -2252,10 +2656,6 @@ static void nft_pipapo_destroy(const struct nft_ctx *ctx,
 	}
 
 	if (priv->clone) {
-		m = priv->clone;
-
-		nft_set_pipapo_match_destroy(ctx, set, m);
-
 		for_each_possible_cpu(cpu)
 			pipapo_free_scratch(priv->clone, cpu);
 		free_percpu(priv->clone->scratch);
@@ -2264,6 +2664,8 @@ static void nft_pipapo_destroy(const struct nft_ctx *ctx,
 		kfree(priv->clone);
 		priv->clone = NULL;
 	}
+
+	pipapo_log_reset(priv, false);
 }
 
 /**
@@ -2328,4 +2730,52 @@ const struct nft_set_type nft_set_pipapo_avx2_type = {
 		.elemsize	= offsetof(struct nft_pipapo_elem, ext),
 	},
 };
+
+const struct nft_set_type nft_set_pipapo_avx512_type = {
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_OBJECT |
+			  NFT_SET_TIMEOUT,
+	.ops		= {
+		.lookup		= nft_pipapo_avx512_lookup,
+		.insert		= nft_pipapo_insert,
+		.activate	= nft_pipapo_activate,
+		.deactivate	= nft_pipapo_deactivate,
+		.flush		= nft_pipapo_flush,
+		.remove		= nft_pipapo_remove,
+		.walk		= nft_pipapo_walk,
+		.get		= nft_pipapo_get,
+		.privsize	= nft_pipapo_privsize,
+		.estimate	= nft_pipapo_avx512_estimate,
+		.init		= nft_pipapo_init,
+		.destroy	= nft_pipapo_destroy,
+		.gc_init	= nft_pipapo_gc_init,
+		.commit		= nft_pipapo_commit,
+		.abort		= nft_pipapo_abort,
+		.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	},
+};
+#endif
+
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+const struct nft_set_type nft_set_pipapo_neon_type = {
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_OBJECT |
+			  NFT_SET_TIMEOUT,
+	.ops		= {
+		.lookup		= nft_pipapo_neon_lookup,
+		.insert		= nft_pipapo_insert,
+		.activate	= nft_pipapo_activate,
+		.deactivate	= nft_pipapo_deactivate,
+		.flush		= nft_pipapo_flush,
+		.remove		= nft_pipapo_remove,
+		.walk		= nft_pipapo_walk,
+		.get		= nft_pipapo_get,
+		.privsize	= nft_pipapo_privsize,
+		.estimate	= nft_pipapo_neon_estimate,
+		.init		= nft_pipapo_init,
+		.destroy	= nft_pipapo_destroy,
+		.gc_init	= nft_pipapo_gc_init,
+		.commit		= nft_pipapo_commit,
+		.abort		= nft_pipapo_abort,
+		.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	},
+};
 #endif
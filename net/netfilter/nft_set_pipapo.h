@@ -24,6 +24,10 @@
 		     (NFT_PIPAPO_GROUP_BITS_LARGE_SET != 4))
 #define NFT_PIPAPO_GROUPS_PER_BYTE(f)	(BITS_PER_BYTE / (f)->bb)
 
+/* Largest number of bit groups in a field */
+#define NFT_PIPAPO_MAX_GROUPS						\
+	(NFT_PIPAPO_MAX_BITS / NFT_PIPAPO_GROUP_BITS_LARGE_SET)
+
 /* If a lookup table gets bigger than NFT_PIPAPO_LT_SIZE_HIGH, switch to the
  * small group width, and switch to the big group width if the table gets
  * smaller than NFT_PIPAPO_LT_SIZE_LOW.
@@ -39,6 +43,12 @@
 #define NFT_PIPAPO_LT_SIZE_LOW		NFT_PIPAPO_LT_SIZE_THRESHOLD -	\
 					NFT_PIPAPO_LT_SIZE_HYSTERESIS
 
+/* Mapping tables grow and shrink in chunks of this many buckets, so that
+ * inserting or deleting a single element doesn't copy the whole table.
+ */
+#define NFT_PIPAPO_MT_CHUNK		(PAGE_SIZE /			\
+					 sizeof(union nft_pipapo_map_bucket))
+
 /* Fields are padded to 32 bits in input registers */
 #define NFT_PIPAPO_GROUPS_PADDED_SIZE(f)				\
 	(round_up((f)->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f), sizeof(u32)))
@@ -81,6 +91,17 @@
 #define NFT_PIPAPO_LT_ASSIGN(field, x)	((field)->lt = (x))
 #endif /* NFT_PIPAPO_ALIGN */
 
+/* Highest vector width the lookup implementations may use, see the
+ * nf_tables.pipapo_simd module parameter
+ */
+enum nft_pipapo_simd {
+	NFT_PIPAPO_SIMD_NONE,		/* Generic C implementation only */
+	NFT_PIPAPO_SIMD_256,		/* Also AVX2 and NEON */
+	NFT_PIPAPO_SIMD_512,		/* Also AVX-512 */
+};
+
+extern unsigned int nft_pipapo_simd;
+
 #define nft_pipapo_for_each_field(field, index, match)		\
 	for ((field) = (match)->f, (index) = 0;			\
 	     (index) < (match)->field_count;			\
@@ -112,6 +133,7 @@ union nft_pipapo_map_bucket {
  * struct nft_pipapo_field - Lookup, mapping tables and related data for a field
  * @groups:	Amount of bit groups
  * @rules:	Number of inserted rules
+ * @rules_alloc: Number of allocated mapping table buckets
  * @bsize:	Size of each bucket in lookup table, in longs
  * @bb:		Number of bits grouped together in lookup table buckets
  * @lt:		Lookup table: 'groups' rows of buckets
@@ -121,6 +143,7 @@ union nft_pipapo_map_bucket {
 struct nft_pipapo_field {
 	int groups;
 	unsigned long rules;
+	unsigned long rules_alloc;
 	size_t bsize;
 	int bb;
 #ifdef NFT_PIPAPO_ALIGN
@@ -164,14 +187,25 @@ struct nft_pipapo_match {
  * @clone:	Copy where pending insertions and deletions are kept
  * @width:	Total bytes to be matched for one packet, including padding
  * @dirty:	Working copy has pending insertions or deletions
+ * @clone_stale: Working copy is the previous matching data, behind by @log
+ * @log_overflow: @log is incomplete, working copy can't be brought up to date
  * @last_gc:	Timestamp of last garbage collection run, jiffies
+ * @clone_gp:	RCU grace period cookie, stale working copy is unused after it
+ * @log:	Changes made in the current transaction, or, if @clone_stale,
+ *		changes from the last committed transaction yet to be replayed
+ * @log_cost:	Estimate of bytes of tables touched by replaying @log
  */
 struct nft_pipapo {
 	struct nft_pipapo_match __rcu *match;
 	struct nft_pipapo_match *clone;
 	int width;
 	bool dirty;
+	bool clone_stale;
+	bool log_overflow;
 	unsigned long last_gc;
+	unsigned long clone_gp;
+	struct list_head log;
+	size_t log_cost;
 };
 
 struct nft_pipapo_elem;
@@ -235,6 +269,36 @@ static inline void pipapo_and_field_buckets_8bit(const struct nft_pipapo_field *
 	}
 }
 
+/**
+ * pipapo_bucket_offsets() - Find lookup table buckets selected by packet data
+ * @f:		Field including lookup table
+ * @off:	Filled with offset of selected bucket for each group, in longs
+ * @data:	Input data selecting table buckets
+ *
+ * Vectorised implementations intersect buckets from all the groups for one
+ * chunk of the bitmap at a time, instead of going through the whole bitmap
+ * once per group, so they need all the bucket positions upfront.
+ */
+static inline void pipapo_bucket_offsets(const struct nft_pipapo_field *f,
+					 unsigned long *off, const u8 *data)
+{
+	int group;
+
+	for (group = 0; group < f->groups; group++) {
+		u8 v;
+
+		if (f->bb == 8)
+			v = data[group];
+		else if (group % 2)
+			v = data[group / 2] & 0x0f;
+		else
+			v = data[group / 2] >> 4;
+		NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+		off[group] = (group * NFT_PIPAPO_BUCKETS(f->bb) + v) * f->bsize;
+	}
+}
+
 /**
  * pipapo_estimate_size() - Estimate worst-case for set size
  * @desc:	Set description, element count and field description used here
@@ -1098,6 +1098,9 @@ bool nft_pipapo_avx2_estimate(const struct nft_set_desc *desc, u32 features,
 	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
 		return false;
 
+	if (nft_pipapo_simd < NFT_PIPAPO_SIMD_256)
+		return false;
+
 	if (!boot_cpu_has(X86_FEATURE_AVX2) || !boot_cpu_has(X86_FEATURE_AVX))
 		return false;
 
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: AVX-512 packet lookup routines
+ *
+ * Intersect lookup table buckets 512 bits at a time, using ternary logic to
+ * AND two buckets into the result with a single instruction. Matching
+ * results are then processed by the generic pipapo_refill().
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <linux/compiler.h>
+#include <asm/fpu/api.h>
+#include <asm/intel-family.h>
+
+#include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_avx512.h"
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_LONGS_PER_M512	(512 / BITS_PER_LONG)
+
+/* Buckets are NFT_PIPAPO_ALIGN (32 bytes) aligned, which is half a ZMM
+ * register: use unaligned loads and stores, masked by k1. Lanes masked out
+ * read as zero, and are not written.
+ */
+#define NFT_PIPAPO_AVX512_LOAD(reg, loc)				\
+	asm volatile("vmovdqu64 %0, %%zmm" #reg "%{%%k1%}%{z%}"	\
+		     : : "m" (loc))
+
+/* Store result from ZMM register into memory, lanes given by k1 */
+#define NFT_PIPAPO_AVX512_STORE(loc, reg)				\
+	asm volatile("vmovdqu64 %%zmm" #reg ", %0%{%%k1%}"		\
+		     : "=m" (loc) : : "memory")
+
+/* Set mask of 64-bit lanes used by loads and stores */
+#define NFT_PIPAPO_AVX512_MASK(lanes)					\
+	asm volatile("kmovw %0, %%k1" : : "r" ((u32)(lanes)))
+
+/* Three-way AND, @dst &= @a & @b: truth table 0x80 is A & B & C */
+#define NFT_PIPAPO_AVX512_AND3(dst, a, b)				\
+	asm volatile("vpternlogq $0x80, %zmm" #b ", %zmm" #a ", %zmm" #dst)
+
+/* Bitwise AND, @dst = @a & @b */
+#define NFT_PIPAPO_AVX512_AND(dst, a, b)				\
+	asm volatile("vpandq %zmm" #a ", %zmm" #b ", %zmm" #dst)
+
+/* Jump to label if @reg is zero */
+#define NFT_PIPAPO_AVX512_NOMATCH_GOTO(reg, label)			\
+	asm goto("vptestmq %%zmm" #reg ", %%zmm" #reg ", %%k2;"	\
+		 "kortestw %%k2, %%k2;"					\
+		 "jz %l[" #label "]" : : : : label)
+
+/**
+ * nft_pipapo_avx512_and_buckets() - Intersect buckets for all groups in field
+ * @f:		Field including lookup table
+ * @map:	Previous match result, replaced by current match result
+ * @pkt:	Packet data, pointer to input nftables register
+ *
+ * This is the equivalent of pipapo_and_field_buckets_4bit() and
+ * pipapo_and_field_buckets_8bit(), but instead of going through the bitmap
+ * once per group, it loads one 512-bit chunk of the bitmap, intersects it with
+ * the same chunk of the selected bucket for each group, and stores it back.
+ * Chunks that are already empty are skipped altogether.
+ *
+ * Return: true if any bit is set in the result, false otherwise.
+ */
+static bool nft_pipapo_avx512_and_buckets(const struct nft_pipapo_field *f,
+					  unsigned long *map, const u8 *pkt)
+{
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned long off[NFT_PIPAPO_MAX_GROUPS];
+	size_t i, bsize = f->bsize;
+	bool match = false;
+	int g;
+
+	pipapo_bucket_offsets(f, off, pkt);
+
+	NFT_PIPAPO_AVX512_MASK(GENMASK(NFT_PIPAPO_LONGS_PER_M512 - 1, 0));
+
+	for (i = 0; i < bsize; i += NFT_PIPAPO_LONGS_PER_M512) {
+		/* Buckets are a multiple of 256 bits: last chunk can be half */
+		if (unlikely(bsize - i < NFT_PIPAPO_LONGS_PER_M512))
+			NFT_PIPAPO_AVX512_MASK(GENMASK(bsize - i - 1, 0));
+
+		NFT_PIPAPO_AVX512_LOAD(0, map[i]);
+		NFT_PIPAPO_AVX512_NOMATCH_GOTO(0, next);
+
+		for (g = 0; g + 1 < f->groups; g += 2) {
+			NFT_PIPAPO_AVX512_LOAD(1, lt[off[g] + i]);
+			NFT_PIPAPO_AVX512_LOAD(2, lt[off[g + 1] + i]);
+			NFT_PIPAPO_AVX512_AND3(0, 1, 2);
+		}
+
+		if (g < f->groups) {
+			NFT_PIPAPO_AVX512_LOAD(1, lt[off[g] + i]);
+			NFT_PIPAPO_AVX512_AND(0, 0, 1);
+		}
+
+		NFT_PIPAPO_AVX512_STORE(map[i], 0);
+		NFT_PIPAPO_AVX512_NOMATCH_GOTO(0, next);
+		match = true;
+next:
+		;
+	}
+
+	return match;
+}
+
+/**
+ * nft_pipapo_avx512_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * Only AVX512F instructions are used here, but, as for the crypto glue code,
+ * also require AVX512VL and AVX512BW, which leaves out Xeon Phi parts, and skip
+ * Skylake-X, which downclocks too much when using ZMM registers: on those CPUs,
+ * the AVX2 implementation is selected instead.
+ *
+ * Return: true if set is compatible and AVX-512 available, false otherwise.
+ */
+bool nft_pipapo_avx512_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (nft_pipapo_simd < NFT_PIPAPO_SIMD_512 ||
+	    !IS_ENABLED(CONFIG_AS_AVX512) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512F) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512VL) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512BW) ||
+	    !cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+			       XFEATURE_MASK_AVX512, NULL))
+		return false;
+
+	if (boot_cpu_data.x86_vendor == X86_VENDOR_INTEL &&
+	    boot_cpu_data.x86 == 6 &&
+	    boot_cpu_data.x86_model == INTEL_FAM6_SKYLAKE_X)
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_avx512_lookup() - Lookup function for AVX-512 implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c.
+ *
+ * Same as nft_pipapo_lookup(), except for bucket intersection. If the FPU
+ * can't be used in this context, fall back to nft_pipapo_lookup().
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_avx512_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_scratch *scratch;
+	unsigned long *res_map, *fill_map;
+	u8 genmask = nft_genmask_cur(net);
+	const struct nft_pipapo_match *m;
+	const struct nft_pipapo_field *f;
+	const u8 *rp = (const u8 *)key;
+	bool map_index, ret = false;
+	int i;
+
+	local_bh_disable();
+
+	if (unlikely(!irq_fpu_usable())) {
+		bool fallback_res = nft_pipapo_lookup(net, set, key, ext);
+
+		local_bh_enable();
+		return fallback_res;
+	}
+
+	m = rcu_dereference(priv->match);
+
+	if (unlikely(!m || !*raw_cpu_ptr(m->scratch)))
+		goto out;
+
+	/* See nft_pipapo_avx2_lookup() for MXCSR considerations */
+	kernel_fpu_begin_mask(0);
+
+	scratch = *raw_cpu_ptr(m->scratch);
+
+	map_index = scratch->map_index;
+
+	res_map  = scratch->map + (map_index ? m->bsize_max : 0);
+	fill_map = scratch->map + (map_index ? 0 : m->bsize_max);
+
+	pipapo_resmap_init(m, res_map);
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+		int b;
+
+		/* If nothing matches, the result map is already clear */
+		if (!nft_pipapo_avx512_and_buckets(f, res_map, rp)) {
+			scratch->map_index = map_index;
+			goto out_fpu;
+		}
+
+		rp += f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f);
+
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0) {
+			scratch->map_index = map_index;
+			goto out_fpu;
+		}
+
+		if (last) {
+			*ext = &f->mt[b].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask)))
+				goto next_match;
+
+			scratch->map_index = map_index;
+			ret = true;
+			goto out_fpu;
+		}
+
+		map_index = !map_index;
+		swap(res_map, fill_map);
+
+		rp += NFT_PIPAPO_GROUPS_PADDING(f);
+	}
+
+out_fpu:
+	kernel_fpu_end();
+out:
+	local_bh_enable();
+	return ret;
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _NFT_SET_PIPAPO_NEON_H
+#define _NFT_SET_PIPAPO_NEON_H
+
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+bool nft_pipapo_neon_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est);
+bool nft_pipapo_neon_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext);
+
+struct nft_pipapo_field;
+bool nft_pipapo_neon_and_buckets(const struct nft_pipapo_field *f,
+				 unsigned long *map, const u8 *pkt);
+#endif /* defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON) */
+
+#endif /* _NFT_SET_PIPAPO_NEON_H */
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON bucket intersection
+ *
+ * This is built with FP/SIMD registers enabled, so it must only be called
+ * between kernel_neon_begin() and kernel_neon_end(), see
+ * nft_set_pipapo_neon.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <asm/neon-intrinsics.h>
+
+#include "nft_set_pipapo_neon.h"
+#include "nft_set_pipapo.h"
+
+/**
+ * nft_pipapo_neon_and_buckets() - Intersect buckets for all groups in field
+ * @f:		Field including lookup table
+ * @map:	Previous match result, replaced by current match result
+ * @pkt:	Packet data, pointer to input nftables register
+ *
+ * Load one 128-bit chunk of the bitmap, intersect it with the same chunk of
+ * the selected bucket for each group, and store it back. Two chains of ANDs
+ * are interleaved to keep more loads in flight. Chunks that are already empty
+ * are skipped altogether.
+ *
+ * Return: true if any bit is set in the result, false otherwise.
+ */
+bool nft_pipapo_neon_and_buckets(const struct nft_pipapo_field *f,
+				 unsigned long *map, const u8 *pkt)
+{
+	const u64 *lt = (const u64 *)NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned long off[NFT_PIPAPO_MAX_GROUPS];
+	uint64x2_t any = vdupq_n_u64(0);
+	size_t i, bsize = f->bsize;
+	u64 *res = (u64 *)map;
+	u64 tail = 0;
+	int g;
+
+	pipapo_bucket_offsets(f, off, pkt);
+
+	for (i = 0; i + 2 <= bsize; i += 2) {
+		uint64x2_t r0 = vld1q_u64(res + i), r1;
+
+		if (!vmaxvq_u32(vreinterpretq_u32_u64(r0)))
+			continue;
+
+		r1 = vld1q_u64(lt + off[0] + i);
+		for (g = 1; g + 1 < f->groups; g += 2) {
+			r0 = vandq_u64(r0, vld1q_u64(lt + off[g] + i));
+			r1 = vandq_u64(r1, vld1q_u64(lt + off[g + 1] + i));
+		}
+
+		if (g < f->groups)
+			r0 = vandq_u64(r0, vld1q_u64(lt + off[g] + i));
+
+		r0 = vandq_u64(r0, r1);
+		vst1q_u64(res + i, r0);
+		any = vorrq_u64(any, r0);
+	}
+
+	/* Odd bucket size, without NFT_PIPAPO_ALIGN: one word left */
+	if (i < bsize && res[i]) {
+		tail = res[i];
+		for (g = 0; g < f->groups; g++)
+			tail &= lt[off[g] + i];
+		res[i] = tail;
+	}
+
+	return vmaxvq_u32(vreinterpretq_u32_u64(any)) || tail;
+}
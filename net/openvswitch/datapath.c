@@ -242,60 +242,77 @@ void ovs_dp_detach_port(struct vport *p)
 	ovs_vport_del(p);
 }
 
+/* Must be called with rcu_read_lock. */
+static void ovs_dp_process_miss(struct datapath *dp, struct sk_buff *skb,
+				struct sw_flow_key *key)
+{
+	const struct vport *p = OVS_CB(skb)->input_vport;
+	struct dp_upcall_info upcall;
+	int error;
+
+	memset(&upcall, 0, sizeof(upcall));
+	upcall.cmd = OVS_PACKET_CMD_MISS;
+
+	if (dp->user_features & OVS_DP_F_DISPATCH_UPCALL_PER_CPU)
+		upcall.portid =
+		    ovs_dp_get_upcall_portid(dp, smp_processor_id());
+	else
+		upcall.portid = ovs_vport_find_upcall_portid(p, skb);
+
+	upcall.mru = OVS_CB(skb)->mru;
+	error = ovs_dp_upcall(dp, skb, key, &upcall, 0);
+	switch (error) {
+	case 0:
+	case -EAGAIN:
+	case -ERESTARTSYS:
+	case -EINTR:
+		consume_skb(skb);
+		break;
+	default:
+		kfree_skb(skb);
+		break;
+	}
+}
+
+/* Must be called with rcu_read_lock. */
+static void ovs_dp_process_hit(struct datapath *dp, struct sk_buff *skb,
+			       struct sw_flow_key *key, struct sw_flow *flow,
+			       const struct sw_flow_actions *sf_acts)
+{
+	int error;
+
+	ovs_flow_stats_update(flow, key->tp.flags, skb);
+	error = ovs_execute_actions(dp, skb, sf_acts, key);
+	if (unlikely(error))
+		net_dbg_ratelimited("ovs: action execution error on datapath %s: %d\n",
+				    ovs_dp_name(dp), error);
+}
+
 /* Must be called with rcu_read_lock. */
 void ovs_dp_process_packet(struct sk_buff *skb, struct sw_flow_key *key)
 {
 	const struct vport *p = OVS_CB(skb)->input_vport;
 	struct datapath *dp = p->dp;
 	struct sw_flow *flow;
-	struct sw_flow_actions *sf_acts;
 	struct dp_stats_percpu *stats;
 	u64 *stats_counter;
 	u32 n_mask_hit;
 	u32 n_cache_hit;
-	int error;
+	u32 n_emc_hit;
 
 	stats = this_cpu_ptr(dp->stats_percpu);
 
 	/* Look up flow. */
 	flow = ovs_flow_tbl_lookup_stats(&dp->table, key, skb_get_hash(skb),
-					 &n_mask_hit, &n_cache_hit);
+					 &n_mask_hit, &n_cache_hit,
+					 &n_emc_hit);
 	if (unlikely(!flow)) {
-		struct dp_upcall_info upcall;
-
-		memset(&upcall, 0, sizeof(upcall));
-		upcall.cmd = OVS_PACKET_CMD_MISS;
-
-		if (dp->user_features & OVS_DP_F_DISPATCH_UPCALL_PER_CPU)
-			upcall.portid =
-			    ovs_dp_get_upcall_portid(dp, smp_processor_id());
-		else
-			upcall.portid = ovs_vport_find_upcall_portid(p, skb);
-
-		upcall.mru = OVS_CB(skb)->mru;
-		error = ovs_dp_upcall(dp, skb, key, &upcall, 0);
-		switch (error) {
-		case 0:
-		case -EAGAIN:
-		case -ERESTARTSYS:
-		case -EINTR:
-			consume_skb(skb);
-			break;
-		default:
-			kfree_skb(skb);
-			break;
-		}
+		ovs_dp_process_miss(dp, skb, key);
 		stats_counter = &stats->n_missed;
 		goto out;
 	}
 
-	ovs_flow_stats_update(flow, key->tp.flags, skb);
-	sf_acts = rcu_dereference(flow->sf_acts);
-	error = ovs_execute_actions(dp, skb, sf_acts, key);
-	if (unlikely(error))
-		net_dbg_ratelimited("ovs: action execution error on datapath %s: %d\n",
-				    ovs_dp_name(dp), error);
-
+	ovs_dp_process_hit(dp, skb, key, flow, rcu_dereference(flow->sf_acts));
 	stats_counter = &stats->n_hit;
 
 out:
@@ -304,6 +321,75 @@ void ovs_dp_process_packet(struct sk_buff *skb, struct sw_flow_key *key)
 	(*stats_counter)++;
 	stats->n_mask_hit += n_mask_hit;
 	stats->n_cache_hit += n_cache_hit;
+	stats->n_emc_hit += n_emc_hit;
+	u64_stats_update_end(&stats->syncp);
+}
+
+/**
+ * ovs_dp_process_batch - process packets received together on a datapath
+ * @dp: datapath all packets were received on
+ * @skbs: packets, with OVS_CB() set up by the receiving vport
+ * @keys: flow keys extracted from @skbs
+ * @count: number of packets, at most %OVS_RX_BATCH
+ *
+ * All packets are classified first, then actions are executed for the packets
+ * hitting the same flow one after another: packets of a given flow keep their
+ * relative order, packets of different flows may be reordered. Datapath
+ * statistics are updated once for the whole batch.
+ *
+ * Must be called with rcu_read_lock.
+ */
+void ovs_dp_process_batch(struct datapath *dp, struct sk_buff **skbs,
+			  struct sw_flow_key *keys, int count)
+{
+	struct dp_stats_percpu *stats = this_cpu_ptr(dp->stats_percpu);
+	u32 n_mask_hit = 0, n_cache_hit = 0, n_emc_hit = 0;
+	struct sw_flow *flows[OVS_RX_BATCH];
+	u64 n_hit = 0, n_missed = 0;
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		u32 mask_hit, cache_hit, emc_hit;
+
+		flows[i] = ovs_flow_tbl_lookup_stats(&dp->table, &keys[i],
+						     skb_get_hash(skbs[i]),
+						     &mask_hit, &cache_hit,
+						     &emc_hit);
+		n_mask_hit += mask_hit;
+		n_cache_hit += cache_hit;
+		n_emc_hit += emc_hit;
+	}
+
+	for (i = 0; i < count; i++) {
+		const struct sw_flow_actions *sf_acts;
+		struct sw_flow *flow = flows[i];
+
+		if (!skbs[i])
+			continue;
+
+		if (unlikely(!flow)) {
+			ovs_dp_process_miss(dp, skbs[i], &keys[i]);
+			n_missed++;
+			continue;
+		}
+
+		sf_acts = rcu_dereference(flow->sf_acts);
+		for (j = i; j < count; j++) {
+			if (!skbs[j] || flows[j] != flow)
+				continue;
+
+			ovs_dp_process_hit(dp, skbs[j], &keys[j], flow, sf_acts);
+			skbs[j] = NULL;
+			n_hit++;
+		}
+	}
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->n_hit += n_hit;
+	stats->n_missed += n_missed;
+	stats->n_mask_hit += n_mask_hit;
+	stats->n_cache_hit += n_cache_hit;
+	stats->n_emc_hit += n_emc_hit;
 	u64_stats_update_end(&stats->syncp);
 }
 
@@ -749,6 +835,7 @@ static void get_dp_stats(const struct datapath *dp, struct ovs_dp_stats *stats,
 		stats->n_lost += local_stats.n_lost;
 		mega_stats->n_mask_hit += local_stats.n_mask_hit;
 		mega_stats->n_cache_hit += local_stats.n_cache_hit;
+		mega_stats->n_emc_hit += local_stats.n_emc_hit;
 	}
 }
 
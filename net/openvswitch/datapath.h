@@ -23,6 +23,7 @@
 #define DP_MAX_PORTS                USHRT_MAX
 #define DP_VPORT_HASH_BUCKETS       1024
 #define DP_MASKS_REBALANCE_INTERVAL 4000
+#define OVS_RX_BATCH                32
 
 /**
  * struct dp_stats_percpu - per-cpu packet processing statistics for a given
@@ -40,6 +41,8 @@
  *   up per packet.
  * @n_cache_hit: The number of received packets that had their mask found using
  * the mask cache.
+ * @n_emc_hit: The number of received packets that had their flow found using
+ * the exact match cache, without any mask lookup.
  */
 struct dp_stats_percpu {
 	u64 n_hit;
@@ -47,6 +50,7 @@ struct dp_stats_percpu {
 	u64 n_lost;
 	u64 n_mask_hit;
 	u64 n_cache_hit;
+	u64 n_emc_hit;
 	struct u64_stats_sync syncp;
 };
 
@@ -254,6 +258,8 @@ extern struct notifier_block ovs_dp_device_notifier;
 extern struct genl_family dp_vport_genl_family;
 
 void ovs_dp_process_packet(struct sk_buff *skb, struct sw_flow_key *key);
+void ovs_dp_process_batch(struct datapath *dp, struct sk_buff **skbs,
+			  struct sw_flow_key *keys, int count);
 void ovs_dp_detach_port(struct vport *);
 int ovs_dp_upcall(struct datapath *, struct sk_buff *,
 		  const struct sw_flow_key *, const struct dp_upcall_info *,
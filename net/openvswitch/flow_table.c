@@ -42,6 +42,9 @@
 #define MC_HASH_SHIFT		8
 #define MC_HASH_SEGS		((sizeof(uint32_t) * 8) / MC_HASH_SHIFT)
 
+#define EMC_MIN_ENTRIES		256
+#define EMC_MAX_ENTRIES		1024
+
 static struct kmem_cache *flow_cache;
 struct kmem_cache *flow_stats_cache __read_mostly;
 
@@ -389,6 +392,68 @@ static struct mask_cache *tbl_mask_cache_alloc(u32 size)
 	new->mask_cache = cache;
 	return new;
 }
+
+static void __emc_destroy(struct flow_emc *emc)
+{
+	free_percpu(emc->entries);
+	kfree(emc);
+}
+
+static void emc_rcu_cb(struct rcu_head *rcu)
+{
+	struct flow_emc *emc = container_of(rcu, struct flow_emc, rcu);
+
+	__emc_destroy(emc);
+}
+
+static struct flow_emc *tbl_emc_alloc(u32 size)
+{
+	struct flow_emc *new;
+
+	if (!is_power_of_2(size) ||
+	    (size * sizeof(struct flow_emc_entry)) > PCPU_MIN_UNIT_SIZE)
+		return NULL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->entries = __alloc_percpu(array_size(sizeof(struct flow_emc_entry),
+						 size),
+				      __alignof__(struct flow_emc_entry));
+	if (!new->entries) {
+		kfree(new);
+		return NULL;
+	}
+
+	new->cache_size = size;
+	return new;
+}
+
+/* Size the exact match cache after the number of flows, with some hysteresis
+ * on the way down. Must be called with OVS mutex held.
+ */
+static void tbl_emc_resize(struct flow_table *table)
+{
+	struct flow_emc *emc = ovsl_dereference(table->emc);
+	struct flow_emc *new;
+	u32 size;
+
+	size = roundup_pow_of_two(max(table->count, 1U));
+	size = clamp_t(u32, size, EMC_MIN_ENTRIES, EMC_MAX_ENTRIES);
+	if (size == emc->cache_size ||
+	    (size < emc->cache_size && size * 4 > emc->cache_size))
+		return;
+
+	/* On failure keep the current cache, it is just smaller than ideal. */
+	new = tbl_emc_alloc(size);
+	if (!new)
+		return;
+
+	rcu_assign_pointer(table->emc, new);
+	call_rcu(&emc->rcu, emc_rcu_cb);
+}
+
 int ovs_flow_tbl_masks_cache_resize(struct flow_table *table, u32 size)
 {
 	struct mask_cache *mc = rcu_dereference_ovsl(table->mask_cache);
@@ -416,14 +481,19 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	struct table_instance *ti, *ufid_ti;
 	struct mask_cache *mc;
 	struct mask_array *ma;
+	struct flow_emc *emc;
 
 	mc = tbl_mask_cache_alloc(MC_DEFAULT_HASH_ENTRIES);
 	if (!mc)
 		return -ENOMEM;
 
+	emc = tbl_emc_alloc(EMC_MIN_ENTRIES);
+	if (!emc)
+		goto free_mask_cache;
+
 	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
 	if (!ma)
-		goto free_mask_cache;
+		goto free_emc;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ti)
@@ -437,6 +507,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
 	rcu_assign_pointer(table->mask_array, ma);
 	rcu_assign_pointer(table->mask_cache, mc);
+	rcu_assign_pointer(table->emc, emc);
+	table->emc_gen = 0;
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -446,6 +518,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	__table_instance_destroy(ti);
 free_mask_array:
 	__mask_array_destroy(ma);
+free_emc:
+	__emc_destroy(emc);
 free_mask_cache:
 	__mask_cache_destroy(mc);
 	return -ENOMEM;
@@ -472,6 +546,13 @@ static void table_instance_flow_free(struct flow_table *table,
 		table->ufid_count--;
 	}
 
+	/* Exact match cache entries don't hold a reference to the flow: bump
+	 * the generation once the flow is unlinked, so that readers seeing the
+	 * new value can't find it anymore, and those that don't are covered by
+	 * the grace period before it's freed.
+	 */
+	smp_store_release(&table->emc_gen, table->emc_gen + 1);
+
 	flow_mask_remove(table, flow->mask);
 }
 
@@ -519,8 +600,10 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
 	struct mask_cache *mc = rcu_dereference_raw(table->mask_cache);
 	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
+	struct flow_emc *emc = rcu_dereference_raw(table->emc);
 
 	call_rcu(&mc->rcu, mask_cache_rcu_cb);
+	call_rcu(&emc->rcu, emc_rcu_cb);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
 	table_instance_destroy(ti, ufid_ti);
 }
@@ -776,6 +859,29 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
 	return NULL;
 }
 
+/* Exact match cache: one slot per skb_hash bucket and CPU, pointing to the
+ * flow found last time. An entry is only trusted if the flow table generation
+ * didn't change since it was filled, and the key still matches the flow under
+ * its own mask: with megaflows not overlapping, that's the flow a full lookup
+ * would return.
+ */
+static struct sw_flow *emc_lookup(const struct flow_emc_entry *e,
+				  const struct sw_flow_key *key,
+				  u32 skb_hash, unsigned long gen)
+{
+	struct sw_flow *flow = e->flow;
+	struct sw_flow_key masked_key;
+
+	if (e->skb_hash != skb_hash || e->gen != gen || !flow)
+		return NULL;
+
+	ovs_flow_mask_key(&masked_key, key, false, flow->mask);
+	if (!flow_cmp_masked_key(flow, &masked_key, &flow->mask->range))
+		return NULL;
+
+	return flow;
+}
+
 /*
  * mask_cache maps flow to probable mask. This cache is not tightly
  * coupled cache, It means updates to  mask list can result in inconsistent
@@ -787,19 +893,24 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 					  const struct sw_flow_key *key,
 					  u32 skb_hash,
 					  u32 *n_mask_hit,
-					  u32 *n_cache_hit)
+					  u32 *n_cache_hit,
+					  u32 *n_emc_hit)
 {
 	struct mask_cache *mc = rcu_dereference(tbl->mask_cache);
 	struct mask_array *ma = rcu_dereference(tbl->mask_array);
 	struct table_instance *ti = rcu_dereference(tbl->ti);
+	struct flow_emc *emc = rcu_dereference(tbl->emc);
 	struct mask_cache_entry *entries, *ce;
+	struct flow_emc_entry *ee;
 	struct sw_flow *flow;
+	unsigned long gen;
 	u32 hash;
 	int seg;
 
 	*n_mask_hit = 0;
 	*n_cache_hit = 0;
-	if (unlikely(!skb_hash || mc->cache_size == 0)) {
+	*n_emc_hit = 0;
+	if (unlikely(!skb_hash)) {
 		u32 mask_index = 0;
 		u32 cache = 0;
 
@@ -813,6 +924,24 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	if (key->recirc_id)
 		skb_hash = jhash_1word(skb_hash, key->recirc_id);
 
+	/* Pairs with smp_store_release() in table_instance_flow_free(). */
+	gen = smp_load_acquire(&tbl->emc_gen);
+	ee = &this_cpu_ptr(emc->entries)[skb_hash & (emc->cache_size - 1)];
+	flow = emc_lookup(ee, key, skb_hash, gen);
+	if (flow) {
+		(*n_emc_hit)++;
+		return flow;
+	}
+
+	if (unlikely(mc->cache_size == 0)) {
+		u32 mask_index = 0;
+		u32 cache = 0;
+
+		flow = flow_lookup(tbl, ti, ma, key, n_mask_hit, &cache,
+				   &mask_index);
+		goto out;
+	}
+
 	ce = NULL;
 	hash = skb_hash;
 	entries = this_cpu_ptr(mc->mask_cache);
@@ -828,7 +957,7 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 					   n_cache_hit, &e->mask_index);
 			if (!flow)
 				e->skb_hash = 0;
-			return flow;
+			goto out;
 		}
 
 		if (!ce || e->skb_hash < ce->skb_hash)
@@ -844,6 +973,12 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 		ce->skb_hash = skb_hash;
 
 	*n_cache_hit = 0;
+out:
+	if (flow) {
+		ee->skb_hash = skb_hash;
+		ee->flow = flow;
+		ee->gen = gen;
+	}
 	return flow;
 }
 
@@ -963,6 +1098,7 @@ void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow)
 
 	BUG_ON(table->count == 0);
 	table_instance_flow_free(table, ti, ufid_ti, flow);
+	tbl_emc_resize(table);
 }
 
 static struct sw_flow_mask *mask_alloc(void)
@@ -1056,6 +1192,8 @@ static void flow_key_insert(struct flow_table *table, struct sw_flow *flow)
 		call_rcu(&ti->rcu, flow_tbl_destroy_rcu_cb);
 		table->last_rehash = jiffies;
 	}
+
+	tbl_emc_resize(table);
 }
 
 /* Must be called with OVS mutex held. */
@@ -33,6 +33,18 @@ struct mask_cache {
 	struct mask_cache_entry __percpu *mask_cache;
 };
 
+struct flow_emc_entry {
+	u32 skb_hash;
+	struct sw_flow *flow;
+	unsigned long gen;
+};
+
+struct flow_emc {
+	struct rcu_head rcu;
+	u32 cache_size;  /* Must be ^2 value. */
+	struct flow_emc_entry __percpu *entries;
+};
+
 struct mask_count {
 	int index;
 	u64 counter;
@@ -64,6 +76,8 @@ struct flow_table {
 	struct table_instance __rcu *ufid_ti;
 	struct mask_cache __rcu *mask_cache;
 	struct mask_array __rcu *mask_array;
+	struct flow_emc __rcu *emc;
+	unsigned long emc_gen;
 	unsigned long last_rehash;
 	unsigned int count;
 	unsigned int ufid_count;
@@ -94,7 +108,8 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *,
 					  const struct sw_flow_key *,
 					  u32 skb_hash,
 					  u32 *n_mask_hit,
-					  u32 *n_cache_hit);
+					  u32 *n_cache_hit,
+					  u32 *n_emc_hit);
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *,
 				    const struct sw_flow_key *);
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
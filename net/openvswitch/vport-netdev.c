@@ -25,9 +25,27 @@
 
 static struct vport_ops ovs_netdev_vport_ops;
 
-/* Must be called with rcu_read_lock. */
-static void netdev_port_receive(struct sk_buff *skb)
+/* Packets received in a NAPI burst are queued here, and handed to the
+ * datapath in batches by a per-CPU NAPI context, polled once the burst is
+ * over.
+ */
+struct netdev_rx_batch {
+	struct sk_buff_head queue;
+	struct napi_struct napi;
+	struct sk_buff *skbs[OVS_RX_BATCH];
+	struct net_device *devs[OVS_RX_BATCH];
+	struct sw_flow_key keys[OVS_RX_BATCH];
+};
+
+static struct netdev_rx_batch __percpu *netdev_rx_batches;
+static struct net_device netdev_rx_napi_dev;
+
+/* Must be called with rcu_read_lock. Returns the vport @skb was received on,
+ * or NULL if the packet was consumed.
+ */
+static struct vport *netdev_port_prepare(struct sk_buff **pskb)
 {
+	struct sk_buff *skb = *pskb;
 	struct vport *vport;
 
 	vport = ovs_netdev_get_vport(skb->dev);
@@ -41,27 +59,127 @@ static void netdev_port_receive(struct sk_buff *skb)
 	 * packet for anyone who came before us (e.g. tcpdump via AF_PACKET).
 	 */
 	skb = skb_share_check(skb, GFP_ATOMIC);
+	*pskb = skb;
 	if (unlikely(!skb))
-		return;
+		return NULL;
 
 	if (skb->dev->type == ARPHRD_ETHER)
 		skb_push_rcsum(skb, ETH_HLEN);
 
-	ovs_vport_receive(vport, skb, skb_tunnel_info(skb));
-	return;
+	return vport;
 error:
 	kfree_skb(skb);
+	return NULL;
+}
+
+/* Must be called with rcu_read_lock. */
+static void netdev_rx_batch_flush(struct netdev_rx_batch *batch,
+				  struct datapath *dp, int count)
+{
+	int i;
+
+	ovs_dp_process_batch(dp, batch->skbs, batch->keys, count);
+
+	for (i = 0; i < count; i++)
+		dev_put(batch->devs[i]);
+}
+
+static int netdev_rx_batch_poll(struct napi_struct *napi, int budget)
+{
+	struct netdev_rx_batch *batch;
+	struct datapath *dp = NULL;
+	int work = 0, count = 0;
+
+	batch = container_of(napi, struct netdev_rx_batch, napi);
+
+	rcu_read_lock();
+	while (work < budget) {
+		struct sk_buff *skb = __skb_dequeue(&batch->queue);
+		struct net_device *dev;
+		struct vport *vport;
+
+		if (!skb)
+			break;
+
+		work++;
+		dev = skb->dev;
+		vport = netdev_port_prepare(&skb);
+		if (unlikely(!vport)) {
+			dev_put(dev);
+			continue;
+		}
+
+		if (count && (vport->dp != dp || count == OVS_RX_BATCH)) {
+			netdev_rx_batch_flush(batch, dp, count);
+			count = 0;
+		}
+
+		if (unlikely(ovs_vport_receive_key(vport, skb,
+						   skb_tunnel_info(skb),
+						   &batch->keys[count]))) {
+			dev_put(dev);
+			continue;
+		}
+
+		dp = vport->dp;
+		batch->skbs[count] = skb;
+		batch->devs[count] = dev;
+		count++;
+	}
+
+	if (count)
+		netdev_rx_batch_flush(batch, dp, count);
+	rcu_read_unlock();
+
+	/* Actions may have looped packets back to us while the last batch was
+	 * processed: stay scheduled in that case.
+	 */
+	if (work < budget && skb_queue_empty(&batch->queue))
+		napi_complete_done(napi, work);
+	else
+		work = budget;
+
+	return work;
 }
 
 /* Called with rcu_read_lock and bottom-halves disabled. */
 static rx_handler_result_t netdev_frame_hook(struct sk_buff **pskb)
 {
+	enum skb_drop_reason reason = SKB_DROP_REASON_CPU_BACKLOG;
 	struct sk_buff *skb = *pskb;
+	struct netdev_rx_batch *batch;
 
 	if (unlikely(skb->pkt_type == PACKET_LOOPBACK))
 		return RX_HANDLER_PASS;
 
-	netdev_port_receive(skb);
+	/* Bounded like the backlog of enqueue_to_backlog() */
+	batch = this_cpu_ptr(netdev_rx_batches);
+	if (unlikely(skb_queue_len(&batch->queue) >=
+		     READ_ONCE(netdev_max_backlog)))
+		goto drop;
+
+	/* A non-refcounted dst, e.g. tunnel metadata, doesn't outlive the
+	 * current RCU read-side section: take a reference, so that the packet
+	 * can be queued behind the ones of the same flow received before.
+	 */
+	if (unlikely(skb_dst_is_noref(skb)) && !skb_dst_force(skb)) {
+		reason = SKB_DROP_REASON_NOT_SPECIFIED;
+		goto drop;
+	}
+
+	/* Keep the device around until the packet is processed, vports only
+	 * go away after an RCU grace period.
+	 */
+	dev_hold(skb->dev);
+
+	__skb_queue_tail(&batch->queue, skb);
+	napi_schedule(&batch->napi);
+
+	return RX_HANDLER_CONSUMED;
+
+drop:
+	dev_core_stats_rx_dropped_inc(skb->dev);
+	kfree_skb_reason(skb, reason);
 	return RX_HANDLER_CONSUMED;
 }
 
@@ -198,12 +316,67 @@ static struct vport_ops ovs_netdev_vport_ops = {
 	.send		= dev_queue_xmit,
 };
 
+static void netdev_rx_batch_purge(struct netdev_rx_batch *batch)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&batch->queue))) {
+		dev_put(skb->dev);
+		kfree_skb(skb);
+	}
+}
+
 int __init ovs_netdev_init(void)
 {
-	return ovs_vport_ops_register(&ovs_netdev_vport_ops);
+	int cpu, err;
+
+	netdev_rx_batches = alloc_percpu(struct netdev_rx_batch);
+	if (!netdev_rx_batches)
+		return -ENOMEM;
+
+	init_dummy_netdev(&netdev_rx_napi_dev);
+	for_each_possible_cpu(cpu) {
+		struct netdev_rx_batch *batch;
+
+		batch = per_cpu_ptr(netdev_rx_batches, cpu);
+		__skb_queue_head_init(&batch->queue);
+		netif_napi_add(&netdev_rx_napi_dev, &batch->napi,
+			       netdev_rx_batch_poll);
+		napi_enable(&batch->napi);
+	}
+
+	err = ovs_vport_ops_register(&ovs_netdev_vport_ops);
+	if (err)
+		goto err_napi;
+
+	return 0;
+
+err_napi:
+	for_each_possible_cpu(cpu) {
+		struct netdev_rx_batch *batch;
+
+		batch = per_cpu_ptr(netdev_rx_batches, cpu);
+		napi_disable(&batch->napi);
+		netif_napi_del(&batch->napi);
+	}
+	free_percpu(netdev_rx_batches);
+	return err;
 }
 
 void ovs_netdev_exit(void)
 {
+	int cpu;
+
 	ovs_vport_ops_unregister(&ovs_netdev_vport_ops);
+
+	/* All vports are gone, nothing can be queued anymore. */
+	for_each_possible_cpu(cpu) {
+		struct netdev_rx_batch *batch;
+
+		batch = per_cpu_ptr(netdev_rx_batches, cpu);
+		napi_disable(&batch->napi);
+		netif_napi_del(&batch->napi);
+		netdev_rx_batch_purge(batch);
+	}
+	free_percpu(netdev_rx_batches);
 }
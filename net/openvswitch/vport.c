@@ -482,19 +482,19 @@ u32 ovs_vport_find_upcall_portid(const struct vport *vport,
 }
 
 /**
- *	ovs_vport_receive - pass up received packet to the datapath for processing
+ *	ovs_vport_receive_key - prepare received packet for the datapath
  *
  * @vport: vport that received the packet
  * @skb: skb that was received
  * @tun_info: tunnel (if any) that carried packet
+ * @key: flow key to fill from @skb
  *
- * Must be called with rcu_read_lock.  The packet cannot be shared and
- * skb->data should point to the Ethernet header.
+ * Same requirements as ovs_vport_receive().  On error, @skb is freed.
  */
-int ovs_vport_receive(struct vport *vport, struct sk_buff *skb,
-		      const struct ip_tunnel_info *tun_info)
+int ovs_vport_receive_key(struct vport *vport, struct sk_buff *skb,
+			  const struct ip_tunnel_info *tun_info,
+			  struct sw_flow_key *key)
 {
-	struct sw_flow_key key;
 	int error;
 
 	OVS_CB(skb)->input_vport = vport;
@@ -510,11 +510,33 @@ int ovs_vport_receive(struct vport *vport, struct sk_buff *skb,
 	}
 
 	/* Extract flow from 'skb' into 'key'. */
-	error = ovs_flow_key_extract(tun_info, skb, &key);
-	if (unlikely(error)) {
+	error = ovs_flow_key_extract(tun_info, skb, key);
+	if (unlikely(error))
 		kfree_skb(skb);
+
+	return error;
+}
+
+/**
+ *	ovs_vport_receive - pass up received packet to the datapath for processing
+ *
+ * @vport: vport that received the packet
+ * @skb: skb that was received
+ * @tun_info: tunnel (if any) that carried packet
+ *
+ * Must be called with rcu_read_lock.  The packet cannot be shared and
+ * skb->data should point to the Ethernet header.
+ */
+int ovs_vport_receive(struct vport *vport, struct sk_buff *skb,
+		      const struct ip_tunnel_info *tun_info)
+{
+	struct sw_flow_key key;
+	int error;
+
+	error = ovs_vport_receive_key(vport, skb, tun_info, &key);
+	if (unlikely(error))
 		return error;
-	}
+
 	ovs_dp_process_packet(skb, &key);
 	return 0;
 }
@@ -190,6 +190,8 @@ static inline struct vport *vport_from_priv(void *priv)
 
 int ovs_vport_receive(struct vport *, struct sk_buff *,
 		      const struct ip_tunnel_info *);
+int ovs_vport_receive_key(struct vport *, struct sk_buff *,
+			  const struct ip_tunnel_info *, struct sw_flow_key *);
 
 static inline const char *ovs_vport_name(struct vport *vport)
 {
@@ -293,7 +293,7 @@ int smc_cdc_get_free_slot(struct smc_connection *conn,
 			  struct smc_cdc_tx_pend **pend);
 void smc_cdc_wait_pend_tx_wr(struct smc_connection *conn);
 int smc_cdc_msg_send(struct smc_connection *conn, struct smc_wr_buf *wr_buf,
-		     struct smc_cdc_tx_pend *pend);
+		     struct smc_cdc_tx_pend *pend, struct ib_send_wr *rdma_wrs);
 int smc_cdc_get_slot_and_msg_send(struct smc_connection *conn);
 int smcd_cdc_msg_send(struct smc_connection *conn);
 int smcr_cdc_msg_send_validation(struct smc_connection *conn,
@@ -234,6 +234,14 @@ static int smc_nl_fill_stats_tech_data(struct sk_buff *skb,
 			      smc_tech->cork_cnt,
 			      SMC_NLA_STATS_PAD))
 		goto errattr;
+	if (nla_put_u64_64bit(skb, SMC_NLA_STATS_T_AUTOCORK_CNT,
+			      smc_tech->autocork_cnt,
+			      SMC_NLA_STATS_PAD))
+		goto errattr;
+	if (nla_put_u64_64bit(skb, SMC_NLA_STATS_T_TX_CHAIN_CNT,
+			      smc_tech->tx_chain_cnt,
+			      SMC_NLA_STATS_PAD))
+		goto errattr;
 	if (nla_put_u64_64bit(skb, SMC_NLA_STATS_T_NDLY_CNT,
 			      smc_tech->ndly_cnt,
 			      SMC_NLA_STATS_PAD))
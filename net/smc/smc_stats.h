@@ -74,6 +74,8 @@ struct smc_stats_tech {
 	u64			urg_data_cnt;
 	u64			splice_cnt;
 	u64			cork_cnt;
+	u64			autocork_cnt;
+	u64			tx_chain_cnt;
 	u64			ndly_cnt;
 	u64			rx_bytes;
 	u64			tx_bytes;
@@ -153,6 +153,7 @@ static bool smc_should_autocork(struct smc_sock *smc)
 	if (atomic_read(&conn->cdc_pend_tx_wr) == 0 ||
 	    smc_tx_prepared_sends(conn) > corking_size)
 		return false;
+	SMC_STAT_INC(smc, autocork_cnt);
 	return true;
 }
 
@@ -313,13 +314,14 @@ int smcd_tx_ism_write(struct smc_connection *conn, void *data, size_t len,
 	return rc;
 }
 
-/* sndbuf consumer: actual data transfer of one target chunk with RDMA write */
-static int smc_tx_rdma_write(struct smc_connection *conn, int peer_rmbe_offset,
-			     int num_sges, struct ib_rdma_wr *rdma_wr)
+/* sndbuf consumer: prepare data transfer of one target chunk with RDMA write,
+ * posted later on together with the CDC message
+ */
+static void smc_tx_rdma_write(struct smc_connection *conn, int peer_rmbe_offset,
+			      int num_sges, struct ib_rdma_wr *rdma_wr)
 {
 	struct smc_link_group *lgr = conn->lgr;
 	struct smc_link *link = conn->lnk;
-	int rc;
 
 	rdma_wr->wr.wr_id = smc_wr_tx_get_next_wr_id(link);
 	rdma_wr->wr.num_sge = num_sges;
@@ -330,10 +332,7 @@ static int smc_tx_rdma_write(struct smc_connection *conn, int peer_rmbe_offset,
 		/* offset within RMBE */
 		peer_rmbe_offset;
 	rdma_wr->rkey = lgr->rtokens[conn->rtoken_idx][link->link_idx].rkey;
-	rc = ib_post_send(link->roce_qp, &rdma_wr->wr, NULL);
-	if (rc)
-		smcr_link_down_cond_sched(link);
-	return rc;
+	rdma_wr->wr.next = NULL;
 }
 
 /* sndbuf consumer */
@@ -352,7 +351,7 @@ static inline void smc_tx_advance_cursors(struct smc_connection *conn,
 	smc_curs_add(conn->sndbuf_desc->len, sent, len);
 }
 
-/* SMC-R helper for smc_tx_rdma_writes() */
+/* SMC-R helper for smc_tx_rdma_writes(), returns the number of chained WRs */
 static int smcr_tx_rdma_writes(struct smc_connection *conn, size_t len,
 			       size_t src_off, size_t src_len,
 			       size_t dst_off, size_t dst_len,
@@ -367,7 +366,6 @@ static int smcr_tx_rdma_writes(struct smc_connection *conn, size_t len,
 	int sent_count = src_off;
 	int srcchunk, dstchunk;
 	int num_sges;
-	int rc;
 
 	for (dstchunk = 0; dstchunk < 2; dstchunk++) {
 		struct ib_rdma_wr *wr = &wr_rdma_buf->wr_tx_rdma[dstchunk];
@@ -401,9 +399,9 @@ static int smcr_tx_rdma_writes(struct smc_connection *conn, size_t len,
 			src_len = dst_len - src_len; /* remainder */
 			src_len_sum += src_len;
 		}
-		rc = smc_tx_rdma_write(conn, dst_off, num_sges, wr);
-		if (rc)
-			return rc;
+		smc_tx_rdma_write(conn, dst_off, num_sges, wr);
+		if (dstchunk)
+			wr_rdma_buf->wr_tx_rdma[0].wr.next = &wr->wr;
 		if (dst_len_sum == len)
 			break; /* either on 1st or 2nd iteration */
 		/* prepare next (== 2nd) iteration */
@@ -414,7 +412,7 @@ static int smcr_tx_rdma_writes(struct smc_connection *conn, size_t len,
 				sent_count);
 		src_len_sum = src_len;
 	}
-	return 0;
+	return dstchunk + 1;
 }
 
 /* SMC-D helper for smc_tx_rdma_writes() */
@@ -458,7 +456,9 @@ static int smcd_tx_rdma_writes(struct smc_connection *conn, size_t len,
 }
 
 /* sndbuf consumer: prepare all necessary (src&dst) chunks of data transmit;
- * usable snd_wnd as max transmit
+ * usable snd_wnd as max transmit.
+ * SMC-R only prepares the RDMA writes in @wr_rdma_buf and returns their
+ * number, they are posted in one go with the following CDC message.
  */
 static int smc_tx_rdma_writes(struct smc_connection *conn,
 			      struct smc_rdma_wr *wr_rdma_buf)
@@ -527,7 +527,7 @@ static int smc_tx_rdma_writes(struct smc_connection *conn,
 	else
 		rc = smcr_tx_rdma_writes(conn, len, sent.count, src_len,
 					 dst_off, dst_len, wr_rdma_buf);
-	if (rc)
+	if (rc < 0)
 		return rc;
 
 	if (conn->urg_tx_pend && len == to_send)
@@ -538,7 +538,7 @@ static int smc_tx_rdma_writes(struct smc_connection *conn,
 							/* dst: peer RMBE */
 	smc_curs_copy(&conn->tx_curs_sent, &sent, conn);/* src: local sndbuf */
 
-	return 0;
+	return rc;
 }
 
 /* Wakeup sndbuf consumers from any context (IRQ or process)
@@ -547,6 +547,7 @@ static int smc_tx_rdma_writes(struct smc_connection *conn,
 static int smcr_tx_sndbuf_nonempty(struct smc_connection *conn)
 {
 	struct smc_cdc_producer_flags *pflags = &conn->local_tx_ctrl.prod_flags;
+	struct ib_send_wr *rdma_wrs = NULL;
 	struct smc_link *link = conn->lnk;
 	struct smc_rdma_wr *wr_rdma_buf;
 	struct smc_cdc_tx_pend *pend;
@@ -583,14 +584,23 @@ static int smcr_tx_sndbuf_nonempty(struct smc_connection *conn)
 	}
 	if (!pflags->urg_data_present) {
 		rc = smc_tx_rdma_writes(conn, wr_rdma_buf);
-		if (rc) {
+		if (rc < 0) {
 			smc_wr_tx_put_slot(link,
 					   (struct smc_wr_tx_pend_priv *)pend);
 			goto out_unlock;
 		}
+		/* piggyback the CDC message on the RDMA writes */
+		if (rc)
+			rdma_wrs = &wr_rdma_buf->wr_tx_rdma[0].wr;
 	}
 
-	rc = smc_cdc_msg_send(conn, wr_buf, pend);
+	rc = smc_cdc_msg_send(conn, wr_buf, pend, rdma_wrs);
+	if (!rc && rdma_wrs) {
+		struct smc_sock *smc =
+			container_of(conn, struct smc_sock, conn);
+
+		SMC_STAT_INC(smc, tx_chain_cnt);
+	}
 	if (!rc && pflags->urg_data_present) {
 		pflags->urg_data_pending = 0;
 		pflags->urg_data_present = 0;
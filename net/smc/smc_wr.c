@@ -317,6 +317,36 @@ int smc_wr_tx_send(struct smc_link *link, struct smc_wr_tx_pend_priv *priv)
 	return rc;
 }
 
+/* Post the unsignaled RDMA writes chained at @rdma_wrs together with the
+ * send WR of @priv, so data and CDC message take a single doorbell and a
+ * single completion.
+ */
+int smc_wr_tx_send_rdma(struct smc_link *link,
+			struct smc_wr_tx_pend_priv *priv,
+			struct ib_send_wr *rdma_wrs)
+{
+	struct ib_send_wr *tail = rdma_wrs;
+	struct smc_wr_tx_pend *pend;
+	int rc;
+
+	if (!rdma_wrs)
+		return smc_wr_tx_send(link, priv);
+
+	while (tail->next)
+		tail = tail->next;
+	ib_req_notify_cq(link->smcibdev->roce_cq_send,
+			 IB_CQ_NEXT_COMP | IB_CQ_REPORT_MISSED_EVENTS);
+	pend = container_of(priv, struct smc_wr_tx_pend, priv);
+	tail->next = &link->wr_tx_ibs[pend->idx];
+	rc = ib_post_send(link->roce_qp, rdma_wrs, NULL);
+	tail->next = NULL;
+	if (rc) {
+		smc_wr_tx_put_slot(link, priv);
+		smcr_link_down_cond_sched(link);
+	}
+	return rc;
+}
+
 int smc_wr_tx_v2_send(struct smc_link *link, struct smc_wr_tx_pend_priv *priv,
 		      int len)
 {
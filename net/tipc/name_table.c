@@ -58,6 +58,12 @@
  *   Used by closest_first lookup and multicast lookup algorithm
  * @all_publ: all publications identical to this one, whatever node and scope
  *   Used by round-robin lookup algorithm
+ * @local_cnt: number of publications in @local_publ
+ * @all_cnt: number of publications in @all_publ
+ * @rcu: RCU callback head used for deferred freeing
+ *
+ * Both publication lists are RCU lists, so that lookups can walk them without
+ * taking the service lock.
  */
 struct service_range {
 	u32 lower;
@@ -66,6 +72,9 @@ struct service_range {
 	u32 max;
 	struct list_head local_publ;
 	struct list_head all_publ;
+	u32 local_cnt;
+	u32 all_cnt;
+	struct rcu_head rcu;
 };
 
 /**
@@ -73,21 +82,33 @@ struct service_range {
  * @type: 32 bit 'type' value for service
  * @publ_cnt: increasing counter for publications in this service
  * @ranges: rb tree containing all service ranges for this service
- * @service_list: links to adjacent name ranges in hash chain
+ * @service_list: links to adjacent services in name table hash chain
  * @subscriptions: list of subscriptions for this service type
  * @lock: spinlock controlling access to pertaining service ranges/publications
+ * @seq: bumped on any change of @ranges, for lookups done without @lock
+ * @rr_cursor: per-CPU round-robin cursor for anycast lookups
  * @rcu: RCU callback head used for deferred freeing
  */
 struct tipc_service {
 	u32 type;
 	u32 publ_cnt;
 	struct rb_root ranges;
-	struct hlist_node service_list;
+	struct rhash_head service_list;
 	struct list_head subscriptions;
 	spinlock_t lock; /* Covers service range list */
+	seqcount_spinlock_t seq;
+	u32 __percpu *rr_cursor;
 	struct rcu_head rcu;
 };
 
+static const struct rhashtable_params tipc_service_rht_params = {
+	.nelem_hint = TIPC_NAMETBL_SIZE,
+	.head_offset = offsetof(struct tipc_service, service_list),
+	.key_offset = offsetof(struct tipc_service, type),
+	.key_len = sizeof(u32), /* type */
+	.automatic_shrinking = true,
+};
+
 #define service_range_upper(sr) ((sr)->upper)
 RB_DECLARE_CALLBACKS_MAX(static, sr_callbacks,
 			 struct service_range, tree_node, u32, max,
@@ -135,8 +156,11 @@ static struct service_range *service_range_match_first(struct rb_node *n,
 	if (!n || service_range_entry(n)->max < start)
 		return NULL;
 
+	/* Top-down only, so this may also run locklessly, see
+	 * tipc_nametbl_lookup_anycast()
+	 */
 	while (n) {
-		l = n->rb_left;
+		l = rcu_dereference_raw(n->rb_left);
 		if (l && service_range_entry(l)->max >= start) {
 			/* A leftmost overlap range node must be one in the left
 			 * subtree. If not, it has lower > end, then nodes on
@@ -154,7 +178,7 @@ static struct service_range *service_range_match_first(struct rb_node *n,
 			return sr;
 
 		/* Ok, try to lookup on the right side */
-		r = n->rb_right;
+		r = rcu_dereference_raw(n->rb_right);
 		if (sr->lower <= end &&
 		    r && service_range_entry(r)->max >= start) {
 			n = r;
@@ -215,9 +239,86 @@ static struct service_range *service_range_match_next(struct rb_node *n,
 	return NULL;
 }
 
-static int hash(int x)
+/**
+ * service_range_match_rcu - call a function for each service range matching
+ *                           a range, without holding the service lock
+ * @n: the root node of service range rbtree for searching
+ * @start: beginning of the search range (end >= start) for matching
+ * @end: end of the search range (end >= start) for matching
+ * @fn: function to call for each matching service range
+ * @arg: argument passed to @fn
+ *
+ * Unlike service_range_match_next(), this never follows parent pointers:
+ * rbtree rotations don't create loops through child pointers, so the walk
+ * terminates even if the tree changes meanwhile. Such a change may make the
+ * walk miss or repeat ranges though, so callers must check the service
+ * seqcount and retry, and @fn must cope with being called twice for a range.
+ * Must be called under RCU read lock.
+ */
+static void service_range_match_rcu(struct rb_node *n, u32 start, u32 end,
+				    void (*fn)(struct service_range *sr,
+					       void *arg),
+				    void *arg)
+{
+	struct service_range *sr;
+
+	while (n) {
+		sr = service_range_entry(n);
+		if (sr->max < start)
+			return;
+		service_range_match_rcu(rcu_dereference_raw(n->rb_left),
+					start, end, fn, arg);
+		if (sr->lower > end)
+			return;
+		if (sr->upper >= start)
+			fn(sr, arg);
+		n = rcu_dereference_raw(n->rb_right);
+	}
+}
+
+/**
+ * tipc_service_pick_publ - pick a publication of a service range round-robin
+ * @sr: the service range to pick the publication from
+ * @local: pick from the node local publications only
+ * @cursor: round-robin cursor
+ *
+ * May be called with or without the service lock held, in the latter case
+ * under RCU read lock.
+ *
+ * Return: the publication at position @cursor modulo the number of
+ * publications, or NULL if there are none.
+ */
+static struct publication *tipc_service_pick_publ(struct service_range *sr,
+						  bool local, u32 cursor)
 {
-	return x & (TIPC_NAMETBL_SIZE - 1);
+	struct publication *p, *first = NULL;
+	u32 cnt, i = 0;
+
+	if (local) {
+		cnt = READ_ONCE(sr->local_cnt);
+		if (!cnt)
+			return NULL;
+		cursor %= cnt;
+		list_for_each_entry_rcu(p, &sr->local_publ, local_publ) {
+			if (i++ == cursor)
+				return p;
+			if (!first)
+				first = p;
+		}
+	} else {
+		cnt = READ_ONCE(sr->all_cnt);
+		if (!cnt)
+			return NULL;
+		cursor %= cnt;
+		list_for_each_entry_rcu(p, &sr->all_publ, all_publ) {
+			if (i++ == cursor)
+				return p;
+			if (!first)
+				first = p;
+		}
+	}
+	/* List shrunk meanwhile */
+	return first;
 }
 
 /**
@@ -259,22 +360,51 @@ static struct tipc_service *tipc_service_create(struct net *net,
 {
 	struct name_table *nt = tipc_name_table(net);
 	struct tipc_service *service;
-	struct hlist_head *hd;
 
 	service = kzalloc(sizeof(*service), GFP_ATOMIC);
-	if (!service) {
-		pr_warn("Service creation failed, no memory\n");
-		return NULL;
-	}
+	if (!service)
+		goto err;
+	service->rr_cursor = alloc_percpu_gfp(u32, GFP_ATOMIC);
+	if (!service->rr_cursor)
+		goto err_free;
 
 	spin_lock_init(&service->lock);
+	seqcount_spinlock_init(&service->seq, &service->lock);
 	service->type = ua->sr.type;
 	service->ranges = RB_ROOT;
-	INIT_HLIST_NODE(&service->service_list);
 	INIT_LIST_HEAD(&service->subscriptions);
-	hd = &nt->services[hash(ua->sr.type)];
-	hlist_add_head_rcu(&service->service_list, hd);
+	if (rhashtable_insert_fast(&nt->services, &service->service_list,
+				   tipc_service_rht_params))
+		goto err_free_cursor;
 	return service;
+
+err_free_cursor:
+	free_percpu(service->rr_cursor);
+err_free:
+	kfree(service);
+err:
+	pr_warn("Service creation failed, no memory\n");
+	return NULL;
+}
+
+static void tipc_service_free_rcu(struct rcu_head *rp)
+{
+	struct tipc_service *service = container_of(rp, struct tipc_service,
+						    rcu);
+
+	free_percpu(service->rr_cursor);
+	kfree(service);
+}
+
+/* tipc_service_unlink - remove service from name table, free it after grace
+ */
+static void tipc_service_unlink(struct net *net, struct tipc_service *service)
+{
+	struct name_table *nt = tipc_name_table(net);
+
+	rhashtable_remove_fast(&nt->services, &service->service_list,
+			       tipc_service_rht_params);
+	call_rcu(&service->rcu, tipc_service_free_rcu);
 }
 
 /*  tipc_service_find_range - find service range matching publication parameters
@@ -301,12 +431,13 @@ static struct service_range *tipc_service_create_range(struct tipc_service *sc,
 	u32 lower = p->sr.lower;
 	u32 upper = p->sr.upper;
 
+	write_seqcount_begin(&sc->seq);
 	n = &sc->ranges.rb_node;
 	while (*n) {
 		parent = *n;
 		sr = service_range_entry(parent);
 		if (lower == sr->lower && upper == sr->upper)
-			return sr;
+			goto out;
 		if (sr->max < upper)
 			sr->max = upper;
 		if (lower <= sr->lower)
@@ -316,17 +447,30 @@ static struct service_range *tipc_service_create_range(struct tipc_service *sc,
 	}
 	sr = kzalloc(sizeof(*sr), GFP_ATOMIC);
 	if (!sr)
-		return NULL;
+		goto out;
 	sr->lower = lower;
 	sr->upper = upper;
 	sr->max = upper;
 	INIT_LIST_HEAD(&sr->local_publ);
 	INIT_LIST_HEAD(&sr->all_publ);
-	rb_link_node(&sr->tree_node, parent, n);
+	rb_link_node_rcu(&sr->tree_node, parent, n);
 	rb_insert_augmented(&sr->tree_node, &sc->ranges, &sr_callbacks);
+out:
+	write_seqcount_end(&sc->seq);
 	return sr;
 }
 
+/* tipc_service_erase_range - remove empty service range, free it after grace
+ */
+static void tipc_service_erase_range(struct tipc_service *sc,
+				     struct service_range *sr)
+{
+	write_seqcount_begin(&sc->seq);
+	rb_erase_augmented(&sr->tree_node, &sc->ranges, &sr_callbacks);
+	write_seqcount_end(&sc->seq);
+	kfree_rcu(sr, rcu);
+}
+
 static bool tipc_service_insert_publ(struct net *net,
 				     struct tipc_service *sc,
 				     struct publication *p)
@@ -356,9 +500,12 @@ static bool tipc_service_insert_publ(struct net *net,
 		}
 	}
 
-	if (in_own_node(net, p->sk.node))
-		list_add(&p->local_publ, &sr->local_publ);
-	list_add(&p->all_publ, &sr->all_publ);
+	if (in_own_node(net, p->sk.node)) {
+		list_add_rcu(&p->local_publ, &sr->local_publ);
+		WRITE_ONCE(sr->local_cnt, sr->local_cnt + 1);
+	}
+	list_add_rcu(&p->all_publ, &sr->all_publ);
+	WRITE_ONCE(sr->all_cnt, sr->all_cnt + 1);
 	p->id = sc->publ_cnt++;
 
 	/* Any subscriptions waiting for notification?  */
@@ -390,8 +537,12 @@ static struct publication *tipc_service_remove_publ(struct service_range *r,
 	list_for_each_entry(p, &r->all_publ, all_publ) {
 		if (p->key != key || (node && node != p->sk.node))
 			continue;
-		list_del(&p->all_publ);
-		list_del(&p->local_publ);
+		if (!list_empty(&p->local_publ)) {
+			list_del_rcu(&p->local_publ);
+			WRITE_ONCE(r->local_cnt, r->local_cnt - 1);
+		}
+		list_del_rcu(&p->all_publ);
+		WRITE_ONCE(r->all_cnt, r->all_cnt - 1);
 		return p;
 	}
 	return NULL;
@@ -462,15 +613,9 @@ static struct tipc_service *tipc_service_find(struct net *net,
 					      struct tipc_uaddr *ua)
 {
 	struct name_table *nt = tipc_name_table(net);
-	struct hlist_head *service_head;
-	struct tipc_service *service;
 
-	service_head = &nt->services[hash(ua->sr.type)];
-	hlist_for_each_entry_rcu(service, service_head, service_list) {
-		if (service->type == ua->sr.type)
-			return service;
-	}
-	return NULL;
+	return rhashtable_lookup_fast(&nt->services, &ua->sr.type,
+				      tipc_service_rht_params);
 };
 
 struct publication *tipc_nametbl_insert_publ(struct net *net,
@@ -524,16 +669,12 @@ struct publication *tipc_nametbl_remove_publ(struct net *net,
 	}
 
 	/* Remove service range item if this was its last publication */
-	if (list_empty(&sr->all_publ)) {
-		rb_erase_augmented(&sr->tree_node, &sc->ranges, &sr_callbacks);
-		kfree(sr);
-	}
+	if (list_empty(&sr->all_publ))
+		tipc_service_erase_range(sc, sr);
 
 	/* Delete service item if no more publications and subscriptions */
-	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions)) {
-		hlist_del_init_rcu(&sc->service_list);
-		kfree_rcu(sc, rcu);
-	}
+	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions))
+		tipc_service_unlink(net, sc);
 unlock:
 	spin_unlock_bh(&sc->lock);
 exit:
@@ -565,6 +706,11 @@ struct publication *tipc_nametbl_remove_publ(struct net *net,
  * Note that for legacy users (node configured with Z.C.N address format) the
  * 'closest-first' lookup algorithm must be maintained, i.e., if sk.node is 0
  * we must look in the local binding list first
+ *
+ * The first matching range is looked up without taking the service lock, and
+ * round-robin is driven by a per-CPU cursor instead of reordering the binding
+ * lists. The service lock is only taken if the ranges changed meanwhile, or
+ * if later ranges must be searched for a node local binding.
  */
 bool tipc_nametbl_lookup_anycast(struct net *net,
 				 struct tipc_uaddr *ua,
@@ -574,11 +720,12 @@ bool tipc_nametbl_lookup_anycast(struct net *net,
 	bool legacy = tn->legacy_addr_format;
 	u32 self = tipc_own_addr(net);
 	u32 inst = ua->sa.instance;
+	struct publication *p = NULL;
 	struct service_range *r;
 	struct tipc_service *sc;
-	struct publication *p;
-	struct list_head *l;
 	bool res = false;
+	unsigned int seq;
+	u32 cursor;
 
 	if (!tipc_in_scope(legacy, sk->node, self))
 		return true;
@@ -588,26 +735,39 @@ bool tipc_nametbl_lookup_anycast(struct net *net,
 	if (unlikely(!sc))
 		goto exit;
 
+	cursor = this_cpu_inc_return(*sc->rr_cursor);
+
+	/* Fast path: first matching range, without the service lock */
+	seq = read_seqcount_begin(&sc->seq);
+	r = service_range_match_first(rcu_dereference_raw(sc->ranges.rb_node),
+				      inst, inst);
+	if (r) {
+		/* Select lookup algo: local, closest-first or round-robin */
+		if (sk->node == self) {
+			p = tipc_service_pick_publ(r, true, cursor);
+		} else if (legacy && !sk->node) {
+			p = tipc_service_pick_publ(r, true, cursor);
+			if (!p)
+				p = tipc_service_pick_publ(r, false, cursor);
+		} else {
+			p = tipc_service_pick_publ(r, false, cursor);
+		}
+	}
+	if (!read_seqcount_retry(&sc->seq, seq) && (p || !r))
+		goto found;
+
+	p = NULL;
 	spin_lock_bh(&sc->lock);
 	service_range_foreach_match(r, sc, inst, inst) {
-		/* Select lookup algo: local, closest-first or round-robin */
 		if (sk->node == self) {
-			l = &r->local_publ;
-			if (list_empty(l))
+			p = tipc_service_pick_publ(r, true, cursor);
+			if (!p)
 				continue;
-			p = list_first_entry(l, struct publication, local_publ);
-			list_move_tail(&p->local_publ, &r->local_publ);
-		} else if (legacy && !sk->node && !list_empty(&r->local_publ)) {
-			l = &r->local_publ;
-			p = list_first_entry(l, struct publication, local_publ);
-			list_move_tail(&p->local_publ, &r->local_publ);
+		} else if (legacy && !sk->node && r->local_cnt) {
+			p = tipc_service_pick_publ(r, true, cursor);
 		} else {
-			l = &r->all_publ;
-			p = list_first_entry(l, struct publication, all_publ);
-			list_move_tail(&p->all_publ, &r->all_publ);
+			p = tipc_service_pick_publ(r, false, cursor);
 		}
-		*sk = p->sk;
-		res = true;
 		/* Todo: as for legacy, pick the first matching range only, a
 		 * "true" round-robin will be performed as needed.
 		 */
@@ -615,6 +775,11 @@ bool tipc_nametbl_lookup_anycast(struct net *net,
 	}
 	spin_unlock_bh(&sc->lock);
 
+found:
+	if (p) {
+		*sk = p->sk;
+		res = true;
+	}
 exit:
 	rcu_read_unlock();
 	return res;
@@ -631,9 +796,10 @@ bool tipc_nametbl_lookup_group(struct net *net, struct tipc_uaddr *ua,
 {
 	u32 self = tipc_own_addr(net);
 	u32 inst = ua->sa.instance;
+	struct publication *p, *pick = NULL;
 	struct service_range *sr;
 	struct tipc_service *sc;
-	struct publication *p;
+	u32 cursor, cnt = 0;
 
 	*dstcnt = 0;
 	rcu_read_lock();
@@ -641,6 +807,7 @@ bool tipc_nametbl_lookup_group(struct net *net, struct tipc_uaddr *ua,
 	if (unlikely(!sc))
 		goto exit;
 
+	cursor = this_cpu_inc_return(*sc->rr_cursor);
 	spin_lock_bh(&sc->lock);
 
 	/* Todo: a full search i.e. service_range_foreach_match() instead? */
@@ -653,13 +820,29 @@ bool tipc_nametbl_lookup_group(struct net *net, struct tipc_uaddr *ua,
 			continue;
 		if (p->sk.ref == exclude && p->sk.node == self)
 			continue;
+		if (!mcast) {
+			cnt++;
+			continue;
+		}
 		tipc_dest_push(dsts, p->sk.node, p->sk.ref);
 		(*dstcnt)++;
-		if (mcast)
+	}
+	if (!cnt)
+		goto no_match;
+
+	/* Anycast: pick one of the eligible members round-robin */
+	cursor %= cnt;
+	list_for_each_entry(p, &sr->all_publ, all_publ) {
+		if (p->scope != ua->scope)
 			continue;
-		list_move_tail(&p->all_publ, &sr->all_publ);
-		break;
+		if (p->sk.ref == exclude && p->sk.node == self)
+			continue;
+		pick = p;
+		if (!cursor--)
+			break;
 	}
+	tipc_dest_push(dsts, pick->sk.node, pick->sk.ref);
+	(*dstcnt)++;
 no_match:
 	spin_unlock_bh(&sc->lock);
 exit:
@@ -672,27 +855,44 @@ bool tipc_nametbl_lookup_group(struct net *net, struct tipc_uaddr *ua,
  * Used on nodes which have received a multicast/broadcast message
  * Returns a list of local sockets
  */
+struct tipc_mcast_sockets_arg {
+	struct list_head *dports;
+	u8 scope;
+};
+
+static void tipc_mcast_sockets_add(struct service_range *sr, void *arg)
+{
+	struct tipc_mcast_sockets_arg *a = arg;
+	struct publication *p;
+
+	/* tipc_dest_push() skips sockets already in the list */
+	list_for_each_entry_rcu(p, &sr->local_publ, local_publ) {
+		if (a->scope == p->scope || a->scope == TIPC_ANY_SCOPE)
+			tipc_dest_push(a->dports, 0, p->sk.ref);
+	}
+}
+
 void tipc_nametbl_lookup_mcast_sockets(struct net *net, struct tipc_uaddr *ua,
 				       struct list_head *dports)
 {
-	struct service_range *sr;
+	struct tipc_mcast_sockets_arg arg = {
+		.dports = dports,
+		.scope = ua->scope,
+	};
 	struct tipc_service *sc;
-	struct publication *p;
-	u8 scope = ua->scope;
+	unsigned int seq;
 
 	rcu_read_lock();
 	sc = tipc_service_find(net, ua);
 	if (!sc)
 		goto exit;
 
-	spin_lock_bh(&sc->lock);
-	service_range_foreach_match(sr, sc, ua->sr.lower, ua->sr.upper) {
-		list_for_each_entry(p, &sr->local_publ, local_publ) {
-			if (scope == p->scope || scope == TIPC_ANY_SCOPE)
-				tipc_dest_push(dports, 0, p->sk.ref);
-		}
-	}
-	spin_unlock_bh(&sc->lock);
+	do {
+		seq = read_seqcount_begin(&sc->seq);
+		service_range_match_rcu(rcu_dereference_raw(sc->ranges.rb_node),
+					ua->sr.lower, ua->sr.upper,
+					tipc_mcast_sockets_add, &arg);
+	} while (read_seqcount_retry(&sc->seq, seq));
 exit:
 	rcu_read_unlock();
 }
@@ -702,25 +902,34 @@ void tipc_nametbl_lookup_mcast_sockets(struct net *net, struct tipc_uaddr *ua,
  * Used on nodes which are sending out a multicast/broadcast message
  * Returns a list of nodes, including own node if applicable
  */
+static void tipc_mcast_nodes_add(struct service_range *sr, void *arg)
+{
+	struct tipc_nlist *nodes = arg;
+	struct publication *p;
+
+	/* tipc_nlist_add() skips nodes already in the list */
+	list_for_each_entry_rcu(p, &sr->all_publ, all_publ) {
+		tipc_nlist_add(nodes, p->sk.node);
+	}
+}
+
 void tipc_nametbl_lookup_mcast_nodes(struct net *net, struct tipc_uaddr *ua,
 				     struct tipc_nlist *nodes)
 {
-	struct service_range *sr;
 	struct tipc_service *sc;
-	struct publication *p;
+	unsigned int seq;
 
 	rcu_read_lock();
 	sc = tipc_service_find(net, ua);
 	if (!sc)
 		goto exit;
 
-	spin_lock_bh(&sc->lock);
-	service_range_foreach_match(sr, sc, ua->sr.lower, ua->sr.upper) {
-		list_for_each_entry(p, &sr->all_publ, all_publ) {
-			tipc_nlist_add(nodes, p->sk.node);
-		}
-	}
-	spin_unlock_bh(&sc->lock);
+	do {
+		seq = read_seqcount_begin(&sc->seq);
+		service_range_match_rcu(rcu_dereference_raw(sc->ranges.rb_node),
+					ua->sr.lower, ua->sr.upper,
+					tipc_mcast_nodes_add, nodes);
+	} while (read_seqcount_retry(&sc->seq, seq));
 exit:
 	rcu_read_unlock();
 }
@@ -873,10 +1082,8 @@ void tipc_nametbl_unsubscribe(struct tipc_subscription *sub)
 	tipc_sub_put(sub);
 
 	/* Delete service item if no more publications and subscriptions */
-	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions)) {
-		hlist_del_init_rcu(&sc->service_list);
-		kfree_rcu(sc, rcu);
-	}
+	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions))
+		tipc_service_unlink(sub->net, sc);
 	spin_unlock_bh(&sc->lock);
 exit:
 	spin_unlock_bh(&tn->nametbl_lock);
@@ -886,14 +1093,17 @@ int tipc_nametbl_init(struct net *net)
 {
 	struct tipc_net *tn = tipc_net(net);
 	struct name_table *nt;
-	int i;
+	int err;
 
 	nt = kzalloc(sizeof(*nt), GFP_KERNEL);
 	if (!nt)
 		return -ENOMEM;
 
-	for (i = 0; i < TIPC_NAMETBL_SIZE; i++)
-		INIT_HLIST_HEAD(&nt->services[i]);
+	err = rhashtable_init(&nt->services, &tipc_service_rht_params);
+	if (err) {
+		kfree(nt);
+		return err;
+	}
 
 	INIT_LIST_HEAD(&nt->node_scope);
 	INIT_LIST_HEAD(&nt->cluster_scope);
@@ -919,37 +1129,36 @@ static void tipc_service_delete(struct net *net, struct tipc_service *sc)
 			tipc_service_remove_publ(sr, &p->sk, p->key);
 			kfree_rcu(p, rcu);
 		}
-		rb_erase_augmented(&sr->tree_node, &sc->ranges, &sr_callbacks);
-		kfree(sr);
+		tipc_service_erase_range(sc, sr);
 	}
-	hlist_del_init_rcu(&sc->service_list);
+	tipc_service_unlink(net, sc);
 	spin_unlock_bh(&sc->lock);
-	kfree_rcu(sc, rcu);
 }
 
 void tipc_nametbl_stop(struct net *net)
 {
 	struct name_table *nt = tipc_name_table(net);
 	struct tipc_net *tn = tipc_net(net);
-	struct hlist_head *service_head;
 	struct tipc_service *service;
-	u32 i;
+	struct rhashtable_iter iter;
 
 	/* Verify name table is empty and purge any lingering
 	 * publications, then release the name table
 	 */
 	spin_lock_bh(&tn->nametbl_lock);
-	for (i = 0; i < TIPC_NAMETBL_SIZE; i++) {
-		if (hlist_empty(&nt->services[i]))
+	rhashtable_walk_enter(&nt->services, &iter);
+	rhashtable_walk_start(&iter);
+	while ((service = rhashtable_walk_next(&iter)) != NULL) {
+		if (IS_ERR(service))
 			continue;
-		service_head = &nt->services[i];
-		hlist_for_each_entry_rcu(service, service_head, service_list) {
-			tipc_service_delete(net, service);
-		}
+		tipc_service_delete(net, service);
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 	spin_unlock_bh(&tn->nametbl_lock);
 
 	synchronize_net();
+	rhashtable_destroy(&nt->services);
 	kfree(nt);
 }
 
@@ -1047,64 +1256,96 @@ static int __tipc_nl_service_range_list(struct tipc_nl_msg *msg,
 	return 0;
 }
 
-static int tipc_nl_service_list(struct net *net, struct tipc_nl_msg *msg,
-				u32 *last_type, u32 *last_lower, u32 *last_key)
+static int tipc_nl_service_list(struct rhashtable_iter *iter,
+				struct tipc_nl_msg *msg, u32 *last_type,
+				u32 *last_lower, u32 *last_key, bool *rewound)
 {
-	struct tipc_net *tn = tipc_net(net);
-	struct tipc_service *service = NULL;
-	struct hlist_head *head;
-	struct tipc_uaddr ua;
-	int err;
-	int i;
-
-	if (*last_type)
-		i = hash(*last_type);
-	else
-		i = 0;
-
-	for (; i < TIPC_NAMETBL_SIZE; i++) {
-		head = &tn->nametbl->services[i];
-
-		if (*last_type ||
-		    (!i && *last_key && (*last_lower == *last_key))) {
-			tipc_uaddr(&ua, TIPC_SERVICE_RANGE, TIPC_NODE_SCOPE,
-				   *last_type, *last_lower, *last_lower);
-			service = tipc_service_find(net, &ua);
-			if (!service)
-				return -EPIPE;
-		} else {
-			hlist_for_each_entry_rcu(service, head, service_list)
+	struct tipc_service *service;
+	int err = 0;
+
+	rhashtable_walk_start(iter);
+
+	/* Resume in the service where the previous call stopped, unless it
+	 * went away meanwhile
+	 */
+	service = rhashtable_walk_peek(iter);
+	while (service) {
+		if (IS_ERR(service)) {
+			err = PTR_ERR(service);
+			if (err != -EAGAIN)
 				break;
-			if (!service)
-				continue;
+			/* Resized, the walk starts over from the beginning */
+			*rewound = true;
+			err = 0;
+			goto next;
 		}
-
-		hlist_for_each_entry_from_rcu(service, service_list) {
-			spin_lock_bh(&service->lock);
-			err = __tipc_nl_service_range_list(msg, service,
-							   last_lower,
-							   last_key);
-
-			if (err) {
-				*last_type = service->type;
-				spin_unlock_bh(&service->lock);
-				return err;
-			}
-			spin_unlock_bh(&service->lock);
+		if (service->type != *last_type) {
+			*last_lower = 0;
+			*last_key = 0;
 		}
+
+		spin_lock_bh(&service->lock);
+		err = __tipc_nl_service_range_list(msg, service, last_lower,
+						   last_key);
+		if (err)
+			*last_type = service->type;
+		spin_unlock_bh(&service->lock);
+		if (err)
+			break;
+next:
+		service = rhashtable_walk_next(iter);
+	}
+	rhashtable_walk_stop(iter);
+
+	if (!err)
 		*last_type = 0;
+	return err;
+}
+
+int __tipc_nl_name_table_dump_start(struct netlink_callback *cb,
+				    struct net *net)
+{
+	/* cb->args[0...3] hold the position, cb->args[4] is taken by
+	 * __tipc_dump_start() for the compat layer
+	 */
+	struct rhashtable_iter *iter = (void *)cb->args[5];
+	struct name_table *nt = tipc_name_table(net);
+
+	if (!iter) {
+		iter = kmalloc(sizeof(*iter), GFP_KERNEL);
+		if (!iter)
+			return -ENOMEM;
+
+		cb->args[5] = (long)iter;
 	}
+
+	rhashtable_walk_enter(&nt->services, iter);
+	return 0;
+}
+
+int tipc_nl_name_table_dump_start(struct netlink_callback *cb)
+{
+	return __tipc_nl_name_table_dump_start(cb, sock_net(cb->skb->sk));
+}
+
+int tipc_nl_name_table_dump_done(struct netlink_callback *cb)
+{
+	struct rhashtable_iter *iter = (void *)cb->args[5];
+
+	rhashtable_walk_exit(iter);
+	kfree(iter);
 	return 0;
 }
 
 int tipc_nl_name_table_dump(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	struct net *net = sock_net(skb->sk);
+	struct rhashtable_iter *iter = (void *)cb->args[5];
 	u32 last_type = cb->args[0];
 	u32 last_lower = cb->args[1];
 	u32 last_key = cb->args[2];
 	int done = cb->args[3];
 	struct tipc_nl_msg msg;
+	bool rewound = false;
 	int err;
 
 	if (done)
@@ -1114,21 +1355,19 @@ int tipc_nl_name_table_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	msg.portid = NETLINK_CB(cb->skb).portid;
 	msg.seq = cb->nlh->nlmsg_seq;
 
-	rcu_read_lock();
-	err = tipc_nl_service_list(net, &msg, &last_type,
-				   &last_lower, &last_key);
-	if (!err) {
+	err = tipc_nl_service_list(iter, &msg, &last_type,
+				   &last_lower, &last_key, &rewound);
+	if (!err)
 		done = 1;
-	} else if (err != -EMSGSIZE) {
+	if (rewound || (err && err != -EMSGSIZE)) {
 		/* We never set seq or call nl_dump_check_consistent() this
 		 * means that setting prev_seq here will cause the consistence
 		 * check to fail in the netlink callback handler. Resulting in
 		 * the NLMSG_DONE message having the NLM_F_DUMP_INTR flag set if
-		 * we got an error.
+		 * we got an error, or if services may have been dumped twice.
 		 */
 		cb->prev_seq = 1;
 	}
-	rcu_read_unlock();
 
 	cb->args[0] = last_type;
 	cb->args[1] = last_lower;
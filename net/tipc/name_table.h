@@ -49,7 +49,7 @@ struct tipc_uaddr;
  */
 #define TIPC_ZM_SRV		3	/* zone master service name type */
 #define TIPC_PUBL_SCOPE_NUM	(TIPC_NODE_SCOPE + 1)
-#define TIPC_NAMETBL_SIZE	1024	/* must be a power of 2 */
+#define TIPC_NAMETBL_SIZE	1024	/* initial size hint of service table */
 
 #define TIPC_ANY_SCOPE 10      /* Both node and cluster scope will match */
 
@@ -90,7 +90,7 @@ struct publication {
 
 /**
  * struct name_table - table containing all existing port name publications
- * @services: name sequence hash lists
+ * @services: service hash table, resized along with the number of services
  * @node_scope: all local publications with node scope
  *               - used by name_distr during re-init of name table
  * @cluster_scope: all local publications with cluster scope
@@ -102,7 +102,7 @@ struct publication {
  * @snd_nxt: next sequence number to be used
  */
 struct name_table {
-	struct hlist_head services[TIPC_NAMETBL_SIZE];
+	struct rhashtable services;
 	struct list_head node_scope;
 	struct list_head cluster_scope;
 	rwlock_t cluster_scope_lock;
@@ -112,6 +112,10 @@ struct name_table {
 };
 
 int tipc_nl_name_table_dump(struct sk_buff *skb, struct netlink_callback *cb);
+int tipc_nl_name_table_dump_start(struct netlink_callback *cb);
+int __tipc_nl_name_table_dump_start(struct netlink_callback *cb,
+				    struct net *net);
+int tipc_nl_name_table_dump_done(struct netlink_callback *cb);
 bool tipc_nametbl_lookup_anycast(struct net *net, struct tipc_uaddr *ua,
 				 struct tipc_socket_addr *sk);
 void tipc_nametbl_lookup_mcast_sockets(struct net *net, struct tipc_uaddr *ua,
@@ -233,7 +233,9 @@ static const struct genl_ops tipc_genl_v2_ops[] = {
 	{
 		.cmd	= TIPC_NL_NAME_TABLE_GET,
 		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.start	= tipc_nl_name_table_dump_start,
 		.dumpit	= tipc_nl_name_table_dump,
+		.done	= tipc_nl_name_table_dump_done,
 	},
 	{
 		.cmd	= TIPC_NL_MON_SET,
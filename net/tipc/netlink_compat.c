@@ -65,7 +65,9 @@ struct tipc_nl_compat_msg {
 
 struct tipc_nl_compat_cmd_dump {
 	int (*header)(struct tipc_nl_compat_msg *);
+	int (*start)(struct netlink_callback *, struct net *);
 	int (*dumpit)(struct sk_buff *, struct netlink_callback *);
+	int (*done)(struct netlink_callback *);
 	int (*format)(struct tipc_nl_compat_msg *msg, struct nlattr **attrs);
 };
 
@@ -202,6 +204,12 @@ static int __tipc_nl_compat_dumpit(struct tipc_nl_compat_cmd_dump *cmd,
 		return -ENOMEM;
 	}
 
+	if (cmd->start && cmd->start(&cb, msg->net)) {
+		tipc_dump_done(&cb);
+		kfree_skb(buf);
+		return -ENOMEM;
+	}
+
 	attrbuf = kcalloc(tipc_genl_family.maxattr + 1,
 			  sizeof(struct nlattr *), GFP_KERNEL);
 	if (!attrbuf) {
@@ -251,6 +259,8 @@ static int __tipc_nl_compat_dumpit(struct tipc_nl_compat_cmd_dump *cmd,
 
 err_out:
 	kfree(attrbuf);
+	if (cmd->done)
+		cmd->done(&cb);
 	tipc_dump_done(&cb);
 	kfree_skb(buf);
 
@@ -1026,6 +1036,7 @@ static int tipc_nl_compat_publ_dump(struct tipc_nl_compat_msg *msg, u32 sock)
 	nla_nest_end(args, nest);
 	genlmsg_end(args, hdr);
 
+	memset(&dump, 0, sizeof(dump));
 	dump.dumpit = tipc_nl_publ_dump;
 	dump.format = __tipc_nl_compat_publ_dump;
 
@@ -1247,7 +1258,9 @@ static int tipc_nl_compat_handle(struct tipc_nl_compat_msg *msg)
 		msg->rep_size = ULTRA_STRING_MAX_LEN;
 		msg->rep_type = TIPC_TLV_ULTRA_STRING;
 		dump.header = tipc_nl_compat_name_table_dump_header;
+		dump.start = __tipc_nl_name_table_dump_start;
 		dump.dumpit = tipc_nl_name_table_dump;
+		dump.done = tipc_nl_name_table_dump_done;
 		dump.format = tipc_nl_compat_name_table_dump;
 		return tipc_nl_compat_dumpit(&dump, msg);
 	case TIPC_CMD_SHOW_PORTS:
@@ -3601,7 +3601,7 @@ EXPORT_SYMBOL(tipc_dump_start);
 
 int __tipc_dump_start(struct netlink_callback *cb, struct net *net)
 {
-	/* tipc_nl_name_table_dump() uses cb->args[0...3]. */
+	/* tipc_nl_name_table_dump() uses cb->args[0...3] and [5]. */
 	struct rhashtable_iter *iter = (void *)cb->args[4];
 	struct tipc_net *tn = tipc_net(net);
 
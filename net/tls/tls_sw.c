@@ -48,6 +48,9 @@
 
 #include "tls.h"
 
+/* Pages extracted at once from a spliced iterator, enough for a full record */
+#define TLS_SPLICE_PAGES	8
+
 struct tls_decrypt_arg {
 	struct_group(inargs,
 	bool zc;
@@ -971,32 +974,66 @@ static int tls_sw_push_pending_record(struct sock *sk, int flags)
 				   &copied, flags);
 }
 
+/* Add a spliced page fragment to the plaintext, merging it with the last
+ * element if contiguous: records built from sub-page chunks then aren't cut
+ * short by running out of fragments.
+ */
+static void tls_sw_splice_page_add(struct sk_msg *msg_pl, struct page *page,
+				   u32 len, u32 off)
+{
+	struct scatterlist *sge;
+	u32 last;
+
+	if (sk_msg_elem_used(msg_pl)) {
+		last = msg_pl->sg.end;
+		sk_msg_iter_var_prev(last);
+		sge = sk_msg_elem(msg_pl, last);
+		if (sg_page(sge) == page && sge->offset + sge->length == off) {
+			sge->length += len;
+			msg_pl->sg.size += len;
+			return;
+		}
+	}
+
+	sk_msg_page_add(msg_pl, page, len, off);
+}
+
 static int tls_sw_sendmsg_splice(struct sock *sk, struct msghdr *msg,
 				 struct sk_msg *msg_pl, size_t try_to_copy,
 				 ssize_t *copied)
 {
-	struct page *page = NULL, **pages = &page;
+	struct page *page_array[TLS_SPLICE_PAGES], **pages = page_array;
 
 	do {
+		unsigned int maxpages, i;
 		ssize_t part;
 		size_t off;
 
+		maxpages = min_t(unsigned int, ARRAY_SIZE(page_array),
+				 MAX_MSG_FRAGS - sk_msg_elem_used(msg_pl));
 		part = iov_iter_extract_pages(&msg->msg_iter, &pages,
-					      try_to_copy, 1, 0, &off);
+					      try_to_copy, maxpages, 0, &off);
 		if (part <= 0)
 			return part ?: -EIO;
 
-		if (WARN_ON_ONCE(!sendpage_ok(page))) {
-			iov_iter_revert(&msg->msg_iter, part);
-			return -EIO;
+		for (i = 0; part; i++) {
+			size_t len = min_t(size_t, part, PAGE_SIZE - off);
+
+			if (WARN_ON_ONCE(!sendpage_ok(pages[i]))) {
+				iov_iter_revert(&msg->msg_iter, part);
+				return -EIO;
+			}
+
+			tls_sw_splice_page_add(msg_pl, pages[i], len, off);
+			sk_mem_charge(sk, len);
+			*copied += len;
+			try_to_copy -= len;
+			part -= len;
+			off = 0;
 		}
 
-		sk_msg_page_add(msg_pl, page, part, off);
 		msg_pl->sg.copybreak = 0;
 		msg_pl->sg.curr = msg_pl->sg.end;
-		sk_mem_charge(sk, part);
-		*copied += part;
-		try_to_copy -= part;
 	} while (try_to_copy && !sk_msg_full(msg_pl));
 
 	return 0;
@@ -1645,7 +1682,11 @@ tls_decrypt_sw(struct sock *sk, struct tls_context *tls_ctx,
 			TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSDECRYPTERROR);
 		return err;
 	}
-	/* keep going even for ->async, the code below is TLS 1.3 */
+	/* TLS 1.3 padding of async records is handled once they are
+	 * decrypted, see tls_rx_async_fixup().
+	 */
+	if (darg->async)
+		return 0;
 
 	/* If opportunistic TLS 1.3 ZC failed retry without ZC */
 	if (unlikely(darg->zc && prot->version == TLS_1_3_VERSION &&
@@ -1777,6 +1818,49 @@ static void tls_rx_rec_done(struct tls_sw_context_rx *ctx)
 	tls_strp_msg_done(&ctx->strp);
 }
 
+/* TLS 1.3 records decrypted asynchronously are queued on the rx_list before
+ * their inner content type and padding are known, with a zero control. Once
+ * all decryptions completed, strip the padding and set the content type.
+ */
+static int tls_rx_async_fixup(struct sock *sk, struct tls_sw_context_rx *ctx)
+{
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+	struct tls_prot_info *prot = &tls_ctx->prot_info;
+	struct sk_buff *skb;
+
+	skb_queue_walk(&ctx->rx_list, skb) {
+		struct strp_msg *rxm = strp_msg(skb);
+		struct tls_msg *tlm = tls_msg(skb);
+		int len = rxm->full_len + prot->tail_size;
+		u8 content_type = 0;
+		int err;
+
+		if (tlm->control)
+			continue;
+
+		while (len > 0) {
+			err = skb_copy_bits(skb, rxm->offset + len - 1,
+					    &content_type, 1);
+			if (err)
+				return err;
+			if (content_type)
+				break;
+			len--;
+		}
+
+		if (!content_type) {
+			ctx->async_wait.err = -EBADMSG;
+			tls_err_abort(sk, -EBADMSG);
+			return -EBADMSG;
+		}
+
+		tlm->control = content_type;
+		rxm->full_len = len - 1;
+	}
+
+	return 0;
+}
+
 /* This function traverses the rx_list in tls receive context to copies the
  * decrypted records into the buffer provided by caller zero copy is not
  * true. Further, the records are removed from the rx_list if it is not a peek
@@ -1960,6 +2044,7 @@ int tls_sw_recvmsg(struct sock *sk,
 	struct sk_psock *psock;
 	unsigned char control = 0;
 	size_t flushed_at = 0;
+	size_t size = len;
 	struct strp_msg *rxm;
 	struct tls_msg *tlm;
 	ssize_t copied = 0;
@@ -2001,6 +2086,7 @@ int tls_sw_recvmsg(struct sock *sk,
 
 	zc_capable = !bpf_strp_enabled && !is_kvec && !is_peek &&
 		ctx->zc_capable;
+decrypt_more:
 	decrypted = 0;
 	while (len && (decrypted + copied < target || tls_strp_msg_ready(ctx))) {
 		struct tls_decrypt_arg darg;
@@ -2028,16 +2114,30 @@ int tls_sw_recvmsg(struct sock *sk,
 
 		to_decrypt = rxm->full_len - prot->overhead_size;
 
+		/* For TLS 1.3, zero-copy records stay synchronous, as they
+		 * may have to be decrypted again if they turn out not to be
+		 * data. Behind async records, use async without zero-copy.
+		 */
 		if (zc_capable && to_decrypt <= len &&
-		    tlm->control == TLS_RECORD_TYPE_DATA)
+		    tlm->control == TLS_RECORD_TYPE_DATA &&
+		    !(async && prot->version == TLS_1_3_VERSION))
 			darg.zc = true;
 
 		/* Do not use async mode if record is non-data */
 		if (tlm->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled)
-			darg.async = ctx->async_capable;
+			darg.async = ctx->async_capable &&
+				     !(darg.zc &&
+				       prot->version == TLS_1_3_VERSION);
 		else
 			darg.async = false;
 
+		/* The content type of TLS 1.3 async records is only known
+		 * once they complete: don't decrypt a record synchronously
+		 * behind them, it could end up reported before them.
+		 */
+		if (async && !darg.async && prot->version == TLS_1_3_VERSION)
+			goto recv_end;
+
 		err = tls_rx_one_record(sk, msg, &darg);
 		if (err < 0) {
 			tls_err_abort(sk, -EBADMSG);
@@ -2045,15 +2145,24 @@ int tls_sw_recvmsg(struct sock *sk,
 		}
 
 		async |= darg.async;
+		if (darg.async)
+			TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSRXASYNC);
 
 		/* If the type of records being processed is not known yet,
 		 * set it to record type just dequeued. If it is already known,
 		 * but does not match the record type just dequeued, go to end.
 		 * We always get record type here since for tls1.2, record type
 		 * is known just after record is dequeued from stream parser.
-		 * For tls1.3, we disable async.
+		 * For tls1.3 async records, it's only known once decrypted:
+		 * mark them, tls_rx_async_fixup() will fill it in.
 		 */
-		err = tls_record_content_type(msg, tls_msg(darg.skb), &control);
+		if (unlikely(darg.async && prot->version == TLS_1_3_VERSION)) {
+			tls_msg(darg.skb)->control = 0;
+			err = 1;
+		} else {
+			err = tls_record_content_type(msg, tls_msg(darg.skb),
+						      &control);
+		}
 		if (err <= 0) {
 			DEBUG_NET_WARN_ON_ONCE(darg.zc);
 			tls_rx_rec_done(ctx);
@@ -2079,14 +2188,18 @@ int tls_sw_recvmsg(struct sock *sk,
 			DEBUG_NET_WARN_ON_ONCE(darg.skb == ctx->strp.anchor);
 
 			if (async) {
-				/* TLS 1.2-only, to_decrypt must be text len */
+				/* to_decrypt is the text len for TLS 1.2, and
+				 * an upper bound for TLS 1.3 with padding, see
+				 * the check after recv_end
+				 */
 				chunk = min_t(int, to_decrypt, len);
 				async_copy_bytes += chunk;
 put_on_rx_list:
 				decrypted += chunk;
 				len -= chunk;
 				__skb_queue_tail(&ctx->rx_list, skb);
-				if (unlikely(control != TLS_RECORD_TYPE_DATA))
+				if (unlikely(control &&
+					     control != TLS_RECORD_TYPE_DATA))
 					break;
 				continue;
 			}
@@ -2143,6 +2256,10 @@ int tls_sw_recvmsg(struct sock *sk,
 		/* Wait for all previously submitted records to be decrypted */
 		ret = tls_decrypt_async_wait(ctx);
 		__skb_queue_purge(&ctx->async_hold);
+		TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSRXASYNCWAIT);
+
+		if (!ret && prot->version == TLS_1_3_VERSION)
+			ret = tls_rx_async_fixup(sk, ctx);
 
 		if (ret) {
 			if (err >= 0 || err == -EINPROGRESS)
@@ -2165,6 +2282,18 @@ int tls_sw_recvmsg(struct sock *sk,
 
 	copied += decrypted;
 
+	/* TLS 1.3 async records were accounted for including their padding,
+	 * which may have ended the loop short of the target: go on reading.
+	 */
+	if (async && prot->version == TLS_1_3_VERSION && !is_peek &&
+	    err >= 0 && control == TLS_RECORD_TYPE_DATA &&
+	    copied < target && copied < size) {
+		len = size - copied;
+		async_copy_bytes = 0;
+		async = false;
+		goto decrypt_more;
+	}
+
 end:
 	tls_rx_reader_unlock(sk, ctx);
 	if (psock)
@@ -2773,7 +2902,6 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 
 		tls_update_rx_zc_capable(ctx);
 		sw_ctx_rx->async_capable =
-			crypto_info->version != TLS_1_3_VERSION &&
 			!!(tfm->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC);
 
 		rc = tls_strp_init(&sw_ctx_rx->strp, sk);
@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Throughput and request/response benchmark for SMC and TCP sockets.
+ *
+ * Run a server with -s, and a client connecting to it. With -S, AF_SMC
+ * sockets are used instead of TCP ones, so that SMC-D over loopback-ism can
+ * be compared with TCP over loopback or veth, see smc_lo_bench.sh.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/netlink.h>
+#include <linux/smc_diag.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef AF_SMC
+#define AF_SMC		43
+#endif
+
+#define SMCPROTO_SMC	0	/* SMC protocol, IPv4 */
+
+static const char *cfg_host = "127.0.0.1";
+static unsigned int cfg_port = 8000;
+static unsigned int cfg_secs = 10;
+static size_t cfg_size = 64 * 1024;
+static bool cfg_server;
+static bool cfg_smc;
+static bool cfg_rr;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		error(1, errno, "clock_gettime");
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int do_socket(void)
+{
+	int fd;
+
+	if (cfg_smc)
+		fd = socket(AF_SMC, SOCK_STREAM, SMCPROTO_SMC);
+	else
+		fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (fd < 0 && cfg_smc &&
+	    (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)) {
+		fprintf(stderr, "AF_SMC not supported\n");
+		exit(KSFT_SKIP);
+	}
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	return fd;
+}
+
+/* Find the mode of an AF_SMC socket from an smc_diag dump, by inode */
+static int smc_mode(int fd)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct smc_diag_req req;
+	} request = {
+		.nlh = {
+			.nlmsg_len = sizeof(request),
+			.nlmsg_type = SOCK_DIAG_BY_FAMILY,
+			.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+		},
+		.req = {
+			.diag_family = AF_SMC,
+		},
+	};
+	static char buf[32768];
+	struct nlmsghdr *nlh;
+	struct stat st;
+	int nl, mode = -1;
+	ssize_t len;
+
+	if (fstat(fd, &st))
+		error(1, errno, "fstat");
+
+	nl = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_SOCK_DIAG);
+	if (nl < 0)
+		error(1, errno, "socket AF_NETLINK");
+	if (send(nl, &request, sizeof(request), 0) < 0)
+		error(1, errno, "send SOCK_DIAG_BY_FAMILY");
+
+	while (mode < 0) {
+		len = recv(nl, buf, sizeof(buf), 0);
+		if (len < 0)
+			error(1, errno, "recv SOCK_DIAG_BY_FAMILY");
+
+		for (nlh = (void *)buf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			struct smc_diag_msg *msg = NLMSG_DATA(nlh);
+
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				goto out;
+			if (nlh->nlmsg_type == NLMSG_ERROR)
+				error(1, 0, "smc_diag dump failed");
+			if (msg->diag_inode == st.st_ino) {
+				mode = msg->diag_mode;
+				break;
+			}
+		}
+	}
+out:
+	close(nl);
+	return mode;
+}
+
+static void setup_addr(struct sockaddr_in *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(cfg_port);
+	if (inet_pton(AF_INET, cfg_host, &addr->sin_addr) != 1)
+		error(1, 0, "invalid address: %s", cfg_host);
+}
+
+static bool read_full(int fd, char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret < 0)
+			error(1, errno, "read");
+		if (!ret)
+			return false;
+		buf += ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static void write_full(int fd, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+		if (ret < 0)
+			error(1, errno, "write");
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void run_server(char *buf)
+{
+	struct sockaddr_in addr;
+	int fd, conn, one = 1;
+
+	setup_addr(&addr);
+
+	fd = do_socket();
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_REUSEADDR");
+	if (bind(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (listen(fd, 1))
+		error(1, errno, "listen");
+
+	conn = accept(fd, NULL, NULL);
+	if (conn < 0)
+		error(1, errno, "accept");
+
+	if (cfg_rr) {
+		while (read_full(conn, buf, cfg_size))
+			write_full(conn, buf, cfg_size);
+	} else {
+		while (read(conn, buf, cfg_size) > 0)
+			;
+	}
+
+	close(conn);
+	close(fd);
+}
+
+static void run_client(char *buf)
+{
+	unsigned long long bytes = 0, trans = 0;
+	struct sockaddr_in addr;
+	double start, end, elapsed;
+	int fd;
+
+	setup_addr(&addr);
+
+	fd = do_socket();
+	if (connect(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+
+	/* Numbers for a connection that fell back to TCP are meaningless */
+	if (cfg_smc && smc_mode(fd) != SMC_DIAG_MODE_SMCD)
+		error(1, 0, "connection is not using SMC-D");
+
+	start = now();
+	end = start + cfg_secs;
+
+	do {
+		write_full(fd, buf, cfg_size);
+		if (cfg_rr) {
+			if (!read_full(fd, buf, cfg_size))
+				error(1, 0, "connection closed by server");
+			trans++;
+		}
+		bytes += cfg_size;
+	} while (now() < end);
+
+	elapsed = now() - start;
+	shutdown(fd, SHUT_WR);
+	close(fd);
+
+	if (cfg_rr)
+		printf("%10.0f trans/s %10.2f us/trans\n",
+		       trans / elapsed, elapsed * 1e6 / trans);
+	else
+		printf("%10.2f Gbit/s\n", bytes * 8 / elapsed / 1e9);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-s] [-S] [-r] [-H host] [-p port] [-l secs] [-b bytes]\n"
+		"  -s  run as server\n"
+		"  -S  use AF_SMC instead of TCP sockets\n"
+		"  -r  request/response of -b bytes instead of streaming\n",
+		name);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "b:H:l:p:rsS")) != -1) {
+		switch (c) {
+		case 'b':
+			cfg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			cfg_host = optarg;
+			break;
+		case 'l':
+			cfg_secs = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_rr = true;
+			break;
+		case 's':
+			cfg_server = true;
+			break;
+		case 'S':
+			cfg_smc = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!cfg_size || !cfg_secs)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	char *buf;
+
+	parse_opts(argc, argv);
+
+	buf = calloc(1, cfg_size);
+	if (!buf)
+		error(1, errno, "calloc");
+
+	if (cfg_server)
+		run_server(buf);
+	else
+		run_client(buf);
+
+	free(buf);
+	return 0;
+}
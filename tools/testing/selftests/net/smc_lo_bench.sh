@@ -0,0 +1,134 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare SMC-D over loopback-ism with TCP over loopback and over a veth pair,
+# for bulk throughput and request/response latency.
+#
+# SMC-D can only be negotiated if a system EID or a user EID is set. Outside
+# s390 there's no system EID, so a user EID is added with smcd(8) from
+# smc-tools. Connections that can't use SMC-D silently fall back to TCP: the
+# client checks with smc_diag that SMC-D is in use, and fails otherwise.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+readonly NS_A="smc-lo-a-$(mktemp -u XXXXXX)"
+readonly NS_B="smc-lo-b-$(mktemp -u XXXXXX)"
+readonly UEID="SMC-LO-BENCH"
+readonly BIN="./smc_lo_bench"
+readonly PORT=8000
+
+SECS=${SECS:-5}
+ueid_added=0
+
+cleanup()
+{
+	ip netns del "${NS_A}" 2>/dev/null
+	ip netns del "${NS_B}" 2>/dev/null
+	[ "${ueid_added}" -eq 1 ] && smcd ueid del "${UEID}" >/dev/null 2>&1
+}
+
+setup()
+{
+	ip netns add "${NS_A}" || return 1
+	ip netns add "${NS_B}" || return 1
+
+	ip -netns "${NS_A}" link set lo up
+	ip -netns "${NS_B}" link set lo up
+
+	ip link add veth0 netns "${NS_A}" type veth peer name veth1 \
+		netns "${NS_B}" || return 1
+	ip -netns "${NS_A}" addr add 10.0.0.1/24 dev veth0
+	ip -netns "${NS_B}" addr add 10.0.0.2/24 dev veth1
+	ip -netns "${NS_A}" link set veth0 up
+	ip -netns "${NS_B}" link set veth1 up
+
+	if command -v smcd >/dev/null 2>&1 &&
+	   smcd ueid add "${UEID}" >/dev/null 2>&1; then
+		ueid_added=1
+	fi
+}
+
+# run_one <label> <server netns> <client netns> <address> [client options]
+run_one()
+{
+	local label="$1" srv_ns="$2" cli_ns="$3" addr="$4"
+	local out ret
+
+	shift 4
+
+	ip netns exec "${srv_ns}" "${BIN}" -s -H "${addr}" -p "${PORT}" "$@" &
+	sleep 0.5
+
+	out=$(ip netns exec "${cli_ns}" "${BIN}" -H "${addr}" -p "${PORT}" \
+	      -l "${SECS}" "$@")
+	ret=$?
+	wait
+
+	[ "${ret}" -eq "${ksft_skip}" ] && return "${ksft_skip}"
+	[ "${ret}" -ne 0 ] && return 1
+
+	printf "%-28s %s\n" "${label}" "${out}"
+}
+
+# run_mode <label> [options]
+run_mode()
+{
+	local mode="$1"
+	local ret=0
+
+	shift
+
+	echo "${mode}:"
+	run_one "  TCP, loopback" "${NS_A}" "${NS_A}" 127.0.0.1 "$@" || ret=1
+	run_one "  TCP, veth" "${NS_A}" "${NS_B}" 10.0.0.1 "$@" || ret=1
+	run_one "  SMC-D, loopback-ism" "${NS_A}" "${NS_A}" 127.0.0.1 -S "$@"
+	case $? in
+	0) ;;
+	"${ksft_skip}") return "${ksft_skip}" ;;
+	*) ret=1 ;;
+	esac
+
+	return "${ret}"
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: Need root privileges"
+	exit "${ksft_skip}"
+fi
+
+if [ ! -x "${BIN}" ]; then
+	echo "SKIP: ${BIN} not built"
+	exit "${ksft_skip}"
+fi
+
+trap cleanup EXIT
+
+if ! setup; then
+	echo "SKIP: Could not set up network namespaces"
+	exit "${ksft_skip}"
+fi
+
+if [ "${ueid_added}" -eq 0 ] && [ "$(uname -m)" != "s390x" ]; then
+	echo "SKIP: Could not set a user EID, SMC-D would fall back to TCP"
+	exit "${ksft_skip}"
+fi
+
+ret=0
+run_mode "stream, 64 KiB writes" -b 65536
+rc=$?
+if [ "${rc}" -eq "${ksft_skip}" ]; then
+	echo "SKIP: AF_SMC not supported"
+	exit "${ksft_skip}"
+fi
+[ "${rc}" -ne 0 ] && ret=1
+
+run_mode "request/response, 64 bytes" -r -b 64 || ret=1
+run_mode "request/response, 16 KiB" -r -b 16384 || ret=1
+
+if [ "${ueid_added}" -eq 1 ]; then
+	echo "SMC-D statistics:"
+	smcd stats
+fi
+
+exit "${ret}"
@@ -0,0 +1,254 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare the lookup implementations of nft_set_pipapo (generic C, AVX2 or
+# NEON, AVX-512) for several set sizes and field widths.
+#
+# Sets are created with the nf_tables.pipapo_simd module parameter set to
+# each level the CPU supports, so that the corresponding implementation is
+# selected. pktgen then sends matching packets over a veth pair into a netns,
+# where a netdev ingress rule looks them up in the set and drops them. The
+# drop rate is reported next to a baseline without lookup.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+readonly NS_TX="pipapo-tx-$(mktemp -u XXXXXX)"
+readonly NS_RX="pipapo-rx-$(mktemp -u XXXXXX)"
+readonly PARAM=/sys/module/nf_tables/parameters/pipapo_simd
+readonly PG=/proc/net/pktgen
+
+SECS=${SECS:-5}
+SIZES=${SIZES:-"256 4096 65536"}
+
+# Field widths: "<set type>|<lookup expression>"
+FIELDS=(
+	"ipv4_addr . inet_service|ip daddr . udp dport"
+	"ipv6_addr . inet_service|ip6 daddr . udp dport"
+	"ether_addr . ipv4_addr . inet_service|ether saddr . ip daddr . udp dport"
+)
+
+simd_saved=""
+
+cleanup()
+{
+	[ -n "${simd_saved}" ] && echo "${simd_saved}" > "${PARAM}"
+	ip netns del "${NS_TX}" 2>/dev/null
+	ip netns del "${NS_RX}" 2>/dev/null
+}
+
+# simd_levels - print "<level>:<implementation>" for levels the CPU supports
+simd_levels()
+{
+	local flags
+
+	flags=$(grep -m1 -E '^(flags|Features)' /proc/cpuinfo)
+
+	echo "0:generic"
+	case "$(uname -m)" in
+	x86_64)
+		[[ " ${flags} " == *" avx2 "* ]] && echo "1:avx2"
+		[[ " ${flags} " == *" avx512f "* &&
+		   " ${flags} " == *" avx512vl "* &&
+		   " ${flags} " == *" avx512bw "* ]] && echo "2:avx512"
+		;;
+	aarch64)
+		[[ " ${flags} " == *" asimd "* ]] && echo "1:neon"
+		;;
+	esac
+}
+
+setup()
+{
+	ip netns add "${NS_TX}" || return 1
+	ip netns add "${NS_RX}" || return 1
+
+	ip link add veth_tx netns "${NS_TX}" type veth peer name veth_rx \
+		netns "${NS_RX}" || return 1
+	ip -netns "${NS_TX}" link set veth_tx address 02:00:00:00:00:01
+	ip -netns "${NS_RX}" link set veth_rx address 02:00:00:00:00:02
+	ip -netns "${NS_TX}" link set veth_tx up
+	ip -netns "${NS_RX}" link set veth_rx up
+}
+
+# element <index> <field set>
+element()
+{
+	local i=$1 type="$2"
+	local a=$((i >> 16 & 255)) b=$((i >> 8 & 255)) c=$((i & 255))
+	local port=$((1024 + i % 60000))
+
+	case "${type}" in
+	ipv4_addr*)
+		echo "10.${a}.${b}.${c} . ${port}"
+		;;
+	ipv6_addr*)
+		printf "2001:db8::%x:%x . %d\n" $((i >> 16)) $((i & 65535)) \
+			"${port}"
+		;;
+	ether_addr*)
+		printf "02:00:00:%02x:%02x:%02x . 10.%d.%d.%d . %d\n" \
+			"${a}" "${b}" "${c}" "${a}" "${b}" "${c}" "${port}"
+		;;
+	esac
+}
+
+# load_ruleset <set type> <lookup expression> <size>
+load_ruleset()
+{
+	local type="$1" expr="$2" size=$3
+	local i
+
+	{
+		echo "table netdev t {"
+		echo "	set s {"
+		echo "		type ${type}"
+		echo "		flags interval"
+		if [ "${size}" -gt 0 ]; then
+			echo -n "		elements = { "
+			for ((i = 0; i < size; i++)); do
+				[ "${i}" -gt 0 ] && echo -n ", "
+				element "${i}" "${type}"
+			done
+			echo " }"
+		fi
+		echo "	}"
+		echo "	chain c {"
+		echo "		type filter hook ingress device veth_rx priority 0"
+		if [ -n "${expr}" ]; then
+			echo "		${expr} @s counter drop"
+		else
+			echo "		counter drop"
+		fi
+		echo "	}"
+		echo "}"
+	} | ip netns exec "${NS_RX}" nft -f -
+}
+
+# pg <file> <command>: pktgen is per network namespace
+pg()
+{
+	ip netns exec "${NS_TX}" bash -c "echo '$2' > ${PG}/$1"
+}
+
+# pktgen_setup <set type> <size>: send packets matching the last element
+pktgen_setup()
+{
+	local type="$1" size=$2
+	local last=$((size > 0 ? size - 1 : 0))
+	local a=$((last >> 16 & 255)) b=$((last >> 8 & 255)) c=$((last & 255))
+	local port=$((1024 + last % 60000))
+
+	pg kpktgend_0 "rem_device_all"
+	pg kpktgend_0 "add_device veth_tx"
+	pg veth_tx "count 0"
+	pg veth_tx "delay 0"
+	pg veth_tx "pkt_size 64"
+	pg veth_tx "dst_mac 02:00:00:00:00:02"
+	pg veth_tx "udp_dst_min ${port}"
+	pg veth_tx "udp_dst_max ${port}"
+
+	case "${type}" in
+	ipv4_addr*)
+		pg veth_tx "dst 10.${a}.${b}.${c}"
+		;;
+	ipv6_addr*)
+		pg veth_tx "$(printf "dst6 2001:db8::%x:%x" $((last >> 16)) \
+			      $((last & 65535)))"
+		;;
+	ether_addr*)
+		pg veth_tx "$(printf "src_mac 02:00:00:%02x:%02x:%02x" \
+			      "${a}" "${b}" "${c}")"
+		pg veth_tx "dst 10.${a}.${b}.${c}"
+		;;
+	esac
+}
+
+# measure: print packets dropped by the ingress rule per second
+measure()
+{
+	local pkts
+
+	pg pgctrl start &
+	sleep "${SECS}"
+	pg pgctrl stop
+	wait
+
+	pkts=$(ip netns exec "${NS_RX}" nft list chain netdev t c |
+	       sed -n 's/.*counter packets \([0-9]*\).*/\1/p')
+
+	echo $((pkts / SECS))
+}
+
+# run_one <set type> <lookup expression> <size>
+run_one()
+{
+	local type="$1" expr="$2" size=$3
+
+	ip netns exec "${NS_RX}" nft flush ruleset
+	load_ruleset "${type}" "${expr}" "${size}" || return 1
+	pktgen_setup "${type}" "${size}"
+	measure
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: Need root privileges"
+	exit "${ksft_skip}"
+fi
+
+if ! nft --version >/dev/null 2>&1; then
+	echo "SKIP: Could not run test without nft tool"
+	exit "${ksft_skip}"
+fi
+
+modprobe -q pktgen
+modprobe -q nf_tables
+if [ ! -d "${PG}" ] || [ ! -w "${PARAM}" ]; then
+	echo "SKIP: Need pktgen and nf_tables with the pipapo_simd parameter"
+	exit "${ksft_skip}"
+fi
+
+trap cleanup EXIT
+simd_saved=$(cat "${PARAM}")
+
+if ! setup; then
+	echo "SKIP: Could not set up network namespaces"
+	exit "${ksft_skip}"
+fi
+
+ret=0
+levels=$(simd_levels)
+
+printf "%-40s %8s" "fields" "elements"
+for l in ${levels}; do
+	printf " %12s" "${l#*:}"
+done
+printf " %12s\n" "baseline"
+
+for f in "${FIELDS[@]}"; do
+	type="${f%%|*}"
+	expr="${f#*|}"
+
+	for size in ${SIZES}; do
+		printf "%-40s %8d" "${type}" "${size}"
+
+		for l in ${levels}; do
+			echo "${l%%:*}" > "${PARAM}"
+			if ! pps=$(run_one "${type}" "${expr}" "${size}"); then
+				ret=1
+				pps="error"
+			fi
+			printf " %12s" "${pps}"
+		done
+
+		if ! pps=$(run_one "${type}" "" 0); then
+			ret=1
+			pps="error"
+		fi
+		printf " %12s\n" "${pps}"
+	done
+done
+
+echo "(packets per second dropped after lookup)"
+
+exit "${ret}"